@@ -87,6 +87,9 @@
 #else
 #define OTA_CLIENT
 #endif
+#ifdef TARGET_ROU
+#define OTA_PEER          //routers running a new image serve it to their neighbours
+#endif
 #endif
 
 #ifdef TARGET_END
@@ -161,6 +164,19 @@ typedef struct
     uint16             sleepPeriod;       //sleep period
     uint16             reqPeriodMs;
     uint16             upsXtalPeriod;     //simulate crystal oscillator frequency of AUPS
+    uint16             streamWindow;      //reliable stream window of DATA mode, 0: off
+    uint16             aggrHoldMs;        //hold time of unicast frame aggregation, 0: off
+    uint16             dataCompress;      //LZSS compression of data frames, 0: off
+    uint16             otaWindow;         //OTA block requests in flight, 0: default
+    uint16             pollFloorMs;       //end device poll interval after traffic, 0: default
+    uint16             pollCeilMs;        //end device poll interval when idle, 0: default
+    uint16             engSleepNa;        //energy accounting current table, 0: default
+    uint16             engAwakeUa;
+    uint16             engRxUa;
+    uint16             engTxUa;
+    uint16             upsWakeCold;       //MCU mode wake up runs ups_init(), 0: warm resume
+    uint16             upsBatchSize;      //samples per batch frame, 0: default
+    uint16             upsBatchAgeS;      //oldest sample of a batch waits at most(s), 0: default
 }tsConfig;
 
 
@@ -185,8 +201,14 @@ typedef struct
     uint32      otaReqPeriod;
     uint32      otaCurBlock;
     uint16      otaSvrAddr16;
-    uint8       otaDownloading;  //0: idle; 1: block downloading; 2: upgrade requesting
+    uint8       otaDownloading;  //0: idle; 1: block downloading; 2: upgrade requesting; 3: multicast receiving; 4: applying delta
     uint32      otaCrc;
+    uint16      otaBlockSize;    //negotiated by OTA notice
+    uint8       otaSession;      //multicast session, 0: unicast download
+    uint32      otaPatchBytes;   //server: delta patch next to the image, 0: none
+    uint32      otaPackedBytes;  //server: compressed image next to the image, 0: none
+    uint8       otaImage;        //client: OTA_IMAGE_xxx being downloaded, otaTotalBytes is its size
+    uint32      otaImageBytes;   //client: size of the new image
     #endif
 } tsDevice;
 
@@ -0,0 +1,52 @@
+/*
+ * firmware_addr_cache.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_ADDR_CACHE_H_
+#define FIRMWARE_ADDR_CACHE_H_
+
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define NAC_CACHE_SIZE          8       //IEEE->NWK mappings kept, least recently used is evicted
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint32 u32Hits;
+    uint32 u32Misses;
+}tsNacStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC void NAC_vUpdate(uint64 u64IeeeAddr, uint16 u16NwkAddr);
+PUBLIC bool NAC_bLookup(uint64 u64IeeeAddr, uint16 *pu16NwkAddr);
+PUBLIC void NAC_vInvalidateIeee(uint64 u64IeeeAddr);
+PUBLIC void NAC_vInvalidateNwk(uint16 u16NwkAddr);
+PUBLIC void NAC_vGetStats(tsNacStats *psStats);
+
+#endif /* FIRMWARE_ADDR_CACHE_H_ */
@@ -26,6 +26,16 @@
 
 #include <jendefs.h>
 
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define TX_STATUS_TABLE_SIZE      6     //frames in flight waiting for APS confirm/ack
+#define TX_STATUS_MAX_RETRIES     2     //module retransmissions after a failed delivery
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool ADS_bSendTracked(uint8 u8FrameId, uint16 u16TxMode, uint16 u16DstAddr, uint64 u64DstAddr, uint8 *pu8Buf, int len);
 
 
 #endif /* FIRMWARE_ADS_H_ */
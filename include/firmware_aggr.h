@@ -0,0 +1,67 @@
+/*
+ * firmware_aggr.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_AGGR_H_
+#define FIRMWARE_AGGR_H_
+
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define AGR_DELIMITER           0x7d    //first byte of a container APDU, API frames start with 0x7e
+#define AGR_MAX_LEN             80      //container size, fits in one secured, unfragmented APS frame
+#define AGR_MAX_DEST            3       //destinations collected at the same time
+#define AGR_MAX_HOLD_MS         1000
+#define AGR_RETRY_MS            200     //a container the stack refused is sent again after it
+#define AGR_MAX_RETRIES         5       //then its frames are dropped
+
+/*
+  Bytes a frame costs on air besides its APS payload, per hop:
+  PHY sync/header 6 + MAC header/FCS 11 + NWK header 8 + NWK security 18
+  + APS header 8 + MAC ack 11. Used to estimate the airtime saved.
+*/
+#define AGR_FRAME_OVERHEAD      62
+#define AGR_US_PER_BYTE         32      //250kbps
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint32 u32FramesIn;       //frames collected
+    uint32 u32Containers;     //container APDUs sent
+    uint32 u32SavedBytes;     //bytes not put on air thanks to aggregation, per hop
+    uint32 u32Retries;        //sends refused by the stack and tried again
+    uint32 u32Dropped;        //frames dropped after AGR_MAX_RETRIES
+}tsAgrStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool AGR_bEnabled(void);
+PUBLIC bool AGR_bSend(uint16 u16DstAddr, uint8 *pu8Frame, int len);
+PUBLIC void AGR_vFlushAll(void);
+PUBLIC void AGR_vGetStats(tsAgrStats *psStats);
+
+#endif /* FIRMWARE_AGGR_H_ */
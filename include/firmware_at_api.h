@@ -27,19 +27,29 @@
 #define __AT_API_H__
 
 #include <jendefs.h>
+#include <stddef.h>
 #include "firmware_uart.h"
 #include "firmware_ota.h"
+#include "firmware_stream.h"
 
 /* macro define */
 
 #define AT_REQ_PARAM_LEN      4         //maximal size of AT parameter
 #define AT_RESP_PARAM_LEN     20        //maximal size of AT response hex value
 #define API_DATA_LEN          32        //maximal size of each API data frame
+#define API_BATCH_LEN         73        //samples of a batch frame, 80 byte air frame less API header, checksum, srcAddr and count
+#define API_MC_STATUS_CLIENTS 8         //clients in an API_OTA_MC_STATUS frame
 
 #define API_START_DELIMITER   0x7e   //API special frame start delimiter
 
 #define OPTION_ACK_MASK       0x01    //option ACK or not
 #define OPTION_CAST_MASK      0x02    //option unicast or broadcast
+#define OPTION_ZIP_MASK       0x04    //data is LZSS compressed
+#define OPTION_PRIO_MASK      0x08    //data frame goes in the control traffic class
+
+/* frame of an older peer may end before a field added later */
+#define API_HAS_FIELD(apiSpec, type, field) \
+    ((apiSpec)->length >= offsetof(type, field) + sizeof(((type *)0)->field))
 
 /*
   API mode index
@@ -69,7 +79,21 @@ typedef enum
     ATOS = 0x66,  //ota status poll
     ATTP = 0x68,  //for test
     ATIO = 0x70,  //set IOs
-    ATAD = 0x72   //read ADC value from AD1 AD2 AD3 AD4
+    ATAD = 0x72,  //read ADC value from AD1 AD2 AD3 AD4
+    ATRW = 0x74,  //reliable stream window of DATA mode, 0: off
+    ATAG = 0x76,  //hold time of unicast frame aggregation, 0: off
+    ATCP = 0x78,  //LZSS compression of data frames, 0: off
+    ATOW = 0x7a,  //OTA block requests in flight
+    ATOM = 0x7c,  //multicast OTA trigger, 1: routers 2: end devices
+    ATOQ = 0x7e,  //multicast OTA status
+    ATOF = 0x80,  //unicast OTA trigger of every router(1) or end device(2)
+    ATOP = 0x82,  //unicast OTA progress of every client
+    ATPF = 0x84,  //end device poll interval after traffic
+    ATPC = 0x86,  //end device poll interval when idle
+    ATES = 0x88,  //energy accounting, current asleep(nA)
+    ATEA = 0x8a,  //energy accounting, current awake with the radio off(uA)
+    ATER = 0x8c,  //energy accounting, current receiving(uA)
+    ATET = 0x8e   //energy accounting, current sending(uA)
 }teAtIndex;
 
 /* API mode AT return value */
@@ -107,9 +131,33 @@ typedef enum
     API_OTA_ST_REQ = 0x91,
     API_OTA_ST_RESP = 0x89,
     API_TOPO_REQ = 0xfb,
-    API_TOPO_RESP = 0x6b
+    API_TOPO_RESP = 0x6b,
+    API_STREAM_DATA = 0x12,      //reliable stream data of DATA mode
+    API_STREAM_ACK = 0x92,
+    API_STREAM_LOST = 0x93,      //reliable stream gave up on its peer, reported to host even in DATA mode
+    API_TX_STATUS = 0x8b,        //delivery status of a data frame, reported to host
+    API_OTA_MC_BLK = 0x16,       //block of a multicast OTA session
+    API_OTA_MC_END = 0xd6,       //end of a multicast pass/repair round
+    API_OTA_MC_NACK = 0xb6,      //blocks a client misses after a round
+    API_OTA_PEER_REQ = 0x19,     //a client looks for a neighbour serving its image
+    API_OTA_PEER_RESP = 0x99,    //a neighbour running the image offers to serve it
+    API_OTA_HOST_START = 0x1b,   //host streams an OTA image over UART
+    API_OTA_HOST_DATA = 0x1c,    //a chunk of the streamed image
+    API_OTA_HOST_REQ = 0x9c,     //server asks host for the chunks it has room for
+    API_ENERGY_REQ = 0x1d,       //host asks a node for its energy accounting
+    API_ENERGY_RESP = 0x9d,      //energy accounting of a node
+    API_SAMPLE_BATCH = 0x1e,     //samples a sketch collected, sent together
+    API_OTA_MC_STATUS = 0x9e     //multicast OTA session and its clients, reported to host
 }teApiIdentifier;
 
+/* Delivery status reported in API_TX_STATUS, other values are ZPS/APS/MAC status codes */
+typedef enum
+{
+    TX_STATUS_SUCCESS = 0x00,    //confirmed(broadcast) or acknowledged by destination(unicast)
+    TX_STATUS_EXPIRED = 0xfd,    //tracking entry was reused before the stack reported
+    TX_STATUS_NOT_SENT = 0xfe    //stack refused the request, e.g. no free APDU
+}teTxStatus;
+
 
 /*--------API mode structure--------*/
 /* Information of topology */
@@ -202,10 +250,28 @@ typedef struct
     uint8 data[API_DATA_LEN]; //data array
 }__attribute__ ((packed)) tsTxDataPacket;
 
+/* Transmit status, the completion of a frame with non-zero frameId */
+typedef struct
+{
+    uint8  frameId;           //frameId of the original frame
+    uint16 unicastAddr;       //destination short address
+    uint8  retries;           //retransmissions done by module
+    uint8  status;            //teTxStatus or stack status code
+    uint16 latencyMs;         //time from first send to completion
+}__attribute__ ((packed)) tsTxStatus;
+
+/* the reliable stream of DATA mode dropped the frames in flight and re-synced */
+typedef struct
+{
+    uint16 unicastAddr;       //peer that stopped acking
+    uint16 bytes;             //bytes in flight, some may have arrived before the acks got lost
+}__attribute__ ((packed)) tsStreamLost;
+
 /* ATLA,list all nodes in network */
 typedef struct
 {
-    uint8 reqCmd;
+    uint8  reqCmd;
+    uint16 windowMs;       //answer in a random slot of this window, 0: answer now
 }__attribute__ ((packed)) tsNwkTopoReq;
 
 /* Network Topology response */
@@ -224,23 +290,161 @@ typedef struct
 {
     uint32 totalBytes;    //total bytes of this OTA image
     uint16 reqPeriodMs;   //require period time of client
+    uint8  maxBlockSize;  //largest block the server sends, missing: OTA_BLOCK_SIZE
+    uint8  session;       //multicast session, 0: clients request blocks by unicast
+    uint8  target;        //OTA_MC_TARGET_xxx, node type a multicast image is for
+    uint32 crc;           //image crc
+    uint16 baseVersion;   //delta patch: version and image crc it applies to
+    uint32 baseCrc;
+    uint32 patchBytes;    //delta patch length, 0: none
+    uint32 packedBytes;   //compressed image length, 0: none
 }__attribute__ ((packed)) tsOtaNotice;
 
 /* OTA require */
 typedef struct
 {
     uint32 blockIdx;
+    uint8  blockSize;     //block size chosen by client, missing: OTA_BLOCK_SIZE
+    uint8  image;         //OTA_IMAGE_xxx, missing: OTA_IMAGE_FULL
 }__attribute__ ((packed)) tsOtaReq;
 
-/* OTA response */
+/*
+  OTA response, the image crc(uint32) follows the block data at
+  block[blockSize], so a response of OTA_BLOCK_SIZE is laid out as before.
+  The block crc(uint16) follows at block[blockSize + 4], old clients don't
+  look at it.
+*/
 typedef struct
 {
     uint32 blockIdx;
     uint16 len;
-    uint8  block[OTA_BLOCK_SIZE];
-    uint32 crc;
+    uint8  block[OTA_MAX_BLOCK_SIZE + 4 + OTA_BLOCK_CRC_LEN];
 }__attribute__ ((packed)) tsOtaResp;
 
+/*
+  block of a multicast OTA session, size fixed by the notice, image crc is
+  in the notice, the block crc(uint16) follows at block[blockSize]
+*/
+typedef struct
+{
+    uint8  session;
+    uint32 blockIdx;
+    uint16 len;
+    uint8  block[OTA_MAX_BLOCK_SIZE + OTA_BLOCK_CRC_LEN];
+}__attribute__ ((packed)) tsOtaMcBlock;
+
+/* end of a multicast pass or repair round */
+typedef struct
+{
+    uint8  session;
+    uint8  round;         //0: first pass
+    uint8  last;          //no more multicast, fetch the rest by unicast
+    uint16 nackWindowMs;  //send the NACK at a random point of it
+}__attribute__ ((packed)) tsOtaMcEnd;
+
+/* blocks a client misses */
+typedef struct
+{
+    uint8  session;
+    uint8  round;
+    uint8  per;           //percent of blocks received
+    uint32 baseBlock;     //first missing block
+    uint8  gaps[OTA_MC_NACK_BYTES];   //bit i: baseBlock + i is missing
+}__attribute__ ((packed)) tsOtaMcNack;
+
+/* a client asks a neighbour for the image it downloads */
+typedef struct
+{
+    uint32 crc;           //image crc of the notice
+    uint32 imageBytes;
+}__attribute__ ((packed)) tsOtaPeerReq;
+
+/* a neighbour running the image offers it, and the patch or compressed image it still has */
+typedef struct
+{
+    uint32 crc;
+    uint32 imageBytes;
+    uint32 patchBytes;    //delta patch length, 0: none
+    uint32 baseCrc;       //image crc the patch applies to
+    uint32 packedBytes;   //compressed image length, 0: none
+}__attribute__ ((packed)) tsOtaPeerResp;
+
+/* host streams an OTA image to the server, totalBytes 0 stops the stream */
+typedef struct
+{
+    uint32 totalBytes;
+    uint32 crc;           //image crc
+    uint8  cache;         //1: the server copies the image into its external flash too
+}__attribute__ ((packed)) tsOtaHostStart;
+
+/* a chunk of the streamed image, the frame length tells its size */
+typedef struct
+{
+    uint32 offset;        //multiple of OTA_HOST_CHUNK_SIZE
+    uint8  data[OTA_HOST_CHUNK_SIZE];
+}__attribute__ ((packed)) tsOtaHostData;
+
+/* server asks host for image bytes, never more than it has room for */
+typedef struct
+{
+    uint32 offset;
+    uint16 len;           //0: nothing to send, see status
+    uint8  status;        //OTA_HOST_xxx
+}__attribute__ ((packed)) tsOtaHostReq;
+
+/* energy accounting request, from host or over the air */
+typedef struct
+{
+    uint16 unicastAddr;   //node asked, 0xfffe or its own address: the local node
+    uint8  reset;         //1: count from zero after the answer
+}__attribute__ ((packed)) tsEnergyReq;
+
+/* energy accounting since the last reset */
+typedef struct
+{
+    uint16 shortAddr;     //node the figures are of
+    uint32 awakeSec;
+    uint32 sleepSec;
+    uint32 rxMs;          //radio receiving for polls
+    uint32 txMs;          //radio sending
+    uint32 sleeps;
+    uint32 polls;
+    uint32 txFrames;
+    uint32 uartBytes;     //received on the UART
+    uint32 chargeUah;     //estimate from the current table
+    uint32 avgNa;         //average current
+}__attribute__ ((packed)) tsEnergyResp;
+
+/* samples collected by a sketch(aupsBatchAdd), the frame length tells the bytes used */
+typedef struct
+{
+    uint16 srcAddr;       //node the samples are from
+    uint8  count;
+    uint8  data[API_BATCH_LEN];  //count x [uint16 age at send(100ms), uint8 len, len bytes]
+}__attribute__ ((packed)) tsSampleBatch;
+
+/* a client of a multicast OTA session */
+typedef struct
+{
+    uint16 addr;
+    uint8  per;           //percent received
+    uint8  done;          //1: image received and checked
+}__attribute__ ((packed)) tsOtaMcClientStatus;
+
+/* multicast OTA session, its clients are spread over frames with rising first */
+typedef struct
+{
+    uint8  session;       //0: no session
+    uint8  multicasting;  //0: over, clients fetch the rest by unicast
+    uint8  round;
+    uint16 clients;       //clients in the table
+    uint16 done;
+    uint16 untracked;     //reports of clients beyond the table
+    uint16 first;         //index of client[0]
+    uint8  count;         //clients in this frame
+    tsOtaMcClientStatus client[API_MC_STATUS_CLIENTS];
+}__attribute__ ((packed)) tsOtaMcStatus;
+
 /* OTA status */
 typedef struct
 {
@@ -285,6 +489,22 @@ typedef struct
         tsOtaReq otaReq;
         tsOtaResp otaResp;
         tsOtaStatusResp otaStatusResp;
+        tsOtaMcBlock otaMcBlock;
+        tsOtaMcEnd otaMcEnd;
+        tsOtaMcNack otaMcNack;
+        tsOtaPeerReq otaPeerReq;
+        tsOtaPeerResp otaPeerResp;
+        tsOtaHostStart otaHostStart;
+        tsOtaHostData otaHostData;
+        tsOtaHostReq otaHostReq;
+        tsEnergyReq energyReq;
+        tsEnergyResp energyResp;
+        tsSampleBatch sampleBatch;
+        tsOtaMcStatus otaMcStatus;
+        tsTxStatus txStatus;
+        tsStreamData streamData;
+        tsStreamAck streamAck;
+        tsStreamLost streamLost;
     }__attribute__ ((packed)) payload;
     uint8 checkSum;                             //verify byte
 }__attribute__ ((packed)) tsApiSpec;
@@ -342,8 +562,13 @@ int API_i32AtCmdProc(uint8 *buf, int len);
 int API_i32ApiFrmProc(tsApiSpec* apiSpec);
 int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent);
 bool API_bSendToAirPort(uint16 txMode, uint16 unicastDest, uint8 *buf, int len);
+bool API_bSendToAirPortNow(uint16 txMode, uint16 unicastDest, uint8 *buf, int len);
+bool API_bSendToAirPortApdu(uint16 txMode, uint16 unicastDest, uint8 *buf, int len, uint8 *pu8SeqNum);
 bool API_bSendToEndPoint(uint16 txMode, uint16 unicastDest, uint8 srcEpId, uint8 dstEpId, char *buf, int len);
 bool API_bSendToMacDev(uint64 unicastMacAddr, uint8 srcEpId, uint8 dstEpId, char *buf, int len);  /*[Override]*/
+bool API_bSendToAirPortTracked(uint16 txMode, uint16 unicastDest, uint8 *buf, int len, uint8 *pu8SeqNum);
+bool API_bSendToMacDevTracked(uint64 unicastMacAddr, uint8 *buf, int len, uint8 *pu8SeqNum);
+int API_i32OtaServeBlock(uint16 u16Dst, uint8 u8Image, uint32 u32BlockIdx, uint16 u16BlockSize);
 void postReboot();
 
 #endif /* __AT_API_H__ */
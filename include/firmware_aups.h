@@ -7,7 +7,8 @@
  * Spread by SeeedStudio
  * Author     : Oliver Wang
  * Create Time: 2014/4
- * Change Log :
+ * Change Log : Warm resume of the sketch after a sleep
+ *              Samples sent in batches(aupsBatchAdd)
  *
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
@@ -31,11 +32,46 @@
 #define AUPS_UART_RB_LEN          50
 #define AUPS_AIR_RB_LEN           50
 
+/*
+  ATBN is an upper limit, a batch also goes when the next sample wouldn't
+  fit in its API_BATCH_LEN bytes. Each sample costs AUPS_BATCH_SAMPLE_HDR
+  more, e.g. 8 samples of up to 6 bytes or 16 of 1 byte fill a frame.
+*/
+#define AUPS_BATCH_DEF_SIZE       8         //samples per batch frame at most, ATBN 0
+#define AUPS_BATCH_MAX_SIZE       16
+#define AUPS_BATCH_DEF_AGE_S      60        //oldest sample of a batch waits at most, ATBA 0
+#define AUPS_BATCH_MAX_AGE_S      3600
+#define AUPS_BATCH_SAMPLE_HDR     3         //age, length
+
+/* [type definition] */
+/* wake up to first arduino_loop() */
+typedef struct
+{
+    uint32 u32Wakes;
+    uint32 u32SumUs;
+    uint32 u32MaxUs;
+}tsUpsWakeStats;
+
+typedef struct
+{
+    uint32 u32Samples;        //added by the sketch
+    uint32 u32Sent;           //samples in frames the stack took
+    uint32 u32Frames;
+    uint32 u32Failed;         //frames the stack refused, the samples are kept
+    uint32 u32Dropped;        //samples lost for a full batch which couldn't be sent
+}tsUpsBatchStats;
+
 /* [public functions] */
 PUBLIC void setNodeState(uint32 state);
 PUBLIC void vDelayMsec(uint32 u32Period);
 PUBLIC void ups_init(void);
+PUBLIC void ups_wakeup(void);
+PUBLIC void ups_printWakeStatus(void);
 PUBLIC uint32 aupsAirPortReadable(void);
 PUBLIC uint8 aupsAirPortRead(void *dst, int len);
 PUBLIC uint8 aupsSendApiFrm(void *dst, int len);
+PUBLIC bool aupsBatchAdd(void *data, uint8 len);
+PUBLIC bool aupsBatchFlush(void);
+PUBLIC void UPS_vBatchSleep(uint32 u32SleepMs);
+PUBLIC void UPS_vPrintBatchStatus(void);
 #endif
@@ -0,0 +1,75 @@
+/*
+ * firmware_energy.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_ENERGY_H_
+#define FIRMWARE_ENERGY_H_
+
+#include <jendefs.h>
+#include "firmware_at_api.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+/* current table defaults, JN5168 datasheet figures rounded up, ATES/ATEA/ATER/ATET 0 */
+#define ENG_DEF_SLEEP_NA        1500    //asleep, RAM held and 32kHz oscillator running
+#define ENG_DEF_AWAKE_UA        8000    //awake with the radio off, CPU at 32MHz
+#define ENG_DEF_RX_UA           17000   //radio receiving
+#define ENG_DEF_TX_UA           15000   //radio sending at 2.5dBm
+
+#define ENG_MAX_SPAN_US         100000  //a radio span whose end went missing counts this long
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint32 u32AwakeSec;       //awake time counted up to u32AwakeMarkMs
+    uint32 u32AwakeMarkMs;    //ms time base the awake time is counted to
+    uint32 u32SleepSec;       //programmed sleeps, a DIO wake counts the whole sleep
+    uint16 u16SleepMs;        //below a second, carried into u32SleepSec
+    uint32 u32Sleeps;
+    uint32 u32Wakes;
+    uint64 u64RxUs;           //radio receiving, poll to poll confirm
+    uint64 u64TxUs;           //radio sending, APDU handed to the stack to its confirm
+    uint32 u32Polls;
+    uint32 u32TxFrames;
+    uint32 u32UartRx;         //UART receive interrupts
+    uint32 u32UartBytes;
+}tsEngStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC void ENG_vPreSleep(void);
+PUBLIC void ENG_vWakeup(void);
+PUBLIC void ENG_vTxStart(void);
+PUBLIC void ENG_vTxDone(void);
+PUBLIC void ENG_vPollStart(void);
+PUBLIC void ENG_vPollDone(void);
+PUBLIC void ENG_vUartRx(uint32 u32Bytes);
+PUBLIC void ENG_vTick(void);
+PUBLIC void ENG_vReset(void);
+PUBLIC void ENG_vAssembleResp(tsApiSpec *psApiSpec);
+PUBLIC void ENG_vPrintStatus(void);
+
+#endif /* FIRMWARE_ENERGY_H_ */
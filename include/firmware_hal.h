@@ -54,4 +54,7 @@ PUBLIC void vHAL_PullXtal(int32 i32Temperature);
 PUBLIC int16 i16HAL_GetChipTemp(uint16 u16AdcValue);
 PUBLIC void vHAL_UartRead(void *data, int len);
 PUBLIC uint16 random();
+PUBLIC uint32 u32HAL_GetMsTime(void);
+PUBLIC void vHAL_TickSleep(void);
+PUBLIC uint32 u32HAL_GetUsTime(void);
 #endif /* FIRMWARE_HAL_H_ */
@@ -0,0 +1,53 @@
+/*
+ * firmware_lzss.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_LZSS_H_
+#define FIRMWARE_LZSS_H_
+
+/*
+  Heatshrink style LZSS(LZS) for small air payloads.
+  A literal is a 1 bit followed by 8 bits, a back-reference is a 0 bit
+  followed by LZS_INDEX_BITS of distance-1 and LZS_COUNT_BITS of length-2,
+  MSB first. The tail of the last byte is padded with 0 bits, too short to
+  hold a token. No heap, no tables; only depends on jendefs.h, so the same
+  code runs in the host benchmark under tools/.
+*/
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define LZS_INDEX_BITS        6       //window of 64 bytes
+#define LZS_COUNT_BITS        4       //matches of 2~17 bytes
+#define LZS_WINDOW            (1 << LZS_INDEX_BITS)
+#define LZS_MIN_MATCH         2
+#define LZS_MAX_MATCH         ((1 << LZS_COUNT_BITS) + LZS_MIN_MATCH - 1)
+#define LZS_MAX_RAW           64      //raw bytes a compressed data frame may carry
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC int LZS_i32Compress(const uint8 *pu8In, int inLen, uint8 *pu8Out, int outMax, int *piConsumed);
+PUBLIC int LZS_i32Decompress(const uint8 *pu8In, int inLen, uint8 *pu8Out, int outMax);
+
+#endif /* FIRMWARE_LZSS_H_ */
@@ -26,22 +26,86 @@
 
 #include "common.h"
 
-#define OTA_BLOCK_SIZE              50
-#define OTA_SECTOR_SIZE             64*1024
+#define OTA_BLOCK_SIZE              50     //block size of peers which don't negotiate it
+#define OTA_AIR_FRAME_MAX           80     //API frame in one secured, unfragmented APS frame
+#define OTA_BLOCK_CRC_LEN           2      //checksum of each block on the air
+#define OTA_RESP_OVERHEAD           (4 + 6 + 4 + OTA_BLOCK_CRC_LEN)  //API frame, block index & length, image crc, block crc
+#define OTA_MAX_BLOCK_SIZE          (OTA_AIR_FRAME_MAX - OTA_RESP_OVERHEAD)
+#define OTA_FLASH_PAGE_SIZE         256    //program page of the external flash
+
+/* multicast OTA */
+#define OTA_MC_TARGET_ROU           1      //image is for routers
+#define OTA_MC_TARGET_END           2      //image is for end devices
+#define OTA_MC_NACK_BYTES           32     //gap bitmap of a NACK, 256 blocks from the first hole
+#define OTA_MC_SILENCE_MS           30000  //client fetches the rest by unicast after that
+#define OTA_FLEET_SPREAD_MS         5000   //clients of a broadcast unicast notice start within that
+#define OTA_PEER_WAIT_MS            1000   //client waits for offers of its neighbours before the first request
+#define OTA_PEER_SILENCE_MS         10000  //client goes back to the server when its peer is silent that long
+#define OTA_PEER_MIN_LQI            100    //offers over weaker links are ignored
+#define OTA_PEER_MAX_QUERIES        8      //neighbours asked for the image
+#define OTA_SECTOR_SIZE             (64*1024)
 #define OTA_SECTOR_CNT              8
 #define OTA_MAGIC_OFFSET            0x0
 #define OTA_IMAGE_LEN_OFFSET        0x20
 #define OTA_MAGIC_NUM_LEN           12
 
+/* delta and compressed OTA, sent instead of the image in external flash */
+#define OTA_DELTA_OFFSET            (4*OTA_SECTOR_SIZE)    //patch from the running image to the new one, a sector
+#define OTA_PACKED_OFFSET           (5*OTA_SECTOR_SIZE)    //compressed image, the rest of the flash
+#define OTA_INTERNAL_FLASH_ADDR     0x00080000             //running image, memory mapped
+#define OTA_IMAGE_FULL              0                      //image asked by a client
+#define OTA_IMAGE_DELTA             1
+#define OTA_IMAGE_PACKED            2
+#define OTA_CACHE_LINE_SIZE         OTA_FLASH_PAGE_SIZE    //server read cache of the external flash
+#ifdef OTA_SERVER
+#define OTA_CACHE_LINES             4      //lent to the host stream while it runs
+#else
+#define OTA_CACHE_LINES             2      //peers serve a few neighbours only
+#endif
+
+/* image streamed by host over UART */
+#define OTA_HOST_CHUNK_SIZE         64     //image bytes of an API_OTA_HOST_DATA frame
+#define OTA_HOST_SEND               0      //status to host: send the bytes asked for
+#define OTA_HOST_CACHED             1      //image is complete in flash, host may stop
+#define OTA_HOST_REFUSED            2      //stream stopped, image not accepted
+
+/* time spent erasing the external flash */
+typedef struct
+{
+    uint32 u32Erases;
+    uint32 u32TotalMs;
+    uint32 u32MaxMs;
+} tsOtaEraseStats;
+
+/* server reads of the external flash through the cache */
+typedef struct
+{
+    uint32 u32Reads;        //cached reads asked for
+    uint32 u32Hits;         //served from RAM only
+    uint32 u32Fills;        //lines read from flash
+    uint32 u32ReadAheads;   //lines read ahead of the one missed
+} tsOtaCacheStats;
+
 extern uint8 magicNum[OTA_MAGIC_NUM_LEN];
+extern tsOtaEraseStats g_sOtaEraseStats;
+extern tsOtaCacheStats g_sOtaCacheStats;
 
 PUBLIC void APP_vOtaFlashLockRead(uint32 offsetByte, uint16 len, uint8 *dest);
+PUBLIC void APP_vOtaFlashCachedRead(uint32 offsetByte, uint16 len, uint8 *dest);
+PUBLIC void APP_vOtaFlashCacheFlush(void);
+PUBLIC uint8 *APP_pu8OtaCacheLend(uint8 u8Line);
+PUBLIC void APP_vOtaCacheReclaim(void);
 PUBLIC void APP_vOtaFlashLockWrite(uint32 offsetByte, uint16 len, uint8 *buff);
 PUBLIC void APP_vOtaFlashLockErase(uint8 sector); 
 PUBLIC void APP_vOtaFlashLockEraseAll(); 
 PUBLIC void APP_vOtaKillInternalReboot();
+PUBLIC uint8 APP_u8OtaClientBlockSize(uint8 u8Offer);
+PUBLIC uint32 APP_u32OtaBlocks(uint32 u32TotalBytes, uint16 u16BlockSize);
+PUBLIC uint16 APP_u16OtaBlockCrc(uint8 *pu8Block, uint16 len);
+PUBLIC uint32 APP_u32OtaPatchBytes(uint32 u32ImageLen, uint32 u32ImageCrc, uint16 *pu16BaseVersion, uint32 *pu32BaseCrc);
+PUBLIC uint32 APP_u32OtaPackedBytes(uint32 u32ImageLen, uint32 u32ImageCrc);
+PUBLIC uint32 APP_u32OtaRunningCrc(void);
 
-PUBLIC void init_crc_table(void);
 PUBLIC unsigned int crc32(unsigned int crc, unsigned char *buffer, unsigned int size); 
 PUBLIC uint32 imageCrc(uint32 imageLen); 
 
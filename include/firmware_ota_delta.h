@@ -0,0 +1,108 @@
+/*
+ * firmware_ota_delta.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_OTA_DELTA_H_
+#define FIRMWARE_OTA_DELTA_H_
+
+/*
+  Delta OTA patch(ODT), built by tools/ota_delta from the image a node runs
+  and the new image. It's applied as a stream: the patch and the output are
+  walked once in order, the base image is read at random, RAM use is two
+  small buffers. Only depends on jendefs.h, so the same code runs in the
+  host tool under tools/.
+
+  Layout, integers little endian:
+    header(ODT_HEADER_LEN): "MBDP", base version(u16), 0(u16), base length,
+    base crc, new length, new crc, patch length(u32 each, patch length
+    counts the header)
+    ops:
+    ODT_OP_COPY, varint len, signed varint move: copy len base bytes from
+                 the end of the last copy + move
+    ODT_OP_ADD,  varint len, len bytes: new bytes
+    ODT_OP_END
+*/
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define ODT_HEADER_LEN        28
+#define ODT_BUF_LEN           64      //patch read and output write chunks
+
+#define ODT_OP_END            0
+#define ODT_OP_COPY           1
+#define ODT_OP_ADD            2
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint16 u16BaseVersion;
+    uint32 u32BaseLen;
+    uint32 u32BaseCrc;
+    uint32 u32NewLen;
+    uint32 u32NewCrc;
+    uint32 u32PatchLen;
+}tsOdtHeader;
+
+typedef enum
+{
+    E_ODT_MORE,
+    E_ODT_DONE,
+    E_ODT_ERROR
+}teOdtStatus;
+
+/* reads base or patch bytes, writes output bytes */
+typedef void (*ODT_tpfRead)(uint32 u32Offset, uint16 len, uint8 *pu8Buf);
+typedef bool (*ODT_tpfWrite)(uint32 u32Offset, uint16 len, uint8 *pu8Buf);
+
+/* one patch being applied */
+typedef struct
+{
+    tsOdtHeader sHdr;
+    uint32 u32PatchPos;           //patch bytes consumed into au8In
+    uint32 u32BasePos;            //end of the last copy
+    uint32 u32OutPos;             //output bytes produced
+    uint8  u8Op;                  //op in progress
+    uint32 u32OpLeft;             //its bytes left
+    uint8  au8In[ODT_BUF_LEN];
+    uint8  u8InLen;
+    uint8  u8InPos;
+    uint8  au8Out[ODT_BUF_LEN];
+    uint8  u8OutLen;
+
+    ODT_tpfRead  pfReadBase;
+    ODT_tpfRead  pfReadPatch;
+    ODT_tpfWrite pfWrite;
+}tsOtaDelta;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool ODT_bParseHeader(uint8 *pu8Hdr, tsOdtHeader *psHdr);
+PUBLIC void ODT_vWriteHeader(tsOdtHeader *psHdr, uint8 *pu8Hdr);
+PUBLIC bool ODT_bInit(tsOtaDelta *psDelta, ODT_tpfRead pfReadBase, ODT_tpfRead pfReadPatch, ODT_tpfWrite pfWrite);
+PUBLIC teOdtStatus ODT_eStep(tsOtaDelta *psDelta, uint32 u32MaxBytes);
+
+#endif /* FIRMWARE_OTA_DELTA_H_ */
@@ -0,0 +1,117 @@
+/*
+ * firmware_ota_dl.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_OTA_DL_H_
+#define FIRMWARE_OTA_DL_H_
+
+/*
+  Pipelined OTA block download of the OTA client(ODL).
+  Keeps a window of block requests in flight and takes the responses in any
+  order. Only depends on jendefs.h, so the same code runs in the host
+  benchmark under tools/.
+*/
+#include <jendefs.h>
+#include "firmware_rtt.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define ODL_MAX_IMAGE_BYTES   (256 * 1024)   //same limit as the OTA server
+#define ODL_MIN_BLOCK_SIZE    50
+#define ODL_MAX_BLOCKS        ((ODL_MAX_IMAGE_BYTES + ODL_MIN_BLOCK_SIZE - 1) / ODL_MIN_BLOCK_SIZE)
+#define ODL_BITMAP_LEN        ((ODL_MAX_BLOCKS + 7) / 8)
+#define ODL_MAX_WINDOW        8       //maximal requests in flight
+#define ODL_DEF_WINDOW        4
+#define ODL_MIN_RTO_MS        100
+#define ODL_MAX_RTO_MS        8000
+#define ODL_MAX_RUNS          16      //received ranges kept over a reboot
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/* sends the request of a block */
+typedef bool (*ODL_tpfRequest)(uint32 u32BlockIdx);
+
+/* a request in flight */
+typedef struct
+{
+    bool   bUsed;
+    uint8  u8Tries;
+    uint32 u32BlockIdx;
+    uint32 u32SentMs;
+}tsOdlSlot;
+
+/* a range of received blocks, the persisted progress is a list of them */
+typedef struct
+{
+    uint16 u16Start;
+    uint16 u16Len;
+}tsOdlRun;
+
+/* statistics */
+typedef struct
+{
+    uint32 u32Requests;
+    uint32 u32Timeouts;
+    uint32 u32RxBlocks;
+    uint32 u32RxDuplicates;
+    uint32 u32RxOutOfOrder;
+    uint32 u32Dropped;            //failed verification or erased, fetched again
+}tsOdlStats;
+
+/* one download */
+typedef struct
+{
+    uint32 u32TotalBlocks;
+    uint32 u32RxBlocks;           //blocks marked in the bitmap
+    uint32 u32FirstHole;          //all blocks below have been received
+    uint32 u32NextNew;            //blocks from here on have never been requested
+    uint8  u8Window;              //configured limit of requests in flight
+    uint8  u8Cwnd;                //current limit, shrinks on loss
+    uint8  u8Ssthresh;
+    uint8  u8AckCnt;
+    uint8  u8InFlight;
+    tsRtt  sRtt;
+    uint32 u32LastCutMs;          //window is cut at most once per rtt
+    tsOdlSlot asSlot[ODL_MAX_WINDOW];
+    uint8  au8Bitmap[ODL_BITMAP_LEN];
+
+    ODL_tpfRequest pfRequest;
+    tsOdlStats     sStats;
+}tsOtaDownload;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC void ODL_vInit(tsOtaDownload *psDl, uint32 u32TotalBlocks, uint32 u32DoneBlocks,
+                      uint8 u8Window, uint32 u32InitRtoMs, ODL_tpfRequest pfRequest);
+PUBLIC bool ODL_bRxBlock(tsOtaDownload *psDl, uint32 u32BlockIdx, uint32 u32NowMs);
+PUBLIC uint32 ODL_u32Poll(tsOtaDownload *psDl, uint32 u32NowMs);
+PUBLIC bool ODL_bDone(tsOtaDownload *psDl);
+PUBLIC uint32 ODL_u32EtaMs(tsOtaDownload *psDl);
+PUBLIC uint16 ODL_u16Gaps(tsOtaDownload *psDl, uint32 u32Base, uint8 *pu8Gaps, uint16 u16Bits);
+PUBLIC uint8 ODL_u8GetRuns(tsOtaDownload *psDl, tsOdlRun *psRuns, uint8 u8MaxRuns);
+PUBLIC void ODL_vSetRuns(tsOtaDownload *psDl, const tsOdlRun *psRuns, uint8 u8Runs);
+PUBLIC void ODL_vDropBlocks(tsOtaDownload *psDl, uint32 u32First, uint32 u32Count);
+
+#endif /* FIRMWARE_OTA_DL_H_ */
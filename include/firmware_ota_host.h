@@ -0,0 +1,68 @@
+/*
+ * firmware_ota_host.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_OTA_HOST_H_
+#define FIRMWARE_OTA_HOST_H_
+
+#include <jendefs.h>
+#include "firmware_ota.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define OHS_LINE_CHUNKS         (OTA_CACHE_LINE_SIZE / OTA_HOST_CHUNK_SIZE)
+#define OHS_BUF_CHUNKS          (OTA_CACHE_LINES * OHS_LINE_CHUNKS)   //chunks kept in RAM, in the read cache lines
+#define OHS_MAX_INFLIGHT        2       //chunks asked from host and not received, the UART pool holds 2 frames
+#define OHS_READ_AHEAD          4       //chunks asked for behind the ones a client waits for
+#define OHS_REQ_TIMEOUT_MS      1000    //a chunk host didn't send by then is asked for again
+#define OHS_MAX_PENDING         16      //client requests waiting for host
+#define OHS_IMAGE_CHUNKS        (OTA_DELTA_OFFSET / OTA_HOST_CHUNK_SIZE)   //largest image, in chunks
+#define OHS_CRC_STEP_BYTES      1024    //bytes of the copy in flash checked per run of APP_taskOtaSrv
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint32 u32Asked;          //chunks asked from host
+    uint32 u32Reasked;        //asked again after OHS_REQ_TIMEOUT_MS
+    uint32 u32Received;
+    uint32 u32Dropped;        //chunks with no room or out of the image
+    uint32 u32Reads;          //reads of the image to serve clients
+    uint32 u32Waits;          //reads that waited for host
+    uint32 u32FlashReads;     //reads served from the copy in flash
+}tsOhsStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool OHS_bStart(uint32 u32Bytes, uint32 u32Crc, bool bCache);
+PUBLIC void OHS_vStop(void);
+PUBLIC bool OHS_bActive(void);
+PUBLIC void OHS_vData(uint32 u32Offset, uint8 *pu8Data, uint16 u16Len);
+PUBLIC bool OHS_bRead(uint32 u32Offset, uint16 u16Len, uint8 *pu8Dest);
+PUBLIC void OHS_vPend(uint16 u16Addr, uint8 u8Image, uint32 u32BlockIdx, uint8 u8BlockSize);
+PUBLIC bool OHS_bCheckStep(void);
+PUBLIC void OHS_vPrintStatus(void);
+
+#endif /* FIRMWARE_OTA_HOST_H_ */
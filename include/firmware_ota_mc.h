@@ -0,0 +1,75 @@
+/*
+ * firmware_ota_mc.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_OTA_MC_H_
+#define FIRMWARE_OTA_MC_H_
+
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+/*
+  Broadcast pace. Every router keeps each broadcast in its broadcast
+  transaction table(BTT) for the broadcast delivery time, a full table
+  drops broadcasts network wide. The blocks take at most 1/OMC_BTT_SHARE
+  of the table, the rest is left to other broadcasts: 9000 * 2 / 64 = 281ms.
+*/
+#define OMC_BTT_SIZE            64      //BroadcastTransactionTableSize of MeshBee.zpscfg
+#define OMC_BTT_PERSIST_MS      9000    //nwkNetworkBroadcastDeliveryTime of ZigBee PRO
+#define OMC_BTT_SHARE           2
+#define OMC_MIN_PERIOD_MS       (OMC_BTT_PERSIST_MS * OMC_BTT_SHARE / OMC_BTT_SIZE)
+#define OMC_NACK_WINDOW_MS      5000    //clients NACK at a random point of it
+#define OMC_NACK_MARGIN_MS      1000    //NACKs of the last moment are still on the way
+#define OMC_MAX_ROUNDS          3       //multicast repair rounds, clients fetch the rest by unicast
+#define OMC_MCAST_MIN_MISSES    2       //a block missed by that many clients is resent by multicast
+#define OMC_MAX_CLIENTS         64      //clients whose status is kept
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef enum
+{
+    E_OMC_CLIENT_NACKED,      //missed blocks in the last round
+    E_OMC_CLIENT_DONE         //image received and checked
+}teOmcClientState;
+
+/* status of a client, as reported to host */
+typedef struct
+{
+    uint16 u16Addr;
+    uint8  u8Per;
+    uint8  eState;
+}tsOmcClient;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool OMC_bStart(uint8 u8Target);
+PUBLIC void OMC_vAbort(void);
+PUBLIC void OMC_vNack(uint16 u16SrcAddr, uint8 u8Session, uint8 u8Round, uint8 u8Per,
+                      uint32 u32Base, uint8 *pu8Gaps);
+PUBLIC void OMC_vClientDone(uint16 u16SrcAddr);
+PUBLIC void OMC_vReportStatus(void);
+
+#endif /* FIRMWARE_OTA_MC_H_ */
@@ -0,0 +1,104 @@
+/*
+ * firmware_ota_pack.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_OTA_PACK_H_
+#define FIRMWARE_OTA_PACK_H_
+
+/*
+  Compressed OTA image(OPK), built by tools/ota_pack. LZSS like
+  firmware_lzss.c with a window that suits a whole image: a literal is a 1
+  bit followed by 8 bits, a back-reference is a 0 bit followed by
+  OPK_INDEX_BITS of distance-1 and OPK_COUNT_BITS of length-2, MSB first.
+  It's expanded as a stream while the compressed blocks come in, the window
+  is the only big buffer. Only depends on jendefs.h, so the same code runs
+  in the host tool under tools/.
+
+  Layout, integers little endian:
+    header(OPK_HEADER_LEN): "MBLZ", image length, image crc, compressed
+    length(counts the header)
+    bit stream, the tail of the last byte is padded with 0 bits
+*/
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define OPK_HEADER_LEN        16
+#define OPK_INDEX_BITS        10      //window of 1KB
+#define OPK_COUNT_BITS        4       //matches of 2~17 bytes
+#define OPK_WINDOW            (1 << OPK_INDEX_BITS)
+#define OPK_MIN_MATCH         2
+#define OPK_MAX_MATCH         ((1 << OPK_COUNT_BITS) + OPK_MIN_MATCH - 1)
+#define OPK_BUF_LEN           64      //compressed read and image write chunks
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint32 u32ImageLen;
+    uint32 u32ImageCrc;
+    uint32 u32PackedLen;
+}tsOpkHeader;
+
+typedef enum
+{
+    E_OPK_MORE,
+    E_OPK_DONE,
+    E_OPK_ERROR
+}teOpkStatus;
+
+/* reads compressed bytes, writes image bytes */
+typedef void (*OPK_tpfRead)(uint32 u32Offset, uint16 len, uint8 *pu8Buf);
+typedef bool (*OPK_tpfWrite)(uint32 u32Offset, uint16 len, uint8 *pu8Buf);
+
+/* one image being expanded */
+typedef struct
+{
+    tsOpkHeader sHdr;
+    uint32 u32InAvail;            //compressed bytes there are so far
+    uint32 u32InPos;              //compressed bytes consumed into au8In
+    uint8  au8In[OPK_BUF_LEN];
+    uint8  u8InLen;
+    uint8  u8InPos;
+    uint8  u8Cur;                 //byte being taken apart
+    uint8  u8CurBits;             //its bits left
+    uint16 u16MatchLeft;          //back-reference in progress
+    uint16 u16MatchDist;
+    uint32 u32OutPos;             //image bytes produced
+    uint32 u32FlushPos;           //image bytes written
+    uint8  au8Win[OPK_WINDOW];
+
+    OPK_tpfRead  pfRead;
+    OPK_tpfWrite pfWrite;
+}tsOtaPack;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool OPK_bParseHeader(uint8 *pu8Hdr, tsOpkHeader *psHdr);
+PUBLIC void OPK_vWriteHeader(tsOpkHeader *psHdr, uint8 *pu8Hdr);
+PUBLIC bool OPK_bInit(tsOtaPack *psPack, OPK_tpfRead pfRead, OPK_tpfWrite pfWrite);
+PUBLIC teOpkStatus OPK_eStep(tsOtaPack *psPack, uint32 u32InAvail, uint32 u32MaxBytes);
+
+#endif /* FIRMWARE_OTA_PACK_H_ */
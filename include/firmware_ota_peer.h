@@ -0,0 +1,61 @@
+/*
+ * firmware_ota_peer.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_OTA_PEER_H_
+#define FIRMWARE_OTA_PEER_H_
+
+#include <jendefs.h>
+#include "firmware_at_api.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/* statistics */
+typedef struct
+{
+    uint32 u32Queries;        //peer: queries of clients
+    uint32 u32Offers;         //peer: offers sent
+    uint32 u32ServedBlocks;   //peer: blocks sent to clients
+    uint32 u32PeerBlocks;     //client: blocks received from a peer
+    uint32 u32Fallbacks;      //client: peer went silent, back to the server
+}tsOprStats;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+extern tsOprStats g_sOprStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool OPR_bImageSpan(uint8 u8Image, uint32 *pu32Base, uint32 *pu32Bytes, uint32 *pu32Crc);
+PUBLIC void OPR_vServed(uint16 u16Addr);
+PUBLIC void OPR_vQuery(uint16 u16SrcAddr, tsOtaPeerReq *psReq);
+PUBLIC void OPR_vInvalidate(void);
+PUBLIC uint8 OPR_u8Search(uint16 u16ServerAddr);
+PUBLIC void OPR_vOffer(uint16 u16SrcAddr, uint8 u8Lqi, tsOtaPeerResp *psResp);
+PUBLIC void OPR_vRxBlock(uint16 u16SrcAddr);
+PUBLIC uint16 OPR_u16Source(void);
+PUBLIC void OPR_vCheckSource(void);
+
+#endif /* FIRMWARE_OTA_PEER_H_ */
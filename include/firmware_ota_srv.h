@@ -0,0 +1,77 @@
+/*
+ * firmware_ota_srv.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_OTA_SRV_H_
+#define FIRMWARE_OTA_SRV_H_
+
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define OSV_MAX_SESSIONS        16      //clients served by unicast at the same time
+#define OSV_STALE_MS            60000   //a client silent that long is reported stalled, its slot can be reused
+#define OSV_REPORT_MS           10000   //aggregate progress to host while clients download
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef enum
+{
+    E_OSV_FREE,
+    E_OSV_NOTIFIED,           //notice sent, no block asked for yet
+    E_OSV_DOWNLOADING,
+    E_OSV_DONE,               //image checked, upgrade granted
+    E_OSV_ABORTED
+}teOsvState;
+
+/* unicast download of a client, as seen by the server */
+typedef struct
+{
+    uint16 u16Addr;
+    uint8  eState;
+    uint8  u8Image;           //OTA_IMAGE_xxx the client asks for
+    uint8  u8BlockSize;
+    uint8  u8Per;             //progress, by block requests or reported by the client
+    uint32 u32Blocks;         //blocks of the image asked for
+    uint32 u32NextBlock;      //highest block asked for + 1
+    uint32 u32Requests;
+    uint32 u32Repeats;        //blocks asked for again, lost on the way
+    uint32 u32ServedBytes;
+    uint32 u32StartMs;        //first block request
+    uint32 u32LastMs;         //last frame of the client
+}tsOsvSession;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC void OSV_vNotified(uint16 u16Addr);
+PUBLIC void OSV_vServed(uint16 u16Addr, uint8 u8Image, uint32 u32BlockIdx, uint8 u8BlockSize,
+                        uint16 u16Len, uint32 u32Blocks);
+PUBLIC void OSV_vStatus(uint16 u16Addr, bool bInOta, uint8 u8Per);
+PUBLIC void OSV_vDone(uint16 u16Addr);
+PUBLIC void OSV_vAborted(uint16 u16Addr);
+PUBLIC void OSV_vReset(void);
+PUBLIC void OSV_vPrintStatus(bool bClients);
+
+#endif /* FIRMWARE_OTA_SRV_H_ */
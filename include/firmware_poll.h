@@ -0,0 +1,64 @@
+/*
+ * firmware_poll.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_POLL_H_
+#define FIRMWARE_POLL_H_
+
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define POL_DEF_FLOOR_MS        50      //poll interval right after traffic, ATPF 0
+#define POL_DEF_CEIL_MS         1000    //longest poll interval when idle, ATPC 0
+#define POL_MAX_CEIL_MS         5000    //parent drops frames it holds for 7s
+#define POL_FAST_POLLS          4       //polls at the floor after traffic, then the interval doubles
+#define POL_MORE_DATA_MS        10      //next poll after one which brought data, the parent may hold more
+#define POL_RESP_WINDOW_MS      10000   //a frame later than that after a transmit isn't its response
+#define POL_FIXED_MS            200     //interval of the former fixed poll, for comparison
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint32 u32Polls;
+    uint32 u32DataPolls;      //polls which brought a frame
+    uint32 u32Failed;         //polls refused by the stack or unanswered by the parent
+    uint32 u32WaitSumMs;      //interval before each poll which brought a frame
+    uint32 u32Resps;          //frames received after a transmit of ours
+    uint32 u32RespSumMs;      //time from the transmit to the frame
+    uint32 u32RespMaxMs;
+    uint32 u32StartMs;        //awake time the stats are counted from
+}tsPolStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC uint32 POL_u32Polled(bool bSent);
+PUBLIC void POL_vPollConfirm(uint8 u8Status);
+PUBLIC void POL_vTraffic(bool bRx);
+PUBLIC void POL_vResetStats(void);
+PUBLIC void POL_vPrintStatus(void);
+
+#endif /* FIRMWARE_POLL_H_ */
@@ -0,0 +1,69 @@
+/*
+ * firmware_qos.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_QOS_H_
+#define FIRMWARE_QOS_H_
+
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define QOS_APDUS               16      //instances of apduZCL
+#define QOS_BULK_MAX_APDUS      10      //the rest is reserved for control traffic
+#define QOS_QUEUE_LEN           4       //frames waiting per class
+#define QOS_MAX_FRAME           100     //size of apduZCL
+#define QOS_CTRL_WEIGHT         3       //control frames sent per bulk frame when both wait
+#define QOS_MAX_TRIES           5       //a queued frame is dropped after that
+#define QOS_RETRY_MS            10      //retry when no APDU is free
+#define QOS_INFLIGHT_TIMEOUT_MS 3000    //an APDU without confirm counts as free after that
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef enum
+{
+    E_QOS_CONTROL,            //AT commands, topology, acks, status
+    E_QOS_BULK,               //data frames, reliable stream, OTA
+    E_QOS_CLASSES
+}teQosClass;
+
+typedef struct
+{
+    uint32 u32Frames;         //frames handed to the stack
+    uint32 u32Queued;         //frames that had to wait in the queue
+    uint32 u32Drops;          //queue full or out of tries
+    uint32 u32WaitSumMs;      //queueing latency of the frames sent
+    uint16 u16WaitMaxMs;
+    uint8  u8InFlight;        //APDUs waiting for confirm
+}tsQosStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC teQosClass QOS_eClassify(uint8 *pu8Frame, int len);
+PUBLIC bool QOS_bSend(uint16 u16TxMode, uint16 u16DstAddr, uint8 *pu8Frame, int len);
+PUBLIC void QOS_vTxConfirm(uint8 u8SeqNum);
+PUBLIC void QOS_vGetStats(teQosClass eClass, tsQosStats *psStats);
+
+#endif /* FIRMWARE_QOS_H_ */
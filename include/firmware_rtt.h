@@ -0,0 +1,53 @@
+/*
+ * firmware_rtt.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_RTT_H_
+#define FIRMWARE_RTT_H_
+
+/*
+  Round trip time estimator(RTT) shared by the reliable stream and the
+  pipelined OTA download. Only depends on jendefs.h, so the host
+  benchmarks under tools/ run it too.
+*/
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint32 u32SrttMs;             //smoothed rtt, 0 when there's no sample yet
+    uint32 u32RttVarMs;
+    uint32 u32RtoMs;              //retransmission timeout
+    uint32 u32MinRtoMs;
+    uint32 u32MaxRtoMs;
+}tsRtt;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC void RTT_vInit(tsRtt *psRtt, uint32 u32InitRtoMs, uint32 u32MinRtoMs, uint32 u32MaxRtoMs);
+PUBLIC void RTT_vSample(tsRtt *psRtt, uint32 u32RttMs);
+PUBLIC uint32 RTT_u32Backoff(tsRtt *psRtt, uint8 u8Resends);
+
+#endif /* FIRMWARE_RTT_H_ */
@@ -27,7 +27,38 @@
 
 #include "common.h"
 
+/* [define] */
+#define SLP_MAX_TIMERS          20          //software timers the sleep scheduler knows
+#define SLP_MIN_SLEEP_MS        20          //a timer due sooner than this puts the sleep off
+#define SLP_RESLEEP_MS          200         //awake window before the rest of a cut short period
+
+/* ms of a software timer tick count */
+#define SLP_TICKS_TO_MS(t)      ((uint32)((uint64)(t) * 1000 / APP_TIME_SEC(1)))
+
+/* [type] */
+/* what a running timer does over a sleep */
+typedef enum
+{
+    SLP_TIMER_WAKE = 0,        //wakes the device when it is due
+    SLP_TIMER_DEFER,           //carried over, runs at the first wake after it is due
+    SLP_TIMER_DROP             //stopped, the wake up path re-arms it
+}teSlpTimerKind;
+
+typedef struct
+{
+    uint32 u32Sleeps;          //sleeps entered
+    uint32 u32TimerWakes;      //sleeps cut short for a timer
+    uint32 u32PutOff;          //sleeps not entered, a timer was about due
+    uint32 u32Carried;         //timers restored with their residual time
+}tsSlpStats;
+
 /* [function] */
+PUBLIC void SLP_vInit(void);
+PUBLIC void SLP_vRegister(OS_thSWTimer hTimer, teSlpTimerKind eKind);
+PUBLIC void SLP_vArmed(OS_thSWTimer hTimer, uint32 u32Ticks);
+PUBLIC void SLP_vPrintStatus(void);
+PUBLIC uint32 SLP_u32SleepMs(void);
+PUBLIC uint32 SLP_u32UpTimeMs(void);
 PUBLIC void stopAllSwTimers();
 PUBLIC void Sleep(uint32 ms);             //must not exceed 7000ms, because parent will discard its message after 7s
 PUBLIC void sleep(uint16 s);
@@ -28,6 +28,7 @@
 /****************************************************************************/
 #include <jendefs.h>
 //#include "zps_apl_aib.h"  //cause problem
+#include "firmware_at_api.h"
 
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
@@ -37,4 +38,5 @@
 
 PUBLIC uint32 UDS_u32SpmPullData(void *data, int len);
 PUBLIC void SPM_vInit();
+PUBLIC void SPM_vStreamFrameProc(tsApiSpec *apiSpec, uint16 u16SrcAddr);
 #endif /* FIRMWARE_CORE_SERVER_H_ */
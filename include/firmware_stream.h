@@ -0,0 +1,145 @@
+/*
+ * firmware_stream.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_STREAM_H_
+#define FIRMWARE_STREAM_H_
+
+/*
+  Reliable byte stream for DATA mode(STM).
+  Only depends on jendefs.h, so the same code runs in the host benchmark
+  under tools/.
+*/
+#include <jendefs.h>
+#include "firmware_rtt.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define STM_DATA_LEN          32      //payload of a stream frame, same as API_DATA_LEN
+#define STM_MAX_WINDOW        8       //maximal frames in flight, also the sack bitmap width
+#define STM_MAX_RETRIES       8       //give up and re-sync the stream after that
+#define STM_INIT_RTO_MS       1000
+#define STM_MIN_RTO_MS        100
+#define STM_MAX_RTO_MS        8000
+
+#define STM_FLAG_SYN          0x01    //first frame of a stream, receiver re-syncs to its seq
+#define STM_ID_SHIFT          1       //flags bit 1~7: id of the stream the frame belongs to
+#define STM_ID_MASK           0x7f
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/* stream data frame */
+typedef struct
+{
+    uint8 seq;
+    uint8 flags;
+    uint8 dataLen;
+    uint8 data[STM_DATA_LEN];
+}__attribute__ ((packed)) tsStreamData;
+
+/* stream ack frame */
+typedef struct
+{
+    uint8 ackSeq;     //cumulative ack, the next seq the receiver expects
+    uint8 sack;       //bit i set: ackSeq+1+i has been received
+}__attribute__ ((packed)) tsStreamAck;
+
+typedef enum
+{
+    E_STM_DATA,
+    E_STM_ACK
+}teStmFrameType;
+
+struct _tsStream;
+typedef bool (*STM_tpfSend)(struct _tsStream *psStream, teStmFrameType eType, void *pvFrame, int len);
+typedef void (*STM_tpfDeliver)(struct _tsStream *psStream, uint8 *pu8Data, int len);
+typedef void (*STM_tpfLost)(struct _tsStream *psStream, uint16 u16Bytes);
+
+/* a frame kept by sender until it's acked */
+typedef struct
+{
+    uint8  len;
+    uint8  retries;
+    bool   bSacked;
+    uint32 u32SentMs;
+    uint8  data[STM_DATA_LEN];
+}tsStmTxSlot;
+
+/* a frame received out of order */
+typedef struct
+{
+    bool   bValid;
+    uint8  len;
+    uint8  data[STM_DATA_LEN];
+}tsStmRxSlot;
+
+/* statistics */
+typedef struct
+{
+    uint32 u32TxFrames;
+    uint32 u32Retransmits;
+    uint32 u32RxFrames;
+    uint32 u32RxDuplicates;
+    uint32 u32DeliveredBytes;
+    uint32 u32Resyncs;
+    uint32 u32LostBytes;      //in flight when the sender gave up
+}tsStmStats;
+
+/* one stream end point, both directions */
+typedef struct _tsStream
+{
+    uint8  u8Window;
+    bool   bSyn;                  //first frame of the stream not acked yet
+    /* sender */
+    uint8  u8TxId;                //id of the stream we send, changes when it re-syncs
+    uint8  u8SynSeq;              //seq of the frame carrying STM_FLAG_SYN
+    uint8  u8TxBase;              //oldest unacked seq
+    uint8  u8TxNext;              //next seq to use
+    tsRtt  sRtt;
+    tsStmTxSlot asTx[STM_MAX_WINDOW];
+    /* receiver */
+    bool   bRxSynced;             //a SYN has been received
+    uint8  u8RxId;                //id of the stream we receive
+    uint8  u8RxNext;              //next seq to deliver
+    tsStmRxSlot asRx[STM_MAX_WINDOW];
+
+    STM_tpfSend    pfSend;
+    STM_tpfDeliver pfDeliver;
+    STM_tpfLost    pfLost;
+    tsStmStats     sStats;
+}tsStream;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC void STM_vInit(tsStream *psStream, uint8 u8Window, uint8 u8Id,
+                      STM_tpfSend pfSend, STM_tpfDeliver pfDeliver, STM_tpfLost pfLost);
+PUBLIC bool STM_bTxReady(tsStream *psStream);
+PUBLIC bool STM_bTxIdle(tsStream *psStream);
+PUBLIC bool STM_bSend(tsStream *psStream, uint8 *pu8Data, int len, uint32 u32NowMs);
+PUBLIC void STM_vRxData(tsStream *psStream, tsStreamData *psData);
+PUBLIC void STM_vRxAck(tsStream *psStream, tsStreamAck *psAck, uint32 u32NowMs);
+PUBLIC uint32 STM_u32Poll(tsStream *psStream, uint32 u32NowMs);
+
+#endif /* FIRMWARE_STREAM_H_ */
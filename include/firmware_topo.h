@@ -0,0 +1,65 @@
+/*
+ * firmware_topo.h
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIRMWARE_TOPO_H_
+#define FIRMWARE_TOPO_H_
+
+#include <jendefs.h>
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define TPO_SLOT_MS             20      //one response slot, a unicast over a few hops
+#define TPO_SLOTS_PER_NODE      2       //spare slots keep collisions rare
+#define TPO_MIN_WINDOW_MS       1000
+#define TPO_MAX_WINDOW_MS       10000
+#define TPO_BCAST_ROUNDS        4       //broadcasts while new nodes keep answering
+#define TPO_LISTEN_MARGIN_MS    500     //responses of the last slots are still on the way
+#define TPO_MAX_NODES           160     //nodes the requester remembers
+#define TPO_FOLLOWUP_ROUNDS     2
+#define TPO_FOLLOWUP_GAP_MS     50      //pace of unicast follow-ups
+#define TPO_FOLLOWUP_WAIT_MS    1000    //time for the answers of a follow-up round
+#define TPO_MAX_MISSES          3       //scans without answer before a node is forgotten
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint16 u16Known;          //nodes remembered
+    uint16 u16Heard;          //nodes answered in the last scan
+    uint16 u16Broadcasts;     //broadcast rounds of the last scan
+    uint16 u16FollowUps;      //unicast follow-ups sent in the last scan
+    uint16 u16Duplicates;     //responses dropped in the last scan
+    uint32 u32DurationMs;     //time of the last scan
+}tsTpoStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+PUBLIC bool TPO_bStartScan(void);
+PUBLIC void TPO_vRequest(uint16 u16SrcAddr, uint8 lqi, uint16 u16WindowMs);
+PUBLIC bool TPO_bResponse(uint16 u16ShortAddr);
+PUBLIC void TPO_vGetStats(tsTpoStats *psStats);
+
+#endif /* FIRMWARE_TOPO_H_ */
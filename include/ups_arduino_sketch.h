@@ -29,6 +29,7 @@
 
 PUBLIC void arduino_setup(void); 
 PUBLIC void arduino_loop(void); 
+PUBLIC void arduino_resume(void);
 
 
 #endif
@@ -57,6 +57,12 @@ typedef struct
 /***        Exported Functions                                            ***/
 /****************************************************************************/
 void clientOtaFinishing();
+PUBLIC void clientOtaLoadProgress(void);
+PUBLIC void clientOtaPrepareDownload(void);
+PUBLIC void clientOtaStartDownload();
+PUBLIC void clientOtaRxBlock(uint32 u32BlockIdx, uint16 len, uint8 *pu8Block, uint8 *pu8BlockCrc);
+PUBLIC void clientOtaProgress(uint8 *pu8Per, uint32 *pu32Min);
+PUBLIC void clientOtaMcEnd(uint8 u8Round, bool bLast, uint16 u16WindowMs);
 
 /****************************************************************************/
 /***        External Variables                                            ***/
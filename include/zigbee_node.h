@@ -39,6 +39,12 @@
 
 #define PDM_REC_MAGIC            0x55667788
 #define REC_ID1                  0x1
+#define REC_ID2                  0x2      //OTA client download progress
+
+/* coo is a many-to-one concentrator */
+#define MTO_ROUTE_PERIOD_MS      60000   //period of many-to-one route requests
+#define MTO_ROUTE_MIN_GAP_MS     5000    //earliest re-issue after a topology change
+#define MTO_ROUTE_RADIUS         0       //0: stack default radius
 
 
 /****************************************************************************/
@@ -51,6 +57,7 @@
 
 PUBLIC void node_vInitialise(void);
 PUBLIC void deleteStackPDM();
+PUBLIC void refreshRoute();
 
 /****************************************************************************/
 /***        External Variables                                            ***/
@@ -0,0 +1,223 @@
+/*
+ * firmware_addr_cache.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_addr_cache.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_NAC
+#define TRACE_NAC  FALSE
+#endif
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint64 u64IeeeAddr;
+    uint16 u16NwkAddr;
+}tsNacEntry;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE void NAC_vRemove(uint8 u8Idx);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+/* kept in LRU order, [0] is the most recently used */
+PRIVATE tsNacEntry asNacCache[NAC_CACHE_SIZE];
+PRIVATE uint8 u8NacUsed = 0;
+PRIVATE tsNacStats sNacStats;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: NAC_vUpdate
+ *
+ * DESCRIPTION:
+ * Learn an IEEE->NWK mapping and make it the most recently used one.
+ * A stale entry that holds the same short address is dropped.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u64IeeeAddr  R   IEEE address
+ *             u16NwkAddr   R   short address it owns now
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void NAC_vUpdate(uint64 u64IeeeAddr, uint16 u16NwkAddr)
+{
+    int i;
+
+    /* unknown IEEE address(all 0s or 1s) or a broadcast short address */
+    if (0 == u64IeeeAddr || 0xffffffffffffffffull == u64IeeeAddr || u16NwkAddr >= 0xfff8) return;
+
+    for (i = u8NacUsed - 1; i >= 0; i--)
+    {
+        if (asNacCache[i].u64IeeeAddr == u64IeeeAddr || asNacCache[i].u16NwkAddr == u16NwkAddr)
+        {
+            NAC_vRemove(i);
+        }
+    }
+
+    /* evict the least recently used one when full */
+    if (u8NacUsed == NAC_CACHE_SIZE) u8NacUsed--;
+
+    memmove(&asNacCache[1], &asNacCache[0], u8NacUsed * sizeof(tsNacEntry));
+    asNacCache[0].u64IeeeAddr = u64IeeeAddr;
+    asNacCache[0].u16NwkAddr  = u16NwkAddr;
+    u8NacUsed++;
+}
+
+/****************************************************************************
+ *
+ * NAME: NAC_bLookup
+ *
+ * DESCRIPTION:
+ * Find the short address of an IEEE address, counts hit/miss
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u64IeeeAddr  R   IEEE address
+ *             pu16NwkAddr  W   short address if found
+ *
+ * RETURNS:
+ * TRUE on cache hit
+ *
+ ****************************************************************************/
+PUBLIC bool NAC_bLookup(uint64 u64IeeeAddr, uint16 *pu16NwkAddr)
+{
+    int i;
+    tsNacEntry sEntry;
+
+    for (i = 0; i < u8NacUsed; i++)
+    {
+        if (asNacCache[i].u64IeeeAddr == u64IeeeAddr)
+        {
+            sEntry = asNacCache[i];
+
+            /* move to front */
+            memmove(&asNacCache[1], &asNacCache[0], i * sizeof(tsNacEntry));
+            asNacCache[0] = sEntry;
+
+            *pu16NwkAddr = sEntry.u16NwkAddr;
+            sNacStats.u32Hits++;
+            return TRUE;
+        }
+    }
+    sNacStats.u32Misses++;
+    DBG_vPrintf(TRACE_NAC, "NAC: miss 0x%08x%08x\r\n", (uint32)(u64IeeeAddr >> 32), (uint32)u64IeeeAddr);
+    return FALSE;
+}
+
+/****************************************************************************
+ *
+ * NAME: NAC_vInvalidateIeee
+ *
+ * DESCRIPTION:
+ * Forget the mapping of a device, e.g. it left the network
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u64IeeeAddr  R   IEEE address
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void NAC_vInvalidateIeee(uint64 u64IeeeAddr)
+{
+    int i;
+
+    for (i = u8NacUsed - 1; i >= 0; i--)
+    {
+        if (asNacCache[i].u64IeeeAddr == u64IeeeAddr) NAC_vRemove(i);
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: NAC_vInvalidateNwk
+ *
+ * DESCRIPTION:
+ * Forget the mapping of a short address, e.g. an address conflict is reported
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16NwkAddr   R   short address
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void NAC_vInvalidateNwk(uint16 u16NwkAddr)
+{
+    int i;
+
+    for (i = u8NacUsed - 1; i >= 0; i--)
+    {
+        if (asNacCache[i].u16NwkAddr == u16NwkAddr) NAC_vRemove(i);
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: NAC_vGetStats
+ *
+ * DESCRIPTION:
+ * Copy hit/miss counters
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psStats      W   statistics
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void NAC_vGetStats(tsNacStats *psStats)
+{
+    *psStats = sNacStats;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+PRIVATE void NAC_vRemove(uint8 u8Idx)
+{
+    DBG_vPrintf(TRACE_NAC, "NAC: drop 0x%04x\r\n", asNacCache[u8Idx].u16NwkAddr);
+    memmove(&asNacCache[u8Idx], &asNacCache[u8Idx + 1], (u8NacUsed - u8Idx - 1) * sizeof(tsNacEntry));
+    u8NacUsed--;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
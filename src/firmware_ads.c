@@ -28,14 +28,50 @@
 #include "common.h"
 #include "zps_apl_aib.h"
 #include "firmware_at_api.h"
+#include "firmware_cmi.h"
+#include "firmware_hal.h"
+#include "firmware_addr_cache.h"
+#include "firmware_qos.h"
+#include "firmware_poll.h"
+#include "firmware_energy.h"
 
 #ifndef TRACE_ADS
 #define TRACE_ADS  FALSE
 #endif
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/* A frame in flight whose completion is reported to the host */
+typedef struct
+{
+    bool   bUsed;
+    bool   bIeee;                      //addressed by IEEE address
+    uint8  u8FrameId;                  //host frameId
+    uint8  u8ApsSeq;                   //APS sequence number of the last attempt
+    uint8  u8Retries;
+    uint16 u16TxMode;
+    uint16 u16DstAddr;
+    uint64 u64DstAddr;
+    uint32 u32SentMs;                  //time of the first attempt
+    uint8  u8Len;
+    uint8  au8Frame[sizeof(tsApiSpec)];  //copy kept for retransmission
+}tsTxTrack;
+
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
 PRIVATE void ADS_vHandleDataIndicatorEvent(ZPS_tsAfEvent sStackEvent);
+PRIVATE void ADS_vHandleTxEvent(uint8 u8ApsSeq, uint8 u8Status, bool bAck);
+PRIVATE bool ADS_bTransmit(tsTxTrack *psTrack);
+PRIVATE void ADS_vReportTxStatus(tsTxTrack *psTrack, uint8 u8Status);
+PRIVATE void ADS_vLearnSrcAddr(ZPS_tsAfEvent *psStackEvent);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+PRIVATE tsTxTrack sTxTrack[TX_STATUS_TABLE_SIZE];
 
 /****************************************************************************/
 /***        Tasks                                                          ***/
@@ -69,6 +105,9 @@ OS_TASK(APP_taskMyEndPoint)
             DBG_vPrintf(TRACE_ADS, "[D_IND] from 0x%04x \r\n",
                         sStackEvent.uEvent.sApsDataIndEvent.uSrcAddress.u16Addr);
 
+            ADS_vLearnSrcAddr(&sStackEvent);
+            POL_vTraffic(TRUE);
+
             /* Handle stack event's data from AirPort */
             ADS_vHandleDataIndicatorEvent(sStackEvent);
         }
@@ -79,11 +118,19 @@ OS_TASK(APP_taskMyEndPoint)
                 DBG_vPrintf(TRACE_ADS, "[D_CFM] from 0x%04x \r\n",
                             sStackEvent.uEvent.sApsDataConfirmEvent.uDstAddr.u16Addr);
             }
+            ENG_vTxDone();
+            QOS_vTxConfirm(sStackEvent.uEvent.sApsDataConfirmEvent.u8SequenceNum);
+            ADS_vHandleTxEvent(sStackEvent.uEvent.sApsDataConfirmEvent.u8SequenceNum,
+                               sStackEvent.uEvent.sApsDataConfirmEvent.u8Status,
+                               FALSE);
         }
         else if (ZPS_EVENT_APS_DATA_ACK == sStackEvent.eType)
         {
             DBG_vPrintf(TRACE_ADS, "[D_ACK] from 0x%04x \r\n",
                         sStackEvent.uEvent.sApsDataAckEvent.u16DstAddr);
+            ADS_vHandleTxEvent(sStackEvent.uEvent.sApsDataAckEvent.u8SequenceNum,
+                               sStackEvent.uEvent.sApsDataAckEvent.u8Status,
+                               TRUE);
         }
         else
         {
@@ -125,6 +172,207 @@ PRIVATE void ADS_vHandleDataIndicatorEvent(ZPS_tsAfEvent sStackEvent)
     }
 }
 
+/****************************************************************************
+ *
+ * NAME: ADS_bSendTracked
+ *
+ * DESCRIPTION:
+ * Send a frame and follow it through APS confirm/ack, an API_TX_STATUS frame
+ * carrying u8FrameId is reported to host when the delivery completes.
+ * Unicast completes on APS ack of destination, broadcast on APS confirm.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8FrameId    R   host frameId, must not be 0
+ *             u16TxMode    R   BROADCAST or UNICAST
+ *             u16DstAddr   R   short address, 0xfffe for IEEE address
+ *             u64DstAddr   R   IEEE address
+ *             pu8Buf       R   frame
+ *             len          R   frame length
+ *
+ * RETURNS:
+ * TRUE if the stack accepted the frame
+ *
+ ****************************************************************************/
+PUBLIC bool ADS_bSendTracked(uint8 u8FrameId, uint16 u16TxMode, uint16 u16DstAddr, uint64 u64DstAddr, uint8 *pu8Buf, int len)
+{
+    int i;
+    tsTxTrack *psTrack = NULL;
+
+    if (len > (int)sizeof(sTxTrack[0].au8Frame)) return FALSE;
+
+    /* take a free entry, or reuse the oldest one */
+    for (i = 0; i < TX_STATUS_TABLE_SIZE; i++)
+    {
+        if (!sTxTrack[i].bUsed)
+        {
+            psTrack = &sTxTrack[i];
+            break;
+        }
+        if (NULL == psTrack || (int32)(sTxTrack[i].u32SentMs - psTrack->u32SentMs) < 0)
+            psTrack = &sTxTrack[i];
+    }
+    if (psTrack->bUsed)
+    {
+        ADS_vReportTxStatus(psTrack, TX_STATUS_EXPIRED);
+    }
+
+    psTrack->bIeee = (0xfffe == u16DstAddr);
+    psTrack->u8FrameId = u8FrameId;
+    psTrack->u8Retries = 0;
+    psTrack->u16TxMode = u16TxMode;
+    psTrack->u16DstAddr = u16DstAddr;
+    psTrack->u64DstAddr = u64DstAddr;
+    psTrack->u32SentMs = u32HAL_GetMsTime();
+    psTrack->u8Len = (uint8)len;
+    memcpy(psTrack->au8Frame, pu8Buf, len);
+
+    if (!ADS_bTransmit(psTrack))
+    {
+        ADS_vReportTxStatus(psTrack, TX_STATUS_NOT_SENT);
+        return FALSE;
+    }
+    psTrack->bUsed = TRUE;
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: ADS_bTransmit
+ *
+ * DESCRIPTION:
+ * (Re)send a tracked frame and remember its APS sequence number
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psTrack      RW  tracked frame
+ *
+ * RETURNS:
+ * TRUE if the stack accepted the frame
+ *
+ ****************************************************************************/
+PRIVATE bool ADS_bTransmit(tsTxTrack *psTrack)
+{
+    if (psTrack->bIeee)
+    {
+        return API_bSendToMacDevTracked(psTrack->u64DstAddr, psTrack->au8Frame, psTrack->u8Len, &psTrack->u8ApsSeq);
+    }
+    return API_bSendToAirPortTracked(psTrack->u16TxMode, psTrack->u16DstAddr,
+                                     psTrack->au8Frame, psTrack->u8Len, &psTrack->u8ApsSeq);
+}
+
+/****************************************************************************
+ *
+ * NAME: ADS_vHandleTxEvent
+ *
+ * DESCRIPTION:
+ * Match an APS confirm/ack with a tracked frame.
+ * A failed delivery is retransmitted up to TX_STATUS_MAX_RETRIES times before
+ * it's reported; a successful confirm of an APS-acked unicast only means the
+ * next hop got it, so wait for the ack.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8ApsSeq     R   APS sequence number
+ *             u8Status     R   stack status
+ *             bAck         R   TRUE for APS ack, FALSE for APS confirm
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void ADS_vHandleTxEvent(uint8 u8ApsSeq, uint8 u8Status, bool bAck)
+{
+    int i;
+    tsTxTrack *psTrack = NULL;
+
+    for (i = 0; i < TX_STATUS_TABLE_SIZE; i++)
+    {
+        if (sTxTrack[i].bUsed && sTxTrack[i].u8ApsSeq == u8ApsSeq)
+        {
+            psTrack = &sTxTrack[i];
+            break;
+        }
+    }
+    if (NULL == psTrack) return;
+
+    if (ZPS_E_SUCCESS == u8Status)
+    {
+        if (bAck || BROADCAST == psTrack->u16TxMode)
+        {
+            ADS_vReportTxStatus(psTrack, TX_STATUS_SUCCESS);
+        }
+        return;
+    }
+
+    DBG_vPrintf(TRACE_ADS, "ADS: frame %d failed, status 0x%x, retries %d\r\n",
+                psTrack->u8FrameId, u8Status, psTrack->u8Retries);
+    if (psTrack->u8Retries < TX_STATUS_MAX_RETRIES)
+    {
+        /* the cached short address may be stale, let the stack resolve it */
+        if (psTrack->bIeee) NAC_vInvalidateIeee(psTrack->u64DstAddr);
+        psTrack->u8Retries++;
+        if (ADS_bTransmit(psTrack)) return;
+    }
+    ADS_vReportTxStatus(psTrack, u8Status);
+}
+
+/****************************************************************************
+ *
+ * NAME: ADS_vReportTxStatus
+ *
+ * DESCRIPTION:
+ * Report API_TX_STATUS to host and release the tracking entry
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psTrack      RW  tracked frame
+ *             u8Status     R   delivery status
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void ADS_vReportTxStatus(tsTxTrack *psTrack, uint8 u8Status)
+{
+    tsApiSpec apiSpec;
+    tsTxStatus txStatus;
+    uint32 u32Latency = u32HAL_GetMsTime() - psTrack->u32SentMs;
+
+    txStatus.frameId = psTrack->u8FrameId;
+    txStatus.unicastAddr = psTrack->u16DstAddr;
+    txStatus.retries = psTrack->u8Retries;
+    txStatus.status = u8Status;
+    txStatus.latencyMs = (u32Latency > 0xffff) ? 0xffff : (uint16)u32Latency;
+    psTrack->bUsed = FALSE;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    assembleApiSpec(&apiSpec, API_TX_STATUS, (uint8 *)&txStatus, sizeof(tsTxStatus));
+    CMI_vLocalAckDistributor(&apiSpec);
+}
+
+/****************************************************************************
+ *
+ * NAME: ADS_vLearnSrcAddr
+ *
+ * DESCRIPTION:
+ * Feed the source of a data indication into the IEEE->NWK address cache
+ *
+ * PARAMETERS: Name          RW  Usage
+ *             psStackEvent  R   data indication
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void ADS_vLearnSrcAddr(ZPS_tsAfEvent *psStackEvent)
+{
+    ZPS_tsAfDataIndEvent *psInd = &psStackEvent->uEvent.sApsDataIndEvent;
+
+    if (ZPS_E_ADDR_MODE_SHORT == psInd->u8SrcAddrMode)
+    {
+        /* the stack learned the IEEE address with the route, if at all */
+        uint64 u64IeeeAddr = ZPS_u64AplZdoLookupIeeeAddr(psInd->uSrcAddress.u16Addr);
+        NAC_vUpdate(u64IeeeAddr, psInd->uSrcAddress.u16Addr);
+    }
+}
+
 /****************************************************************************/
 /***        END OF FILE                                                   ***/
 /****************************************************************************/
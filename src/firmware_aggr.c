@@ -0,0 +1,358 @@
+/*
+ * firmware_aggr.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_aggr.h"
+#include "firmware_at_api.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_AGR
+#define TRACE_AGR  FALSE
+#endif
+
+#define AGR_MIN_FRAME_LEN       5       //delimiter, length, identifier, 1 byte payload, checksum
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/* frames collected for one destination */
+typedef struct
+{
+    bool   bUsed;
+    uint16 u16DstAddr;
+    uint8  u8Frames;
+    uint8  u8Len;
+    uint32 u32FirstMs;                  //arrival of the first frame, hold time counts from here
+    uint8  u8Retries;                   //failed sends so far
+    uint32 u32FailMs;                   //last failed send, the retry counts from here
+    uint8  au8Buf[AGR_MAX_LEN];         //AGR_DELIMITER followed by complete API frames
+}tsAgrSlot;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE tsAgrSlot *AGR_psFindSlot(uint16 u16DstAddr);
+PRIVATE tsAgrSlot *AGR_psNewSlot(uint16 u16DstAddr);
+PRIVATE bool AGR_bFlush(tsAgrSlot *psSlot);
+PRIVATE uint32 AGR_u32Left(tsAgrSlot *psSlot, uint32 u32Now);
+PRIVATE void AGR_vArmTimer(void);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+PRIVATE tsAgrSlot asAgrSlot[AGR_MAX_DEST];
+PRIVATE tsAgrStats sAgrStats;
+
+/****************************************************************************/
+/***        Tasks                                                         ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: APP_taskAggr
+ *
+ * DESCRIPTION:
+ * Sends the containers whose hold time, or retry time after a failed
+ * send, is over
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+OS_TASK(APP_taskAggr)
+{
+    int i;
+    uint32 u32Now = u32HAL_GetMsTime();
+
+    for (i = 0; i < AGR_MAX_DEST; i++)
+    {
+        if (asAgrSlot[i].bUsed && 0 == AGR_u32Left(&asAgrSlot[i], u32Now))
+        {
+            AGR_bFlush(&asAgrSlot[i]);
+        }
+    }
+    AGR_vArmTimer();
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: AGR_bEnabled
+ *
+ * DESCRIPTION:
+ * Aggregation is on when a hold time is configured(ATAG)
+ *
+ * RETURNS:
+ * TRUE if enabled
+ *
+ ****************************************************************************/
+PUBLIC bool AGR_bEnabled(void)
+{
+    return (g_sDevice.config.aggrHoldMs > 0);
+}
+
+/****************************************************************************
+ *
+ * NAME: AGR_bSend
+ *
+ * DESCRIPTION:
+ * Collect a unicast API frame into the container of its destination.
+ * The container is sent when the hold time is over or it's full.
+ * Frames too big to share an APDU are sent at once, after what is
+ * collected for the same destination, so the order is kept.
+ * A container the stack refuses is kept and sent again later, while it's
+ * pending a frame that doesn't fit in it is refused.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16DstAddr   R   short address of destination
+ *             pu8Frame     R   complete API frame
+ *             len          R   frame length
+ *
+ * RETURNS:
+ * TRUE if the frame is sent or held to be sent, FALSE if it's dropped
+ *
+ ****************************************************************************/
+PUBLIC bool AGR_bSend(uint16 u16DstAddr, uint8 *pu8Frame, int len)
+{
+    tsAgrSlot *psSlot = AGR_psFindSlot(u16DstAddr);
+
+    /* a big frame goes alone */
+    if (len + 1 + AGR_MIN_FRAME_LEN > AGR_MAX_LEN)
+    {
+        if (NULL != psSlot && !AGR_bFlush(psSlot)) return FALSE;
+        return API_bSendToAirPortNow(UNICAST, u16DstAddr, pu8Frame, len);
+    }
+
+    if (NULL != psSlot && psSlot->u8Len + len > AGR_MAX_LEN)
+    {
+        if (!AGR_bFlush(psSlot)) return FALSE;
+        psSlot = NULL;
+    }
+    if (NULL == psSlot)
+    {
+        psSlot = AGR_psNewSlot(u16DstAddr);
+    }
+
+    memcpy(&psSlot->au8Buf[psSlot->u8Len], pu8Frame, len);
+    psSlot->u8Len += len;
+    psSlot->u8Frames++;
+    sAgrStats.u32FramesIn++;
+
+    /* no room for another frame */
+    if (psSlot->u8Len + AGR_MIN_FRAME_LEN > AGR_MAX_LEN)
+    {
+        AGR_bFlush(psSlot);
+    }
+    AGR_vArmTimer();
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: AGR_vFlushAll
+ *
+ * DESCRIPTION:
+ * Send everything collected, e.g. before sleeping
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void AGR_vFlushAll(void)
+{
+    int i;
+
+    for (i = 0; i < AGR_MAX_DEST; i++)
+    {
+        if (asAgrSlot[i].bUsed) AGR_bFlush(&asAgrSlot[i]);
+    }
+    /* what the stack refused is tried again later */
+    AGR_vArmTimer();
+}
+
+/****************************************************************************
+ *
+ * NAME: AGR_vGetStats
+ *
+ * DESCRIPTION:
+ * Copy aggregation counters
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psStats      W   statistics
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void AGR_vGetStats(tsAgrStats *psStats)
+{
+    *psStats = sAgrStats;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+PRIVATE tsAgrSlot *AGR_psFindSlot(uint16 u16DstAddr)
+{
+    int i;
+
+    for (i = 0; i < AGR_MAX_DEST; i++)
+    {
+        if (asAgrSlot[i].bUsed && asAgrSlot[i].u16DstAddr == u16DstAddr) return &asAgrSlot[i];
+    }
+    return NULL;
+}
+
+/* take a free slot, the oldest one is sent, or dropped if it can't be, to make room */
+PRIVATE tsAgrSlot *AGR_psNewSlot(uint16 u16DstAddr)
+{
+    int i;
+    tsAgrSlot *psSlot = NULL;
+
+    for (i = 0; i < AGR_MAX_DEST; i++)
+    {
+        if (!asAgrSlot[i].bUsed)
+        {
+            psSlot = &asAgrSlot[i];
+            break;
+        }
+        if (NULL == psSlot || (int32)(asAgrSlot[i].u32FirstMs - psSlot->u32FirstMs) < 0)
+        {
+            psSlot = &asAgrSlot[i];
+        }
+    }
+    if (psSlot->bUsed && !AGR_bFlush(psSlot) && psSlot->bUsed)
+    {
+        sAgrStats.u32Dropped += psSlot->u8Frames;
+    }
+
+    psSlot->bUsed      = TRUE;
+    psSlot->u16DstAddr = u16DstAddr;
+    psSlot->u8Frames   = 0;
+    psSlot->u8Retries  = 0;
+    psSlot->au8Buf[0]  = AGR_DELIMITER;
+    psSlot->u8Len      = 1;
+    psSlot->u32FirstMs = u32HAL_GetMsTime();
+    return psSlot;
+}
+
+/*
+  A single frame is sent as it is, without the container. If the stack
+  refuses it the slot is kept for a retry, after AGR_MAX_RETRIES it's freed.
+*/
+PRIVATE bool AGR_bFlush(tsAgrSlot *psSlot)
+{
+    bool bRet;
+
+    if (psSlot->u8Frames <= 1)
+    {
+        bRet = API_bSendToAirPortNow(UNICAST, psSlot->u16DstAddr, &psSlot->au8Buf[1], psSlot->u8Len - 1);
+    }
+    else
+    {
+        DBG_vPrintf(TRACE_AGR, "AGR: %d frames, %d bytes to 0x%04x\r\n", psSlot->u8Frames, psSlot->u8Len, psSlot->u16DstAddr);
+        bRet = API_bSendToAirPortNow(UNICAST, psSlot->u16DstAddr, psSlot->au8Buf, psSlot->u8Len);
+        if (bRet)
+        {
+            sAgrStats.u32Containers++;
+            sAgrStats.u32SavedBytes += (psSlot->u8Frames - 1) * AGR_FRAME_OVERHEAD - 1;
+        }
+    }
+
+    if (bRet)
+    {
+        psSlot->bUsed = FALSE;
+    }
+    else if (++psSlot->u8Retries > AGR_MAX_RETRIES)
+    {
+        DBG_vPrintf(TRACE_AGR, "AGR: %d frames to 0x%04x dropped\r\n", psSlot->u8Frames, psSlot->u16DstAddr);
+        sAgrStats.u32Dropped += psSlot->u8Frames;
+        psSlot->bUsed = FALSE;
+    }
+    else
+    {
+        sAgrStats.u32Retries++;
+        psSlot->u32FailMs = u32HAL_GetMsTime();
+    }
+    return bRet;
+}
+
+/* ms until a container is due, 0: now */
+PRIVATE uint32 AGR_u32Left(tsAgrSlot *psSlot, uint32 u32Now)
+{
+    uint32 u32Age, u32Wait;
+
+    if (psSlot->u8Retries > 0)
+    {
+        u32Age = u32Now - psSlot->u32FailMs;
+        u32Wait = AGR_RETRY_MS;
+    }
+    else
+    {
+        u32Age = u32Now - psSlot->u32FirstMs;
+        u32Wait = g_sDevice.config.aggrHoldMs;
+    }
+    return (u32Age >= u32Wait) ? 0 : u32Wait - u32Age;
+}
+
+/* wake up at the earliest hold deadline */
+PRIVATE void AGR_vArmTimer(void)
+{
+    int i;
+    bool bPending = FALSE;
+    uint32 u32Now = u32HAL_GetMsTime();
+    uint32 u32Wait = AGR_MAX_HOLD_MS;
+
+    for (i = 0; i < AGR_MAX_DEST; i++)
+    {
+        if (asAgrSlot[i].bUsed)
+        {
+            uint32 u32Left = AGR_u32Left(&asAgrSlot[i], u32Now);
+            if (0 == u32Left) u32Left = 1;
+            if (u32Left < u32Wait) u32Wait = u32Left;
+            bPending = TRUE;
+        }
+    }
+
+    if (bPending)
+    {
+        vResetATimer(APP_tmrAggr, APP_TIME_MS(u32Wait));
+    } else if (OS_eGetSWTimerStatus(APP_tmrAggr) != OS_E_SWTIMER_STOPPED)
+    {
+        OS_eStopSWTimer(APP_tmrAggr);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
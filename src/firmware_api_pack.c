@@ -25,6 +25,7 @@
 /****************************************************************************/
 #include "firmware_api_pack.h"
 #include "firmware_at_api.h"
+#include "firmware_lzss.h"
 
 /****************************************************************************/
 /***        External Functions                                            ***/
@@ -145,6 +146,67 @@ PUBLIC void PCK_vApiSpecDataFrame(tsApiSpec *apiSpec, uint8 frameId, uint8 optio
     apiSpec->checkSum = calCheckSum((uint8*)&txDataPacket, apiSpec->length);
 }
 
+/****************************************************************************
+ *
+ * NAME: PCK_i32ApiSpecZipDataFrame
+ *
+ * DESCRIPTION:
+ * Pack data frame, LZSS compressed when that saves space.
+ * Up to LZS_MAX_RAW raw bytes are squeezed into API_DATA_LEN; when the
+ * data doesn't compress a plain frame of API_DATA_LEN bytes is packed.
+ *
+ * RETURNS:
+ * int, raw bytes carried by the frame
+ *
+ ****************************************************************************/
+PUBLIC int PCK_i32ApiSpecZipDataFrame(tsApiSpec *apiSpec, uint8 frameId, uint8 option, uint8 *data, int len)
+{
+    uint8 zip[API_DATA_LEN];
+    int consumed = 0;
+    int zipLen = LZS_i32Compress(data, MIN(len, LZS_MAX_RAW), zip, API_DATA_LEN, &consumed);
+
+    /* must beat a plain frame, both in bytes carried and bytes sent */
+    if (consumed >= MIN(len, API_DATA_LEN) && zipLen < consumed)
+    {
+        PCK_vApiSpecDataFrame(apiSpec, frameId, option | OPTION_ZIP_MASK, zip, zipLen);
+        return consumed;
+    }
+
+    PCK_vApiSpecDataFrame(apiSpec, frameId, option & ~OPTION_ZIP_MASK, data, len);
+    return MIN(len, API_DATA_LEN);
+}
+
+/****************************************************************************
+ *
+ * NAME: PCK_vZipDataFrame
+ *
+ * DESCRIPTION:
+ * Compress a packed data frame in place, left as it is when that
+ * doesn't save anything or the host compressed it already.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void PCK_vZipDataFrame(tsApiSpec *apiSpec)
+{
+    tsTxDataPacket *pkt = &apiSpec->payload.txDataPacket;
+    uint8 zip[API_DATA_LEN];
+    int consumed = 0;
+    int zipLen;
+
+    if ((pkt->option & OPTION_ZIP_MASK) || pkt->dataLen > API_DATA_LEN) return;
+
+    zipLen = LZS_i32Compress(pkt->data, pkt->dataLen, zip, API_DATA_LEN, &consumed);
+    if (consumed < pkt->dataLen || zipLen >= pkt->dataLen) return;
+
+    memcpy(pkt->data, zip, zipLen);
+    apiSpec->length -= pkt->dataLen - zipLen;
+    pkt->dataLen = zipLen;
+    pkt->option |= OPTION_ZIP_MASK;
+    apiSpec->checkSum = calCheckSum((uint8*)pkt, apiSpec->length);
+}
+
 /****************************************************************************
  *
  * NAME: PCK_u8ApiSpecLocalAtIo
@@ -31,11 +31,25 @@
 #include "zigbee_join.h"
 #include "firmware_at_api.h"
 #include "firmware_ota.h"
+#include "firmware_ota_dl.h"
+#include "firmware_ota_mc.h"
+#include "firmware_ota_srv.h"
+#include "firmware_ota_peer.h"
+#include "firmware_ota_host.h"
+#include "firmware_poll.h"
+#include "firmware_energy.h"
+#include "firmware_aups.h"
 #include "zigbee_endpoint.h"
 #include "firmware_hal.h"
 #include "firmware_api_pack.h"
 #include "firmware_cmi.h"
 #include "firmware_sleep.h"
+#include "firmware_ads.h"
+#include "firmware_spm.h"
+#include "firmware_addr_cache.h"
+#include "firmware_aggr.h"
+#include "firmware_topo.h"
+#include "firmware_qos.h"
 #include "suli.h"
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
@@ -51,6 +65,7 @@
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
+int API_i32AirFrameProc(tsApiSpec *apiSpec, uint16 u16SrcAddr, uint8 lqi);
 int API_Reboot_CallBack(tsApiSpec *inputApiSpec, tsApiSpec *retApiSpec, uint16 *regAddr);
 int API_RegisterSetResp_CallBack(tsApiSpec *inputApiSpec, tsApiSpec *retApiSpec, uint16 *regAddr);
 int API_QueryOnChipTemper_CallBack(tsApiSpec *inputApiSpec, tsApiSpec *retApiSpec, uint16 *regAddr);
@@ -71,6 +86,18 @@ int AT_showInfo(uint16 *regAddr);
 int AT_triggerOTAUpgrade(uint16 *regAddr);
 int AT_abortOTAUpgrade(uint16 *regAddr);
 int AT_OTAStatusPoll(uint16 *regAddr);
+int AT_triggerOTAMulticast(uint16 *regAddr);
+int AT_OTAMulticastStatus(uint16 *regAddr);
+int AT_triggerOTAFleet(uint16 *regAddr);
+int AT_OTASessionStatus(uint16 *regAddr);
+int AT_setPollBounds(uint16 *regAddr);
+int AT_pollStatus(uint16 *regAddr);
+int AT_energyStatus(uint16 *regAddr);
+int AT_energyReset(uint16 *regAddr);
+int AT_mcuWakeStatus(uint16 *regAddr);
+int AT_batchStatus(uint16 *regAddr);
+PRIVATE uint32 AT_u32CheckOTAImage(void);
+PRIVATE bool AT_bSendOTANotice(uint32 u32TotalImage, uint16 txMode, uint16 u16DstAddr, uint8 u8Target);
 int AT_TestTest(uint16 *regAddr);
 int AT_i32QueryOnChipTemper(uint16 *regAddr);
 int AT_SleepTest(uint16 *regAddr);
@@ -79,7 +106,8 @@ int AT_RPC(uint16 *regAddr);
 /***        Local Variables                                               ***/
 /****************************************************************************/
 static uint16 attt_dummy_reg = 0;
-static uint8  dummy_value = 0;
+static uint16 atom_dummy_reg = 0;
+static uint16 atof_dummy_reg = 0;
 /*
   Instruction set of AT mode
   [cmd_name, reg_addr, isHex, digits, max, printFunc, callback_func]
@@ -134,7 +162,29 @@ static AT_Command_t atCommands[] =
     { "ST", &g_sDevice.config.sleepWaitingTime, DEC, 4, 9999, NULL, NULL },
 
     { "SL", NULL, DEC, 0, 0, NULL, AT_SleepTest },  //for inner test
+
+    /* poll interval(ms) after traffic and when idle, 0: default */
+    { "PF", &g_sDevice.config.pollFloorMs, DEC, 4, POL_MAX_CEIL_MS, NULL, AT_setPollBounds },
+
+    { "PC", &g_sDevice.config.pollCeilMs, DEC, 4, POL_MAX_CEIL_MS, NULL, AT_setPollBounds },
+
+    /* polls per hour and downlink latency */
+    { "PS", NULL, DEC, 0, 0, NULL, AT_pollStatus },
 #endif
+    /* energy accounting current table, asleep(nA), awake/receiving/sending(uA), 0: default */
+    { "ES", &g_sDevice.config.engSleepNa, DEC, 5, 60000, NULL, NULL },
+
+    { "EA", &g_sDevice.config.engAwakeUa, DEC, 5, 60000, NULL, NULL },
+
+    { "ER", &g_sDevice.config.engRxUa, DEC, 5, 60000, NULL, NULL },
+
+    { "ET", &g_sDevice.config.engTxUa, DEC, 5, 60000, NULL, NULL },
+
+    /* time in each state and the charge it took, ATEZ counts from zero */
+    { "EN", NULL, DEC, 0, 0, NULL, AT_energyStatus },
+
+    { "EZ", NULL, DEC, 0, 0, NULL, AT_energyReset },
+
     //show the information of node
     { "IF", NULL, DEC, 0, 0, NULL, AT_showInfo },
 
@@ -150,6 +200,33 @@ static AT_Command_t atCommands[] =
     /* XTAL frequency of Arduino-ful MCU, rang from 10ms~3000ms */
     { "MF", &g_sDevice.config.upsXtalPeriod, DEC, 4, 3000, NULL, NULL },
 
+    /* most samples per batch frame of aupsBatchAdd() and the most its oldest waits(s), 0: default */
+    { "BN", &g_sDevice.config.upsBatchSize, DEC, 2, AUPS_BATCH_MAX_SIZE, NULL, NULL },
+
+    { "BA", &g_sDevice.config.upsBatchAgeS, DEC, 4, AUPS_BATCH_MAX_AGE_S, NULL, NULL },
+
+    { "BS", NULL, DEC, 0, 0, NULL, AT_batchStatus },
+
+#ifdef TARGET_END
+    /* Arduino-ful MCU after a sleep, 0: warm resume, 1: full init */
+    { "MW", &g_sDevice.config.upsWakeCold, DEC, 1, 1, NULL, NULL },
+
+    /* wake up to first loop latency */
+    { "ML", NULL, DEC, 0, 0, NULL, AT_mcuWakeStatus },
+#endif
+
+    /* reliable stream window of DATA mode(unicast only), 0: off */
+    { "RW", &g_sDevice.config.streamWindow, DEC, 1, STM_MAX_WINDOW, NULL, NULL },
+
+    /* hold time(ms) of unicast frame aggregation, 0: off */
+    { "AG", &g_sDevice.config.aggrHoldMs, DEC, 4, AGR_MAX_HOLD_MS, NULL, NULL },
+
+    /* LZSS compression of data frames, 0: off */
+    { "CP", &g_sDevice.config.dataCompress, DEC, 1, 1, NULL, NULL },
+
+    /* OTA block requests in flight of the client */
+    { "OW", &g_sDevice.config.otaWindow, DEC, 1, ODL_MAX_WINDOW, NULL, NULL },
+
 #ifdef OTA_SERVER
     //ota trigger, trigger upgrade for unicastDstAddr
     { "OT", NULL, DEC, 0, 0, NULL, AT_triggerOTAUpgrade },
@@ -162,6 +239,18 @@ static AT_Command_t atCommands[] =
 
     //ota status poll
     { "OS", NULL, DEC, 0, 0, NULL, AT_OTAStatusPoll },
+
+    //multicast ota trigger, 1: routers 2: end devices
+    { "OM", &atom_dummy_reg, DEC, 1, 2, NULL, AT_triggerOTAMulticast },
+
+    //multicast ota status of every client
+    { "OQ", NULL, DEC, 0, 0, NULL, AT_OTAMulticastStatus },
+
+    //unicast ota trigger of every router(1) or end device(2)
+    { "OF", &atof_dummy_reg, DEC, 1, 2, NULL, AT_triggerOTAFleet },
+
+    //unicast ota progress of every client
+    { "OP", NULL, DEC, 0, 0, NULL, AT_OTASessionStatus },
 #endif
     { "TT", &attt_dummy_reg, DEC, 1, 5, AT_printTT, AT_TestTest },
 
@@ -212,6 +301,27 @@ static AT_Command_ApiMode_t atCommandsApiMode[] =
     /* Set digital output */
     { "ATIO", ATIO, NULL, API_i32Gpio_CallBack },
 
+    /* reliable stream window of DATA mode */
+    { "ATRW", ATRW, &g_sDevice.config.streamWindow, API_RegisterSetResp_CallBack },
+
+    /* hold time of unicast frame aggregation */
+    { "ATAG", ATAG, &g_sDevice.config.aggrHoldMs, API_RegisterSetResp_CallBack },
+    { "ATCP", ATCP, &g_sDevice.config.dataCompress, API_RegisterSetResp_CallBack },
+
+    /* OTA block requests in flight */
+    { "ATOW", ATOW, &g_sDevice.config.otaWindow, API_RegisterSetResp_CallBack },
+
+#ifdef TARGET_END
+    /* poll interval after traffic and when idle */
+    { "ATPF", ATPF, &g_sDevice.config.pollFloorMs, API_RegisterSetResp_CallBack },
+    { "ATPC", ATPC, &g_sDevice.config.pollCeilMs, API_RegisterSetResp_CallBack },
+#endif
+    /* energy accounting current table */
+    { "ATES", ATES, &g_sDevice.config.engSleepNa, API_RegisterSetResp_CallBack },
+    { "ATEA", ATEA, &g_sDevice.config.engAwakeUa, API_RegisterSetResp_CallBack },
+    { "ATER", ATER, &g_sDevice.config.engRxUa, API_RegisterSetResp_CallBack },
+    { "ATET", ATET, &g_sDevice.config.engTxUa, API_RegisterSetResp_CallBack },
+
 #ifndef TARGET_COO
     { "LN", ATLN, NULL, API_listNetworkScaned_CallBack },
 #endif
@@ -229,6 +339,43 @@ int AT_SleepTest(uint16 *regAddr)
     return OK;
 }
 
+/* new poll bounds, the stats start over to compare them */
+int AT_setPollBounds(uint16 *regAddr)
+{
+    POL_vResetStats();
+    return OK;
+}
+
+int AT_pollStatus(uint16 *regAddr)
+{
+    POL_vPrintStatus();
+    return OK;
+}
+
+int AT_energyStatus(uint16 *regAddr)
+{
+    ENG_vPrintStatus();
+    return OK;
+}
+
+int AT_energyReset(uint16 *regAddr)
+{
+    ENG_vReset();
+    return OK;
+}
+
+int AT_mcuWakeStatus(uint16 *regAddr)
+{
+    ups_printWakeStatus();
+    return OK;
+}
+
+int AT_batchStatus(uint16 *regAddr)
+{
+    UPS_vPrintBatchStatus();
+    return OK;
+}
+
 int AT_RPC(uint16 *regAddr)
 {
     uart_printf("send RPC req to %04x\r\n", g_sDevice.config.unicastDstAddr);
@@ -716,6 +863,43 @@ int AT_showInfo(uint16 *regAddr)
 
     uart_printf("Unicast Dest Addr: 0x%04x \r\n", g_sDevice.config.unicastDstAddr);
 
+    tsNacStats sNacStats;
+    NAC_vGetStats(&sNacStats);
+    uart_printf("Addr Cache       : %d hits, %d misses \r\n", sNacStats.u32Hits, sNacStats.u32Misses);
+
+    tsAgrStats sAgrStats;
+    AGR_vGetStats(&sAgrStats);
+    uart_printf("Aggregation      : %d frames, %d APDUs, %d ms airtime saved per hop, %d retries, %d dropped \r\n",
+                sAgrStats.u32FramesIn, sAgrStats.u32Containers,
+                sAgrStats.u32SavedBytes * AGR_US_PER_BYTE / 1000,
+                sAgrStats.u32Retries, sAgrStats.u32Dropped);
+
+    tsTpoStats sTpoStats;
+    TPO_vGetStats(&sTpoStats);
+    uart_printf("Last ATLA Scan   : %d known, %d heard, %d broadcasts, %d follow-ups, %d dup, %d ms \r\n",
+                sTpoStats.u16Known, sTpoStats.u16Heard, sTpoStats.u16Broadcasts,
+                sTpoStats.u16FollowUps, sTpoStats.u16Duplicates, sTpoStats.u32DurationMs);
+
+    tsQosStats sQosStats;
+    uint8 u8Class;
+    for (u8Class = 0; u8Class < E_QOS_CLASSES; u8Class++)
+    {
+        QOS_vGetStats((teQosClass)u8Class, &sQosStats);
+        uart_printf("%s: %d frames, %d queued, %d dropped, wait avg %d max %d ms \r\n",
+                    (E_QOS_CONTROL == u8Class) ? "Control Class    " : "Bulk Class       ",
+                    sQosStats.u32Frames, sQosStats.u32Queued, sQosStats.u32Drops,
+                    sQosStats.u32Frames ? sQosStats.u32WaitSumMs / sQosStats.u32Frames : 0,
+                    sQosStats.u16WaitMaxMs);
+    }
+
+    uart_printf("OTA Peer         : %d blocks served, %d offers, %d blocks pulled, %d fallbacks \r\n",
+                g_sOprStats.u32ServedBlocks, g_sOprStats.u32Offers,
+                g_sOprStats.u32PeerBlocks, g_sOprStats.u32Fallbacks);
+#ifdef TARGET_END
+    POL_vPrintStatus();
+    SLP_vPrintStatus();
+#endif
+
     txt = "\r\n\r\n3.Belonging to:\r\n";
     uart_printf(txt);
 
@@ -742,16 +926,235 @@ int AT_showInfo(uint16 *regAddr)
  *
  ****************************************************************************/
 int AT_triggerOTAUpgrade(uint16 *regAddr)
+{
+    uint32 u32TotalImage = AT_u32CheckOTAImage();
+    if (0 == u32TotalImage) return ERR;
+
+    if (AT_bSendOTANotice(u32TotalImage, UNICAST, g_sDevice.config.unicastDstAddr, 0))
+    {
+#ifdef OTA_SERVER
+        OSV_vNotified(g_sDevice.config.unicastDstAddr);
+#endif
+        PDM_vSaveRecord(&g_sDevicePDDesc);
+        return OK;
+    }
+    return ERR;
+}
+
+/****************************************************************************
+ *
+ * NAME: AT_triggerOTAFleet
+ *
+ * DESCRIPTION:
+ * Notify every router(1) or end device(2) at once, they all pull the image
+ * by unicast and the server keeps a session per client. Progress goes to
+ * host every OSV_REPORT_MS, ATOP lists the clients.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             regAddr      R   node type of the image
+ *
+ * RETURNS:
+ * OK / ERR
+ *
+ ****************************************************************************/
+int AT_triggerOTAFleet(uint16 *regAddr)
+{
+#ifdef OTA_SERVER
+    uint8 u8Target = (uint8)*regAddr;
+    if (OTA_MC_TARGET_ROU != u8Target && OTA_MC_TARGET_END != u8Target)
+    {
+        uart_printf("1: routers, 2: end devices.\r\n");
+        return ERR;
+    }
+
+    uint32 u32TotalImage = AT_u32CheckOTAImage();
+    if (0 == u32TotalImage) return ERR;
+
+    /* sessions of the last rollout are forgotten */
+    OSV_vReset();
+    if (AT_bSendOTANotice(u32TotalImage, BROADCAST, 0, u8Target))
+    {
+        PDM_vSaveRecord(&g_sDevicePDDesc);
+        return OK;
+    }
+#endif
+    return ERR;
+}
+
+/****************************************************************************
+ *
+ * NAME: AT_OTASessionStatus
+ *
+ * DESCRIPTION:
+ * Print the progress of every client downloading by unicast
+ *
+ * RETURNS:
+ * OK
+ *
+ ****************************************************************************/
+int AT_OTASessionStatus(uint16 *regAddr)
+{
+#ifdef OTA_SERVER
+    OSV_vPrintStatus(TRUE);
+    OHS_vPrintStatus();
+#endif
+    return OK;
+}
+
+/****************************************************************************
+ *
+ * NAME: AT_bSendOTANotice
+ *
+ * DESCRIPTION:
+ * Notify a client, or every client of a node type, of the image in
+ * external flash. Clients pull the blocks by unicast.
+ *
+ * PARAMETERS: Name           RW  Usage
+ *             u32TotalImage  R   image length
+ *             txMode         R   UNICAST / BROADCAST
+ *             u16DstAddr     R   client of a unicast notice
+ *             u8Target       R   OTA_MC_TARGET_xxx of a broadcast notice, 0: any
+ *
+ * RETURNS:
+ * TRUE if sent
+ *
+ ****************************************************************************/
+PRIVATE bool AT_bSendOTANotice(uint32 u32TotalImage, uint16 txMode, uint16 u16DstAddr, uint8 u8Target)
+{
+    /* server notify client,here comes an OTA upgrade event */
+    tsOtaNotice otaNotice;
+    memset(&otaNotice, 0, sizeof(tsOtaNotice));
+
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+
+    /* package OtaNotice */
+    otaNotice.reqPeriodMs = g_sDevice.config.reqPeriodMs;
+    otaNotice.totalBytes = u32TotalImage;
+    otaNotice.maxBlockSize = OTA_MAX_BLOCK_SIZE;
+    otaNotice.crc = g_sDevice.otaCrc;
+    otaNotice.target = u8Target;
+
+    /* nodes running the base image of the patch download the patch only */
+    if (g_sDevice.otaPatchBytes > 0)
+    {
+        uint16 u16BaseVersion = 0;
+        uint32 u32BaseCrc = 0;
+        otaNotice.patchBytes = APP_u32OtaPatchBytes(g_sDevice.otaTotalBytes, g_sDevice.otaCrc,
+                                                     &u16BaseVersion, &u32BaseCrc);
+        otaNotice.baseVersion = u16BaseVersion;
+        otaNotice.baseCrc = u32BaseCrc;
+    }
+    otaNotice.packedBytes = g_sDevice.otaPackedBytes;
+
+    /* package ApiSpec */
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaNotice);
+    apiSpec.teApiIdentifier = API_OTA_NTC;
+    apiSpec.payload.otaNotice = otaNotice;
+    apiSpec.checkSum = calCheckSum((uint8 *)&otaNotice, apiSpec.length);
+
+    uart_printf("Total bytes: %d, client req period: %dms \r\n", otaNotice.totalBytes, otaNotice.reqPeriodMs);
+    if (otaNotice.patchBytes > 0)
+    {
+        uart_printf("Delta bytes: %d, from version 0x%04x \r\n", otaNotice.patchBytes, otaNotice.baseVersion);
+    }
+    if (otaNotice.packedBytes > 0)
+    {
+        uart_printf("Compressed bytes: %d \r\n", otaNotice.packedBytes);
+    }
+
+    /* send through AirPort */
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    return API_bSendToAirPort(txMode, u16DstAddr, tmp, size);
+}
+
+/****************************************************************************
+ *
+ * NAME: AT_triggerOTAMulticast
+ *
+ * DESCRIPTION:
+ * Send the image in external flash to every router(1) or end device(2)
+ * at once, blocks are broadcast and clients NACK what they miss
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             regAddr      R   node type of the image
+ *
+ * RETURNS:
+ * OK / ERR
+ *
+ ****************************************************************************/
+int AT_triggerOTAMulticast(uint16 *regAddr)
+{
+#ifdef OTA_SERVER
+    if (0 == AT_u32CheckOTAImage()) return ERR;
+    if (!OMC_bStart((uint8)*regAddr))
+    {
+        uart_printf("1: routers, 2: end devices.\r\n");
+        return ERR;
+    }
+    PDM_vSaveRecord(&g_sDevicePDDesc);
+    return OK;
+#else
+    return ERR;
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: AT_OTAMulticastStatus
+ *
+ * DESCRIPTION:
+ * Report the status of every client of the multicast session
+ *
+ * RETURNS:
+ * OK
+ *
+ ****************************************************************************/
+int AT_OTAMulticastStatus(uint16 *regAddr)
+{
+#ifdef OTA_SERVER
+    OMC_vReportStatus();
+#endif
+    return OK;
+}
+
+/****************************************************************************
+ *
+ * NAME: AT_u32CheckOTAImage
+ *
+ * DESCRIPTION:
+ * Check the image in external flash and calculate its crc, the length
+ * and crc are kept in g_sDevice
+ *
+ * RETURNS:
+ * image length, 0 if there's no valid image
+ *
+ ****************************************************************************/
+PRIVATE uint32 AT_u32CheckOTAImage(void)
 {
     if (!g_sDevice.supportOTA)
     {
         uart_printf("Node does not support OTA.\r\n");
-        return ERR;
+        return 0;
     }
 
     uint8 au8Values[OTA_MAGIC_NUM_LEN];
     uint32 u32TotalImage = 0;
 
+#ifdef OTA_SERVER
+    /* host streams the image while clients download it */
+    if (OHS_bActive())
+    {
+        uart_printf("Image streamed by host, CRC: 0x%08x.\r\n", g_sDevice.otaCrc);
+        return g_sDevice.otaTotalBytes;
+    }
+#endif
+
+    /* a new image may have been loaded */
+    APP_vOtaFlashCacheFlush();
+
     /* check external flash to detect image header at first */
     APP_vOtaFlashLockRead(OTA_MAGIC_OFFSET, OTA_MAGIC_NUM_LEN, au8Values);
 
@@ -765,53 +1168,111 @@ int AT_triggerOTAUpgrade(uint16 *regAddr)
         if (u32TotalImage > 256 * 1024)
         {
             uart_printf("invalid image length.\r\n");
-            return ERR;
+            return 0;
         }
     } else
     {
         uart_printf("invalid image file.\r\n");
-        return ERR;
+        return 0;
     }
 
     /* calculate crc */
     g_sDevice.otaCrc = imageCrc(u32TotalImage);
     uart_printf("Image CRC: 0x%08x.\r\n", g_sDevice.otaCrc);
 
-    /* server notify client,here comes an OTA upgrade event */
-    tsOtaNotice otaNotice;
-    memset(&otaNotice, 0, sizeof(tsOtaNotice));
+    /* calculate how many blocks of this OTA image */
+    g_sDevice.otaTotalBytes = u32TotalImage;
+    g_sDevice.otaTotalBlocks = APP_u32OtaBlocks(g_sDevice.otaTotalBytes, OTA_BLOCK_SIZE);
 
-    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
-    tsApiSpec apiSpec;
-    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    /* a patch of this image is loaded behind it */
+    g_sDevice.otaPatchBytes = APP_u32OtaPatchBytes(g_sDevice.otaTotalBytes, g_sDevice.otaCrc, NULL, NULL);
+    if (g_sDevice.otaPatchBytes > 0)
+    {
+        uart_printf("Found delta image, %d bytes.\r\n", g_sDevice.otaPatchBytes);
+    }
+    g_sDevice.otaPackedBytes = APP_u32OtaPackedBytes(g_sDevice.otaTotalBytes, g_sDevice.otaCrc);
+    if (g_sDevice.otaPackedBytes > 0)
+    {
+        uart_printf("Found compressed image, %d bytes.\r\n", g_sDevice.otaPackedBytes);
+    }
+    return u32TotalImage;
+}
 
-    /* package OtaNotice */
-    otaNotice.reqPeriodMs = g_sDevice.config.reqPeriodMs;
-    otaNotice.totalBytes = u32TotalImage;
+/****************************************************************************
+ *
+ * NAME: API_i32OtaServeBlock
+ *
+ * DESCRIPTION:
+ * Answer a block request of a client. A block host hasn't streamed yet is
+ * answered when it comes in.
+ *
+ * PARAMETERS: Name          RW  Usage
+ *             u16Dst        R   client
+ *             u8Image       R   OTA_IMAGE_xxx asked for
+ *             u32BlockIdx   R   block
+ *             u16BlockSize  R   block size of the client
+ *
+ * RETURNS:
+ * OK / ERR
+ *
+ ****************************************************************************/
+int API_i32OtaServeBlock(uint16 u16Dst, uint8 u8Image, uint32 u32BlockIdx, uint16 u16BlockSize)
+{
+#if defined(OTA_SERVER) || defined(OTA_PEER)
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec respApiSpec;
+    uint32 u32Base, u32Bytes, u32Crc;
 
-    /* package ApiSpec */
-    apiSpec.startDelimiter = API_START_DELIMITER;
-    apiSpec.length = sizeof(tsOtaNotice);
-    apiSpec.teApiIdentifier = API_OTA_NTC;
-    apiSpec.payload.otaNotice = otaNotice;
-    apiSpec.checkSum = calCheckSum((uint8 *)&otaNotice, apiSpec.length);
+    if (u16BlockSize < 1 || u16BlockSize > OTA_MAX_BLOCK_SIZE) return ERR;
+    if (!OPR_bImageSpan(u8Image, &u32Base, &u32Bytes, &u32Crc)) return ERR;
+    if (u32BlockIdx >= APP_u32OtaBlocks(u32Bytes, u16BlockSize)) return ERR;
 
-    /* calculate how many blocks of this OTA image */
-    g_sDevice.otaTotalBytes = otaNotice.totalBytes;
-    g_sDevice.otaTotalBlocks = (g_sDevice.otaTotalBytes % OTA_BLOCK_SIZE == 0) ?
-        (g_sDevice.otaTotalBytes / OTA_BLOCK_SIZE) :
-        (g_sDevice.otaTotalBytes / OTA_BLOCK_SIZE + 1);
+    uint16 rdLen = ((u32BlockIdx + 1) * u16BlockSize > u32Bytes) ?
+        (u32Bytes - u32BlockIdx * u16BlockSize) :
+        (u16BlockSize);
 
-    uart_printf("Total bytes: %d, client req period: %dms \r\n", otaNotice.totalBytes, otaNotice.reqPeriodMs);
+    tsOtaResp resp;
+    memset(&resp, 0, sizeof(tsOtaResp));
+    resp.blockIdx = u32BlockIdx;
+    resp.len = rdLen;
 
-    /* send through AirPort */
-    int size = i32CopyApiSpec(&apiSpec, tmp);
-    if (API_bSendToAirPort(UNICAST, g_sDevice.config.unicastDstAddr, tmp, size))
+    /* read a block from flash, image crc and block crc follow the block */
+#ifdef OTA_SERVER
+    if (!OHS_bRead(u32Base + u32BlockIdx * u16BlockSize, rdLen, resp.block))
     {
-        PDM_vSaveRecord(&g_sDevicePDDesc);
+        OHS_vPend(u16Dst, u8Image, u32BlockIdx, (uint8)u16BlockSize);
         return OK;
     }
+#else
+    APP_vOtaFlashCachedRead(u32Base + u32BlockIdx * u16BlockSize, rdLen, resp.block);
+#endif
+    memcpy(&resp.block[u16BlockSize], &u32Crc, 4);
+    uint16 blkCrc = APP_u16OtaBlockCrc(resp.block, rdLen);
+    memcpy(&resp.block[u16BlockSize + 4], &blkCrc, OTA_BLOCK_CRC_LEN);
+
+    DBG_vPrintf(TRACE_ATAPI, "OTA_REQ: blkIdx: %d, size: %d \r\n", u32BlockIdx, u16BlockSize);
+
+    memset(&respApiSpec, 0, sizeof(tsApiSpec));
+    respApiSpec.startDelimiter = API_START_DELIMITER;
+    respApiSpec.length = 6 + u16BlockSize + 4 + OTA_BLOCK_CRC_LEN;
+    respApiSpec.teApiIdentifier = API_OTA_RESP;
+    respApiSpec.payload.otaResp = resp;
+    respApiSpec.checkSum = calCheckSum((uint8 *)&resp, respApiSpec.length);
+
+    /* ACK unicast to the client */
+    int size = i32CopyApiSpec(&respApiSpec, tmp);
+    bool ret = API_bSendToAirPort(UNICAST, u16Dst, tmp, size);
+
+#ifdef OTA_SERVER
+    /* requests of many clients interleave, each is tracked by its address */
+    OSV_vServed(u16Dst, u8Image, u32BlockIdx, (uint8)u16BlockSize, rdLen, APP_u32OtaBlocks(u32Bytes, u16BlockSize));
+#else
+    OPR_vServed(u16Dst);
+#endif
+    return ret ? OK : ERR;
+#else
     return ERR;
+#endif
 }
 
 /****************************************************************************
@@ -834,6 +1295,11 @@ int AT_abortOTAUpgrade(uint16 *regAddr)
     tsApiSpec apiSpec;
     memset(&apiSpec, 0, sizeof(tsApiSpec));
 
+#ifdef OTA_SERVER
+    /* a multicast session stops too */
+    OMC_vAbort();
+#endif
+
     apiSpec.startDelimiter = API_START_DELIMITER;
     apiSpec.length = 1;
     apiSpec.teApiIdentifier = API_OTA_ABT_REQ;
@@ -902,24 +1368,8 @@ int AT_OTAStatusPoll(uint16 *regAddr)
  ****************************************************************************/
 int AT_listAllNodes(uint16 *regAddr)
 {
-    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
-    tsApiSpec apiSpec;
-    memset(&apiSpec, 0, sizeof(tsApiSpec));
-
-    tsNwkTopoReq nwkTopoReq;
-    memset(&nwkTopoReq, 0, sizeof(tsNwkTopoReq));
-
-    nwkTopoReq.reqCmd = dummy_value;
-
-    /* Package Nwk Topo require apiSpec */
-    apiSpec.startDelimiter = API_START_DELIMITER;
-    apiSpec.length = sizeof(tsNwkTopoReq);
-    apiSpec.teApiIdentifier = API_TOPO_REQ;
-    apiSpec.payload.nwkTopoReq = nwkTopoReq;
-    apiSpec.checkSum = calCheckSum((uint8 *)&nwkTopoReq, apiSpec.length);
-
-    int size = i32CopyApiSpec(&apiSpec, tmp);
-    if (API_bSendToAirPort(BROADCAST, 0, tmp, size))
+    /* nodes answer in random slots, silent ones are asked again by unicast */
+    if (TPO_bStartScan())
     {
         uart_printf("The request has been sent.\r\n");
         uart_printf("Waiting for response...\r\n");
@@ -1732,9 +2182,12 @@ int API_i32ApiFrmProc(tsApiSpec *apiSpec)
             if (0 == ((apiSpec->payload.remoteAtReq.option) & OPTION_CAST_MASK)) txMode = UNICAST;
             else txMode = BROADCAST;
 
-            /* Send to AirPort */
+            /* Send to AirPort, frameId 0 means the host wants no transmit status */
             size = i32CopyApiSpec(apiSpec, tmp);
-            if (destAddr == 0xfffe)
+            if (0 != apiSpec->payload.remoteAtReq.frameId)
+            {
+                ret = ADS_bSendTracked(apiSpec->payload.remoteAtReq.frameId, txMode, destAddr, destAddr64, tmp, size);
+            } else if (destAddr == 0xfffe)
             {
                 ret = API_bSendToMacDev(destAddr64, TRANS_ENDPOINT_ID, TRANS_ENDPOINT_ID, tmp, size);
             } else
@@ -1759,13 +2212,17 @@ int API_i32ApiFrmProc(tsApiSpec *apiSpec)
             /* change unicast address of data frame to localAddr */
             apiSpec->payload.txDataPacket.unicastAddr = (uint16)ZPS_u16AplZdoGetNwkAddr();
             apiSpec->payload.txDataPacket.unicastAddr64 = ZPS_u64AplZdoGetIeeeAddr();
+            if (0 != g_sDevice.config.dataCompress) PCK_vZipDataFrame(apiSpec);
             apiSpec->checkSum = calCheckSum((uint8 *)(&(apiSpec->payload)), apiSpec->length); //modify payload, should refresh checkSum too
 
             if (0 == ((apiSpec->payload.txDataPacket.option) & OPTION_CAST_MASK)) txMode = UNICAST;
             else txMode = BROADCAST;
-            /* Send to AirPort */
+            /* Send to AirPort, frameId 0 means the host wants no transmit status */
             size = i32CopyApiSpec(apiSpec, tmp);
-            if (destAddr == 0xfffe)
+            if (0 != apiSpec->payload.txDataPacket.frameId)
+            {
+                ret = ADS_bSendTracked(apiSpec->payload.txDataPacket.frameId, txMode, destAddr, destAddr64, tmp, size);
+            } else if (destAddr == 0xfffe)
             {
                 ret = API_bSendToMacDev(destAddr64, TRANS_ENDPOINT_ID, TRANS_ENDPOINT_ID, tmp, size);
             } else
@@ -1776,6 +2233,56 @@ int API_i32ApiFrmProc(tsApiSpec *apiSpec)
             else result = OK;
             break;
         }
+
+        /*
+          Energy accounting require:
+          1.Local node: UART DataPort ACK[tsEnergyResp]
+          2.Other node: send to AirPort, the response comes back over the air
+        */
+    case API_ENERGY_REQ:
+        {
+            uint16 destAddr = apiSpec->payload.energyReq.unicastAddr;
+            if (apiSpec->length < sizeof(tsEnergyReq)) break;
+
+            if (0xfffe == destAddr || (uint16)ZPS_u16AplZdoGetNwkAddr() == destAddr)
+            {
+                ENG_vAssembleResp(&retApiSpec);
+                if (0 != apiSpec->payload.energyReq.reset) ENG_vReset();
+                CMI_vLocalAckDistributor(&retApiSpec);
+                result = OK;
+            } else
+            {
+                size = i32CopyApiSpec(apiSpec, tmp);
+                result = API_bSendToAirPort(UNICAST, destAddr, tmp, size) ? OK : ERR;
+            }
+            break;
+        }
+
+#ifdef OTA_SERVER
+        /*
+          Host streams an OTA image
+          1.Ask host for the first chunks, or stop the stream
+        */
+    case API_OTA_HOST_START:
+        {
+            tsOtaHostStart start = apiSpec->payload.otaHostStart;
+            if (apiSpec->length < sizeof(tsOtaHostStart)) break;
+
+            result = OHS_bStart(start.totalBytes, start.crc, (0 != start.cache)) ? OK : ERR;
+            break;
+        }
+
+        /* a chunk of the streamed image, the server asked for it */
+    case API_OTA_HOST_DATA:
+        {
+            uint32 offset = apiSpec->payload.otaHostData.offset;
+            if (apiSpec->length <= 4) break;
+
+            OHS_vData(offset, apiSpec->payload.otaHostData.data, apiSpec->length - 4);
+            result = OK;
+            break;
+        }
+#endif
     }
     return result;
 }
@@ -1786,6 +2293,8 @@ int API_i32ApiFrmProc(tsApiSpec *apiSpec)
 *
 * DESCRIPTION:
 * API support layer,Processing frame from AirPort
+* An APDU holds one API frame, or a container of aggregated frames which
+* are dispatched one by one.
 *
 * PARAMETERS: Name          RW   Usage
 *             ZPS_tsAfEvent R    StackEvent
@@ -1796,14 +2305,11 @@ int API_i32ApiFrmProc(tsApiSpec *apiSpec)
 ****************************************************************************/
 int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
 {
-    int cnt = 0, i = 0;
-    int size = 0;
     int result = ERR;
-    bool ret = ERR;
-    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
     PDUM_thAPduInstance hapdu_ins;
     uint16 u16PayloadSize;
-    uint8 *payload_addr;
+    uint16 u16Pos;
+    uint8 au8Payload[(sizeof(tsApiSpec) > AGR_MAX_LEN) ? sizeof(tsApiSpec) : AGR_MAX_LEN];
 
     uint8 lqi;
     uint16 pwmWidth;
@@ -1815,33 +2321,64 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
     if (pwmWidth > 500) pwmWidth = 500;
     vAHI_TimerStartRepeat(E_AHI_TIMER_1, 500 - pwmWidth, 500 + pwmWidth);
 
-    /* Get information from Stack Event */
+    /* Get information from Stack Event, free the APDU at first */
     hapdu_ins = sStackEvent->uEvent.sApsDataIndEvent.hAPduInst;         //APDU
     u16PayloadSize = PDUM_u16APduInstanceGetPayloadSize(hapdu_ins);    //Payload size
-    payload_addr = PDUM_pvAPduInstanceGetPayload(hapdu_ins);           //Get Payload's address
+    if (u16PayloadSize > sizeof(au8Payload)) u16PayloadSize = sizeof(au8Payload);
+    memcpy(au8Payload, PDUM_pvAPduInstanceGetPayload(hapdu_ins), u16PayloadSize);
+    PDUM_eAPduFreeAPduInstance(hapdu_ins);
+
+    /* Get frame source address */
+    uint16 u16SrcAddr = sStackEvent->uEvent.sApsDataIndEvent.uSrcAddress.u16Addr;
 
     /* Decode apiSpec frame,Now,UART and AirPort have the same structure */
     bool bValid = FALSE;
     tsApiSpec apiSpec;
-    memset(&apiSpec, 0, sizeof(tsApiSpec));
 
-    /* Decode frame from AirPort */
-    u16DecodeApiSpec(payload_addr, u16PayloadSize, &apiSpec, &bValid);
-    if (!bValid)
+    u16Pos = (u16PayloadSize > 0 && AGR_DELIMITER == au8Payload[0]) ? 1 : 0;
+    do
     {
-        DBG_vPrintf(TRACE_ATAPI, "Not a valid frame, discard it.\r\n");
-        PDUM_eAPduFreeAPduInstance(hapdu_ins);
-        return ERR;
-    }
+        memset(&apiSpec, 0, sizeof(tsApiSpec));
+        u16Pos += u16DecodeApiSpec(&au8Payload[u16Pos], u16PayloadSize - u16Pos, &apiSpec, &bValid);
+        if (!bValid)
+        {
+            DBG_vPrintf(TRACE_ATAPI, "Not a valid frame, discard it.\r\n");
+            break;
+        }
+        result = API_i32AirFrameProc(&apiSpec, u16SrcAddr, lqi);
+    } while (u16Pos < u16PayloadSize);
 
-    /* Get frame source address */
-    uint16 u16SrcAddr = sStackEvent->uEvent.sApsDataIndEvent.uSrcAddress.u16Addr;
+    return result;
+}
+
+/****************************************************************************
+*
+* NAME: API_i32AirFrameProc
+*
+* DESCRIPTION:
+* Handle one API frame received from AirPort
+*
+* PARAMETERS: Name          RW   Usage
+*             apiSpec       R    decoded frame
+*             u16SrcAddr    R    short address of the sender
+*             lqi           R    link quality of the APDU
+* RETURNS:
+* uint8 ErrorCode
+*
+****************************************************************************/
+int API_i32AirFrameProc(tsApiSpec *apiSpec, uint16 u16SrcAddr, uint8 lqi)
+{
+    int cnt = 0, i = 0;
+    int size = 0;
+    int result = ERR;
+    bool ret = ERR;
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
 
     tsApiSpec respApiSpec;
     memset(&respApiSpec, 0, sizeof(tsApiSpec));
 
     /* Handle Tree,Call API support layer */
-    switch (apiSpec.teApiIdentifier)
+    switch (apiSpec->teApiIdentifier)
     {
         /*
           Remote AT require:
@@ -1850,23 +2387,20 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_REMOTE_AT_REQ:
         {
-            /* Free APDU at first */
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
-
             cnt = sizeof(atCommandsApiMode) / sizeof(AT_Command_ApiMode_t);
             for (i = 0; i < cnt; i++)
             {
-                if (atCommandsApiMode[i].atCmdIndex == apiSpec.payload.remoteAtReq.atCmdId)
+                if (atCommandsApiMode[i].atCmdIndex == apiSpec->payload.remoteAtReq.atCmdId)
                 {
                     if (NULL != atCommandsApiMode[i].function)
                     {
-                        result = atCommandsApiMode[i].function(&apiSpec, &respApiSpec, atCommandsApiMode[i].configAddr);
+                        result = atCommandsApiMode[i].function(apiSpec, &respApiSpec, atCommandsApiMode[i].configAddr);
                         break;
                     }
                 }
             }
 
-            if (0 == ((apiSpec.payload.remoteAtReq.option) & OPTION_ACK_MASK))
+            if (0 == ((apiSpec->payload.remoteAtReq.option) & OPTION_ACK_MASK))
             {
             	/* ACK unicast to u16SrcAddr */
 				size = i32CopyApiSpec(&respApiSpec, tmp);
@@ -1888,8 +2422,7 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_REMOTE_AT_RESP:
         {
-            CMI_vAirDataDistributor(&apiSpec);
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
+            CMI_vAirDataDistributor(apiSpec);
             result = OK;
             break;
         }
@@ -1897,8 +2430,7 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         /* Data */
     case API_DATA_PACKET:
         {
-            CMI_vAirDataDistributor(&apiSpec);
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
+            CMI_vAirDataDistributor(apiSpec);
             result = OK;
             break;
         }
@@ -1910,32 +2442,15 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_TOPO_REQ:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             DBG_vPrintf(TRACE_ATAPI, "NWK_TOPO_REQ: from 0x%04x \r\n", u16SrcAddr);
 
-            /* Pack a NwkTopoResp,AirPort ACK */
-            tsNwkTopoResp nwkTopoResp;
-            memset(&nwkTopoResp, 0, sizeof(nwkTopoResp));
-
-            /* Fill in the parameter */
-            nwkTopoResp.dbm = (lqi - 305) / 3;
-            nwkTopoResp.lqi = lqi;
-            nwkTopoResp.nodeFWVer = (uint16)(FW_VERSION);
-            nwkTopoResp.shortAddr = (uint16)ZPS_u16AplZdoGetNwkAddr();              //Short Address
-            nwkTopoResp.nodeMacAddr0 = (uint32)ZPS_u64AplZdoGetIeeeAddr();          //Low
-            nwkTopoResp.nodeMacAddr1 = (uint32)(ZPS_u64AplZdoGetIeeeAddr() >> 32);  //High
+            /* old requesters send no window, answer them at once */
+            uint16 u16WindowMs = 0;
+            if (apiSpec->length >= sizeof(tsNwkTopoReq)) u16WindowMs = apiSpec->payload.nwkTopoReq.windowMs;
 
-            respApiSpec.startDelimiter = API_START_DELIMITER;
-            respApiSpec.length = sizeof(tsNwkTopoResp);
-            respApiSpec.teApiIdentifier = API_TOPO_RESP;
-            respApiSpec.payload.nwkTopoResp = nwkTopoResp;
-            respApiSpec.checkSum = calCheckSum((uint8 *)&nwkTopoResp, respApiSpec.length);
-
-            /* ACK unicast to u16SrcAddr */
-            size = i32CopyApiSpec(&respApiSpec, tmp);
-            ret = API_bSendToAirPort(UNICAST, u16SrcAddr, tmp, size);
-            if (!ret) result = ERR;
-            else result = OK;
+            /* ACK unicast to u16SrcAddr, in a random slot of the window */
+            TPO_vRequest(u16SrcAddr, lqi, u16WindowMs);
+            result = OK;
             break;
         }
 
@@ -1945,8 +2460,43 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_TOPO_RESP:
         {
-            CMI_vAirDataDistributor(&apiSpec);
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
+            NAC_vUpdate(((uint64)apiSpec->payload.nwkTopoResp.nodeMacAddr1 << 32) | apiSpec->payload.nwkTopoResp.nodeMacAddr0,
+                        apiSpec->payload.nwkTopoResp.shortAddr);
+            if (TPO_bResponse(apiSpec->payload.nwkTopoResp.shortAddr)) CMI_vAirDataDistributor(apiSpec);
+            result = OK;
+            break;
+        }
+
+        /*
+          Energy accounting require:
+          1.AirPort ACK[tsEnergyResp] to source address
+        */
+    case API_ENERGY_REQ:
+        {
+            DBG_vPrintf(TRACE_ATAPI, "ENERGY_REQ: from 0x%04x \r\n", u16SrcAddr);
+            if (apiSpec->length < sizeof(tsEnergyReq)) break;
+
+            ENG_vAssembleResp(&respApiSpec);
+            if (0 != apiSpec->payload.energyReq.reset) ENG_vReset();
+            size = i32CopyApiSpec(&respApiSpec, tmp);
+            result = API_bSendToAirPort(UNICAST, u16SrcAddr, tmp, size) ? OK : ERR;
+            break;
+        }
+
+        /* Energy accounting response, samples of a sketch: up to host */
+    case API_ENERGY_RESP:
+    case API_SAMPLE_BATCH:
+        {
+            CMI_vAirDataDistributor(apiSpec);
+            result = OK;
+            break;
+        }
+
+        /* Reliable stream of DATA mode, SPM owns it */
+    case API_STREAM_DATA:
+    case API_STREAM_ACK:
+        {
+            SPM_vStreamFrameProc(apiSpec, u16SrcAddr);
             result = OK;
             break;
         }
@@ -1960,59 +2510,171 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_OTA_NTC:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             if (!g_sDevice.supportOTA) break;
-            g_sDevice.otaReqPeriod  = apiSpec.payload.otaNotice.reqPeriodMs;
-            g_sDevice.otaTotalBytes = apiSpec.payload.otaNotice.totalBytes;
+
+            /* multicast and fleet notices are broadcast, they name the device type they're for */
+            uint8 session = API_HAS_FIELD(apiSpec, tsOtaNotice, session) ? apiSpec->payload.otaNotice.session : 0;
+            uint8 target = API_HAS_FIELD(apiSpec, tsOtaNotice, target) ? apiSpec->payload.otaNotice.target : 0;
+            if (session != 0 || target != 0)
+            {
+#ifdef TARGET_END
+                if (OTA_MC_TARGET_END != target) break;
+#else
+                if (OTA_MC_TARGET_ROU != target) break;
+#endif
+            }
+            if (0 == session && target != 0)
+            {
+                /* nodes running or already fetching the image of a fleet rollout stay out */
+                uint32 crc = 0;
+                if (API_HAS_FIELD(apiSpec, tsOtaNotice, crc)) memcpy(&crc, &apiSpec->payload.otaNotice.crc, 4);
+                if (crc == APP_u32OtaRunningCrc()) break;
+                if (g_sDevice.otaDownloading > 0 && crc == g_sDevice.otaCrc) break;
+            }
+            if (session != 0)
+            {
+                /* the notice is repeated */
+                if (session == g_sDevice.otaSession && g_sDevice.otaDownloading > 0) break;
+
+                /* every client takes the server's block size */
+                uint8 blkSize = apiSpec->payload.otaNotice.maxBlockSize;
+                if (blkSize < OTA_BLOCK_SIZE || blkSize > OTA_MAX_BLOCK_SIZE) break;
+                g_sDevice.otaBlockSize = blkSize;
+            }
+
+            /* image crc lets a repeated notice resume, old servers only send it with the blocks */
+            if (API_HAS_FIELD(apiSpec, tsOtaNotice, crc))
+                memcpy(&g_sDevice.otaCrc, &apiSpec->payload.otaNotice.crc, 4);
+            else
+                g_sDevice.otaCrc = 0;
+
+            /*
+              a node running the base image of a patch downloads the patch only,
+              else the compressed image if there is one
+            */
+            uint32 u32Bytes = apiSpec->payload.otaNotice.totalBytes;
+            g_sDevice.otaImage = OTA_IMAGE_FULL;
+            g_sDevice.otaImageBytes = u32Bytes;
+            if (0 == session && API_HAS_FIELD(apiSpec, tsOtaNotice, patchBytes) &&
+                apiSpec->payload.otaNotice.patchBytes > 0 &&
+                apiSpec->payload.otaNotice.baseVersion == FW_VERSION &&
+                apiSpec->payload.otaNotice.baseCrc == APP_u32OtaRunningCrc())
+            {
+                g_sDevice.otaImage = OTA_IMAGE_DELTA;
+                u32Bytes = apiSpec->payload.otaNotice.patchBytes;
+            }
+            else if (0 == session && API_HAS_FIELD(apiSpec, tsOtaNotice, packedBytes) &&
+                     apiSpec->payload.otaNotice.packedBytes > 0)
+            {
+                g_sDevice.otaImage = OTA_IMAGE_PACKED;
+                u32Bytes = apiSpec->payload.otaNotice.packedBytes;
+            }
+            g_sDevice.otaSession    = session;
+            g_sDevice.otaReqPeriod  = apiSpec->payload.otaNotice.reqPeriodMs;
+            g_sDevice.otaTotalBytes = u32Bytes;
             g_sDevice.otaSvrAddr16  = u16SrcAddr;
             g_sDevice.otaCurBlock   = 0;
-            g_sDevice.otaTotalBlocks = (g_sDevice.otaTotalBytes % OTA_BLOCK_SIZE == 0) ?
-                (g_sDevice.otaTotalBytes / OTA_BLOCK_SIZE) :
-                (g_sDevice.otaTotalBytes / OTA_BLOCK_SIZE + 1);
-            g_sDevice.otaDownloading = 1;
-            DBG_vPrintf(TRACE_ATAPI, "OTA_NTC: %d blks \r\n", g_sDevice.otaTotalBlocks);
+
+            /* old servers don't offer a block size */
+            if (0 == session)
+            {
+                g_sDevice.otaBlockSize = APP_u8OtaClientBlockSize(
+                    API_HAS_FIELD(apiSpec, tsOtaNotice, maxBlockSize) ? apiSpec->payload.otaNotice.maxBlockSize : OTA_BLOCK_SIZE);
+            }
+            g_sDevice.otaTotalBlocks = APP_u32OtaBlocks(g_sDevice.otaTotalBytes, g_sDevice.otaBlockSize);
+            g_sDevice.otaDownloading = (0 == session) ? 1 : 3;
+            DBG_vPrintf(TRACE_ATAPI, "OTA_NTC: %d blks of %d bytes, image %d \r\n",
+                        g_sDevice.otaTotalBlocks, g_sDevice.otaBlockSize, g_sDevice.otaImage);
             PDM_vSaveRecord(&g_sDevicePDDesc);
 
-            /* erase covered sectors */
-            APP_vOtaFlashLockEraseAll();
+            /* resume the same image, else erase covered sectors */
+            clientOtaPrepareDownload();
+
+            if (session != 0)
+            {
+                /* blocks are pushed, the timer only watches for silence */
+                vResetATimer(APP_OTAReqTimer, APP_TIME_MS(OTA_MC_SILENCE_MS));
+            }
+            else
+            {
+                /* the whole fleet got the notice, spread the first requests */
+                uint32 u32DelayMs = (target != 0) ? 1 + random() % OTA_FLEET_SPREAD_MS : 0;
 
-            /* Activate OTA require Task */
-            OS_eActivateTask(APP_taskOTAReq);
+                /* neighbours running the image answer in the meantime */
+                if (OPR_u8Search(u16SrcAddr) > 0 && u32DelayMs < OTA_PEER_WAIT_MS) u32DelayMs = OTA_PEER_WAIT_MS;
+
+                if (u32DelayMs > 0)
+                {
+                    vResetATimer(APP_OTAReqTimer, APP_TIME_MS(u32DelayMs));
+                }
+                else
+                {
+                    /* Activate OTA require Task */
+                    OS_eActivateTask(APP_taskOTAReq);
+                }
+            }
+            result = OK;
+            break;
+        }
+
+        /* multicast block, the crc came with the notice */
+    case API_OTA_MC_BLK:
+        {
+            uint8 session = apiSpec->payload.otaMcBlock.session;
+            if (0 == session || session != g_sDevice.otaSession) break;
+            if (apiSpec->length < 7 + g_sDevice.otaBlockSize + OTA_BLOCK_CRC_LEN) break;
+
+            clientOtaRxBlock(apiSpec->payload.otaMcBlock.blockIdx, apiSpec->payload.otaMcBlock.len,
+                             apiSpec->payload.otaMcBlock.block,
+                             &apiSpec->payload.otaMcBlock.block[g_sDevice.otaBlockSize]);
+            result = OK;
+            break;
+        }
+
+        /* multicast round ended, report the gaps or pull them */
+    case API_OTA_MC_END:
+        {
+            if (0 == g_sDevice.otaSession || apiSpec->payload.otaMcEnd.session != g_sDevice.otaSession) break;
+
+            DBG_vPrintf(TRACE_ATAPI, "OTA_MC_END: round %d, last %d \r\n",
+                        apiSpec->payload.otaMcEnd.round, apiSpec->payload.otaMcEnd.last);
+            clientOtaMcEnd(apiSpec->payload.otaMcEnd.round, apiSpec->payload.otaMcEnd.last,
+                           apiSpec->payload.otaMcEnd.nackWindowMs);
             result = OK;
             break;
         }
 
         /*
           OTA response hold a block
-          1. Write this block into external flash.
-          2. If this is the last block, activate upgrade.
+          1. Write this block into external flash, blocks may come in any order.
+          2. If all blocks are received, activate upgrade.
         */
     case API_OTA_RESP:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
-            uint32 blkIdx = apiSpec.payload.otaResp.blockIdx;
-            uint32 offset = blkIdx * OTA_BLOCK_SIZE;
-            uint16 len    = apiSpec.payload.otaResp.len;
-            uint32 crc    = apiSpec.payload.otaResp.crc;
-
-            /* Synchronous blocks */
-            if (blkIdx == g_sDevice.otaCurBlock)
-            {
-                DBG_vPrintf(TRACE_ATAPI, "OTA_RESP: Blk: %d\r\n", blkIdx);
-                APP_vOtaFlashLockWrite(offset, len, apiSpec.payload.otaResp.block);
-                g_sDevice.otaCurBlock += 1;
-                g_sDevice.otaCrc = crc;
-                if (g_sDevice.otaCurBlock % 100 == 0) PDM_vSaveRecord(&g_sDevicePDDesc);
-            } else
-            {
-                DBG_vPrintf(TRACE_ATAPI, "OTA_RESP: DesireBlk: %d, RecvBlk: %d \r\n", g_sDevice.otaCurBlock, blkIdx);
-            }
+            uint32 blkIdx = apiSpec->payload.otaResp.blockIdx;
+            uint16 blkSize = g_sDevice.otaBlockSize;
 
-            /* if this is the last block,client start to upgrade */
-            if (g_sDevice.otaCurBlock >= g_sDevice.otaTotalBlocks)
-            {
-                clientOtaFinishing();
-            }
+            DBG_vPrintf(TRACE_ATAPI, "OTA_RESP: Blk: %d\r\n", blkIdx);
+            if (blkSize > OTA_MAX_BLOCK_SIZE || apiSpec->length < 6 + blkSize + 4) break;
+
+            memcpy(&g_sDevice.otaCrc, &apiSpec->payload.otaResp.block[blkSize], 4);
+
+            /* servers before the block crc leave it out */
+            uint8 *blkCrc = (apiSpec->length >= 6 + blkSize + 4 + OTA_BLOCK_CRC_LEN) ?
+                            &apiSpec->payload.otaResp.block[blkSize + 4] : NULL;
+            OPR_vRxBlock(u16SrcAddr);
+            clientOtaRxBlock(blkIdx, apiSpec->payload.otaResp.len, apiSpec->payload.otaResp.block, blkCrc);
+            result = OK;
+            break;
+        }
+
+        /* a neighbour running the image offers to serve it */
+    case API_OTA_PEER_RESP:
+        {
+            tsOtaPeerResp offer = apiSpec->payload.otaPeerResp;
+            if (apiSpec->length < sizeof(tsOtaPeerResp)) break;
+
+            OPR_vOffer(u16SrcAddr, lqi, &offer);
             result = OK;
             break;
         }
@@ -2023,7 +2685,6 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_OTA_UPG_RESP:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             DBG_vPrintf(TRACE_ATAPI, "FRM_OTA_UPG_RESP: from 0x%04x \r\n", u16SrcAddr);
 
             g_sDevice.otaDownloading = 0;
@@ -2042,16 +2703,26 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_OTA_ABT_REQ:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             DBG_vPrintf(TRACE_ATAPI, "FRM_OTA_ABT_REQ: from 0x%04x \r\n", u16SrcAddr);
+
+            /* a multicast abort is broadcast with its session, nobody acks it */
+            uint8 session = apiSpec->payload.dummyByte;
+            if (session != 0 && session != g_sDevice.otaSession) break;
+
             if (g_sDevice.otaDownloading > 0)
             {
                 g_sDevice.otaDownloading = 0;
                 g_sDevice.otaCurBlock = 0;
                 g_sDevice.otaTotalBytes = 0;
                 g_sDevice.otaTotalBlocks = 0;
+                g_sDevice.otaSession = 0;
                 PDM_vSaveRecord(&g_sDevicePDDesc);
             }
+            if (session != 0)
+            {
+                result = OK;
+                break;
+            }
 
             /* package apiSpec */
             respApiSpec.startDelimiter = API_START_DELIMITER;
@@ -2075,16 +2746,24 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         */
     case API_OTA_ST_REQ:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             DBG_vPrintf(TRACE_ATAPI, "FRM_OTA_ST_REQ: from 0x%04x \r\n", u16SrcAddr);
 
             tsOtaStatusResp otaStatusResp;
             otaStatusResp.inOTA = (g_sDevice.otaDownloading > 0);
             otaStatusResp.per = 0;
-            if (otaStatusResp.inOTA && g_sDevice.otaTotalBlocks > 0)
+            otaStatusResp.min = 0;
+            if ((1 == g_sDevice.otaDownloading || 3 == g_sDevice.otaDownloading) && g_sDevice.otaTotalBlocks > 0)
+            {
+                /* packed struct, don't point into it */
+                uint8 per;
+                uint32 min;
+                clientOtaProgress(&per, &min);
+                otaStatusResp.per = per;
+                otaStatusResp.min = min;
+            }
+            else if (otaStatusResp.inOTA)
             {
-                otaStatusResp.per = (uint8)((g_sDevice.otaCurBlock * 100) / g_sDevice.otaTotalBlocks);
-                otaStatusResp.min = g_sDevice.config.reqPeriodMs * (g_sDevice.otaTotalBlocks - g_sDevice.otaCurBlock) / 60000;
+                otaStatusResp.per = 100;
             }
 
             /* response */
@@ -2104,57 +2783,48 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
 
 #endif
 
-#ifdef OTA_SERVER
+#if defined(OTA_SERVER) || defined(OTA_PEER)
         /*
-          OTA data block require
+          OTA data block require, to the server or a router running the image
           1. return block data
         */
     case API_OTA_REQ:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
-            uint32 blkIdx  = apiSpec.payload.otaReq.blockIdx;
-            if (blkIdx >= g_sDevice.otaTotalBlocks) break;
+            uint32 blkIdx  = apiSpec->payload.otaReq.blockIdx;
 
-            uint8 buff[OTA_BLOCK_SIZE];
-            uint16 rdLen = ((blkIdx + 1) * OTA_BLOCK_SIZE > g_sDevice.otaTotalBytes) ?
-                (g_sDevice.otaTotalBytes - blkIdx * OTA_BLOCK_SIZE) :
-                (OTA_BLOCK_SIZE);
-            if (rdLen > OTA_BLOCK_SIZE) rdLen = OTA_BLOCK_SIZE;
+            /* old clients don't ask for a block size */
+            uint16 blkSize = API_HAS_FIELD(apiSpec, tsOtaReq, blockSize) ? apiSpec->payload.otaReq.blockSize : OTA_BLOCK_SIZE;
+            uint8 image = API_HAS_FIELD(apiSpec, tsOtaReq, image) ? apiSpec->payload.otaReq.image : OTA_IMAGE_FULL;
 
-            /* read a block from flash */
-            APP_vOtaFlashLockRead(blkIdx * OTA_BLOCK_SIZE, rdLen, buff);
-
-            DBG_vPrintf(TRACE_ATAPI, "OTA_REQ: blkIdx: %d \r\n", blkIdx);
-
-            tsOtaResp resp;
-            resp.blockIdx = blkIdx;
-            memcpy(&resp.block[0], buff, rdLen);
-            resp.len = rdLen;
-            resp.crc = g_sDevice.otaCrc;
+            result = API_i32OtaServeBlock(u16SrcAddr, image, blkIdx, blkSize);
+            break;
+        }
+#endif
 
-            respApiSpec.startDelimiter = API_START_DELIMITER;
-            respApiSpec.length = sizeof(tsOtaResp);
-            respApiSpec.teApiIdentifier = API_OTA_RESP;
-            respApiSpec.payload.otaResp = resp;
-            respApiSpec.checkSum = calCheckSum((uint8 *)&resp, respApiSpec.length);
+#ifdef OTA_PEER
+        /* a neighbour looks for the image it downloads */
+    case API_OTA_PEER_REQ:
+        {
+            tsOtaPeerReq query = apiSpec->payload.otaPeerReq;
+            if (apiSpec->length < sizeof(tsOtaPeerReq)) break;
 
-            /* ACK unicast to u16SrcAddr */
-            size = i32CopyApiSpec(&respApiSpec, tmp);
-            ret = API_bSendToAirPort(UNICAST, u16SrcAddr, tmp, size);
-            if (!ret) result = ERR;
-            else result = OK;
+            OPR_vQuery(u16SrcAddr, &query);
+            result = OK;
             break;
         }
+#endif
 
+#ifdef OTA_SERVER
         /*
           Upgrade require from OTA client device
           1.Permit client to activate upgrade
         */
     case API_OTA_UPG_REQ:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             DBG_vPrintf(TRACE_ATAPI, "FRM_OTA_UPG_REQ: from 0x%04x \r\n", u16SrcAddr);
             uart_printf("OTA: Node 0x%04x's OTA download done, crc check ok.\r\n", u16SrcAddr);
+            OMC_vClientDone(u16SrcAddr);
+            OSV_vDone(u16SrcAddr);
 
             /* package apiSpec */
             respApiSpec.startDelimiter = API_START_DELIMITER;
@@ -2171,12 +2841,24 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
             break;
         }
 
+        /* gaps of a client after a multicast round */
+    case API_OTA_MC_NACK:
+        {
+            tsOtaMcNack nack = apiSpec->payload.otaMcNack;
+            if (apiSpec->length < sizeof(tsOtaMcNack)) break;
+
+            uint32 baseBlock = nack.baseBlock;
+            OMC_vNack(u16SrcAddr, nack.session, nack.round, nack.per, baseBlock, nack.gaps);
+            result = OK;
+            break;
+        }
+
         /* Telling server, abort OK */
     case API_OTA_ABT_RESP:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             DBG_vPrintf(TRACE_ATAPI, "FRM_OTA_ABT_RESP: from 0x%04x \r\n", u16SrcAddr);
             uart_printf("OTA: abort ack from 0x%04x.\r\n", u16SrcAddr);
+            OSV_vAborted(u16SrcAddr);
             result = OK;
             break;
         }
@@ -2184,15 +2866,15 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
         /* interact with user */
     case API_OTA_ST_RESP:
         {
-            PDUM_eAPduFreeAPduInstance(hapdu_ins);
             DBG_vPrintf(TRACE_ATAPI, "FRM_OTA_ST_RESP: from 0x%04x \r\n", u16SrcAddr);
-            if (apiSpec.payload.otaStatusResp.inOTA)
+            OSV_vStatus(u16SrcAddr, apiSpec->payload.otaStatusResp.inOTA, apiSpec->payload.otaStatusResp.per);
+            if (apiSpec->payload.otaStatusResp.inOTA)
             {
                 uart_printf(" -------------------- \r\n");
                 uart_printf("     OTA status       \r\n");
                 uart_printf(" Node: 0x%04x         \r\n", u16SrcAddr);
-                uart_printf(" Finished: %d%%       \r\n", apiSpec.payload.otaStatusResp.per);
-                uart_printf(" Remaining: %ld min   \r\n", apiSpec.payload.otaStatusResp.min);
+                uart_printf(" Finished: %d%%       \r\n", apiSpec->payload.otaStatusResp.per);
+                uart_printf(" Remaining: %ld min   \r\n", apiSpec->payload.otaStatusResp.min);
                 uart_printf(" -------------------- \r\n");
             } else
             {
@@ -2203,9 +2885,8 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
 
 #endif
 
-        /* default:free APDU only */
+        /* default:ignore */
     default:
-        PDUM_eAPduFreeAPduInstance(hapdu_ins);
         result = OK;
         break;
     }
@@ -2226,6 +2907,55 @@ int API_i32AdsStackEventProc(ZPS_tsAfEvent *sStackEvent)
 *
 ****************************************************************************/
 bool API_bSendToAirPort(uint16 txMode, uint16 unicastDest, uint8 *buf, int len)
+{
+    /* unicast bulk frames may wait a little to share an APDU with others */
+    if (UNICAST == txMode && AGR_bEnabled() && E_QOS_BULK == QOS_eClassify(buf, len))
+    {
+        return AGR_bSend(unicastDest, buf, len);
+    }
+    return API_bSendToAirPortNow(txMode, unicastDest, buf, len);
+}
+
+/****************************************************************************
+*
+* NAME: API_bSendToAirPortNow
+*
+* DESCRIPTION:
+* Send a frame bypassing aggregation, at once or after the frames of its
+* traffic class queued ahead of it
+*
+* PARAMETERS: Name          RW   Usage
+*             txMode        R    BROADCAST or UNICAST
+*             unicastDest   R    short address of destination
+*             buf           R    frame to send
+*             len           R    frame length
+* RETURNS:
+* TRUE if the frame is sent or queued
+*
+****************************************************************************/
+bool API_bSendToAirPortNow(uint16 txMode, uint16 unicastDest, uint8 *buf, int len)
+{
+    return QOS_bSend(txMode, unicastDest, buf, len);
+}
+
+/****************************************************************************
+*
+* NAME: API_bSendToAirPortApdu
+*
+* DESCRIPTION:
+* Put a frame into an APDU and hand it to the stack
+*
+* PARAMETERS: Name          RW   Usage
+*             txMode        R    BROADCAST or UNICAST
+*             unicastDest   R    short address of destination
+*             buf           R    frame to send
+*             len           R    frame length
+*             pu8SeqNum     W    APS counter of the frame, matches the confirm
+* RETURNS:
+* TRUE if the stack accepted the request
+*
+****************************************************************************/
+bool API_bSendToAirPortApdu(uint16 txMode, uint16 unicastDest, uint8 *buf, int len, uint8 *pu8SeqNum)
 {
     PDUM_thAPduInstance hapdu_ins = PDUM_hAPduAllocateAPduInstance(apduZCL);
     /* Invalid instance */
@@ -2252,7 +2982,7 @@ bool API_bSendToAirPort(uint16 txMode, uint16 unicastDest, uint8 *buf, int len)
                                         ZPS_E_BROADCAST_ALL,
                                         SEC_MODE_FOR_DATA_ON_AIR,
                                         0,
-                                        NULL);
+                                        pu8SeqNum);
     } else if (UNICAST == txMode)
     {
         DBG_vPrintf(TRACE_ATAPI, "SendToAirPort Unicast len %d to 0x%04x ...\r\n", len, unicastDest);
@@ -2264,7 +2994,7 @@ bool API_bSendToAirPort(uint16 txMode, uint16 unicastDest, uint8 *buf, int len)
                                       unicastDest,
                                       SEC_MODE_FOR_DATA_ON_AIR,
                                       0,
-                                      NULL);
+                                      pu8SeqNum);
     }
 
     if (ZPS_E_SUCCESS != st)
@@ -2278,6 +3008,9 @@ bool API_bSendToAirPort(uint16 txMode, uint16 unicastDest, uint8 *buf, int len)
         PDUM_eAPduFreeAPduInstance(hapdu_ins);
         return FALSE;
     }
+    /* an end device polls fast for the answer */
+    POL_vTraffic(FALSE);
+    ENG_vTxStart();
     return TRUE;
 }
 
@@ -2348,6 +3081,8 @@ bool API_bSendToEndPoint(uint16 txMode, uint16 unicastDest, uint8 srcEpId, uint8
         PDUM_eAPduFreeAPduInstance(hapdu_ins);
         return FALSE;
     }
+    POL_vTraffic(FALSE);
+    ENG_vTxStart();
     return TRUE;
 }
 
@@ -2368,16 +3103,31 @@ bool API_bSendToMacDev(uint64 unicastMacAddr, uint8 srcEpId, uint8 dstEpId, char
     PDUM_eAPduInstanceSetPayloadSize(hapdu_ins, len);
 
     ZPS_teStatus st;
+    uint16 u16NwkAddr;
 
     DBG_vPrintf(TRACE_ATAPI, "SendToMacDev Unicast %d to 0x%08x%08x...\r\n", len, (uint32)(unicastMacAddr >> 32), (uint32)unicastMacAddr);
-    st = ZPS_eAplAfUnicastIeeeDataReq(hapdu_ins,
+    /* A known short address saves the stack an address discovery */
+    if (NAC_bLookup(unicastMacAddr, &u16NwkAddr))
+    {
+        st = ZPS_eAplAfUnicastDataReq(hapdu_ins,
                                       TRANS_CLUSTER_ID,
                                       srcEpId,
                                       dstEpId,
-                                      unicastMacAddr,
+                                      u16NwkAddr,
                                       SEC_MODE_FOR_DATA_ON_AIR,
                                       0,
                                       NULL);
+    } else
+    {
+        st = ZPS_eAplAfUnicastIeeeDataReq(hapdu_ins,
+                                          TRANS_CLUSTER_ID,
+                                          srcEpId,
+                                          dstEpId,
+                                          unicastMacAddr,
+                                          SEC_MODE_FOR_DATA_ON_AIR,
+                                          0,
+                                          NULL);
+    }
     if (ZPS_E_SUCCESS != st)
     {
         /*
@@ -2389,6 +3139,132 @@ bool API_bSendToMacDev(uint64 unicastMacAddr, uint8 srcEpId, uint8 dstEpId, char
         PDUM_eAPduFreeAPduInstance(hapdu_ins);
         return FALSE;
     }
+    POL_vTraffic(FALSE);
+    ENG_vTxStart();
+    return TRUE;
+}
+/****************************************************************************
+*
+* NAME: API_bSendToAirPortTracked
+*
+* DESCRIPTION:
+* Same as API_bSendToAirPort, but hands back the APS sequence number so the
+* caller can match the later APS confirm/ack. Unicast is sent with APS ack
+* requested, so delivery is confirmed by the destination, not the next hop.
+*
+* PARAMETERS: Name          RW   Usage
+*             txMode        R    BROADCAST or UNICAST
+*             unicastDest   R    short address of destination
+*             buf           R    frame to send
+*             len           R    frame length
+*             pu8SeqNum     W    APS sequence number of this request
+* RETURNS:
+* TRUE if the stack accepted the request
+*
+****************************************************************************/
+bool API_bSendToAirPortTracked(uint16 txMode, uint16 unicastDest, uint8 *buf, int len, uint8 *pu8SeqNum)
+{
+    PDUM_thAPduInstance hapdu_ins = PDUM_hAPduAllocateAPduInstance(apduZCL);
+    /* Invalid instance */
+    if (PDUM_INVALID_HANDLE == hapdu_ins) return FALSE;
+
+    uint8 *payload_addr = PDUM_pvAPduInstanceGetPayload(hapdu_ins);
+    memcpy(payload_addr, buf, len);
+    PDUM_eAPduInstanceSetPayloadSize(hapdu_ins, len);
+
+    ZPS_teStatus st;
+    if (BROADCAST == txMode)
+    {
+        st = ZPS_eAplAfBroadcastDataReq(hapdu_ins,
+                                        TRANS_CLUSTER_ID,
+                                        TRANS_ENDPOINT_ID,
+                                        TRANS_ENDPOINT_ID,
+                                        ZPS_E_BROADCAST_ALL,
+                                        SEC_MODE_FOR_DATA_ON_AIR,
+                                        0,
+                                        pu8SeqNum);
+    } else
+    {
+        st = ZPS_eAplAfUnicastAckDataReq(hapdu_ins,
+                                         TRANS_CLUSTER_ID,
+                                         TRANS_ENDPOINT_ID,
+                                         TRANS_ENDPOINT_ID,
+                                         unicastDest,
+                                         SEC_MODE_FOR_DATA_ON_AIR,
+                                         0,
+                                         pu8SeqNum);
+    }
+
+    if (ZPS_E_SUCCESS != st)
+    {
+        DBG_vPrintf(TRACE_ATAPI, "Fail to send tracked, error code: 0x%x \r\n", st);
+        PDUM_eAPduFreeAPduInstance(hapdu_ins);
+        return FALSE;
+    }
+    DBG_vPrintf(TRACE_ATAPI, "SendToAirPort tracked len %d to 0x%04x, seq %d\r\n", len, unicastDest, *pu8SeqNum);
+    POL_vTraffic(FALSE);
+    ENG_vTxStart();
+    return TRUE;
+}
+
+/****************************************************************************
+*
+* NAME: API_bSendToMacDevTracked
+*
+* DESCRIPTION:
+* IEEE addressed unicast with APS ack, returns the APS sequence number
+*
+* PARAMETERS: Name           RW   Usage
+*             unicastMacAddr R    IEEE address of destination
+*             buf            R    frame to send
+*             len            R    frame length
+*             pu8SeqNum      W    APS sequence number of this request
+* RETURNS:
+* TRUE if the stack accepted the request
+*
+****************************************************************************/
+bool API_bSendToMacDevTracked(uint64 unicastMacAddr, uint8 *buf, int len, uint8 *pu8SeqNum)
+{
+    PDUM_thAPduInstance hapdu_ins = PDUM_hAPduAllocateAPduInstance(apduZCL);
+    /* Invalid instance */
+    if (PDUM_INVALID_HANDLE == hapdu_ins) return FALSE;
+
+    uint8 *payload_addr = PDUM_pvAPduInstanceGetPayload(hapdu_ins);
+    memcpy(payload_addr, buf, len);
+    PDUM_eAPduInstanceSetPayloadSize(hapdu_ins, len);
+
+    ZPS_teStatus st;
+    uint16 u16NwkAddr;
+
+    if (NAC_bLookup(unicastMacAddr, &u16NwkAddr))
+    {
+        st = ZPS_eAplAfUnicastAckDataReq(hapdu_ins,
+                                         TRANS_CLUSTER_ID,
+                                         TRANS_ENDPOINT_ID,
+                                         TRANS_ENDPOINT_ID,
+                                         u16NwkAddr,
+                                         SEC_MODE_FOR_DATA_ON_AIR,
+                                         0,
+                                         pu8SeqNum);
+    } else
+    {
+        st = ZPS_eAplAfUnicastIeeeAckDataReq(hapdu_ins,
+                                             TRANS_CLUSTER_ID,
+                                             TRANS_ENDPOINT_ID,
+                                             TRANS_ENDPOINT_ID,
+                                             unicastMacAddr,
+                                             SEC_MODE_FOR_DATA_ON_AIR,
+                                             0,
+                                             pu8SeqNum);
+    }
+    if (ZPS_E_SUCCESS != st)
+    {
+        DBG_vPrintf(TRACE_ATAPI, "Fail to send tracked, error code: 0x%x \r\n", st);
+        PDUM_eAPduFreeAPduInstance(hapdu_ins);
+        return FALSE;
+    }
+    POL_vTraffic(FALSE);
+    ENG_vTxStart();
     return TRUE;
 }
 /****************************************************************************/
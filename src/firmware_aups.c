@@ -7,7 +7,8 @@
  * Spread by SeeedStudio
  * Author     : Oliver Wang
  * Create Time: 2014/4
- * Change Log :
+ * Change Log : Warm resume of the sketch after a sleep
+ *              Samples sent in batches(aupsBatchAdd)
  *
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
@@ -30,6 +31,9 @@
 #include "suli.h"
 #include "ups_arduino_sketch.h"
 #include "firmware_hal.h"
+#include "firmware_sleep.h"
+#include "firmware_at_api.h"
+#include "firmware_api_pack.h"
 
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
@@ -47,6 +51,8 @@
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
 extern bool searchAtStarter(uint8 *buffer, int len);
+PRIVATE uint8 UPS_u8BatchSize(void);
+PRIVATE bool UPS_bBatchOld(uint32 u32AheadMs);
 
 /****************************************************************************/
 /***        Exported Variables                                            ***/
@@ -65,6 +71,27 @@ uint8 aups_air_mempool[AUPS_AIR_RB_LEN] = {0};
 
 PRIVATE uint32 _loopInterval = 0;
 
+/* ups_init() has run, RAM state of the sketch is valid */
+PRIVATE bool bUpsReady = FALSE;
+
+/* wake up to first loop, warm resume and full init */
+PRIVATE bool bUpsTiming = FALSE;
+PRIVATE bool bUpsWarm = FALSE;
+PRIVATE uint32 u32UpsWakeUs = 0;
+PRIVATE tsUpsWakeStats sUpsWarm;
+PRIVATE tsUpsWakeStats sUpsCold;
+
+/*
+  Samples of aupsBatchAdd(), laid out as in tsSampleBatch with the ages
+  filled in at send. Static RAM is held over sleeps, so a batch grows
+  across sleep cycles and the radio is used once per batch.
+*/
+PRIVATE uint8  au8UpsBatch[API_BATCH_LEN];
+PRIVATE uint8  u8UpsBatchLen = 0;
+PRIVATE uint8  u8UpsBatchCnt = 0;
+PRIVATE uint32 au32UpsBatchMs[AUPS_BATCH_MAX_SIZE];   //SLP_u32UpTimeMs() of each sample
+PRIVATE tsUpsBatchStats sUpsBatch;
+
 
 /****************************************************************************/
 /***        External Variables                                            ***/
@@ -121,6 +148,65 @@ PUBLIC void ups_init(void)
 
     /* Activate Arduino-ful MCU */
     OS_eStartSWTimer(Arduino_LoopTimer, APP_TIME_MS(500), NULL);
+    bUpsReady = TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: ups_wakeup
+ *
+ * DESCRIPTION:
+ * Continue the sketch after a sleep. RAM is held over sleeps, so the
+ * ringbuffers and the sketch's state are kept, arduino_resume() turns on
+ * what the loop needs and the loop runs at once. ATMW 1 does the full
+ * ups_init() instead, for sketches which need arduino_setup() again.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ups_wakeup(void)
+{
+    u32UpsWakeUs = u32HAL_GetUsTime();
+    bUpsTiming = TRUE;
+    bUpsWarm = (bUpsReady && 0 == g_sDevice.config.upsWakeCold);
+
+    if (!bUpsWarm)
+    {
+        ups_init();
+        return;
+    }
+
+    /* timer0 of millis()/micros() is off in sleep, its overflow count is kept */
+    suli_init();
+
+    arduino_resume();
+    OS_eActivateTask(Arduino_Loop);
+}
+
+/****************************************************************************
+ *
+ * NAME: ups_printWakeStatus
+ *
+ * DESCRIPTION:
+ * Print the wake up to first loop latency of both wake up paths
+ *
+ * PARAMETERS: Name         RW  Usage
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ups_printWakeStatus(void)
+{
+    uart_printf("Wake To Loop     : warm resume %d wakes, %d us avg, %d us max \r\n",
+                sUpsWarm.u32Wakes, sUpsWarm.u32Wakes ? sUpsWarm.u32SumUs / sUpsWarm.u32Wakes : 0,
+                sUpsWarm.u32MaxUs);
+    uart_printf("                   full init %d wakes, %d us avg, %d us max \r\n",
+                sUpsCold.u32Wakes, sUpsCold.u32Wakes ? sUpsCold.u32SumUs / sUpsCold.u32Wakes : 0,
+                sUpsCold.u32MaxUs);
 }
 
 
@@ -251,6 +337,149 @@ PUBLIC uint8 aupsSendApiFrm(void *data, int len)
 }
 
 
+/****************************************************************************
+ *
+ * NAME: aupsBatchAdd
+ *
+ * DESCRIPTION:
+ * Add a sample to the batch, which is sent to ATDA when it holds ATBN
+ * samples, when another sample of this size won't fit, or when its oldest
+ * sample is ATBA seconds old
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             data         R   sample
+ *             len          R   bytes of the sample
+ * RETURNS:
+ * TRUE if the sample is kept or sent
+ *
+ ****************************************************************************/
+PUBLIC bool aupsBatchAdd(void *data, uint8 len)
+{
+    if (len + AUPS_BATCH_SAMPLE_HDR > API_BATCH_LEN) return FALSE;
+
+    /* no room for it, the batch goes first */
+    if (u8UpsBatchCnt >= AUPS_BATCH_MAX_SIZE ||
+        u8UpsBatchLen + AUPS_BATCH_SAMPLE_HDR + len > API_BATCH_LEN)
+    {
+        if (!aupsBatchFlush())
+        {
+            sUpsBatch.u32Dropped += u8UpsBatchCnt;
+            u8UpsBatchCnt = 0;
+            u8UpsBatchLen = 0;
+        }
+    }
+
+    uint8 *pu8 = &au8UpsBatch[u8UpsBatchLen];
+    pu8[2] = len;
+    memcpy(&pu8[AUPS_BATCH_SAMPLE_HDR], data, len);
+    u8UpsBatchLen += AUPS_BATCH_SAMPLE_HDR + len;
+    au32UpsBatchMs[u8UpsBatchCnt++] = SLP_u32UpTimeMs();
+    sUpsBatch.u32Samples++;
+
+    /* samples of a sketch are mostly the same size, don't hold a full batch */
+    if (u8UpsBatchCnt >= UPS_u8BatchSize() ||
+        u8UpsBatchLen + AUPS_BATCH_SAMPLE_HDR + len > API_BATCH_LEN ||
+        UPS_bBatchOld(0))
+    {
+        aupsBatchFlush();
+    }
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: aupsBatchFlush
+ *
+ * DESCRIPTION:
+ * Send the samples collected so far in one API_SAMPLE_BATCH frame
+ *
+ * PARAMETERS: Name         RW  Usage
+ *
+ * RETURNS:
+ * TRUE if the batch is sent or empty
+ *
+ ****************************************************************************/
+PUBLIC bool aupsBatchFlush(void)
+{
+    tsSampleBatch batch;
+    tsApiSpec apiSpec;
+    uint8 tmp[sizeof(tsApiSpec)];
+    uint32 u32NowMs = SLP_u32UpTimeMs();
+    uint8 i, pos = 0;
+
+    if (0 == u8UpsBatchCnt) return TRUE;
+
+    batch.srcAddr = (uint16)ZPS_u16AplZdoGetNwkAddr();
+    batch.count = u8UpsBatchCnt;
+    memcpy(batch.data, au8UpsBatch, u8UpsBatchLen);
+
+    /* age of each sample at send, big endian */
+    for (i = 0; i < u8UpsBatchCnt; i++)
+    {
+        uint32 u32Age = (u32NowMs - au32UpsBatchMs[i]) / 100;
+        if (u32Age > 0xffff) u32Age = 0xffff;
+        batch.data[pos] = (uint8)(u32Age >> 8);
+        batch.data[pos + 1] = (uint8)u32Age;
+        pos += AUPS_BATCH_SAMPLE_HDR + batch.data[pos + 2];
+    }
+
+    assembleApiSpec(&apiSpec, API_SAMPLE_BATCH, (uint8 *)&batch, 3 + u8UpsBatchLen);
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    if (!API_bSendToAirPort(UNICAST, g_sDevice.config.unicastDstAddr, tmp, size))
+    {
+        DBG_vPrintf(TRACE_UPS, "UPS: batch of %d not sent\r\n", u8UpsBatchCnt);
+        sUpsBatch.u32Failed++;
+        return FALSE;
+    }
+
+    DBG_vPrintf(TRACE_UPS, "UPS: batch of %d sent\r\n", u8UpsBatchCnt);
+    sUpsBatch.u32Frames++;
+    sUpsBatch.u32Sent += u8UpsBatchCnt;
+    u8UpsBatchCnt = 0;
+    u8UpsBatchLen = 0;
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: UPS_vBatchSleep
+ *
+ * DESCRIPTION:
+ * The node is going to sleep, send the batch if its oldest sample would
+ * be too old at wake
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32SleepMs   R   length of the sleep
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void UPS_vBatchSleep(uint32 u32SleepMs)
+{
+    if (UPS_bBatchOld(u32SleepMs)) aupsBatchFlush();
+}
+
+/****************************************************************************
+ *
+ * NAME: UPS_vPrintBatchStatus
+ *
+ * DESCRIPTION:
+ * Print the samples and frames of the batching
+ *
+ * PARAMETERS: Name         RW  Usage
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void UPS_vPrintBatchStatus(void)
+{
+    uart_printf("Sample Batches   : %d samples in %d frames, %d waiting, %d sends failed, %d samples dropped \r\n",
+                sUpsBatch.u32Sent, sUpsBatch.u32Frames, u8UpsBatchCnt,
+                sUpsBatch.u32Failed, sUpsBatch.u32Dropped);
+}
+
 /****************************************************************************
  *
  * NAME: Arduino_Loop
@@ -267,6 +496,19 @@ OS_TASK(Arduino_Loop)
     */
     if(E_MODE_MCU == g_sDevice.eMode)
     {
+        /* first loop after a wake up */
+        if (bUpsTiming)
+        {
+            tsUpsWakeStats *psStats = bUpsWarm ? &sUpsWarm : &sUpsCold;
+            uint32 u32Us = u32HAL_GetUsTime() - u32UpsWakeUs;
+
+            bUpsTiming = FALSE;
+            psStats->u32Wakes++;
+            psStats->u32SumUs += u32Us;
+            if (u32Us > psStats->u32MaxUs) psStats->u32MaxUs = u32Us;
+            DBG_vPrintf(TRACE_UPS, "UPS: loop %d us after wake up\r\n", u32Us);
+        }
+
         /* Back-Ground to search AT delimiter */
         uint8 tmp[AUPS_UART_RB_LEN];
         uint32 avlb_cnt = suli_uart_readable(NULL, NULL);
@@ -309,6 +551,25 @@ OS_TASK(Arduino_Loop)
     }
 }
 
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+PRIVATE uint8 UPS_u8BatchSize(void)
+{
+    if (0 == g_sDevice.config.upsBatchSize) return AUPS_BATCH_DEF_SIZE;
+    return (uint8)MIN(g_sDevice.config.upsBatchSize, AUPS_BATCH_MAX_SIZE);
+}
+
+/* oldest sample reaches the age limit within u32AheadMs */
+PRIVATE bool UPS_bBatchOld(uint32 u32AheadMs)
+{
+    uint32 u32MaxS = (0 == g_sDevice.config.upsBatchAgeS) ? AUPS_BATCH_DEF_AGE_S : g_sDevice.config.upsBatchAgeS;
+
+    if (0 == u8UpsBatchCnt) return FALSE;
+    return SLP_u32UpTimeMs() + u32AheadMs - au32UpsBatchMs[0] >= u32MaxS * 1000;
+}
+
 /****************************************************************************/
 /***        END OF FILE                                                   ***/
 /****************************************************************************/
@@ -29,6 +29,7 @@
 #include "firmware_uart.h"
 #include "firmware_ringbuffer.h"
 #include "firmware_api_pack.h"
+#include "firmware_lzss.h"
 #include "common.h"
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
@@ -40,11 +41,14 @@
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
+PRIVATE void CMI_vUnzipDataPacket(tsApiSpec *apiSpec);
+PRIVATE void CMI_vBatchToUart(tsApiSpec *apiSpec);
 
 /****************************************************************************/
 /***        External Function Prototypes                                     ***/
 /****************************************************************************/
 extern uint32 SPM_u32PushData(void *data, int len);
+extern uint8 calCheckSum(uint8 *in, int len);
 
 /****************************************************************************/
 /***        Exported Variables                                            ***/
@@ -53,6 +57,80 @@ extern uint32 SPM_u32PushData(void *data, int len);
 /****************************************************************************/
 /***        Local Functions                                               ***/
 /****************************************************************************/
+/****************************************************************************
+ *
+ * NAME: CMI_vUnzipDataPacket
+ *
+ * DESCRIPTION:
+ * Decompress a data frame with OPTION_ZIP_MASK, DATA mode gets the raw
+ * bytes, API and MCU mode get plain data frames of API_DATA_LEN at most,
+ * so the host never sees the compressed form.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void CMI_vUnzipDataPacket(tsApiSpec *apiSpec)
+{
+    uint8 raw[LZS_MAX_RAW];
+    tsApiSpec plainSpec;
+    int rawLen, pos, chunk;
+
+    rawLen = LZS_i32Decompress(apiSpec->payload.txDataPacket.data,
+                               MIN(apiSpec->payload.txDataPacket.dataLen, API_DATA_LEN),
+                               raw, LZS_MAX_RAW);
+    if (rawLen < 0)
+    {
+        DBG_vPrintf(TRACE_CMI, "CMI: bad zip frame, dropped\r\n");
+        return;
+    }
+
+    if (E_MODE_DATA == g_sDevice.eMode)
+    {
+        uart_tx_data(raw, rawLen);
+        return;
+    }
+
+    for (pos = 0; pos < rawLen; pos += chunk)
+    {
+        chunk = MIN(rawLen - pos, API_DATA_LEN);
+        plainSpec = *apiSpec;
+        plainSpec.payload.txDataPacket.option &= ~OPTION_ZIP_MASK;
+        plainSpec.payload.txDataPacket.dataLen = chunk;
+        memcpy(plainSpec.payload.txDataPacket.data, raw + pos, chunk);
+        plainSpec.length = sizeof(tsTxDataPacket) - API_DATA_LEN + chunk;
+        plainSpec.checkSum = calCheckSum((uint8 *)&plainSpec.payload, plainSpec.length);
+        CMI_vAirDataDistributor(&plainSpec);
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: CMI_vBatchToUart
+ *
+ * DESCRIPTION:
+ * DATA mode gets the bytes of the samples in a batch frame, one after the
+ * other, like the data frames they replace
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void CMI_vBatchToUart(tsApiSpec *apiSpec)
+{
+    tsSampleBatch *psBatch = &apiSpec->payload.sampleBatch;
+    int end = MIN(apiSpec->length - 3, API_BATCH_LEN);
+    int pos = 0;
+    uint8 i;
+
+    for (i = 0; i < psBatch->count && pos + 3 <= end; i++)
+    {
+        uint8 len = psBatch->data[pos + 2];
+        if (pos + 3 + len > end) break;
+        uart_tx_data(&psBatch->data[pos + 3], len);
+        pos += 3 + len;
+    }
+}
 
 
 /****************************************************************************
@@ -212,6 +290,13 @@ void CMI_vAirDataDistributor(tsApiSpec *apiSpec)
 
     uint32 len = 0;
 
+    if (API_DATA_PACKET == apiSpec->teApiIdentifier &&
+        (apiSpec->payload.txDataPacket.option & OPTION_ZIP_MASK))
+    {
+        CMI_vUnzipDataPacket(apiSpec);
+        return;
+    }
+
     switch(g_sDevice.eMode)
     {
         /* AT mode */
@@ -247,6 +332,11 @@ void CMI_vAirDataDistributor(tsApiSpec *apiSpec)
         /* DATA mode */
         case E_MODE_DATA:
         {
+            if (API_SAMPLE_BATCH == apiSpec->teApiIdentifier)
+            {
+                CMI_vBatchToUart(apiSpec);
+                break;
+            }
             /* Mechanism: wait until ringbuffer has enough space */
             uart_tx_data(apiSpec->payload.txDataPacket.data, apiSpec->payload.txDataPacket.dataLen);
             break;
@@ -0,0 +1,389 @@
+/*
+ * firmware_energy.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_energy.h"
+#include "firmware_at_api.h"
+#include "firmware_sleep.h"
+#include "firmware_uart.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_ENG
+#define TRACE_ENG  FALSE
+#endif
+
+/* configured current, 0 picks the default */
+#define ENG_CURRENT(cfg, def)   ((0 != g_sDevice.config.cfg) ? g_sDevice.config.cfg : (def))
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/*
+  Awake time comes from the u32HAL_GetMsTime() time base, which stands
+  still while the node sleeps. Sleep time is what Sleep() programmed in the
+  wake timer. Both are kept in seconds, the ms time base wraps after 49.7
+  days: ENG_vTick takes the whole seconds out of it on each sleep and from
+  the radio recalibration task every 2 minutes. Radio spans are timed in
+  us: a poll from PollTask to its confirm counts as receiving, a frame from
+  the stack taking it to its APS confirm as sending. The charge estimate
+  weighs those times with the current table and can be recomputed after
+  the table is changed.
+*/
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE uint32 ENG_u32Span(uint32 u32StartUs);
+PRIVATE void ENG_vCloseTx(void);
+PRIVATE void ENG_vClosePoll(void);
+PRIVATE uint64 ENG_u64AwakeMs(void);
+PRIVATE uint64 ENG_u64ChargePc(uint64 u64AwakeMs, uint64 u64SleepMs);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+PRIVATE tsEngStats sEngStats;
+
+PRIVATE uint8  u8EngTxBusy = 0;         //frames handed to the stack, not confirmed
+PRIVATE uint32 u32EngTxStartUs = 0;
+PRIVATE bool   bEngPolling = FALSE;     //poll sent, no confirm yet
+PRIVATE uint32 u32EngPollStartUs = 0;
+PRIVATE bool   bEngAsleep = FALSE;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: ENG_vPreSleep
+ *
+ * DESCRIPTION:
+ * Power manager is about to sleep, close the radio spans still open
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vPreSleep(void)
+{
+    ENG_vCloseTx();
+    ENG_vClosePoll();
+
+    /* count the awake time up to here, the tick timer stops */
+    ENG_vTick();
+    sEngStats.u32Sleeps++;
+    bEngAsleep = TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vWakeup
+ *
+ * DESCRIPTION:
+ * Power manager woke the node up, count the sleep
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vWakeup(void)
+{
+    if (!bEngAsleep) return;
+
+    uint32 u32Ms = sEngStats.u16SleepMs + SLP_u32SleepMs();
+
+    bEngAsleep = FALSE;
+    sEngStats.u32Wakes++;
+    sEngStats.u32SleepSec += u32Ms / 1000;
+    sEngStats.u16SleepMs = (uint16)(u32Ms % 1000);
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vTxStart
+ *
+ * DESCRIPTION:
+ * The stack took a frame to send
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vTxStart(void)
+{
+    sEngStats.u32TxFrames++;
+
+    /* frames sent back to back make one span */
+    if (u8EngTxBusy > 0 && ENG_u32Span(u32EngTxStartUs) >= ENG_MAX_SPAN_US) ENG_vCloseTx();
+    if (0 == u8EngTxBusy) u32EngTxStartUs = u32HAL_GetUsTime();
+    if (u8EngTxBusy < 0xff) u8EngTxBusy++;
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vTxDone
+ *
+ * DESCRIPTION:
+ * The stack confirmed a frame
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vTxDone(void)
+{
+    if (0 == u8EngTxBusy) return;
+    if (1 == u8EngTxBusy)
+    {
+        ENG_vCloseTx();
+        return;
+    }
+    u8EngTxBusy--;
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vPollStart
+ *
+ * DESCRIPTION:
+ * PollTask sent a poll to the parent, the receiver stays on until the
+ * confirm
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vPollStart(void)
+{
+    ENG_vClosePoll();
+    sEngStats.u32Polls++;
+    u32EngPollStartUs = u32HAL_GetUsTime();
+    bEngPolling = TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vPollDone
+ *
+ * DESCRIPTION:
+ * The poll was confirmed, with or without data
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vPollDone(void)
+{
+    ENG_vClosePoll();
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vUartRx
+ *
+ * DESCRIPTION:
+ * Bytes received on the UART, called by the UART ISR
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32Bytes     R   bytes read from the FIFO
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vUartRx(uint32 u32Bytes)
+{
+    sEngStats.u32UartRx++;
+    sEngStats.u32UartBytes += u32Bytes;
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vTick
+ *
+ * DESCRIPTION:
+ * Move the whole seconds of awake time out of the ms time base, call it
+ * from task context well within 49.7 days
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vTick(void)
+{
+    uint32 u32Sec = (u32HAL_GetMsTime() - sEngStats.u32AwakeMarkMs) / 1000;
+
+    sEngStats.u32AwakeSec += u32Sec;
+    sEngStats.u32AwakeMarkMs += u32Sec * 1000;
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vReset
+ *
+ * DESCRIPTION:
+ * Count from zero
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vReset(void)
+{
+    memset(&sEngStats, 0, sizeof(tsEngStats));
+    sEngStats.u32AwakeMarkMs = u32HAL_GetMsTime();
+    u8EngTxBusy = 0;
+    bEngPolling = FALSE;
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vAssembleResp
+ *
+ * DESCRIPTION:
+ * Assemble an API_ENERGY_RESP of the local node
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psApiSpec    W   frame to fill
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vAssembleResp(tsApiSpec *psApiSpec)
+{
+    tsEnergyResp resp;
+    uint64 u64AwakeMs = ENG_u64AwakeMs();
+    uint64 u64SleepMs = (uint64)sEngStats.u32SleepSec * 1000 + sEngStats.u16SleepMs;
+    uint64 u64TotalMs = u64AwakeMs + u64SleepMs;
+    uint64 u64ChargePc = ENG_u64ChargePc(u64AwakeMs, u64SleepMs);
+
+    memset(&resp, 0, sizeof(tsEnergyResp));
+    resp.shortAddr = ZPS_u16AplZdoGetNwkAddr();
+    resp.awakeSec = (uint32)(u64AwakeMs / 1000);
+    resp.sleepSec = sEngStats.u32SleepSec;
+    resp.rxMs = (uint32)(sEngStats.u64RxUs / 1000);
+    resp.txMs = (uint32)(sEngStats.u64TxUs / 1000);
+    resp.sleeps = sEngStats.u32Sleeps;
+    resp.polls = sEngStats.u32Polls;
+    resp.txFrames = sEngStats.u32TxFrames;
+    resp.uartBytes = sEngStats.u32UartBytes;
+    resp.chargeUah = (uint32)(u64ChargePc / 3600000000ULL);
+    resp.avgNa = (u64TotalMs > 0) ? (uint32)(u64ChargePc / u64TotalMs) : 0;
+
+    assembleApiSpec(psApiSpec, API_ENERGY_RESP, (uint8 *)&resp, sizeof(tsEnergyResp));
+}
+
+/****************************************************************************
+ *
+ * NAME: ENG_vPrintStatus
+ *
+ * DESCRIPTION:
+ * Print the time spent in each state and the charge it took
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ENG_vPrintStatus(void)
+{
+    uint64 u64AwakeMs = ENG_u64AwakeMs();
+    uint64 u64SleepMs = (uint64)sEngStats.u32SleepSec * 1000 + sEngStats.u16SleepMs;
+    uint64 u64TotalMs = u64AwakeMs + u64SleepMs;
+    uint64 u64ChargePc = ENG_u64ChargePc(u64AwakeMs, u64SleepMs);
+    uint32 u32AvgNa = (u64TotalMs > 0) ? (uint32)(u64ChargePc / u64TotalMs) : 0;
+    uint32 u32ChargeNah = (uint32)((u64ChargePc / 3600000) % 1000000);
+
+    uart_printf("Awake/Asleep     : %d s / %d s, %d sleeps, %d wakes \r\n",
+                (uint32)(u64AwakeMs / 1000), sEngStats.u32SleepSec, sEngStats.u32Sleeps, sEngStats.u32Wakes);
+    uart_printf("Radio            : rx %d ms in %d polls, tx %d ms for %d frames \r\n",
+                (uint32)(sEngStats.u64RxUs / 1000), sEngStats.u32Polls,
+                (uint32)(sEngStats.u64TxUs / 1000), sEngStats.u32TxFrames);
+    uart_printf("UART             : %d bytes received in %d interrupts \r\n",
+                sEngStats.u32UartBytes, sEngStats.u32UartRx);
+    uart_printf("Current Table    : asleep %d nA, awake %d uA, rx %d uA, tx %d uA \r\n",
+                ENG_CURRENT(engSleepNa, ENG_DEF_SLEEP_NA), ENG_CURRENT(engAwakeUa, ENG_DEF_AWAKE_UA),
+                ENG_CURRENT(engRxUa, ENG_DEF_RX_UA), ENG_CURRENT(engTxUa, ENG_DEF_TX_UA));
+    uart_printf("Charge           : %d.%06d mAh, average %d.%03d uA, %d days per 1000 mAh \r\n",
+                (uint32)(u64ChargePc / 3600000000000ULL), u32ChargeNah, u32AvgNa / 1000, u32AvgNa % 1000,
+                (u32AvgNa > 0) ? (uint32)(1000000000ULL / u32AvgNa / 24) : 0);
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* a span whose end went missing counts ENG_MAX_SPAN_US */
+PRIVATE uint32 ENG_u32Span(uint32 u32StartUs)
+{
+    uint32 u32Us = u32HAL_GetUsTime() - u32StartUs;
+    return (u32Us > ENG_MAX_SPAN_US) ? ENG_MAX_SPAN_US : u32Us;
+}
+
+PRIVATE void ENG_vCloseTx(void)
+{
+    if (0 == u8EngTxBusy) return;
+    sEngStats.u64TxUs += ENG_u32Span(u32EngTxStartUs);
+    u8EngTxBusy = 0;
+}
+
+PRIVATE void ENG_vClosePoll(void)
+{
+    if (!bEngPolling) return;
+    sEngStats.u64RxUs += ENG_u32Span(u32EngPollStartUs);
+    bEngPolling = FALSE;
+}
+
+/* awake time since the reset, the part below a second is still in the ms time base */
+PRIVATE uint64 ENG_u64AwakeMs(void)
+{
+    ENG_vTick();
+    return (uint64)sEngStats.u32AwakeSec * 1000 + (u32HAL_GetMsTime() - sEngStats.u32AwakeMarkMs);
+}
+
+/* pC(nA*ms, uA*us) since the reset, the radio spans are part of the awake time */
+PRIVATE uint64 ENG_u64ChargePc(uint64 u64AwakeMs, uint64 u64SleepMs)
+{
+    uint64 u64RadioUs = sEngStats.u64RxUs + sEngStats.u64TxUs;
+    uint64 u64IdleUs = u64AwakeMs * 1000;
+
+    u64IdleUs = (u64IdleUs > u64RadioUs) ? u64IdleUs - u64RadioUs : 0;
+    DBG_vPrintf(TRACE_ENG, "ENG: idle %d ms, radio %d ms \r\n", (uint32)(u64IdleUs / 1000), (uint32)(u64RadioUs / 1000));
+
+    return (uint64)ENG_CURRENT(engSleepNa, ENG_DEF_SLEEP_NA) * u64SleepMs
+         + (uint64)ENG_CURRENT(engAwakeUa, ENG_DEF_AWAKE_UA) * u64IdleUs
+         + (uint64)ENG_CURRENT(engRxUa, ENG_DEF_RX_UA) * sEngStats.u64RxUs
+         + (uint64)ENG_CURRENT(engTxUa, ENG_DEF_TX_UA) * sEngStats.u64TxUs;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
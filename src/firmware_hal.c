@@ -59,6 +59,9 @@
 /****************************************************************************/
 /***        Local Variables                                               ***/
 /****************************************************************************/
+PRIVATE uint32 u32LastTick = 0;        //last tick timer reading
+PRIVATE uint32 u32TickResidue = 0;     //ticks not yet accounted as a full ms
+PRIVATE uint32 u32MsTime = 0;          //ms time base
 
 
 /****************************************************************************/
@@ -290,3 +293,72 @@ PUBLIC uint16 random()
 
 	return u16AHI_ReadRandomNumber();
 }
+
+/****************************************************************************
+ *
+ * NAME: u32HAL_GetMsTime
+ *
+ * DESCRIPTION:
+ * Millisecond time base derived from the 16MHz tick timer which drives the OS.
+ * suli_millis() can't be used here because timer0 only runs in MCU mode.
+ * Call it from task context, at least once per tick timer period.
+ *
+ * PARAMETERS:  void
+ *
+ * RETURNS:
+ * uint32: ms elapsed since power up
+ *
+ ****************************************************************************/
+PUBLIC uint32 u32HAL_GetMsTime(void)
+{
+    uint32 u32Now = u32AHI_TickTimerRead();
+
+    /* unsigned difference, right across a wrap of the counter */
+    u32TickResidue += u32Now - u32LastTick;
+    u32LastTick = u32Now;
+
+    u32MsTime += u32TickResidue / 16000;
+    u32TickResidue %= 16000;
+    return u32MsTime;
+}
+
+/****************************************************************************
+ *
+ * NAME: vHAL_TickSleep
+ *
+ * DESCRIPTION:
+ * The tick timer stops for a sleep and restarts from zero at wake up, take
+ * the ticks up to now and count the ones after wake up from zero.
+ * Call it just before sleeping.
+ *
+ * PARAMETERS:  void
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void vHAL_TickSleep(void)
+{
+    u32HAL_GetMsTime();
+    u32LastTick = 0;
+}
+
+/****************************************************************************
+ *
+ * NAME: u32HAL_GetUsTime
+ *
+ * DESCRIPTION:
+ * Microsecond reading of the u32HAL_GetMsTime() time base, wraps every
+ * 71 minutes, only differences of two readings are meaningful
+ *
+ * PARAMETERS:  void
+ *
+ * RETURNS:
+ * uint32: us elapsed since power up
+ *
+ ****************************************************************************/
+PUBLIC uint32 u32HAL_GetUsTime(void)
+{
+    uint32 u32Ms = u32HAL_GetMsTime();
+    return u32Ms * 1000 + u32TickResidue / 16;
+}
@@ -0,0 +1,207 @@
+/*
+ * firmware_lzss.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include "firmware_lzss.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define LZS_LITERAL_BITS      9
+#define LZS_BACKREF_BITS      (1 + LZS_INDEX_BITS + LZS_COUNT_BITS)
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+typedef struct
+{
+    uint8 *pu8Buf;
+    int    i32Bits;     //size in bits
+    int    i32Pos;      //next bit
+}tsLzsBits;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE void LZS_vPutBits(tsLzsBits *psBits, uint16 u16Value, int n);
+PRIVATE uint16 LZS_u16GetBits(tsLzsBits *psBits, int n);
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: LZS_i32Compress
+ *
+ * DESCRIPTION:
+ * Compress as much of the input as fits into the output buffer.
+ * Greedy longest match over the last LZS_WINDOW bytes.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             pu8In        R   raw data
+ *             inLen        R   raw length
+ *             pu8Out       W   compressed data
+ *             outMax       R   size of output buffer
+ *             piConsumed   W   raw bytes covered by the output
+ *
+ * RETURNS:
+ * compressed length in bytes
+ *
+ ****************************************************************************/
+PUBLIC int LZS_i32Compress(const uint8 *pu8In, int inLen, uint8 *pu8Out, int outMax, int *piConsumed)
+{
+    tsLzsBits sBits;
+    int pos = 0;
+
+    sBits.pu8Buf  = pu8Out;
+    sBits.i32Bits = outMax * 8;
+    sBits.i32Pos  = 0;
+
+    while (pos < inLen)
+    {
+        int bestLen = 0, bestDist = 0;
+        int maxLen = inLen - pos;
+        int start = (pos > LZS_WINDOW) ? pos - LZS_WINDOW : 0;
+        int i;
+
+        if (maxLen > LZS_MAX_MATCH) maxLen = LZS_MAX_MATCH;
+
+        /* the nearest of the longest matches, a match may run into itself */
+        for (i = pos - 1; i >= start && bestLen < maxLen; i--)
+        {
+            int len = 0;
+            while (len < maxLen && pu8In[i + len] == pu8In[pos + len]) len++;
+            if (len > bestLen)
+            {
+                bestLen  = len;
+                bestDist = pos - i;
+            }
+        }
+
+        if (bestLen >= LZS_MIN_MATCH)
+        {
+            if (sBits.i32Pos + LZS_BACKREF_BITS > sBits.i32Bits) break;
+            LZS_vPutBits(&sBits, 0, 1);
+            LZS_vPutBits(&sBits, bestDist - 1, LZS_INDEX_BITS);
+            LZS_vPutBits(&sBits, bestLen - LZS_MIN_MATCH, LZS_COUNT_BITS);
+            pos += bestLen;
+        } else
+        {
+            if (sBits.i32Pos + LZS_LITERAL_BITS > sBits.i32Bits) break;
+            LZS_vPutBits(&sBits, 0x100 | pu8In[pos], LZS_LITERAL_BITS);
+            pos++;
+        }
+    }
+
+    *piConsumed = pos;
+    return (sBits.i32Pos + 7) / 8;
+}
+
+/****************************************************************************
+ *
+ * NAME: LZS_i32Decompress
+ *
+ * DESCRIPTION:
+ * Expand data made by LZS_i32Compress
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             pu8In        R   compressed data
+ *             inLen        R   compressed length
+ *             pu8Out       W   raw data
+ *             outMax       R   size of output buffer
+ *
+ * RETURNS:
+ * raw length, -1 if the input is corrupted or too big
+ *
+ ****************************************************************************/
+PUBLIC int LZS_i32Decompress(const uint8 *pu8In, int inLen, uint8 *pu8Out, int outMax)
+{
+    tsLzsBits sBits;
+    int out = 0;
+
+    sBits.pu8Buf  = (uint8 *)pu8In;
+    sBits.i32Bits = inLen * 8;
+    sBits.i32Pos  = 0;
+
+    /* less than a literal left is padding */
+    while (sBits.i32Bits - sBits.i32Pos >= LZS_LITERAL_BITS)
+    {
+        if (LZS_u16GetBits(&sBits, 1))
+        {
+            if (out >= outMax) return -1;
+            pu8Out[out++] = (uint8)LZS_u16GetBits(&sBits, 8);
+        } else
+        {
+            int dist, len;
+
+            if (sBits.i32Bits - sBits.i32Pos < LZS_BACKREF_BITS - 1) return -1;
+            dist = LZS_u16GetBits(&sBits, LZS_INDEX_BITS) + 1;
+            len  = LZS_u16GetBits(&sBits, LZS_COUNT_BITS) + LZS_MIN_MATCH;
+            if (dist > out || out + len > outMax) return -1;
+            while (len--)
+            {
+                pu8Out[out] = pu8Out[out - dist];
+                out++;
+            }
+        }
+    }
+    return out;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+PRIVATE void LZS_vPutBits(tsLzsBits *psBits, uint16 u16Value, int n)
+{
+    while (n--)
+    {
+        uint8 u8Mask = 0x80 >> (psBits->i32Pos & 7);
+        uint8 *pu8Byte = &psBits->pu8Buf[psBits->i32Pos >> 3];
+
+        if (0 == (psBits->i32Pos & 7)) *pu8Byte = 0;
+        if (u16Value & (1 << n)) *pu8Byte |= u8Mask;
+        psBits->i32Pos++;
+    }
+}
+
+PRIVATE uint16 LZS_u16GetBits(tsLzsBits *psBits, int n)
+{
+    uint16 u16Value = 0;
+
+    while (n--)
+    {
+        uint8 u8Mask = 0x80 >> (psBits->i32Pos & 7);
+
+        u16Value <<= 1;
+        if (psBits->pu8Buf[psBits->i32Pos >> 3] & u8Mask) u16Value |= 1;
+        psBits->i32Pos++;
+    }
+    return u16Value;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
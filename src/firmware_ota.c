@@ -24,6 +24,9 @@
 
 #include "common.h"
 #include "firmware_ota.h"
+#include "firmware_hal.h"
+#include "firmware_ota_delta.h"
+#include "firmware_ota_pack.h"
 
 
 #ifndef TRACE_OTA
@@ -31,9 +34,76 @@
 #endif
 
 
+tsOtaEraseStats g_sOtaEraseStats;
+tsOtaCacheStats g_sOtaCacheStats;
+
+#if defined(OTA_SERVER) || defined(OTA_PEER)
+/* a line of the read cache, u32Addr is a multiple of OTA_CACHE_LINE_SIZE */
+typedef struct
+{
+    bool   bValid;
+    uint32 u32Addr;
+    uint32 u32LastUse;
+    uint8  au8Data[OTA_CACHE_LINE_SIZE];
+} tsOtaCacheLine;
+
+PRIVATE tsOtaCacheLine asOtaCache[OTA_CACHE_LINES];
+PRIVATE uint32 u32OtaCacheClock = 0;
+PRIVATE bool   bOtaCacheLent = FALSE;      //the lines hold chunks of a host stream
+
+PRIVATE tsOtaCacheLine *APP_psOtaCacheLine(uint32 u32Addr);
+PRIVATE tsOtaCacheLine *APP_psOtaCacheVictim(tsOtaCacheLine *psKeep);
+#endif
+
 uint8 magicNum[OTA_MAGIC_NUM_LEN] = { 0x12, 0x34, 0x56, 0x78, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 }; // TODO fill the magic value
 
-static unsigned int crc_table[256];
+/* crc32 table of the polynomial 0xedb88320, constant so it lives in flash */
+static const uint32 crc_table[256] =
+{
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+};
 
 /****************************************************************************
  *
@@ -56,6 +126,155 @@ PUBLIC void APP_vOtaFlashLockRead(uint32 offsetByte, uint16 len, uint8 *dest)
     OS_eExitCriticalSection(hSpiMutex);
 }
 
+/****************************************************************************
+ *
+ * NAME: APP_vOtaFlashCachedRead
+ *
+ * DESCRIPTION:
+ * Read the external flash through a RAM cache of whole flash pages. The
+ * server reads the same blocks for every client, and a client asks for the
+ * blocks of a page one after the other, so most reads don't touch the SPI
+ * bus. A missed page is read together with the one behind it, under the
+ * same lock of the SPI bus, as images are read forward. The server and
+ * routers serving as peers keep the cache, end devices read directly, and
+ * so does the server while the cache RAM is lent to a host stream.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             offsetByte   R   flash address
+ *             len          R   bytes to read
+ *             dest         W   buffer
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void APP_vOtaFlashCachedRead(uint32 offsetByte, uint16 len, uint8 *dest)
+{
+#if defined(OTA_SERVER) || defined(OTA_PEER)
+    bool bHit = TRUE;
+
+    if (bOtaCacheLent)
+    {
+        APP_vOtaFlashLockRead(offsetByte, len, dest);
+        return;
+    }
+
+    while (len > 0)
+    {
+        uint32 u32Addr = offsetByte & ~(uint32)(OTA_CACHE_LINE_SIZE - 1);
+        uint16 u16Skip = (uint16)(offsetByte - u32Addr);
+        uint16 u16Len  = (len > OTA_CACHE_LINE_SIZE - u16Skip) ? (OTA_CACHE_LINE_SIZE - u16Skip) : len;
+        tsOtaCacheLine *psLine = APP_psOtaCacheLine(u32Addr);
+
+        if (NULL == psLine)
+        {
+            tsOtaCacheLine *psNext = NULL;
+            bHit = FALSE;
+            psLine = APP_psOtaCacheVictim(NULL);
+
+            /* read ahead the next page if it isn't cached */
+            uint32 u32NextAddr = u32Addr + OTA_CACHE_LINE_SIZE;
+            if (u32NextAddr < OTA_SECTOR_CNT * OTA_SECTOR_SIZE && NULL == APP_psOtaCacheLine(u32NextAddr))
+            {
+                psNext = APP_psOtaCacheVictim(psLine);
+            }
+
+            OS_eEnterCriticalSection(hSpiMutex);
+            bAHI_FullFlashRead(u32Addr, OTA_CACHE_LINE_SIZE, psLine->au8Data);
+            if (NULL != psNext) bAHI_FullFlashRead(u32NextAddr, OTA_CACHE_LINE_SIZE, psNext->au8Data);
+            OS_eExitCriticalSection(hSpiMutex);
+
+            psLine->bValid = TRUE;
+            psLine->u32Addr = u32Addr;
+            g_sOtaCacheStats.u32Fills++;
+            if (NULL != psNext)
+            {
+                psNext->bValid = TRUE;
+                psNext->u32Addr = u32NextAddr;
+                psNext->u32LastUse = ++u32OtaCacheClock;
+                g_sOtaCacheStats.u32Fills++;
+                g_sOtaCacheStats.u32ReadAheads++;
+            }
+        }
+
+        psLine->u32LastUse = ++u32OtaCacheClock;
+        memcpy(dest, &psLine->au8Data[u16Skip], u16Len);
+        dest += u16Len;
+        offsetByte += u16Len;
+        len -= u16Len;
+    }
+
+    g_sOtaCacheStats.u32Reads++;
+    if (bHit) g_sOtaCacheStats.u32Hits++;
+#else
+    APP_vOtaFlashLockRead(offsetByte, len, dest);
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: APP_vOtaFlashCacheFlush
+ *
+ * DESCRIPTION:
+ * Forget the cached pages, the flash is written or a new image is loaded
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void APP_vOtaFlashCacheFlush(void)
+{
+#if defined(OTA_SERVER) || defined(OTA_PEER)
+    uint8 i;
+    for (i = 0; i < OTA_CACHE_LINES; i++) asOtaCache[i].bValid = FALSE;
+#endif
+}
+
+#ifdef OTA_SERVER
+/****************************************************************************
+ *
+ * NAME: APP_pu8OtaCacheLend
+ *
+ * DESCRIPTION:
+ * The host stream and reads of the image in flash never run together, the
+ * stream keeps its chunks in the RAM of the cache. The cache is off until
+ * APP_vOtaCacheReclaim.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8Line       R   line, below OTA_CACHE_LINES
+ *
+ * RETURNS:
+ * OTA_CACHE_LINE_SIZE bytes of RAM
+ *
+ ****************************************************************************/
+PUBLIC uint8 *APP_pu8OtaCacheLend(uint8 u8Line)
+{
+    if (!bOtaCacheLent)
+    {
+        APP_vOtaFlashCacheFlush();
+        bOtaCacheLent = TRUE;
+    }
+    return asOtaCache[u8Line].au8Data;
+}
+
+/****************************************************************************
+ *
+ * NAME: APP_vOtaCacheReclaim
+ *
+ * DESCRIPTION:
+ * The host stream is over, the cache is on again, empty
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void APP_vOtaCacheReclaim(void)
+{
+    APP_vOtaFlashCacheFlush();
+    bOtaCacheLent = FALSE;
+}
+#endif
+
 /****************************************************************************
  *
  * NAME: function below
@@ -72,6 +291,7 @@ PUBLIC void APP_vOtaFlashLockRead(uint32 offsetByte, uint16 len, uint8 *dest)
  ****************************************************************************/
 PUBLIC void APP_vOtaFlashLockWrite(uint32 offsetByte, uint16 len, uint8 *buff)
 {
+    APP_vOtaFlashCacheFlush();
     OS_eEnterCriticalSection(hSpiMutex);
     bAHI_FullFlashProgram(offsetByte, len, buff);
     OS_eExitCriticalSection(hSpiMutex);
@@ -93,9 +313,19 @@ PUBLIC void APP_vOtaFlashLockWrite(uint32 offsetByte, uint16 len, uint8 *buff)
  ****************************************************************************/
 PUBLIC void APP_vOtaFlashLockErase(uint8 sector)
 {
+    uint32 u32StartMs = u32HAL_GetMsTime();
+
+    APP_vOtaFlashCacheFlush();
     OS_eEnterCriticalSection(hSpiMutex);
     bAHI_FlashEraseSector(sector);
     OS_eExitCriticalSection(hSpiMutex);
+
+    /* a sector erase blocks for hundreds of ms, keep an eye on it */
+    uint32 u32Ms = u32HAL_GetMsTime() - u32StartMs;
+    g_sOtaEraseStats.u32Erases++;
+    g_sOtaEraseStats.u32TotalMs += u32Ms;
+    if (u32Ms > g_sOtaEraseStats.u32MaxMs) g_sOtaEraseStats.u32MaxMs = u32Ms;
+    DBG_vPrintf(TRACE_OTA, "OTA: erase sector %d in %dms \r\n", sector, u32Ms);
 }
 
 /****************************************************************************
@@ -154,35 +384,74 @@ PUBLIC void APP_vOtaKillInternalReboot()
 
 /****************************************************************************
  *
- * NAME: function below
+ * NAME: APP_u8OtaClientBlockSize
  *
  * DESCRIPTION:
- *
+ * Block size the client asks for, out of the largest size offered by the
+ * server. A block which straddles a flash page costs a second page program,
+ * so the largest size dividing the page is taken unless it's smaller than
+ * the default block.
  *
  * PARAMETERS: Name         RW  Usage
- *
+ *             u8Offer      R   maximal block size of the server
  *
  * RETURNS:
- * void
+ * block size
  *
  ****************************************************************************/
-PUBLIC void init_crc_table(void)
+PUBLIC uint8 APP_u8OtaClientBlockSize(uint8 u8Offer)
 {
-    unsigned int c;
-    unsigned int i, j;
+    uint8 u8Size;
+
+    if (u8Offer > OTA_MAX_BLOCK_SIZE) u8Offer = OTA_MAX_BLOCK_SIZE;
+    if (u8Offer <= OTA_BLOCK_SIZE) return OTA_BLOCK_SIZE;
 
-    for (i = 0; i < 256; i++)
+    for (u8Size = u8Offer; u8Size > OTA_BLOCK_SIZE; u8Size--)
     {
-        c = (unsigned int)i;
-        for (j = 0; j < 8; j++)
-        {
-            if (c & 1)  c = 0xedb88320L ^ (c >> 1);
-            else  c = c >> 1;
-        }
-        crc_table[i] = c;
+        if (OTA_FLASH_PAGE_SIZE % u8Size == 0) return u8Size;
     }
+    return u8Offer;
 }
 
+/****************************************************************************
+ *
+ * NAME: APP_u32OtaBlocks
+ *
+ * DESCRIPTION:
+ * how many blocks of an OTA image
+ *
+ * PARAMETERS: Name          RW  Usage
+ *             u32TotalBytes R   image length
+ *             u16BlockSize  R   block size
+ *
+ * RETURNS:
+ * block count
+ *
+ ****************************************************************************/
+PUBLIC uint32 APP_u32OtaBlocks(uint32 u32TotalBytes, uint16 u16BlockSize)
+{
+    return (u32TotalBytes + u16BlockSize - 1) / u16BlockSize;
+}
+
+/****************************************************************************
+ *
+ * NAME: APP_u16OtaBlockCrc
+ *
+ * DESCRIPTION:
+ * checksum of a single block on the air, the low half of its crc32
+ *
+ * PARAMETERS: Name          RW  Usage
+ *             pu8Block      R   block data
+ *             len           R   block length
+ *
+ * RETURNS:
+ * block checksum
+ *
+ ****************************************************************************/
+PUBLIC uint16 APP_u16OtaBlockCrc(uint8 *pu8Block, uint16 len)
+{
+    return (uint16)crc32(0xffffffff, pu8Block, len);
+}
 
 /****************************************************************************
  *
@@ -229,8 +498,6 @@ PUBLIC uint32 imageCrc(uint32 imageLen)
     uint8 buff[128];
     uint32 crc = 0xffffffff;
 
-    init_crc_table();
-
     for (i = 0; i < imageLen; i += 128)
     {
         rdLen = (imageLen - i) >= 128 ? 128 : ((imageLen - i));
@@ -240,6 +507,128 @@ PUBLIC uint32 imageCrc(uint32 imageLen)
     return crc;
 }
 
+/****************************************************************************
+ *
+ * NAME: APP_u32OtaPatchBytes
+ *
+ * DESCRIPTION:
+ * Look for a delta patch at OTA_DELTA_OFFSET which builds the given image
+ *
+ * PARAMETERS: Name            RW  Usage
+ *             u32ImageLen     R   length of the new image
+ *             u32ImageCrc     R   its crc
+ *             pu16BaseVersion W   version the patch applies to, may be NULL
+ *             pu32BaseCrc     W   crc of that image, may be NULL
+ *
+ * RETURNS:
+ * patch length, 0 if there's no patch for this image
+ *
+ ****************************************************************************/
+PUBLIC uint32 APP_u32OtaPatchBytes(uint32 u32ImageLen, uint32 u32ImageCrc, uint16 *pu16BaseVersion, uint32 *pu32BaseCrc)
+{
+    uint8 au8Hdr[ODT_HEADER_LEN];
+    tsOdtHeader sHdr;
+
+    APP_vOtaFlashLockRead(OTA_DELTA_OFFSET, ODT_HEADER_LEN, au8Hdr);
+    if (!ODT_bParseHeader(au8Hdr, &sHdr)) return 0;
+
+    /* a stale patch of an older release is left alone */
+    if (sHdr.u32NewLen != u32ImageLen || sHdr.u32NewCrc != u32ImageCrc) return 0;
+    if (sHdr.u32PatchLen > OTA_PACKED_OFFSET - OTA_DELTA_OFFSET) return 0;
+
+    if (NULL != pu16BaseVersion) *pu16BaseVersion = sHdr.u16BaseVersion;
+    if (NULL != pu32BaseCrc) *pu32BaseCrc = sHdr.u32BaseCrc;
+    return sHdr.u32PatchLen;
+}
+
+/****************************************************************************
+ *
+ * NAME: APP_u32OtaPackedBytes
+ *
+ * DESCRIPTION:
+ * Look for the compressed copy of the given image at OTA_PACKED_OFFSET
+ *
+ * PARAMETERS: Name            RW  Usage
+ *             u32ImageLen     R   length of the image
+ *             u32ImageCrc     R   its crc
+ *
+ * RETURNS:
+ * compressed length, 0 if there's none for this image
+ *
+ ****************************************************************************/
+PUBLIC uint32 APP_u32OtaPackedBytes(uint32 u32ImageLen, uint32 u32ImageCrc)
+{
+    uint8 au8Hdr[OPK_HEADER_LEN];
+    tsOpkHeader sHdr;
+
+    APP_vOtaFlashLockRead(OTA_PACKED_OFFSET, OPK_HEADER_LEN, au8Hdr);
+    if (!OPK_bParseHeader(au8Hdr, &sHdr)) return 0;
+
+    if (sHdr.u32ImageLen != u32ImageLen || sHdr.u32ImageCrc != u32ImageCrc) return 0;
+    if (sHdr.u32PackedLen > OTA_SECTOR_CNT * OTA_SECTOR_SIZE - OTA_PACKED_OFFSET) return 0;
+    return sHdr.u32PackedLen;
+}
+
+/****************************************************************************
+ *
+ * NAME: APP_u32OtaRunningCrc
+ *
+ * DESCRIPTION:
+ * crc of the image in internal flash, computed once, a node takes a delta
+ * patch only if it runs the patch's base image
+ *
+ * RETURNS:
+ * crc, 0 if the image length makes no sense
+ *
+ ****************************************************************************/
+PUBLIC uint32 APP_u32OtaRunningCrc(void)
+{
+    static bool bDone = FALSE;
+    static uint32 u32Crc = 0;
+
+    if (!bDone)
+    {
+        uint32 u32Len;
+        memcpy(&u32Len, (uint8 *)(OTA_INTERNAL_FLASH_ADDR + OTA_IMAGE_LEN_OFFSET), 4);
+        if (u32Len > 0 && u32Len <= 256 * 1024)
+        {
+            u32Crc = crc32(0xffffffff, (uint8 *)OTA_INTERNAL_FLASH_ADDR, u32Len);
+        }
+        bDone = TRUE;
+    }
+    return u32Crc;
+}
+
+#if defined(OTA_SERVER) || defined(OTA_PEER)
+/* cached line of a flash page, NULL if it isn't cached */
+PRIVATE tsOtaCacheLine *APP_psOtaCacheLine(uint32 u32Addr)
+{
+    uint8 i;
+    for (i = 0; i < OTA_CACHE_LINES; i++)
+    {
+        if (asOtaCache[i].bValid && asOtaCache[i].u32Addr == u32Addr) return &asOtaCache[i];
+    }
+    return NULL;
+}
+
+/* a free or the least recently used line, other than psKeep */
+PRIVATE tsOtaCacheLine *APP_psOtaCacheVictim(tsOtaCacheLine *psKeep)
+{
+    tsOtaCacheLine *psVictim = NULL;
+    uint8 i;
+
+    for (i = 0; i < OTA_CACHE_LINES; i++)
+    {
+        tsOtaCacheLine *psLine = &asOtaCache[i];
+        if (psLine == psKeep) continue;
+        if (!psLine->bValid) return psLine;
+        if (NULL == psVictim || psLine->u32LastUse < psVictim->u32LastUse) psVictim = psLine;
+    }
+    psVictim->bValid = FALSE;
+    return psVictim;
+}
+#endif
+
 /****************************************************************************/
 /***        END OF FILE                                                   ***/
 /****************************************************************************/
@@ -0,0 +1,275 @@
+/*
+ * firmware_ota_delta.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "firmware_ota_delta.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define ODT_MAGIC             "MBDP"
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE uint32 ODT_u32Get(uint8 *pu8);
+PRIVATE void ODT_vPut(uint8 *pu8, uint32 u32Value);
+PRIVATE bool ODT_bGetByte(tsOtaDelta *psDelta, uint8 *pu8Byte);
+PRIVATE bool ODT_bGetVarint(tsOtaDelta *psDelta, uint32 *pu32Value);
+PRIVATE bool ODT_bFlush(tsOtaDelta *psDelta);
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: ODT_bParseHeader
+ *
+ * DESCRIPTION:
+ * Parse the header of a patch
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             pu8Hdr       R   ODT_HEADER_LEN bytes
+ *             psHdr        W   header
+ *
+ * RETURNS:
+ * TRUE if it's a patch header
+ *
+ ****************************************************************************/
+PUBLIC bool ODT_bParseHeader(uint8 *pu8Hdr, tsOdtHeader *psHdr)
+{
+    if (0 != memcmp(pu8Hdr, ODT_MAGIC, 4)) return FALSE;
+
+    psHdr->u16BaseVersion = (uint16)(pu8Hdr[4] | (pu8Hdr[5] << 8));
+    psHdr->u32BaseLen  = ODT_u32Get(&pu8Hdr[8]);
+    psHdr->u32BaseCrc  = ODT_u32Get(&pu8Hdr[12]);
+    psHdr->u32NewLen   = ODT_u32Get(&pu8Hdr[16]);
+    psHdr->u32NewCrc   = ODT_u32Get(&pu8Hdr[20]);
+    psHdr->u32PatchLen = ODT_u32Get(&pu8Hdr[24]);
+    return psHdr->u32PatchLen > ODT_HEADER_LEN;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODT_vWriteHeader
+ *
+ * DESCRIPTION:
+ * Lay out the header of a patch
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psHdr        R   header
+ *             pu8Hdr       W   ODT_HEADER_LEN bytes
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ODT_vWriteHeader(tsOdtHeader *psHdr, uint8 *pu8Hdr)
+{
+    memset(pu8Hdr, 0, ODT_HEADER_LEN);
+    memcpy(pu8Hdr, ODT_MAGIC, 4);
+    pu8Hdr[4] = (uint8)psHdr->u16BaseVersion;
+    pu8Hdr[5] = (uint8)(psHdr->u16BaseVersion >> 8);
+    ODT_vPut(&pu8Hdr[8],  psHdr->u32BaseLen);
+    ODT_vPut(&pu8Hdr[12], psHdr->u32BaseCrc);
+    ODT_vPut(&pu8Hdr[16], psHdr->u32NewLen);
+    ODT_vPut(&pu8Hdr[20], psHdr->u32NewCrc);
+    ODT_vPut(&pu8Hdr[24], psHdr->u32PatchLen);
+}
+
+/****************************************************************************
+ *
+ * NAME: ODT_bInit
+ *
+ * DESCRIPTION:
+ * Start applying a patch, reads its header
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDelta      W   patch being applied
+ *             pfReadBase   R   reads the base image
+ *             pfReadPatch  R   reads the patch
+ *             pfWrite      R   writes the new image in order
+ *
+ * RETURNS:
+ * TRUE if the patch has a valid header
+ *
+ ****************************************************************************/
+PUBLIC bool ODT_bInit(tsOtaDelta *psDelta, ODT_tpfRead pfReadBase, ODT_tpfRead pfReadPatch, ODT_tpfWrite pfWrite)
+{
+    uint8 au8Hdr[ODT_HEADER_LEN];
+
+    memset(psDelta, 0, sizeof(tsOtaDelta));
+    psDelta->pfReadBase  = pfReadBase;
+    psDelta->pfReadPatch = pfReadPatch;
+    psDelta->pfWrite     = pfWrite;
+
+    pfReadPatch(0, ODT_HEADER_LEN, au8Hdr);
+    psDelta->u32PatchPos = ODT_HEADER_LEN;
+    return ODT_bParseHeader(au8Hdr, &psDelta->sHdr);
+}
+
+/****************************************************************************
+ *
+ * NAME: ODT_eStep
+ *
+ * DESCRIPTION:
+ * Produce up to u32MaxBytes of the new image, so a big patch is applied
+ * over several calls. Every op is checked against the base and new image
+ * lengths, a broken patch ends in E_ODT_ERROR and never writes out of the
+ * new image.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDelta      RW  patch being applied
+ *             u32MaxBytes  R   output bytes of this call
+ *
+ * RETURNS:
+ * E_ODT_MORE, E_ODT_DONE when the whole new image is written, E_ODT_ERROR
+ *
+ ****************************************************************************/
+PUBLIC teOdtStatus ODT_eStep(tsOtaDelta *psDelta, uint32 u32MaxBytes)
+{
+    uint32 i;
+
+    while (u32MaxBytes > 0)
+    {
+        if (0 == psDelta->u32OpLeft)
+        {
+            uint8 u8Op;
+            uint32 u32Len;
+
+            if (!ODT_bGetByte(psDelta, &u8Op)) return E_ODT_ERROR;
+            if (ODT_OP_END == u8Op)
+            {
+                if (!ODT_bFlush(psDelta)) return E_ODT_ERROR;
+                return (psDelta->u32OutPos == psDelta->sHdr.u32NewLen) ? E_ODT_DONE : E_ODT_ERROR;
+            }
+
+            if (!ODT_bGetVarint(psDelta, &u32Len) || 0 == u32Len) return E_ODT_ERROR;
+            if (u32Len > psDelta->sHdr.u32NewLen - psDelta->u32OutPos - psDelta->u8OutLen) return E_ODT_ERROR;
+
+            if (ODT_OP_COPY == u8Op)
+            {
+                uint32 u32Move;
+                if (!ODT_bGetVarint(psDelta, &u32Move)) return E_ODT_ERROR;
+
+                /* zigzag coded, small moves either way take one byte */
+                int32 i32Pos = (int32)psDelta->u32BasePos + ((u32Move & 1) ? -(int32)(u32Move >> 1) : (int32)(u32Move >> 1));
+                if (i32Pos < 0 || (uint32)i32Pos > psDelta->sHdr.u32BaseLen) return E_ODT_ERROR;
+                if (u32Len > psDelta->sHdr.u32BaseLen - (uint32)i32Pos) return E_ODT_ERROR;
+                psDelta->u32BasePos = (uint32)i32Pos;
+            }
+            else if (ODT_OP_ADD != u8Op)
+            {
+                return E_ODT_ERROR;
+            }
+            psDelta->u8Op = u8Op;
+            psDelta->u32OpLeft = u32Len;
+        }
+
+        uint32 u32Chunk = ODT_BUF_LEN - psDelta->u8OutLen;
+        if (u32Chunk > psDelta->u32OpLeft) u32Chunk = psDelta->u32OpLeft;
+        if (u32Chunk > u32MaxBytes) u32Chunk = u32MaxBytes;
+
+        if (ODT_OP_COPY == psDelta->u8Op)
+        {
+            psDelta->pfReadBase(psDelta->u32BasePos, (uint16)u32Chunk, &psDelta->au8Out[psDelta->u8OutLen]);
+            psDelta->u32BasePos += u32Chunk;
+        }
+        else
+        {
+            for (i = 0; i < u32Chunk; i++)
+            {
+                if (!ODT_bGetByte(psDelta, &psDelta->au8Out[psDelta->u8OutLen + i])) return E_ODT_ERROR;
+            }
+        }
+        psDelta->u8OutLen  += (uint8)u32Chunk;
+        psDelta->u32OpLeft -= u32Chunk;
+        u32MaxBytes        -= u32Chunk;
+
+        if (ODT_BUF_LEN == psDelta->u8OutLen && !ODT_bFlush(psDelta)) return E_ODT_ERROR;
+    }
+    return E_ODT_MORE;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+PRIVATE uint32 ODT_u32Get(uint8 *pu8)
+{
+    return (uint32)pu8[0] | ((uint32)pu8[1] << 8) | ((uint32)pu8[2] << 16) | ((uint32)pu8[3] << 24);
+}
+
+PRIVATE void ODT_vPut(uint8 *pu8, uint32 u32Value)
+{
+    pu8[0] = (uint8)u32Value;
+    pu8[1] = (uint8)(u32Value >> 8);
+    pu8[2] = (uint8)(u32Value >> 16);
+    pu8[3] = (uint8)(u32Value >> 24);
+}
+
+/* next patch byte, the patch is read ODT_BUF_LEN bytes at a time */
+PRIVATE bool ODT_bGetByte(tsOtaDelta *psDelta, uint8 *pu8Byte)
+{
+    if (psDelta->u8InPos >= psDelta->u8InLen)
+    {
+        uint32 u32Left = psDelta->sHdr.u32PatchLen - psDelta->u32PatchPos;
+        if (0 == u32Left) return FALSE;
+        if (u32Left > ODT_BUF_LEN) u32Left = ODT_BUF_LEN;
+
+        psDelta->pfReadPatch(psDelta->u32PatchPos, (uint16)u32Left, psDelta->au8In);
+        psDelta->u32PatchPos += u32Left;
+        psDelta->u8InLen = (uint8)u32Left;
+        psDelta->u8InPos = 0;
+    }
+    *pu8Byte = psDelta->au8In[psDelta->u8InPos++];
+    return TRUE;
+}
+
+/* 7 bits per byte, low bits first, top bit set: more bytes follow */
+PRIVATE bool ODT_bGetVarint(tsOtaDelta *psDelta, uint32 *pu32Value)
+{
+    uint8 u8Byte, u8Shift;
+
+    *pu32Value = 0;
+    for (u8Shift = 0; u8Shift < 32; u8Shift += 7)
+    {
+        if (!ODT_bGetByte(psDelta, &u8Byte)) return FALSE;
+        *pu32Value |= (uint32)(u8Byte & 0x7f) << u8Shift;
+        if (0 == (u8Byte & 0x80)) return TRUE;
+    }
+    return FALSE;
+}
+
+PRIVATE bool ODT_bFlush(tsOtaDelta *psDelta)
+{
+    if (0 == psDelta->u8OutLen) return TRUE;
+    if (!psDelta->pfWrite(psDelta->u32OutPos, psDelta->u8OutLen, psDelta->au8Out)) return FALSE;
+    psDelta->u32OutPos += psDelta->u8OutLen;
+    psDelta->u8OutLen = 0;
+    return TRUE;
+}
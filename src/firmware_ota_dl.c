@@ -0,0 +1,430 @@
+/*
+ * firmware_ota_dl.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "firmware_ota_dl.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define ODL_IS_RX(psDl, idx)   ((psDl)->au8Bitmap[(idx) >> 3] & (1 << ((idx) & 7)))
+#define ODL_SET_RX(psDl, idx)  ((psDl)->au8Bitmap[(idx) >> 3] |= (1 << ((idx) & 7)))
+#define ODL_CLR_RX(psDl, idx)  ((psDl)->au8Bitmap[(idx) >> 3] &= ~(1 << ((idx) & 7)))
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE void ODL_vTxRequest(tsOtaDownload *psDl, tsOdlSlot *psSlot, uint32 u32NowMs);
+PRIVATE uint32 ODL_u32SlotRto(tsOtaDownload *psDl, tsOdlSlot *psSlot);
+PRIVATE bool ODL_bInFlight(tsOtaDownload *psDl, uint32 u32BlockIdx);
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: ODL_vInit
+ *
+ * DESCRIPTION:
+ * Init a download. Blocks below u32DoneBlocks are already in flash(resumed
+ * download) and won't be requested again. The window opens from 1 request
+ * and grows with every response, so a slow route isn't flooded at start.
+ *
+ * PARAMETERS: Name           RW  Usage
+ *             psDl           W   download
+ *             u32TotalBlocks R   blocks of the image
+ *             u32DoneBlocks  R   blocks already received in order
+ *             u8Window       R   requests in flight, 1~ODL_MAX_WINDOW
+ *             u32InitRtoMs   R   request timeout until rtt is measured
+ *             pfRequest      R   sends a block request
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ODL_vInit(tsOtaDownload *psDl, uint32 u32TotalBlocks, uint32 u32DoneBlocks,
+                      uint8 u8Window, uint32 u32InitRtoMs, ODL_tpfRequest pfRequest)
+{
+    memset(psDl, 0, sizeof(tsOtaDownload));
+    if (u32TotalBlocks > ODL_MAX_BLOCKS) u32TotalBlocks = ODL_MAX_BLOCKS;
+    if (u32DoneBlocks > u32TotalBlocks) u32DoneBlocks = u32TotalBlocks;
+    if (u8Window < 1) u8Window = 1;
+    if (u8Window > ODL_MAX_WINDOW) u8Window = ODL_MAX_WINDOW;
+
+    psDl->u32TotalBlocks = u32TotalBlocks;
+    psDl->u8Window   = u8Window;
+    psDl->u8Cwnd     = 1;
+    psDl->u8Ssthresh = u8Window;
+    RTT_vInit(&psDl->sRtt, u32InitRtoMs, ODL_MIN_RTO_MS, ODL_MAX_RTO_MS);
+    psDl->pfRequest  = pfRequest;
+
+    memset(psDl->au8Bitmap, 0xff, u32DoneBlocks >> 3);
+    for (psDl->u32RxBlocks = u32DoneBlocks & ~7; psDl->u32RxBlocks < u32DoneBlocks; psDl->u32RxBlocks++)
+    {
+        ODL_SET_RX(psDl, psDl->u32RxBlocks);
+    }
+    psDl->u32FirstHole = u32DoneBlocks;
+    psDl->u32NextNew   = u32DoneBlocks;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_bRxBlock
+ *
+ * DESCRIPTION:
+ * A block response arrived. Frees its request, samples rtt if the request
+ * was sent only once(Karn) and opens the window: by one per response below
+ * the slow start threshold, by one per window of responses above it.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDl         RW  download
+ *             u32BlockIdx  R   block of the response
+ *             u32NowMs     R   current time
+ *
+ * RETURNS:
+ * TRUE if the block is new and has to be written to flash
+ *
+ ****************************************************************************/
+PUBLIC bool ODL_bRxBlock(tsOtaDownload *psDl, uint32 u32BlockIdx, uint32 u32NowMs)
+{
+    uint8 i;
+
+    if (u32BlockIdx >= psDl->u32TotalBlocks) return FALSE;
+
+    for (i = 0; i < ODL_MAX_WINDOW; i++)
+    {
+        tsOdlSlot *psSlot = &psDl->asSlot[i];
+        if (!psSlot->bUsed || psSlot->u32BlockIdx != u32BlockIdx) continue;
+
+        if (1 == psSlot->u8Tries) RTT_vSample(&psDl->sRtt, u32NowMs - psSlot->u32SentMs);
+        psSlot->bUsed = FALSE;
+        psDl->u8InFlight--;
+
+        if (psDl->u8Cwnd < psDl->u8Ssthresh)
+        {
+            psDl->u8Cwnd++;
+        }
+        else if (++psDl->u8AckCnt >= psDl->u8Cwnd)
+        {
+            psDl->u8AckCnt = 0;
+            if (psDl->u8Cwnd < psDl->u8Window) psDl->u8Cwnd++;
+        }
+        break;
+    }
+
+    if (ODL_IS_RX(psDl, u32BlockIdx))
+    {
+        psDl->sStats.u32RxDuplicates++;
+        return FALSE;
+    }
+
+    ODL_SET_RX(psDl, u32BlockIdx);
+    psDl->u32RxBlocks++;
+    psDl->sStats.u32RxBlocks++;
+    if (u32BlockIdx != psDl->u32FirstHole) psDl->sStats.u32RxOutOfOrder++;
+
+    while (psDl->u32FirstHole < psDl->u32TotalBlocks && ODL_IS_RX(psDl, psDl->u32FirstHole))
+    {
+        psDl->u32FirstHole++;
+    }
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_u32Poll
+ *
+ * DESCRIPTION:
+ * Resend requests whose timer expired and fill the window with requests of
+ * new blocks. A timeout halves the window(at most once per rtt) and doubles
+ * the timer of that request, so the request rate follows the latency and
+ * loss of the route instead of a fixed period.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDl         RW  download
+ *             u32NowMs     R   current time
+ *
+ * RETURNS:
+ * ms until the next request timer expires, 0 if nothing is in flight
+ *
+ ****************************************************************************/
+PUBLIC uint32 ODL_u32Poll(tsOtaDownload *psDl, uint32 u32NowMs)
+{
+    uint32 u32Next = 0;
+    uint8 i;
+
+    for (i = 0; i < ODL_MAX_WINDOW; i++)
+    {
+        tsOdlSlot *psSlot = &psDl->asSlot[i];
+        if (!psSlot->bUsed) continue;
+        if (u32NowMs - psSlot->u32SentMs < ODL_u32SlotRto(psDl, psSlot)) continue;
+
+        psDl->sStats.u32Timeouts++;
+        if (0 == psDl->u32LastCutMs || u32NowMs - psDl->u32LastCutMs >= psDl->sRtt.u32SrttMs)
+        {
+            psDl->u8Ssthresh = (psDl->u8Cwnd > 1) ? (psDl->u8Cwnd / 2) : 1;
+            psDl->u8Cwnd = psDl->u8Ssthresh;
+            psDl->u8AckCnt = 0;
+            psDl->u32LastCutMs = u32NowMs ? u32NowMs : 1;
+        }
+        ODL_vTxRequest(psDl, psSlot, u32NowMs);
+    }
+
+    for (i = 0; i < ODL_MAX_WINDOW && psDl->u8InFlight < psDl->u8Cwnd; i++)
+    {
+        tsOdlSlot *psSlot = &psDl->asSlot[i];
+        if (psSlot->bUsed) continue;
+
+        /* blocks may have arrived unrequested, dropped blocks may still be in flight */
+        while (psDl->u32NextNew < psDl->u32TotalBlocks &&
+               (ODL_IS_RX(psDl, psDl->u32NextNew) || ODL_bInFlight(psDl, psDl->u32NextNew)))
+        {
+            psDl->u32NextNew++;
+        }
+        if (psDl->u32NextNew >= psDl->u32TotalBlocks) break;
+
+        psSlot->bUsed = TRUE;
+        psSlot->u8Tries = 0;
+        psSlot->u32BlockIdx = psDl->u32NextNew++;
+        psDl->u8InFlight++;
+        ODL_vTxRequest(psDl, psSlot, u32NowMs);
+    }
+
+    for (i = 0; i < ODL_MAX_WINDOW; i++)
+    {
+        tsOdlSlot *psSlot = &psDl->asSlot[i];
+        if (!psSlot->bUsed) continue;
+
+        uint32 u32Left = ODL_u32SlotRto(psDl, psSlot) - (u32NowMs - psSlot->u32SentMs);
+        if (0 == u32Next || u32Left < u32Next) u32Next = u32Left;
+    }
+    return u32Next;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_bDone
+ *
+ * DESCRIPTION:
+ * All blocks of the image have been received
+ *
+ ****************************************************************************/
+PUBLIC bool ODL_bDone(tsOtaDownload *psDl)
+{
+    return psDl->u32RxBlocks >= psDl->u32TotalBlocks;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_u32EtaMs
+ *
+ * DESCRIPTION:
+ * Time left of the download at the current window and rtt
+ *
+ ****************************************************************************/
+PUBLIC uint32 ODL_u32EtaMs(tsOtaDownload *psDl)
+{
+    uint32 u32Rtt = psDl->sRtt.u32SrttMs ? psDl->sRtt.u32SrttMs : psDl->sRtt.u32RtoMs;
+    return (psDl->u32TotalBlocks - psDl->u32RxBlocks) * u32Rtt / psDl->u8Cwnd;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_u16Gaps
+ *
+ * DESCRIPTION:
+ * Bitmap of the blocks still missing from u32Base on, for a NACK
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDl         R   download
+ *             u32Base      R   first block of the bitmap
+ *             pu8Gaps      W   bit i set: u32Base + i is missing
+ *             u16Bits      R   bits of pu8Gaps
+ *
+ * RETURNS:
+ * number of missing blocks in the bitmap
+ *
+ ****************************************************************************/
+PUBLIC uint16 ODL_u16Gaps(tsOtaDownload *psDl, uint32 u32Base, uint8 *pu8Gaps, uint16 u16Bits)
+{
+    uint16 i, u16Gaps = 0;
+
+    memset(pu8Gaps, 0, (u16Bits + 7) / 8);
+    for (i = 0; i < u16Bits && u32Base + i < psDl->u32TotalBlocks; i++)
+    {
+        if (!ODL_IS_RX(psDl, u32Base + i))
+        {
+            pu8Gaps[i >> 3] |= (1 << (i & 7));
+            u16Gaps++;
+        }
+    }
+    return u16Gaps;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_u8GetRuns
+ *
+ * DESCRIPTION:
+ * Received blocks as a list of ranges, to be persisted. A download keeps
+ * few ranges as the window only reaches a little beyond the first hole,
+ * ranges beyond u8MaxRuns are left out and fetched again after a reboot.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDl         R   download
+ *             psRuns       W   ranges
+ *             u8MaxRuns    R   room of psRuns
+ *
+ * RETURNS:
+ * number of ranges
+ *
+ ****************************************************************************/
+PUBLIC uint8 ODL_u8GetRuns(tsOtaDownload *psDl, tsOdlRun *psRuns, uint8 u8MaxRuns)
+{
+    uint32 u32Idx = 0;
+    uint8 u8Runs = 0;
+
+    while (u8Runs < u8MaxRuns)
+    {
+        while (u32Idx < psDl->u32TotalBlocks && !ODL_IS_RX(psDl, u32Idx)) u32Idx++;
+        if (u32Idx >= psDl->u32TotalBlocks) break;
+
+        psRuns[u8Runs].u16Start = (uint16)u32Idx;
+        while (u32Idx < psDl->u32TotalBlocks && ODL_IS_RX(psDl, u32Idx)) u32Idx++;
+        psRuns[u8Runs].u16Len = (uint16)(u32Idx - psRuns[u8Runs].u16Start);
+        u8Runs++;
+    }
+    return u8Runs;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_vSetRuns
+ *
+ * DESCRIPTION:
+ * Mark persisted ranges as received, right after ODL_vInit of a resumed
+ * download
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDl         RW  download
+ *             psRuns       R   ranges
+ *             u8Runs       R   number of ranges
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ODL_vSetRuns(tsOtaDownload *psDl, const tsOdlRun *psRuns, uint8 u8Runs)
+{
+    uint32 u32Idx;
+    uint8 i;
+
+    for (i = 0; i < u8Runs; i++)
+    {
+        for (u32Idx = psRuns[i].u16Start;
+             u32Idx < (uint32)psRuns[i].u16Start + psRuns[i].u16Len && u32Idx < psDl->u32TotalBlocks;
+             u32Idx++)
+        {
+            if (ODL_IS_RX(psDl, u32Idx)) continue;
+            ODL_SET_RX(psDl, u32Idx);
+            psDl->u32RxBlocks++;
+        }
+    }
+
+    while (psDl->u32FirstHole < psDl->u32TotalBlocks && ODL_IS_RX(psDl, psDl->u32FirstHole))
+    {
+        psDl->u32FirstHole++;
+    }
+    psDl->u32NextNew = psDl->u32FirstHole;
+}
+
+/****************************************************************************
+ *
+ * NAME: ODL_vDropBlocks
+ *
+ * DESCRIPTION:
+ * Blocks failed to verify or were erased with their sector, they are
+ * requested again
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psDl         RW  download
+ *             u32First     R   first block
+ *             u32Count     R   number of blocks
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void ODL_vDropBlocks(tsOtaDownload *psDl, uint32 u32First, uint32 u32Count)
+{
+    uint32 u32Idx;
+
+    if (0 == u32Count || u32First >= psDl->u32TotalBlocks) return;
+    for (u32Idx = u32First; u32Idx < u32First + u32Count && u32Idx < psDl->u32TotalBlocks; u32Idx++)
+    {
+        if (!ODL_IS_RX(psDl, u32Idx)) continue;
+        ODL_CLR_RX(psDl, u32Idx);
+        psDl->u32RxBlocks--;
+        psDl->sStats.u32Dropped++;
+    }
+    if (u32First < psDl->u32FirstHole) psDl->u32FirstHole = u32First;
+    if (u32First < psDl->u32NextNew) psDl->u32NextNew = u32First;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* a request of the block is in flight */
+PRIVATE bool ODL_bInFlight(tsOtaDownload *psDl, uint32 u32BlockIdx)
+{
+    uint8 i;
+    for (i = 0; i < ODL_MAX_WINDOW; i++)
+    {
+        if (psDl->asSlot[i].bUsed && psDl->asSlot[i].u32BlockIdx == u32BlockIdx) return TRUE;
+    }
+    return FALSE;
+}
+
+/* (re)send the request of a slot, if it fails the request timer tries again */
+PRIVATE void ODL_vTxRequest(tsOtaDownload *psDl, tsOdlSlot *psSlot, uint32 u32NowMs)
+{
+    if (psSlot->u8Tries < 0xff) psSlot->u8Tries++;
+    psSlot->u32SentMs = u32NowMs;
+    psDl->sStats.u32Requests++;
+    psDl->pfRequest(psSlot->u32BlockIdx);
+}
+
+/* timer of a request, doubled for each resend */
+PRIVATE uint32 ODL_u32SlotRto(tsOtaDownload *psDl, tsOdlSlot *psSlot)
+{
+    return RTT_u32Backoff(&psDl->sRtt, (psSlot->u8Tries > 1) ? (psSlot->u8Tries - 1) : 0);
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,775 @@
+/*
+ * firmware_ota_host.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_ota.h"
+#include "firmware_ota_host.h"
+#include "firmware_ota_peer.h"
+#include "firmware_ota_mc.h"
+#include "firmware_at_api.h"
+#include "firmware_cmi.h"
+#include "firmware_uart.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_OHS
+#define TRACE_OHS  FALSE
+#endif
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/*
+  Host streams the image over UART while clients download it. The server
+  keeps a few chunks of it in RAM and pulls the ones clients ask for, plus
+  a few behind them, with API_OTA_HOST_REQ. The chunks live in the RAM of
+  the flash read cache, nothing is read from flash while host streams. It never asks for more than it
+  has room for, that's the flow control toward host. A block request which
+  can't be answered yet waits in the pending table and is answered when
+  its chunks come in.
+  With cache on, every chunk is copied into external flash as well, the
+  first one last, so a partial copy is never taken for an image. A sector
+  is erased just before the first chunk is written into it. Once the
+  copy is complete APP_taskOtaSrv checks its crc a step at a time, clients
+  are still served from RAM meanwhile. If it is right the stream ends and
+  clients are served from flash as usual.
+  Host parses frames only, so it learns about the stream from the status
+  of API_OTA_HOST_REQ, nothing is printed.
+*/
+typedef enum
+{
+    E_OHS_EMPTY,
+    E_OHS_WANTED,             //asked from host
+    E_OHS_VALID
+}teOhsChunkState;
+
+typedef struct
+{
+    uint8  eState;
+    uint16 u16Chunk;          //offset / OTA_HOST_CHUNK_SIZE
+    uint32 u32Stamp;          //wanted: when asked, valid: last use
+    uint8  *pu8Data;          //in a line lent by the read cache
+}tsOhsChunk;
+
+/* block request of a client waiting for host */
+typedef struct
+{
+    bool   bUsed;
+    uint8  u8Image;
+    uint8  u8BlockSize;
+    uint16 u16Addr;
+    uint32 u32BlockIdx;
+    uint32 u32Stamp;
+}tsOhsPending;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+PRIVATE bool OHS_bCopy(uint16 u16Chunk, uint16 u16Pos, uint16 u16Len, uint8 *pu8Dest);
+PRIVATE bool OHS_bHave(uint32 u32Offset, uint16 u16Len);
+PRIVATE tsOhsChunk *OHS_psChunk(uint16 u16Chunk);
+PRIVATE tsOhsChunk *OHS_psVictim(uint16 u16Keep, uint16 u16KeepLast);
+PRIVATE void OHS_vFetch(uint16 u16First, uint16 u16Last);
+PRIVATE void OHS_vAsk(uint16 u16First, uint16 u16Cnt);
+PRIVATE void OHS_vReply(uint32 u32Offset, uint16 u16Len, uint8 u8Status);
+PRIVATE void OHS_vCache(uint16 u16Chunk, uint8 *pu8Data, uint16 u16Len);
+PRIVATE void OHS_vCacheWrite(uint16 u16Chunk, uint8 *pu8Data, uint16 u16Len);
+PRIVATE void OHS_vCheckDone(void);
+PRIVATE void OHS_vServePending(void);
+PRIVATE uint16 OHS_u16ChunkLen(uint16 u16Chunk);
+#endif
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+PRIVATE bool   bOhsActive = FALSE;
+PRIVATE bool   bOhsCache = FALSE;
+PRIVATE uint32 u32OhsBytes = 0;
+PRIVATE uint16 u16OhsChunks = 0;
+PRIVATE uint32 u32OhsClock = 0;            //LRU clock of the RAM chunks
+PRIVATE uint32 u32OhsStartMs = 0;
+
+/* the first chunk holds the image header, it stays in RAM until the copy in flash is complete */
+PRIVATE bool   bOhsHead = FALSE;
+PRIVATE uint8  au8OhsHead[OTA_HOST_CHUNK_SIZE];
+
+PRIVATE tsOhsChunk asOhsChunk[OHS_BUF_CHUNKS];
+PRIVATE tsOhsPending asOhsPending[OHS_MAX_PENDING];
+
+/* chunks already copied into flash */
+PRIVATE uint8  au8OhsInFlash[OHS_IMAGE_CHUNKS / 8];
+PRIVATE uint16 u16OhsInFlash = 0;
+PRIVATE uint8  u8OhsErased = 0;            //bit i: sector i has been erased for the copy
+
+/* crc check of the complete copy */
+PRIVATE bool   bOhsChecking = FALSE;
+PRIVATE uint32 u32OhsCheckPos = 0;
+PRIVATE uint32 u32OhsCheckCrc = 0;
+
+PRIVATE tsOhsStats sOhsStats;
+#endif
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+
+/****************************************************************************
+ *
+ * NAME: OHS_bStart
+ *
+ * DESCRIPTION:
+ * Host starts streaming an image, it is announced like an image in flash
+ * with ATOT/ATOF/ATOM. The first chunks are asked for right away.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32Bytes     R   image length, 0 stops the stream
+ *             u32Crc       R   image crc
+ *             bCache       R   copy the image into external flash too
+ *
+ * RETURNS:
+ * TRUE if accepted
+ *
+ ****************************************************************************/
+PUBLIC bool OHS_bStart(uint32 u32Bytes, uint32 u32Crc, bool bCache)
+{
+    uint8 au8Zero[OTA_MAGIC_NUM_LEN];
+    uint8 i;
+
+    if (0 == u32Bytes)
+    {
+        OHS_vStop();
+        return TRUE;
+    }
+    if (!g_sDevice.supportOTA || u32Bytes > OTA_DELTA_OFFSET)
+    {
+        DBG_vPrintf(TRACE_OHS, "OHS: invalid image length %ld \r\n", u32Bytes);
+        OHS_vReply(0, 0, OTA_HOST_REFUSED);
+        return FALSE;
+    }
+
+    memset(asOhsChunk, 0, sizeof(asOhsChunk));
+    for (i = 0; i < OHS_BUF_CHUNKS; i++)
+    {
+        asOhsChunk[i].pu8Data = APP_pu8OtaCacheLend(i / OHS_LINE_CHUNKS) + (i % OHS_LINE_CHUNKS) * OTA_HOST_CHUNK_SIZE;
+    }
+    memset(asOhsPending, 0, sizeof(asOhsPending));
+    memset(au8OhsInFlash, 0, sizeof(au8OhsInFlash));
+    memset(&sOhsStats, 0, sizeof(sOhsStats));
+    u16OhsInFlash = 0;
+    u8OhsErased = 0;
+    bOhsChecking = FALSE;
+    bOhsHead = FALSE;
+    bOhsCache = bCache;
+    u32OhsBytes = u32Bytes;
+    u16OhsChunks = (uint16)((u32Bytes + OTA_HOST_CHUNK_SIZE - 1) / OTA_HOST_CHUNK_SIZE);
+
+    /*
+      The image in flash is overwritten, its sectors are erased one by one as
+      the copy reaches them. Until then the old magic is cleared, programming
+      only clears bits, so a half overwritten image is never taken as valid.
+    */
+    if (bCache)
+    {
+        memset(au8Zero, 0, sizeof(au8Zero));
+        APP_vOtaFlashLockWrite(OTA_MAGIC_OFFSET, OTA_MAGIC_NUM_LEN, au8Zero);
+    }
+    APP_vOtaFlashCacheFlush();
+
+    /* served like an image in flash, there's no patch or compressed image of it */
+    g_sDevice.otaTotalBytes = u32Bytes;
+    g_sDevice.otaCrc = u32Crc;
+    g_sDevice.otaTotalBlocks = APP_u32OtaBlocks(u32Bytes, OTA_BLOCK_SIZE);
+    g_sDevice.otaPatchBytes = 0;
+    g_sDevice.otaPackedBytes = 0;
+
+    bOhsActive = TRUE;
+    u32OhsStartMs = u32HAL_GetMsTime();
+    DBG_vPrintf(TRACE_OHS, "OHS: streaming %ld bytes, crc 0x%08lx, cache %d \r\n", u32Bytes, u32Crc, bCache);
+
+    OHS_vFetch(0, OHS_READ_AHEAD);
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: OHS_vStop
+ *
+ * DESCRIPTION:
+ * Host stops the stream, clients can't get the rest of the image, a
+ * multicast session of it is aborted
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OHS_vStop(void)
+{
+    if (!bOhsActive) return;
+
+    bOhsActive = FALSE;
+    bOhsChecking = FALSE;
+    APP_vOtaCacheReclaim();
+    g_sDevice.otaTotalBytes = 0;
+    g_sDevice.otaTotalBlocks = 0;
+    OMC_vAbort();
+    DBG_vPrintf(TRACE_OHS, "OHS: stream stopped \r\n");
+}
+
+/****************************************************************************
+ *
+ * NAME: OHS_bActive
+ *
+ * DESCRIPTION:
+ * Is the image served streamed by host
+ *
+ * RETURNS:
+ * TRUE while streaming
+ *
+ ****************************************************************************/
+PUBLIC bool OHS_bActive(void)
+{
+    return bOhsActive;
+}
+
+/****************************************************************************
+ *
+ * NAME: OHS_vData
+ *
+ * DESCRIPTION:
+ * A chunk of the image from host, block requests waiting for it are
+ * answered
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32Offset    R   image offset of the chunk
+ *             pu8Data      R   chunk
+ *             u16Len       R   its length
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OHS_vData(uint32 u32Offset, uint8 *pu8Data, uint16 u16Len)
+{
+    if (!bOhsActive) return;
+
+    uint16 u16Chunk = (uint16)(u32Offset / OTA_HOST_CHUNK_SIZE);
+    if (0 != u32Offset % OTA_HOST_CHUNK_SIZE || u32Offset >= u32OhsBytes ||
+        u16Len != OHS_u16ChunkLen(u16Chunk))
+    {
+        sOhsStats.u32Dropped++;
+        return;
+    }
+
+    if (0 == u16Chunk)
+    {
+        /* the header must be the one of an image of the length host announced */
+        uint32 u32Len = 0;
+        memcpy(&u32Len, &pu8Data[OTA_IMAGE_LEN_OFFSET], 4);
+        if (memcmp(magicNum, &pu8Data[OTA_MAGIC_OFFSET], OTA_MAGIC_NUM_LEN) != 0 || u32Len != u32OhsBytes)
+        {
+            DBG_vPrintf(TRACE_OHS, "OHS: invalid image header \r\n");
+            OHS_vReply(0, 0, OTA_HOST_REFUSED);
+            OHS_vStop();
+            return;
+        }
+        memcpy(au8OhsHead, pu8Data, u16Len);
+        bOhsHead = TRUE;
+    }
+    else
+    {
+        /* host may send a chunk again or unasked, it is kept if there's room */
+        tsOhsChunk *psChunk = OHS_psChunk(u16Chunk);
+        if (NULL == psChunk) psChunk = OHS_psVictim(u16Chunk, u16Chunk);
+        if (NULL == psChunk)
+        {
+            sOhsStats.u32Dropped++;
+            return;
+        }
+        psChunk->eState = E_OHS_VALID;
+        psChunk->u16Chunk = u16Chunk;
+        psChunk->u32Stamp = ++u32OhsClock;
+        memcpy(psChunk->pu8Data, pu8Data, u16Len);
+    }
+    sOhsStats.u32Received++;
+    DBG_vPrintf(TRACE_OHS, "OHS: chunk %d \r\n", u16Chunk);
+
+    if (bOhsCache) OHS_vCache(u16Chunk, pu8Data, u16Len);
+    OHS_vServePending();
+}
+
+/****************************************************************************
+ *
+ * NAME: OHS_bRead
+ *
+ * DESCRIPTION:
+ * Read bytes of the image to serve. Without a stream they come from flash.
+ * While streaming, missing chunks and the ones behind them are asked from
+ * host and the read fails, ask again when they are in.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32Offset    R   flash offset
+ *             u16Len       R   bytes
+ *             pu8Dest      W   buffer
+ *
+ * RETURNS:
+ * TRUE if read
+ *
+ ****************************************************************************/
+PUBLIC bool OHS_bRead(uint32 u32Offset, uint16 u16Len, uint8 *pu8Dest)
+{
+    if (!bOhsActive)
+    {
+        APP_vOtaFlashCachedRead(u32Offset, u16Len, pu8Dest);
+        return TRUE;
+    }
+    if (0 == u16Len || u32Offset + u16Len > u32OhsBytes) return FALSE;
+
+    uint16 u16First = (uint16)(u32Offset / OTA_HOST_CHUNK_SIZE);
+    uint16 u16Last = (uint16)((u32Offset + u16Len - 1) / OTA_HOST_CHUNK_SIZE);
+    uint16 u16Chunk;
+    bool bAll = TRUE;
+
+    sOhsStats.u32Reads++;
+    for (u16Chunk = u16First; u16Chunk <= u16Last; u16Chunk++)
+    {
+        uint32 u32Start = (u16Chunk == u16First) ? u32Offset : (uint32)u16Chunk * OTA_HOST_CHUNK_SIZE;
+        uint32 u32End = MIN(u32Offset + u16Len, ((uint32)u16Chunk + 1) * OTA_HOST_CHUNK_SIZE);
+
+        if (!OHS_bCopy(u16Chunk, (uint16)(u32Start % OTA_HOST_CHUNK_SIZE), (uint16)(u32End - u32Start),
+                       pu8Dest + (u32Start - u32Offset)))
+        {
+            bAll = FALSE;
+        }
+    }
+
+    /* keep the chunks clients will ask for next coming */
+    if (bAll)
+    {
+        OHS_vFetch(u16Last + 1, u16Last + OHS_READ_AHEAD);
+    }
+    else
+    {
+        sOhsStats.u32Waits++;
+        OHS_vFetch(u16First, u16Last + OHS_READ_AHEAD);
+    }
+    return bAll;
+}
+
+/****************************************************************************
+ *
+ * NAME: OHS_vPend
+ *
+ * DESCRIPTION:
+ * A block request waits for host, the same request of a client is kept
+ * once. When the table is full the oldest request is dropped, the client
+ * asks again.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Addr      R   client
+ *             u8Image      R   OTA_IMAGE_xxx
+ *             u32BlockIdx  R   block
+ *             u8BlockSize  R   block size of the client
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OHS_vPend(uint16 u16Addr, uint8 u8Image, uint32 u32BlockIdx, uint8 u8BlockSize)
+{
+    tsOhsPending *psFree = NULL;
+    tsOhsPending *psOldest = &asOhsPending[0];
+    uint8 i;
+
+    for (i = 0; i < OHS_MAX_PENDING; i++)
+    {
+        tsOhsPending *psPending = &asOhsPending[i];
+        if (!psPending->bUsed)
+        {
+            if (NULL == psFree) psFree = psPending;
+            continue;
+        }
+        if (psPending->u16Addr == u16Addr && psPending->u8Image == u8Image &&
+            psPending->u32BlockIdx == u32BlockIdx && psPending->u8BlockSize == u8BlockSize)
+        {
+            return;
+        }
+        if ((int32)(psPending->u32Stamp - psOldest->u32Stamp) < 0) psOldest = psPending;
+    }
+
+    if (NULL == psFree) psFree = psOldest;
+    psFree->bUsed = TRUE;
+    psFree->u16Addr = u16Addr;
+    psFree->u8Image = u8Image;
+    psFree->u8BlockSize = u8BlockSize;
+    psFree->u32BlockIdx = u32BlockIdx;
+    psFree->u32Stamp = u32HAL_GetMsTime();
+}
+
+/****************************************************************************
+ *
+ * NAME: OHS_vPrintStatus
+ *
+ * DESCRIPTION:
+ * Print the stream state to host, ATOP
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OHS_vPrintStatus(void)
+{
+    if (!bOhsActive && 0 == sOhsStats.u32Received) return;
+
+    uint8 i, u8Valid = 0, u8Pending = 0;
+    for (i = 0; i < OHS_BUF_CHUNKS; i++)
+    {
+        if (E_OHS_VALID == asOhsChunk[i].eState) u8Valid++;
+    }
+    for (i = 0; i < OHS_MAX_PENDING; i++)
+    {
+        if (asOhsPending[i].bUsed) u8Pending++;
+    }
+
+    uart_printf("OTA host: %s, %d bytes, %ds \r\n", bOhsActive ? "streaming" : "ended", u32OhsBytes,
+                (u32HAL_GetMsTime() - u32OhsStartMs) / 1000);
+    uart_printf("  chunks asked %d (again %d), received %d, dropped %d, in RAM %d/%d \r\n",
+                sOhsStats.u32Asked, sOhsStats.u32Reasked, sOhsStats.u32Received, sOhsStats.u32Dropped,
+                u8Valid, OHS_BUF_CHUNKS);
+    uart_printf("  reads %d, waited %d, from flash %d, requests waiting %d \r\n",
+                sOhsStats.u32Reads, sOhsStats.u32Waits, sOhsStats.u32FlashReads, u8Pending);
+    if (bOhsCache)
+    {
+        uart_printf("  copied into flash %d/%d chunks%s \r\n", u16OhsInFlash, u16OhsChunks,
+                    bOhsChecking ? ", checking crc" : "");
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: OHS_bCheckStep
+ *
+ * DESCRIPTION:
+ * Check OHS_CRC_STEP_BYTES more of the crc of the copy in flash, run by
+ * APP_taskOtaSrv so the UART and the radio go on between the steps. The
+ * last step ends the stream if the crc is right.
+ *
+ * RETURNS:
+ * TRUE if there are steps left
+ *
+ ****************************************************************************/
+PUBLIC bool OHS_bCheckStep(void)
+{
+    uint8 au8Buf[128];
+    uint32 u32End;
+
+    if (!bOhsChecking) return FALSE;
+
+    u32End = MIN(u32OhsCheckPos + OHS_CRC_STEP_BYTES, u32OhsBytes);
+    while (u32OhsCheckPos < u32End)
+    {
+        uint16 u16Len = (uint16)MIN(sizeof(au8Buf), u32End - u32OhsCheckPos);
+        APP_vOtaFlashLockRead(u32OhsCheckPos, u16Len, au8Buf);
+        u32OhsCheckCrc = crc32(u32OhsCheckCrc, au8Buf, u16Len);
+        u32OhsCheckPos += u16Len;
+    }
+    if (u32OhsCheckPos < u32OhsBytes) return TRUE;
+
+    OHS_vCheckDone();
+    return FALSE;
+}
+
+#endif
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+
+/* part of a chunk from RAM or the copy in flash, FALSE if it isn't there */
+PRIVATE bool OHS_bCopy(uint16 u16Chunk, uint16 u16Pos, uint16 u16Len, uint8 *pu8Dest)
+{
+    if (0 == u16Chunk && bOhsHead)
+    {
+        memcpy(pu8Dest, &au8OhsHead[u16Pos], u16Len);
+        return TRUE;
+    }
+
+    tsOhsChunk *psChunk = OHS_psChunk(u16Chunk);
+    if (NULL != psChunk && E_OHS_VALID == psChunk->eState)
+    {
+        psChunk->u32Stamp = ++u32OhsClock;
+        memcpy(pu8Dest, &psChunk->pu8Data[u16Pos], u16Len);
+        return TRUE;
+    }
+
+    if (bOhsCache && (au8OhsInFlash[u16Chunk / 8] & (1 << (u16Chunk % 8))))
+    {
+        sOhsStats.u32FlashReads++;
+        APP_vOtaFlashCachedRead((uint32)u16Chunk * OTA_HOST_CHUNK_SIZE + u16Pos, u16Len, pu8Dest);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* are the bytes there, without asking host for them */
+PRIVATE bool OHS_bHave(uint32 u32Offset, uint16 u16Len)
+{
+    uint16 u16Chunk = (uint16)(u32Offset / OTA_HOST_CHUNK_SIZE);
+    uint16 u16Last = (uint16)((u32Offset + u16Len - 1) / OTA_HOST_CHUNK_SIZE);
+
+    for (; u16Chunk <= u16Last; u16Chunk++)
+    {
+        if (0 == u16Chunk && bOhsHead) continue;
+        if (bOhsCache && (au8OhsInFlash[u16Chunk / 8] & (1 << (u16Chunk % 8)))) continue;
+
+        tsOhsChunk *psChunk = OHS_psChunk(u16Chunk);
+        if (NULL == psChunk || E_OHS_VALID != psChunk->eState) return FALSE;
+    }
+    return TRUE;
+}
+
+/* RAM slot holding or waiting for a chunk */
+PRIVATE tsOhsChunk *OHS_psChunk(uint16 u16Chunk)
+{
+    uint8 i;
+    for (i = 0; i < OHS_BUF_CHUNKS; i++)
+    {
+        if (E_OHS_EMPTY != asOhsChunk[i].eState && asOhsChunk[i].u16Chunk == u16Chunk) return &asOhsChunk[i];
+    }
+    return NULL;
+}
+
+/*
+  RAM slot for another chunk: an empty one, one host didn't send in time
+  or the least recently used one, but none of the chunks being fetched
+*/
+PRIVATE tsOhsChunk *OHS_psVictim(uint16 u16Keep, uint16 u16KeepLast)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    tsOhsChunk *psVictim = NULL;
+    uint8 i;
+
+    for (i = 0; i < OHS_BUF_CHUNKS; i++)
+    {
+        tsOhsChunk *psChunk = &asOhsChunk[i];
+        if (E_OHS_EMPTY == psChunk->eState) return psChunk;
+        if (psChunk->u16Chunk >= u16Keep && psChunk->u16Chunk <= u16KeepLast) continue;
+        if (E_OHS_WANTED == psChunk->eState)
+        {
+            if (u32NowMs - psChunk->u32Stamp >= OHS_REQ_TIMEOUT_MS) return psChunk;
+            continue;
+        }
+        if (NULL == psVictim || (int32)(psChunk->u32Stamp - psVictim->u32Stamp) < 0) psVictim = psChunk;
+    }
+    return psVictim;
+}
+
+/*
+  Ask host for the chunks of a range which aren't there or asked for,
+  while fewer than OHS_MAX_INFLIGHT are on the way. Chunks host didn't
+  send in time are asked for again.
+*/
+PRIVATE void OHS_vFetch(uint16 u16First, uint16 u16Last)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    uint16 u16Chunk, u16Run = 0, u16RunCnt = 0;
+    uint8 i, u8InFlight = 0;
+
+    if (u16Last >= u16OhsChunks) u16Last = u16OhsChunks - 1;
+
+    for (i = 0; i < OHS_BUF_CHUNKS; i++)
+    {
+        if (E_OHS_WANTED == asOhsChunk[i].eState && u32NowMs - asOhsChunk[i].u32Stamp < OHS_REQ_TIMEOUT_MS)
+        {
+            u8InFlight++;
+        }
+    }
+
+    for (u16Chunk = u16First; u16Chunk <= u16Last && u8InFlight < OHS_MAX_INFLIGHT; u16Chunk++)
+    {
+        if (OHS_bHave((uint32)u16Chunk * OTA_HOST_CHUNK_SIZE, OHS_u16ChunkLen(u16Chunk))) continue;
+
+        tsOhsChunk *psChunk = OHS_psChunk(u16Chunk);
+        if (NULL != psChunk)
+        {
+            if (u32NowMs - psChunk->u32Stamp < OHS_REQ_TIMEOUT_MS) continue;
+            sOhsStats.u32Reasked++;
+        }
+        else
+        {
+            psChunk = OHS_psVictim(u16First, u16Last);
+            if (NULL == psChunk) break;
+        }
+        psChunk->eState = E_OHS_WANTED;
+        psChunk->u16Chunk = u16Chunk;
+        psChunk->u32Stamp = u32NowMs;
+        u8InFlight++;
+
+        /* consecutive chunks go in one request */
+        if (u16RunCnt > 0 && u16Run + u16RunCnt == u16Chunk)
+        {
+            u16RunCnt++;
+        }
+        else
+        {
+            if (u16RunCnt > 0) OHS_vAsk(u16Run, u16RunCnt);
+            u16Run = u16Chunk;
+            u16RunCnt = 1;
+        }
+    }
+    if (u16RunCnt > 0) OHS_vAsk(u16Run, u16RunCnt);
+}
+
+PRIVATE void OHS_vAsk(uint16 u16First, uint16 u16Cnt)
+{
+    uint32 u32Offset = (uint32)u16First * OTA_HOST_CHUNK_SIZE;
+    uint32 u32End = MIN(u32Offset + (uint32)u16Cnt * OTA_HOST_CHUNK_SIZE, u32OhsBytes);
+
+    sOhsStats.u32Asked += u16Cnt;
+    DBG_vPrintf(TRACE_OHS, "OHS: ask %d+%d \r\n", u16First, u16Cnt);
+    OHS_vReply(u32Offset, (uint16)(u32End - u32Offset), OTA_HOST_SEND);
+}
+
+PRIVATE void OHS_vReply(uint32 u32Offset, uint16 u16Len, uint8 u8Status)
+{
+    tsApiSpec apiSpec;
+    tsOtaHostReq hostReq;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    hostReq.offset = u32Offset;
+    hostReq.len = u16Len;
+    hostReq.status = u8Status;
+
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaHostReq);
+    apiSpec.teApiIdentifier = API_OTA_HOST_REQ;
+    apiSpec.payload.otaHostReq = hostReq;
+    apiSpec.checkSum = calCheckSum((uint8 *)&hostReq, apiSpec.length);
+    CMI_vLocalAckDistributor(&apiSpec);
+}
+
+/*
+  Copy a chunk into flash. The header goes in after all the others, then
+  APP_taskOtaSrv checks the copy, see OHS_bCheckStep.
+*/
+PRIVATE void OHS_vCache(uint16 u16Chunk, uint8 *pu8Data, uint16 u16Len)
+{
+    if (au8OhsInFlash[u16Chunk / 8] & (1 << (u16Chunk % 8))) return;
+
+    if (0 != u16Chunk)
+    {
+        OHS_vCacheWrite(u16Chunk, pu8Data, u16Len);
+    }
+    if (!bOhsHead || u16OhsInFlash + 1 < u16OhsChunks) return;
+
+    OHS_vCacheWrite(0, au8OhsHead, OHS_u16ChunkLen(0));
+
+    bOhsChecking = TRUE;
+    u32OhsCheckPos = 0;
+    u32OhsCheckCrc = 0xffffffff;
+    OS_eActivateTask(APP_taskOtaSrv);
+}
+
+/* the copy is checked, it becomes the image in flash or it is wiped */
+PRIVATE void OHS_vCheckDone(void)
+{
+    bOhsChecking = FALSE;
+    if (u32OhsCheckCrc == g_sDevice.otaCrc)
+    {
+        DBG_vPrintf(TRACE_OHS, "OHS: copy in flash, crc ok \r\n");
+        bOhsActive = FALSE;
+        APP_vOtaCacheReclaim();
+        OHS_vReply(0, 0, OTA_HOST_CACHED);
+        OHS_vServePending();
+    }
+    else
+    {
+        DBG_vPrintf(TRACE_OHS, "OHS: crc of the copy in flash is wrong \r\n");
+        APP_vOtaFlashLockErase(0);
+        OHS_vReply(0, 0, OTA_HOST_REFUSED);
+        OHS_vStop();
+    }
+}
+
+/* a chunk doesn't straddle sectors, its sector is erased by the first write into it */
+PRIVATE void OHS_vCacheWrite(uint16 u16Chunk, uint8 *pu8Data, uint16 u16Len)
+{
+    uint32 u32Offset = (uint32)u16Chunk * OTA_HOST_CHUNK_SIZE;
+    uint8 u8Sector = (uint8)(u32Offset / OTA_SECTOR_SIZE);
+
+    if (0 == (u8OhsErased & (1 << u8Sector)))
+    {
+        DBG_vPrintf(TRACE_OHS, "OHS: erase sector %d \r\n", u8Sector);
+        APP_vOtaFlashLockErase(u8Sector);
+        u8OhsErased |= (1 << u8Sector);
+    }
+    APP_vOtaFlashLockWrite(u32Offset, u16Len, pu8Data);
+    au8OhsInFlash[u16Chunk / 8] |= (1 << (u16Chunk % 8));
+    u16OhsInFlash++;
+}
+
+/* answer the block requests whose chunks are all in */
+PRIVATE void OHS_vServePending(void)
+{
+    uint8 i;
+
+    for (i = 0; i < OHS_MAX_PENDING; i++)
+    {
+        tsOhsPending *psPending = &asOhsPending[i];
+        uint32 u32Base, u32Bytes, u32Crc;
+        if (!psPending->bUsed) continue;
+
+        if (!OPR_bImageSpan(psPending->u8Image, &u32Base, &u32Bytes, &u32Crc))
+        {
+            psPending->bUsed = FALSE;
+            continue;
+        }
+        uint32 u32Offset = psPending->u32BlockIdx * psPending->u8BlockSize;
+        uint16 u16Len = (uint16)MIN(psPending->u8BlockSize, u32Bytes - u32Offset);
+        if (bOhsActive && !OHS_bHave(u32Base + u32Offset, u16Len)) continue;
+
+        psPending->bUsed = FALSE;
+        API_i32OtaServeBlock(psPending->u16Addr, psPending->u8Image, psPending->u32BlockIdx, psPending->u8BlockSize);
+    }
+}
+
+PRIVATE uint16 OHS_u16ChunkLen(uint16 u16Chunk)
+{
+    uint32 u32Offset = (uint32)u16Chunk * OTA_HOST_CHUNK_SIZE;
+    return (uint16)MIN(OTA_HOST_CHUNK_SIZE, u32OhsBytes - u32Offset);
+}
+
+#endif
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
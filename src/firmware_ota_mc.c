@@ -0,0 +1,570 @@
+/*
+ * firmware_ota_mc.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_ota.h"
+#include "firmware_ota_dl.h"
+#include "firmware_ota_mc.h"
+#include "firmware_ota_host.h"
+#include "firmware_at_api.h"
+#include "firmware_api_pack.h"
+#include "firmware_cmi.h"
+#include "firmware_uart.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_OMC
+#define TRACE_OMC  FALSE
+#endif
+
+#define OMC_NOTICES             3       //notice is repeated, a client missing it misses the session
+#define OMC_IS_SET(map, idx)    ((map)[(idx) >> 3] & (1 << ((idx) & 7)))
+#define OMC_SET(map, idx)       ((map)[(idx) >> 3] |= (1 << ((idx) & 7)))
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/*
+  Server side of a multicast session:
+  PASS    - every block is broadcast once
+  COLLECT - clients NACK the blocks they miss
+  REPAIR  - blocks missed by several clients are broadcast again
+  After OMC_MAX_ROUNDS, or when no block is missed by several clients,
+  the last END tells the clients to fetch what's left by unicast.
+*/
+typedef enum
+{
+    E_OMC_IDLE,
+    E_OMC_PASS,
+    E_OMC_COLLECT,
+    E_OMC_REPAIR
+}teOmcState;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+PRIVATE bool OMC_bSendNotice(void);
+PRIVATE bool OMC_bSendBlock(uint32 u32BlockIdx);
+PRIVATE bool OMC_bSendEnd(bool bLast);
+PRIVATE tsOmcClient *OMC_psClient(uint16 u16Addr);
+PRIVATE void OMC_vEndRound(void);
+PRIVATE void OMC_vSendStatus(uint16 u16Done);
+#endif
+
+/****************************************************************************/
+/***        External Functions                                            ***/
+/****************************************************************************/
+extern uint8 calCheckSum(uint8 *in, int len);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+PRIVATE teOmcState eOmcState = E_OMC_IDLE;
+PRIVATE uint8  u8OmcSession = 0;
+PRIVATE uint8  u8OmcTarget = 0;
+PRIVATE uint8  u8OmcRound = 0;
+PRIVATE uint8  u8OmcNotices = 0;
+PRIVATE uint16 u16OmcBlockSize = 0;
+PRIVATE uint32 u32OmcBlocks = 0;
+PRIVATE uint32 u32OmcCursor = 0;
+PRIVATE uint32 u32OmcPeriodMs = 0;
+
+/* blocks NACKed in this round, by one client and by several */
+PRIVATE uint8  au8OmcMiss[ODL_BITMAP_LEN];
+PRIVATE uint8  au8OmcMulti[ODL_BITMAP_LEN];
+PRIVATE uint16 u16OmcNacks = 0;
+
+PRIVATE tsOmcClient asOmcClient[OMC_MAX_CLIENTS];
+PRIVATE uint16 u16OmcClients = 0;
+PRIVATE uint16 u16OmcUntracked = 0;       //reports of clients beyond the table
+PRIVATE uint32 u32OmcTxBlocks = 0;
+PRIVATE uint32 u32OmcRepairBlocks = 0;
+#endif
+
+/****************************************************************************/
+/***        Tasks                                                         ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: APP_taskOtaMc
+ *
+ * DESCRIPTION:
+ * Multicast session state machine, one block per period
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+OS_TASK(APP_taskOtaMc)
+{
+#ifdef OTA_SERVER
+    uint32 u32NextMs = u32OmcPeriodMs;
+
+    switch (eOmcState)
+    {
+    case E_OMC_PASS:
+        if (u8OmcNotices < OMC_NOTICES)
+        {
+            if (OMC_bSendNotice()) u8OmcNotices++;
+        }
+        else if (u32OmcCursor < u32OmcBlocks)
+        {
+            /* radio refused it, try again next period */
+            if (OMC_bSendBlock(u32OmcCursor)) u32OmcCursor++;
+        }
+        else
+        {
+            OMC_vEndRound();
+            u32NextMs = OMC_NACK_WINDOW_MS + OMC_NACK_MARGIN_MS;
+        }
+        break;
+
+    case E_OMC_COLLECT:
+    {
+        uint16 i;
+        bool bMulti = FALSE;
+        for (i = 0; i < ODL_BITMAP_LEN && !bMulti; i++) bMulti = (0 != au8OmcMulti[i]);
+
+        if (!bMulti || u8OmcRound >= OMC_MAX_ROUNDS)
+        {
+            OMC_bSendEnd(TRUE);
+            eOmcState = E_OMC_IDLE;
+            if (E_MODE_AT == g_sDevice.eMode)
+            {
+                uart_printf("OTA mc: multicast done, %ld blocks + %ld repaired\r\n",
+                            u32OmcTxBlocks - u32OmcRepairBlocks, u32OmcRepairBlocks);
+            }
+            OMC_vReportStatus();
+            return;
+        }
+        /* progress of the clients after every round */
+        if (E_MODE_AT == g_sDevice.eMode)
+        {
+            uart_printf("OTA mc: round %d, %d NACKs\r\n", u8OmcRound, u16OmcNacks);
+        }
+        else
+        {
+            OMC_vReportStatus();
+        }
+        u8OmcRound++;
+        u32OmcCursor = 0;
+        eOmcState = E_OMC_REPAIR;
+    }
+        /* fall through */
+    case E_OMC_REPAIR:
+        while (u32OmcCursor < u32OmcBlocks && !OMC_IS_SET(au8OmcMulti, u32OmcCursor)) u32OmcCursor++;
+
+        if (u32OmcCursor < u32OmcBlocks)
+        {
+            if (OMC_bSendBlock(u32OmcCursor))
+            {
+                u32OmcRepairBlocks++;
+                u32OmcCursor++;
+            }
+        }
+        else
+        {
+            OMC_vEndRound();
+            u32NextMs = OMC_NACK_WINDOW_MS + OMC_NACK_MARGIN_MS;
+        }
+        break;
+
+    default:
+        return;
+    }
+    vResetATimer(APP_tmrOtaMc, APP_TIME_MS(u32NextMs));
+#endif
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+
+/****************************************************************************
+ *
+ * NAME: OMC_bStart
+ *
+ * DESCRIPTION:
+ * Start a multicast session of the image in g_sDevice(otaTotalBytes and
+ * otaCrc are set by the caller). A session in progress starts over.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8Target     R   OTA_MC_TARGET_ROU or OTA_MC_TARGET_END
+ *
+ * RETURNS:
+ * TRUE if started
+ *
+ ****************************************************************************/
+PUBLIC bool OMC_bStart(uint8 u8Target)
+{
+    if (OTA_MC_TARGET_ROU != u8Target && OTA_MC_TARGET_END != u8Target) return FALSE;
+    if (0 == g_sDevice.otaTotalBytes || g_sDevice.otaTotalBytes > ODL_MAX_IMAGE_BYTES) return FALSE;
+
+    /* a new session id each time, clients of an old session ignore this one */
+    u8OmcSession = (0 == u8OmcSession) ? (uint8)(random() | 1) : (uint8)(u8OmcSession + 1);
+    if (0 == u8OmcSession) u8OmcSession = 1;      //0 is a unicast download
+
+    /* block carries a session byte more than a unicast response, but no image crc */
+    u16OmcBlockSize = APP_u8OtaClientBlockSize(OTA_MAX_BLOCK_SIZE);
+    u32OmcBlocks    = APP_u32OtaBlocks(g_sDevice.otaTotalBytes, u16OmcBlockSize);
+    u32OmcPeriodMs  = (g_sDevice.config.reqPeriodMs > OMC_MIN_PERIOD_MS) ? g_sDevice.config.reqPeriodMs : OMC_MIN_PERIOD_MS;
+    u8OmcTarget     = u8Target;
+    u8OmcRound      = 0;
+    u8OmcNotices    = 0;
+    u32OmcCursor    = 0;
+    u16OmcClients   = 0;
+    u16OmcUntracked = 0;
+    u32OmcTxBlocks  = 0;
+    u32OmcRepairBlocks = 0;
+    eOmcState       = E_OMC_PASS;
+
+    if (E_MODE_AT == g_sDevice.eMode)
+    {
+        uart_printf("OTA mc: session %d, %ld blocks of %d bytes every %ldms\r\n",
+                    u8OmcSession, u32OmcBlocks, u16OmcBlockSize, u32OmcPeriodMs);
+    }
+    OS_eActivateTask(APP_taskOtaMc);
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: OMC_vAbort
+ *
+ * DESCRIPTION:
+ * Stop the multicast session, clients are told by a broadcast abort
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OMC_vAbort(void)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+
+    if (E_OMC_IDLE == eOmcState) return;
+    eOmcState = E_OMC_IDLE;
+    if (OS_eGetSWTimerStatus(APP_tmrOtaMc) != OS_E_SWTIMER_STOPPED) OS_eStopSWTimer(APP_tmrOtaMc);
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = 1;
+    apiSpec.teApiIdentifier = API_OTA_ABT_REQ;
+    apiSpec.payload.dummyByte = u8OmcSession;     //clients of this session only, no ack
+    apiSpec.checkSum = calCheckSum(&u8OmcSession, 1);
+
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    API_bSendToAirPort(BROADCAST, 0, tmp, size);
+    if (E_MODE_AT == g_sDevice.eMode)
+    {
+        uart_printf("OTA mc: session %d aborted\r\n", u8OmcSession);
+    }
+    else
+    {
+        OMC_vReportStatus();
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: OMC_vNack
+ *
+ * DESCRIPTION:
+ * A client reports the blocks it misses after a round. Blocks in the
+ * bitmap of another NACK already are marked for multicast repair, blocks
+ * only one client misses are left to its unicast requests.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16SrcAddr   R   client
+ *             u8Session    R   session of the NACK
+ *             u8Round      R   round of the NACK
+ *             u8Per        R   percent received by the client
+ *             u32Base      R   first block of the gap bitmap
+ *             pu8Gaps      R   gap bitmap, OTA_MC_NACK_BYTES
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OMC_vNack(uint16 u16SrcAddr, uint8 u8Session, uint8 u8Round, uint8 u8Per,
+                      uint32 u32Base, uint8 *pu8Gaps)
+{
+    tsOmcClient *psClient;
+    uint16 i;
+
+    if (u8Session != u8OmcSession) return;
+
+    psClient = OMC_psClient(u16SrcAddr);
+    if (NULL != psClient && E_OMC_CLIENT_DONE != psClient->eState)
+    {
+        psClient->u8Per = u8Per;
+        psClient->eState = E_OMC_CLIENT_NACKED;
+    }
+
+    if (E_OMC_COLLECT != eOmcState || u8Round != u8OmcRound) return;
+    u16OmcNacks++;
+
+    for (i = 0; i < OTA_MC_NACK_BYTES * 8; i++)
+    {
+        uint32 u32Idx = u32Base + i;
+        if (u32Idx >= u32OmcBlocks) break;
+        if (0 == (pu8Gaps[i >> 3] & (1 << (i & 7)))) continue;
+
+        if (OMC_IS_SET(au8OmcMiss, u32Idx)) OMC_SET(au8OmcMulti, u32Idx);
+        else OMC_SET(au8OmcMiss, u32Idx);
+    }
+    DBG_vPrintf(TRACE_OMC, "OMC: NACK from 0x%04x, %d%%, base %ld\r\n", u16SrcAddr, u8Per, u32Base);
+}
+
+/****************************************************************************
+ *
+ * NAME: OMC_vClientDone
+ *
+ * DESCRIPTION:
+ * A client checked its image and asks for the upgrade
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16SrcAddr   R   client
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OMC_vClientDone(uint16 u16SrcAddr)
+{
+    if (0 == u8OmcSession) return;
+
+    tsOmcClient *psClient = OMC_psClient(u16SrcAddr);
+    if (NULL == psClient) return;
+    psClient->u8Per = 100;
+    psClient->eState = E_OMC_CLIENT_DONE;
+}
+
+/****************************************************************************
+ *
+ * NAME: OMC_vReportStatus
+ *
+ * DESCRIPTION:
+ * Report the status of every client of the session to host, as text in
+ * AT mode, otherwise as API_OTA_MC_STATUS frames
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OMC_vReportStatus(void)
+{
+    uint16 i, u16Done = 0;
+
+    for (i = 0; i < u16OmcClients; i++)
+    {
+        if (E_OMC_CLIENT_DONE == asOmcClient[i].eState) u16Done++;
+    }
+    if (E_MODE_AT != g_sDevice.eMode)
+    {
+        OMC_vSendStatus(u16Done);
+        return;
+    }
+
+    if (0 == u8OmcSession)
+    {
+        uart_printf("OTA mc: no session.\r\n");
+        return;
+    }
+    for (i = 0; i < u16OmcClients; i++)
+    {
+        uart_printf("  0x%04x: %3d%% %s\r\n", asOmcClient[i].u16Addr, asOmcClient[i].u8Per,
+                    (E_OMC_CLIENT_DONE == asOmcClient[i].eState) ? "done" : "receiving");
+    }
+    uart_printf("OTA mc: session %d %s, round %d, %d clients, %d done, %d untracked\r\n",
+                u8OmcSession, (E_OMC_IDLE == eOmcState) ? "unicast only" : "multicasting",
+                u8OmcRound, u16OmcClients, u16Done, u16OmcUntracked);
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* status frames to host, API_MC_STATUS_CLIENTS clients each, one frame without clients at least */
+PRIVATE void OMC_vSendStatus(uint16 u16Done)
+{
+    tsApiSpec apiSpec;
+    tsOtaMcStatus *psStatus = &apiSpec.payload.otaMcStatus;
+    uint16 u16First = 0;
+
+    do
+    {
+        uint8 i;
+
+        memset(&apiSpec, 0, sizeof(tsApiSpec));
+        psStatus->session = u8OmcSession;
+        psStatus->multicasting = (E_OMC_IDLE != eOmcState);
+        psStatus->round = u8OmcRound;
+        psStatus->clients = u16OmcClients;
+        psStatus->done = u16Done;
+        psStatus->untracked = u16OmcUntracked;
+        psStatus->first = u16First;
+        for (i = 0; i < API_MC_STATUS_CLIENTS && u16First + i < u16OmcClients; i++)
+        {
+            tsOmcClient *psClient = &asOmcClient[u16First + i];
+            psStatus->client[i].addr = psClient->u16Addr;
+            psStatus->client[i].per = psClient->u8Per;
+            psStatus->client[i].done = (E_OMC_CLIENT_DONE == psClient->eState);
+        }
+        psStatus->count = i;
+
+        apiSpec.startDelimiter = API_START_DELIMITER;
+        apiSpec.length = sizeof(tsOtaMcStatus) - (API_MC_STATUS_CLIENTS - i) * sizeof(tsOtaMcClientStatus);
+        apiSpec.teApiIdentifier = API_OTA_MC_STATUS;
+        apiSpec.checkSum = calCheckSum((uint8 *)psStatus, apiSpec.length);
+        CMI_vLocalAckDistributor(&apiSpec);
+
+        u16First += API_MC_STATUS_CLIENTS;
+    } while (u16First < u16OmcClients);
+}
+
+/* clear the NACK bitmaps and tell the clients the round is over */
+PRIVATE void OMC_vEndRound(void)
+{
+    memset(au8OmcMiss, 0, sizeof(au8OmcMiss));
+    memset(au8OmcMulti, 0, sizeof(au8OmcMulti));
+    u16OmcNacks = 0;
+    OMC_bSendEnd(FALSE);
+    eOmcState = E_OMC_COLLECT;
+}
+
+PRIVATE bool OMC_bSendNotice(void)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+    tsOtaNotice otaNotice;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    memset(&otaNotice, 0, sizeof(tsOtaNotice));
+    otaNotice.totalBytes   = g_sDevice.otaTotalBytes;
+    otaNotice.reqPeriodMs  = g_sDevice.config.reqPeriodMs;
+    otaNotice.maxBlockSize = (uint8)u16OmcBlockSize;
+    otaNotice.session      = u8OmcSession;
+    otaNotice.target       = u8OmcTarget;
+    otaNotice.crc          = g_sDevice.otaCrc;
+
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaNotice);
+    apiSpec.teApiIdentifier = API_OTA_NTC;
+    apiSpec.payload.otaNotice = otaNotice;
+    apiSpec.checkSum = calCheckSum((uint8 *)&otaNotice, apiSpec.length);
+
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    return API_bSendToAirPort(BROADCAST, 0, tmp, size);
+}
+
+PRIVATE bool OMC_bSendBlock(uint32 u32BlockIdx)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+    tsOtaMcBlock mcBlock;
+    uint32 u32Offset = u32BlockIdx * u16OmcBlockSize;
+    uint16 rdLen = (g_sDevice.otaTotalBytes - u32Offset > u16OmcBlockSize) ?
+                   u16OmcBlockSize : (uint16)(g_sDevice.otaTotalBytes - u32Offset);
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    memset(&mcBlock, 0, sizeof(tsOtaMcBlock));
+    mcBlock.session  = u8OmcSession;
+    mcBlock.blockIdx = u32BlockIdx;
+    mcBlock.len      = rdLen;
+
+    /* a block host hasn't streamed yet goes next period */
+    if (!OHS_bRead(u32Offset, rdLen, mcBlock.block)) return FALSE;
+    uint16 u16BlockCrc = APP_u16OtaBlockCrc(mcBlock.block, rdLen);
+    memcpy(&mcBlock.block[u16OmcBlockSize], &u16BlockCrc, OTA_BLOCK_CRC_LEN);
+
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = 1 + 4 + 2 + u16OmcBlockSize + OTA_BLOCK_CRC_LEN;
+    apiSpec.teApiIdentifier = API_OTA_MC_BLK;
+    apiSpec.payload.otaMcBlock = mcBlock;
+    apiSpec.checkSum = calCheckSum((uint8 *)&mcBlock, apiSpec.length);
+
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    if (!API_bSendToAirPort(BROADCAST, 0, tmp, size)) return FALSE;
+    u32OmcTxBlocks++;
+    return TRUE;
+}
+
+PRIVATE bool OMC_bSendEnd(bool bLast)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+    tsOtaMcEnd mcEnd;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    mcEnd.session = u8OmcSession;
+    mcEnd.round = u8OmcRound;
+    mcEnd.last = bLast;
+    mcEnd.nackWindowMs = OMC_NACK_WINDOW_MS;
+
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaMcEnd);
+    apiSpec.teApiIdentifier = API_OTA_MC_END;
+    apiSpec.payload.otaMcEnd = mcEnd;
+    apiSpec.checkSum = calCheckSum((uint8 *)&mcEnd, apiSpec.length);
+
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    return API_bSendToAirPort(BROADCAST, 0, tmp, size);
+}
+
+/* status entry of a client, added if there's room */
+PRIVATE tsOmcClient *OMC_psClient(uint16 u16Addr)
+{
+    uint16 i;
+
+    for (i = 0; i < u16OmcClients; i++)
+    {
+        if (asOmcClient[i].u16Addr == u16Addr) return &asOmcClient[i];
+    }
+    if (u16OmcClients >= OMC_MAX_CLIENTS)
+    {
+        u16OmcUntracked++;
+        return NULL;
+    }
+    asOmcClient[u16OmcClients].u16Addr = u16Addr;
+    asOmcClient[u16OmcClients].u8Per = 0;
+    asOmcClient[u16OmcClients].eState = E_OMC_CLIENT_NACKED;
+    return &asOmcClient[u16OmcClients++];
+}
+
+#endif
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,263 @@
+/*
+ * firmware_ota_pack.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "firmware_ota_pack.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define OPK_MAGIC             "MBLZ"
+#define OPK_LITERAL_BITS      9
+#define OPK_BACKREF_BITS      (1 + OPK_INDEX_BITS + OPK_COUNT_BITS)
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE uint32 OPK_u32Get(uint8 *pu8);
+PRIVATE void OPK_vPut(uint8 *pu8, uint32 u32Value);
+PRIVATE uint32 OPK_u32BitsLeft(tsOtaPack *psPack);
+PRIVATE uint16 OPK_u16GetBits(tsOtaPack *psPack, uint8 n);
+PRIVATE bool OPK_bOutput(tsOtaPack *psPack, uint8 u8Byte);
+PRIVATE bool OPK_bFlush(tsOtaPack *psPack);
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: OPK_bParseHeader
+ *
+ * DESCRIPTION:
+ * Parse the header of a compressed image
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             pu8Hdr       R   OPK_HEADER_LEN bytes
+ *             psHdr        W   header
+ *
+ * RETURNS:
+ * TRUE if it's a compressed image header
+ *
+ ****************************************************************************/
+PUBLIC bool OPK_bParseHeader(uint8 *pu8Hdr, tsOpkHeader *psHdr)
+{
+    if (0 != memcmp(pu8Hdr, OPK_MAGIC, 4)) return FALSE;
+
+    psHdr->u32ImageLen  = OPK_u32Get(&pu8Hdr[4]);
+    psHdr->u32ImageCrc  = OPK_u32Get(&pu8Hdr[8]);
+    psHdr->u32PackedLen = OPK_u32Get(&pu8Hdr[12]);
+    return psHdr->u32PackedLen > OPK_HEADER_LEN && psHdr->u32ImageLen > 0;
+}
+
+/****************************************************************************
+ *
+ * NAME: OPK_vWriteHeader
+ *
+ * DESCRIPTION:
+ * Lay out the header of a compressed image
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psHdr        R   header
+ *             pu8Hdr       W   OPK_HEADER_LEN bytes
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OPK_vWriteHeader(tsOpkHeader *psHdr, uint8 *pu8Hdr)
+{
+    memcpy(pu8Hdr, OPK_MAGIC, 4);
+    OPK_vPut(&pu8Hdr[4],  psHdr->u32ImageLen);
+    OPK_vPut(&pu8Hdr[8],  psHdr->u32ImageCrc);
+    OPK_vPut(&pu8Hdr[12], psHdr->u32PackedLen);
+}
+
+/****************************************************************************
+ *
+ * NAME: OPK_bInit
+ *
+ * DESCRIPTION:
+ * Start expanding a compressed image, reads its header which must be there
+ * already
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psPack       W   image being expanded
+ *             pfRead       R   reads the compressed image
+ *             pfWrite      R   writes the image in order
+ *
+ * RETURNS:
+ * TRUE if the header is valid
+ *
+ ****************************************************************************/
+PUBLIC bool OPK_bInit(tsOtaPack *psPack, OPK_tpfRead pfRead, OPK_tpfWrite pfWrite)
+{
+    uint8 au8Hdr[OPK_HEADER_LEN];
+
+    memset(psPack, 0, sizeof(tsOtaPack));
+    psPack->pfRead  = pfRead;
+    psPack->pfWrite = pfWrite;
+
+    pfRead(0, OPK_HEADER_LEN, au8Hdr);
+    psPack->u32InPos = OPK_HEADER_LEN;
+    psPack->u32InAvail = OPK_HEADER_LEN;
+    return OPK_bParseHeader(au8Hdr, &psPack->sHdr);
+}
+
+/****************************************************************************
+ *
+ * NAME: OPK_eStep
+ *
+ * DESCRIPTION:
+ * Expand up to u32MaxBytes of the image out of the first u32InAvail bytes
+ * of the compressed image, the rest may still be on its way. A token is
+ * only taken when all of its bits are there, so the next call goes on
+ * where this one stopped. Corrupted input ends in E_OPK_ERROR and never
+ * writes out of the image.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psPack       RW  image being expanded
+ *             u32InAvail   R   compressed bytes in place, header included
+ *             u32MaxBytes  R   image bytes of this call
+ *
+ * RETURNS:
+ * E_OPK_MORE, E_OPK_DONE when the whole image is written, E_OPK_ERROR
+ *
+ ****************************************************************************/
+PUBLIC teOpkStatus OPK_eStep(tsOtaPack *psPack, uint32 u32InAvail, uint32 u32MaxBytes)
+{
+    if (u32InAvail > psPack->sHdr.u32PackedLen) u32InAvail = psPack->sHdr.u32PackedLen;
+    if (u32InAvail > psPack->u32InAvail) psPack->u32InAvail = u32InAvail;
+
+    while (psPack->u32OutPos < psPack->sHdr.u32ImageLen && u32MaxBytes > 0)
+    {
+        if (psPack->u16MatchLeft > 0)
+        {
+            uint8 u8Byte = psPack->au8Win[(psPack->u32OutPos - psPack->u16MatchDist) & (OPK_WINDOW - 1)];
+            if (!OPK_bOutput(psPack, u8Byte)) return E_OPK_ERROR;
+            psPack->u16MatchLeft--;
+            u32MaxBytes--;
+            continue;
+        }
+
+        uint32 u32Bits = OPK_u32BitsLeft(psPack);
+        bool bAll = (psPack->u32InAvail == psPack->sHdr.u32PackedLen);
+
+        /* wait for the blocks holding the rest of the token */
+        if (u32Bits < OPK_BACKREF_BITS && !bAll) return E_OPK_MORE;
+        if (u32Bits < OPK_LITERAL_BITS) return E_OPK_ERROR;
+
+        if (OPK_u16GetBits(psPack, 1))
+        {
+            if (!OPK_bOutput(psPack, (uint8)OPK_u16GetBits(psPack, 8))) return E_OPK_ERROR;
+            u32MaxBytes--;
+        }
+        else
+        {
+            if (u32Bits < OPK_BACKREF_BITS) return E_OPK_ERROR;
+
+            uint16 u16Dist = OPK_u16GetBits(psPack, OPK_INDEX_BITS) + 1;
+            uint16 u16Len  = OPK_u16GetBits(psPack, OPK_COUNT_BITS) + OPK_MIN_MATCH;
+            if (u16Dist > psPack->u32OutPos || u16Len > psPack->sHdr.u32ImageLen - psPack->u32OutPos) return E_OPK_ERROR;
+            psPack->u16MatchDist = u16Dist;
+            psPack->u16MatchLeft = u16Len;
+        }
+    }
+
+    if (psPack->u32OutPos < psPack->sHdr.u32ImageLen) return E_OPK_MORE;
+    return OPK_bFlush(psPack) ? E_OPK_DONE : E_OPK_ERROR;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+PRIVATE uint32 OPK_u32Get(uint8 *pu8)
+{
+    return (uint32)pu8[0] | ((uint32)pu8[1] << 8) | ((uint32)pu8[2] << 16) | ((uint32)pu8[3] << 24);
+}
+
+PRIVATE void OPK_vPut(uint8 *pu8, uint32 u32Value)
+{
+    pu8[0] = (uint8)u32Value;
+    pu8[1] = (uint8)(u32Value >> 8);
+    pu8[2] = (uint8)(u32Value >> 16);
+    pu8[3] = (uint8)(u32Value >> 24);
+}
+
+/* bits which can be taken now */
+PRIVATE uint32 OPK_u32BitsLeft(tsOtaPack *psPack)
+{
+    uint32 u32Bytes = psPack->u8InLen - psPack->u8InPos;
+    if (psPack->u32InAvail > psPack->u32InPos) u32Bytes += psPack->u32InAvail - psPack->u32InPos;
+    return psPack->u8CurBits + 8 * u32Bytes;
+}
+
+/* n bits, MSB first, the caller made sure they're there */
+PRIVATE uint16 OPK_u16GetBits(tsOtaPack *psPack, uint8 n)
+{
+    uint16 u16Value = 0;
+
+    while (n--)
+    {
+        if (0 == psPack->u8CurBits)
+        {
+            if (psPack->u8InPos >= psPack->u8InLen)
+            {
+                uint32 u32Len = psPack->u32InAvail - psPack->u32InPos;
+                if (u32Len > OPK_BUF_LEN) u32Len = OPK_BUF_LEN;
+
+                psPack->pfRead(psPack->u32InPos, (uint16)u32Len, psPack->au8In);
+                psPack->u32InPos += u32Len;
+                psPack->u8InLen = (uint8)u32Len;
+                psPack->u8InPos = 0;
+            }
+            psPack->u8Cur = psPack->au8In[psPack->u8InPos++];
+            psPack->u8CurBits = 8;
+        }
+        u16Value = (u16Value << 1) | ((psPack->u8Cur >> --psPack->u8CurBits) & 1);
+    }
+    return u16Value;
+}
+
+/* an image byte goes to the window, which is written OPK_BUF_LEN at a time */
+PRIVATE bool OPK_bOutput(tsOtaPack *psPack, uint8 u8Byte)
+{
+    psPack->au8Win[psPack->u32OutPos & (OPK_WINDOW - 1)] = u8Byte;
+    psPack->u32OutPos++;
+    if (psPack->u32OutPos - psPack->u32FlushPos == OPK_BUF_LEN) return OPK_bFlush(psPack);
+    return TRUE;
+}
+
+PRIVATE bool OPK_bFlush(tsOtaPack *psPack)
+{
+    uint16 len = (uint16)(psPack->u32OutPos - psPack->u32FlushPos);
+
+    if (0 == len) return TRUE;
+    if (!psPack->pfWrite(psPack->u32FlushPos, len, &psPack->au8Win[psPack->u32FlushPos & (OPK_WINDOW - 1)])) return FALSE;
+    psPack->u32FlushPos = psPack->u32OutPos;
+    return TRUE;
+}
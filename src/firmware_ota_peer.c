@@ -0,0 +1,480 @@
+/*
+ * firmware_ota_peer.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_ota.h"
+#include "firmware_ota_peer.h"
+#include "firmware_at_api.h"
+#include "firmware_api_pack.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_OPR
+#define TRACE_OPR  FALSE
+#endif
+
+#define OPR_NO_PEER             0xffff
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/*
+  Peer assisted OTA(OPR).
+  A router whose external flash holds the image it runs, that is a router
+  which downloaded, checked and booted an image, serves it like the OTA
+  server does. A client asks the routers of its neighbour table for the
+  image of a notice. Neighbours with the image answer with an offer, and
+  the client pulls its blocks from the one with the best link, one hop
+  instead of the whole route to the coordinator. When that neighbour goes
+  silent the client goes back to the server. The upgrade request always
+  goes to the server.
+*/
+
+/* image a peer serves, found in its external flash */
+typedef struct
+{
+    uint32 u32ImageBytes;       //0: nothing to serve
+    uint32 u32Crc;
+    uint32 u32PatchBytes;
+    uint32 u32BaseCrc;
+    uint32 u32PackedBytes;
+}tsOprImage;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+#ifdef OTA_PEER
+PRIVATE tsOprImage *OPR_psImage(void);
+#endif
+#ifdef OTA_CLIENT
+PRIVATE bool OPR_bSendQuery(uint16 u16DstAddr);
+#endif
+
+/****************************************************************************/
+/***        External Functions                                            ***/
+/****************************************************************************/
+extern uint8 calCheckSum(uint8 *in, int len);
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+tsOprStats g_sOprStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+#ifdef OTA_PEER
+PRIVATE tsOprImage sOprImage;
+PRIVATE bool bOprChecked = FALSE;      //sOprImage is up to date
+#endif
+
+#ifdef OTA_CLIENT
+PRIVATE uint16 u16OprPeer = OPR_NO_PEER;    //source of the blocks, else the server
+PRIVATE uint8  u8OprPeerLqi = 0;
+PRIVATE uint16 u16OprBadPeer = OPR_NO_PEER; //went silent in this download
+PRIVATE uint32 u32OprLastRxMs = 0;
+#endif
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: OPR_bImageSpan
+ *
+ * DESCRIPTION:
+ * Where the blocks of an image kind are in external flash, on the server
+ * the image loaded by host, on a peer the image it runs
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8Image      R   OTA_IMAGE_xxx asked for
+ *             pu32Base     W   flash offset of the first block
+ *             pu32Bytes    W   length
+ *             pu32Crc      W   crc of the full image
+ *
+ * RETURNS:
+ * TRUE if there's such an image to serve
+ *
+ ****************************************************************************/
+PUBLIC bool OPR_bImageSpan(uint8 u8Image, uint32 *pu32Base, uint32 *pu32Bytes, uint32 *pu32Crc)
+{
+#if defined(OTA_SERVER)
+    uint32 u32ImageBytes  = g_sDevice.otaTotalBytes;
+    uint32 u32PatchBytes  = g_sDevice.otaPatchBytes;
+    uint32 u32PackedBytes = g_sDevice.otaPackedBytes;
+    *pu32Crc = g_sDevice.otaCrc;
+#elif defined(OTA_PEER)
+    tsOprImage *psImage = OPR_psImage();
+    if (NULL == psImage) return FALSE;
+    uint32 u32ImageBytes  = psImage->u32ImageBytes;
+    uint32 u32PatchBytes  = psImage->u32PatchBytes;
+    uint32 u32PackedBytes = psImage->u32PackedBytes;
+    *pu32Crc = psImage->u32Crc;
+#else
+    return FALSE;
+#endif
+
+#if defined(OTA_SERVER) || defined(OTA_PEER)
+    /* blocks of the delta patch or compressed image are counted from its start */
+    switch (u8Image)
+    {
+    case OTA_IMAGE_FULL:
+        *pu32Base = 0;
+        *pu32Bytes = u32ImageBytes;
+        break;
+    case OTA_IMAGE_DELTA:
+        *pu32Base = OTA_DELTA_OFFSET;
+        *pu32Bytes = u32PatchBytes;
+        break;
+    case OTA_IMAGE_PACKED:
+        *pu32Base = OTA_PACKED_OFFSET;
+        *pu32Bytes = u32PackedBytes;
+        break;
+    default:
+        return FALSE;
+    }
+    return (*pu32Bytes > 0);
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_vServed
+ *
+ * DESCRIPTION:
+ * A peer sent a block to a client
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Addr      R   client
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OPR_vServed(uint16 u16Addr)
+{
+    g_sOprStats.u32ServedBlocks++;
+    DBG_vPrintf(TRACE_OPR, "OPR: block to 0x%04x\r\n", u16Addr);
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_vQuery
+ *
+ * DESCRIPTION:
+ * A neighbour asks for an image, offer it if it's the one running here
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16SrcAddr   R   client
+ *             psReq        R   the query
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OPR_vQuery(uint16 u16SrcAddr, tsOtaPeerReq *psReq)
+{
+#ifdef OTA_PEER
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+    tsOtaPeerResp offer;
+    tsOprImage *psImage;
+
+    g_sOprStats.u32Queries++;
+    psImage = OPR_psImage();
+    if (NULL == psImage || psImage->u32Crc != psReq->crc || psImage->u32ImageBytes != psReq->imageBytes) return;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    offer.crc         = psImage->u32Crc;
+    offer.imageBytes  = psImage->u32ImageBytes;
+    offer.patchBytes  = psImage->u32PatchBytes;
+    offer.baseCrc     = psImage->u32BaseCrc;
+    offer.packedBytes = psImage->u32PackedBytes;
+
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaPeerResp);
+    apiSpec.teApiIdentifier = API_OTA_PEER_RESP;
+    apiSpec.payload.otaPeerResp = offer;
+    apiSpec.checkSum = calCheckSum((uint8 *)&offer, apiSpec.length);
+
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    if (API_bSendToAirPort(UNICAST, u16SrcAddr, tmp, size)) g_sOprStats.u32Offers++;
+    DBG_vPrintf(TRACE_OPR, "OPR: offer to 0x%04x\r\n", u16SrcAddr);
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_vInvalidate
+ *
+ * DESCRIPTION:
+ * A download starts, the external flash is about to change. Peers don't
+ * serve until they run the new image.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OPR_vInvalidate(void)
+{
+#ifdef OTA_PEER
+    bOprChecked = FALSE;
+#endif
+#ifdef OTA_CLIENT
+    u16OprPeer = OPR_NO_PEER;
+    u16OprBadPeer = OPR_NO_PEER;
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_u8Search
+ *
+ * DESCRIPTION:
+ * Ask the routers of the neighbour table for the image of the notice in
+ * g_sDevice. Nothing is asked if the server is a neighbour itself.
+ *
+ * PARAMETERS: Name           RW  Usage
+ *             u16ServerAddr  R   OTA server
+ *
+ * RETURNS:
+ * neighbours asked
+ *
+ ****************************************************************************/
+PUBLIC uint8 OPR_u8Search(uint16 u16ServerAddr)
+{
+    uint8 u8Asked = 0;
+#ifdef OTA_CLIENT
+    ZPS_tsNwkNib *thisNib = ZPS_psNwkNibGetHandle(ZPS_pvAplZdoGetNwkHandle());
+    uint16 i;
+
+    u16OprPeer = OPR_NO_PEER;
+    u16OprBadPeer = OPR_NO_PEER;
+
+    /* old servers send no image crc, a peer couldn't tell it has the image */
+    if (0 == g_sDevice.otaCrc) return 0;
+
+    for (i = 0; i < thisNib->sTblSize.u16NtActv; i++)
+    {
+        if (thisNib->sTbl.psNtActv[i].u16NwkAddr == u16ServerAddr) return 0;
+    }
+
+    /* routers only, sleeping end devices don't serve */
+    for (i = 0; i < thisNib->sTblSize.u16NtActv && u8Asked < OTA_PEER_MAX_QUERIES; i++)
+    {
+        uint16 u16Addr = thisNib->sTbl.psNtActv[i].u16NwkAddr;
+        if (u16Addr >= 0xfff8) continue;
+        if (!thisNib->sTbl.psNtActv[i].uAncAttrs.bfBitfields.u1RxOnWhenIdle) continue;
+        if (thisNib->sTbl.psNtActv[i].u8LinkQuality < OTA_PEER_MIN_LQI) continue;
+        if (OPR_bSendQuery(u16Addr)) u8Asked++;
+    }
+    DBG_vPrintf(TRACE_OPR, "OPR: %d neighbours asked\r\n", u8Asked);
+#endif
+    return u8Asked;
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_vOffer
+ *
+ * DESCRIPTION:
+ * A neighbour offers the image, take it if it has the image kind being
+ * downloaded and its link is better than the one of the current peer
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16SrcAddr   R   neighbour
+ *             u8Lqi        R   link quality of the offer
+ *             psResp       R   the offer
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OPR_vOffer(uint16 u16SrcAddr, uint8 u8Lqi, tsOtaPeerResp *psResp)
+{
+#ifdef OTA_CLIENT
+    uint32 u32Bytes;
+
+    if (1 != g_sDevice.otaDownloading || 0 != g_sDevice.otaSession) return;
+    if (psResp->crc != g_sDevice.otaCrc || psResp->imageBytes != g_sDevice.otaImageBytes) return;
+    if (u8Lqi < OTA_PEER_MIN_LQI || u16SrcAddr == u16OprBadPeer) return;
+
+    switch (g_sDevice.otaImage)
+    {
+    case OTA_IMAGE_DELTA:
+        if (psResp->baseCrc != APP_u32OtaRunningCrc()) return;
+        u32Bytes = psResp->patchBytes;
+        break;
+    case OTA_IMAGE_PACKED:
+        u32Bytes = psResp->packedBytes;
+        break;
+    default:
+        u32Bytes = psResp->imageBytes;
+        break;
+    }
+    if (u32Bytes != g_sDevice.otaTotalBytes) return;
+
+    if (OPR_NO_PEER != u16OprPeer && u8Lqi <= u8OprPeerLqi) return;
+    u16OprPeer = u16SrcAddr;
+    u8OprPeerLqi = u8Lqi;
+    u32OprLastRxMs = u32HAL_GetMsTime();
+    DBG_vPrintf(TRACE_OPR, "OPR: pull from 0x%04x, lqi %d\r\n", u16SrcAddr, u8Lqi);
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_vRxBlock
+ *
+ * DESCRIPTION:
+ * A block came in
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16SrcAddr   R   sender
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OPR_vRxBlock(uint16 u16SrcAddr)
+{
+#ifdef OTA_CLIENT
+    if (OPR_NO_PEER == u16OprPeer || u16SrcAddr != u16OprPeer) return;
+    u32OprLastRxMs = u32HAL_GetMsTime();
+    g_sOprStats.u32PeerBlocks++;
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_u16Source
+ *
+ * DESCRIPTION:
+ * Where block requests go
+ *
+ * RETURNS:
+ * short address of the peer, else of the server
+ *
+ ****************************************************************************/
+PUBLIC uint16 OPR_u16Source(void)
+{
+#ifdef OTA_CLIENT
+    if (OPR_NO_PEER != u16OprPeer) return u16OprPeer;
+#endif
+    return g_sDevice.otaSvrAddr16;
+}
+
+/****************************************************************************
+ *
+ * NAME: OPR_vCheckSource
+ *
+ * DESCRIPTION:
+ * Go back to the server when the peer went silent, e.g. it left the
+ * network or started a download of its own
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OPR_vCheckSource(void)
+{
+#ifdef OTA_CLIENT
+    if (OPR_NO_PEER == u16OprPeer) return;
+    if (u32HAL_GetMsTime() - u32OprLastRxMs < OTA_PEER_SILENCE_MS) return;
+
+    DBG_vPrintf(TRACE_OPR, "OPR: 0x%04x silent, back to server\r\n", u16OprPeer);
+    u16OprBadPeer = u16OprPeer;
+    u16OprPeer = OPR_NO_PEER;
+    g_sOprStats.u32Fallbacks++;
+#endif
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+#ifdef OTA_PEER
+/*
+  image this router serves: a valid image in external flash which is the
+  one running, so it was checked before the upgrade. Worked out once, its
+  crc reads the whole image.
+*/
+PRIVATE tsOprImage *OPR_psImage(void)
+{
+    uint8 au8Values[OTA_MAGIC_NUM_LEN];
+    uint32 u32Len = 0;
+
+    if (!g_sDevice.supportOTA || g_sDevice.otaDownloading > 0) return NULL;
+    if (bOprChecked) return (sOprImage.u32ImageBytes > 0) ? &sOprImage : NULL;
+
+    bOprChecked = TRUE;
+    memset(&sOprImage, 0, sizeof(sOprImage));
+
+    APP_vOtaFlashLockRead(OTA_MAGIC_OFFSET, OTA_MAGIC_NUM_LEN, au8Values);
+    if (memcmp(magicNum, au8Values, OTA_MAGIC_NUM_LEN) != 0) return NULL;
+    APP_vOtaFlashLockRead(OTA_IMAGE_LEN_OFFSET, 4, (uint8 *)&u32Len);
+    if (0 == u32Len || u32Len > 256 * 1024) return NULL;
+
+    uint32 u32Crc = imageCrc(u32Len);
+    if (u32Crc != APP_u32OtaRunningCrc()) return NULL;
+
+    sOprImage.u32ImageBytes  = u32Len;
+    sOprImage.u32Crc         = u32Crc;
+    sOprImage.u32PatchBytes  = APP_u32OtaPatchBytes(u32Len, u32Crc, NULL, &sOprImage.u32BaseCrc);
+    sOprImage.u32PackedBytes = APP_u32OtaPackedBytes(u32Len, u32Crc);
+    DBG_vPrintf(TRACE_OPR, "OPR: serving image of %d bytes, crc 0x%08x\r\n", u32Len, u32Crc);
+    return &sOprImage;
+}
+#endif
+
+#ifdef OTA_CLIENT
+PRIVATE bool OPR_bSendQuery(uint16 u16DstAddr)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+    tsOtaPeerReq query;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    query.crc = g_sDevice.otaCrc;
+    query.imageBytes = g_sDevice.otaImageBytes;
+
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaPeerReq);
+    apiSpec.teApiIdentifier = API_OTA_PEER_REQ;
+    apiSpec.payload.otaPeerReq = query;
+    apiSpec.checkSum = calCheckSum((uint8 *)&query, apiSpec.length);
+
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    return API_bSendToAirPort(UNICAST, u16DstAddr, tmp, size);
+}
+#endif
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
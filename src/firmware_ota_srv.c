@@ -0,0 +1,432 @@
+/*
+ * firmware_ota_srv.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_ota.h"
+#include "firmware_ota_srv.h"
+#include "firmware_ota_host.h"
+#include "firmware_uart.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_OSV
+#define TRACE_OSV  FALSE
+#endif
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/*
+  Unicast downloads are pulled by the clients, every block request carries
+  all the server needs to answer it, so any number of clients are served
+  at the same time. The session table only watches them: a slot per client
+  address, taken by the notice or the first block request and kept until
+  it is reused for another client.
+*/
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+PRIVATE tsOsvSession *OSV_psSession(uint16 u16Addr, bool bAdd);
+PRIVATE bool OSV_bActive(tsOsvSession *psSession, uint32 u32NowMs);
+PRIVATE uint32 OSV_u32Rate(tsOsvSession *psSession);
+#endif
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+PRIVATE tsOsvSession asOsvSession[OSV_MAX_SESSIONS];
+PRIVATE uint16 u16OsvUntracked = 0;       //requests of clients beyond the table
+PRIVATE bool   bOsvReporting = FALSE;
+
+PRIVATE const char *apcOsvState[] = { "free", "notified", "downloading", "done", "aborted" };
+#endif
+
+/****************************************************************************/
+/***        Tasks                                                         ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: APP_taskOtaSrv
+ *
+ * DESCRIPTION:
+ * Aggregate progress report to host, every OSV_REPORT_MS while clients
+ * download. Text only in AT mode, it would break the frames of API mode.
+ * Also checks the copy of a host stream in flash, a step per run.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+OS_TASK(APP_taskOtaSrv)
+{
+#ifdef OTA_SERVER
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    uint16 i;
+    bool bActive = FALSE;
+
+    if (OHS_bCheckStep()) OS_eActivateTask(APP_taskOtaSrv);
+
+    for (i = 0; i < OSV_MAX_SESSIONS && !bActive; i++)
+    {
+        bActive = OSV_bActive(&asOsvSession[i], u32NowMs);
+    }
+
+    if (E_MODE_AT == g_sDevice.eMode) OSV_vPrintStatus(FALSE);
+    if (bActive)
+    {
+        vResetATimer(APP_tmrOtaSrv, APP_TIME_MS(OSV_REPORT_MS));
+    }
+    else
+    {
+        bOsvReporting = FALSE;
+    }
+#endif
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+#ifdef OTA_SERVER
+
+/****************************************************************************
+ *
+ * NAME: OSV_vNotified
+ *
+ * DESCRIPTION:
+ * An OTA notice was sent to a client, its session starts over
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Addr      R   client
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OSV_vNotified(uint16 u16Addr)
+{
+    tsOsvSession *psSession = OSV_psSession(u16Addr, TRUE);
+    if (NULL == psSession) return;
+
+    memset(psSession, 0, sizeof(tsOsvSession));
+    psSession->u16Addr = u16Addr;
+    psSession->eState = E_OSV_NOTIFIED;
+    psSession->u32StartMs = psSession->u32LastMs = u32HAL_GetMsTime();
+}
+
+/****************************************************************************
+ *
+ * NAME: OSV_vServed
+ *
+ * DESCRIPTION:
+ * A block request of a client was answered
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Addr      R   client
+ *             u8Image      R   OTA_IMAGE_xxx asked for
+ *             u32BlockIdx  R   block asked for
+ *             u8BlockSize  R   block size of the client
+ *             u16Len       R   bytes sent
+ *             u32Blocks    R   blocks of the image asked for
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OSV_vServed(uint16 u16Addr, uint8 u8Image, uint32 u32BlockIdx, uint8 u8BlockSize,
+                        uint16 u16Len, uint32 u32Blocks)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    tsOsvSession *psSession = OSV_psSession(u16Addr, TRUE);
+    if (NULL == psSession) return;
+
+    /* a new download, e.g. after the notice of a fleet rollout or a resume */
+    if (E_OSV_DOWNLOADING != psSession->eState ||
+        u8Image != psSession->u8Image || u8BlockSize != psSession->u8BlockSize)
+    {
+        memset(psSession, 0, sizeof(tsOsvSession));
+        psSession->u16Addr     = u16Addr;
+        psSession->eState      = E_OSV_DOWNLOADING;
+        psSession->u8Image     = u8Image;
+        psSession->u8BlockSize = u8BlockSize;
+        psSession->u32Blocks   = u32Blocks;
+        psSession->u32StartMs  = u32NowMs;
+        DBG_vPrintf(TRACE_OSV, "OSV: 0x%04x starts at blk %ld of %ld, image %d\r\n",
+                    u16Addr, u32BlockIdx, u32Blocks, u8Image);
+    }
+
+    psSession->u32Requests++;
+    if (u32BlockIdx < psSession->u32NextBlock)
+    {
+        psSession->u32Repeats++;
+    }
+    else
+    {
+        psSession->u32NextBlock = u32BlockIdx + 1;
+    }
+    psSession->u32ServedBytes += u16Len;
+    psSession->u32LastMs = u32NowMs;
+    if (psSession->u32Blocks > 0)
+    {
+        psSession->u8Per = (uint8)((uint64)psSession->u32NextBlock * 100 / psSession->u32Blocks);
+    }
+
+    if (!bOsvReporting)
+    {
+        bOsvReporting = TRUE;
+        vResetATimer(APP_tmrOtaSrv, APP_TIME_MS(OSV_REPORT_MS));
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: OSV_vStatus
+ *
+ * DESCRIPTION:
+ * A client answered a status poll(ATOS)
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Addr      R   client
+ *             bInOta       R   client is downloading
+ *             u8Per        R   percent received by the client
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OSV_vStatus(uint16 u16Addr, bool bInOta, uint8 u8Per)
+{
+    tsOsvSession *psSession = OSV_psSession(u16Addr, FALSE);
+    if (NULL == psSession) return;
+
+    psSession->u32LastMs = u32HAL_GetMsTime();
+    if (bInOta && E_OSV_DOWNLOADING == psSession->eState) psSession->u8Per = u8Per;
+}
+
+/****************************************************************************
+ *
+ * NAME: OSV_vDone
+ *
+ * DESCRIPTION:
+ * A client checked its image and asks for the upgrade
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Addr      R   client
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OSV_vDone(uint16 u16Addr)
+{
+    tsOsvSession *psSession = OSV_psSession(u16Addr, TRUE);
+    if (NULL == psSession) return;
+
+    /* the request is repeated until the client reboots */
+    if (E_OSV_DONE == psSession->eState) return;
+    psSession->eState = E_OSV_DONE;
+    psSession->u8Per = 100;
+    psSession->u32LastMs = u32HAL_GetMsTime();
+}
+
+/****************************************************************************
+ *
+ * NAME: OSV_vAborted
+ *
+ * DESCRIPTION:
+ * A client acknowledged an abort
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Addr      R   client
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OSV_vAborted(uint16 u16Addr)
+{
+    tsOsvSession *psSession = OSV_psSession(u16Addr, FALSE);
+    if (NULL == psSession) return;
+
+    psSession->eState = E_OSV_ABORTED;
+    psSession->u32LastMs = u32HAL_GetMsTime();
+}
+
+/****************************************************************************
+ *
+ * NAME: OSV_vReset
+ *
+ * DESCRIPTION:
+ * Forget every session, e.g. before a fleet rollout of a new image
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OSV_vReset(void)
+{
+    memset(asOsvSession, 0, sizeof(asOsvSession));
+    u16OsvUntracked = 0;
+}
+
+/****************************************************************************
+ *
+ * NAME: OSV_vPrintStatus
+ *
+ * DESCRIPTION:
+ * Print the aggregate progress of all clients to host, and a line per
+ * client if asked for
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             bClients     R   list the clients too
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void OSV_vPrintStatus(bool bClients)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    uint32 u32Rate = 0, u32PerSum = 0;
+    uint16 i, u16Clients = 0, u16Active = 0, u16Stalled = 0, u16Done = 0;
+
+    for (i = 0; i < OSV_MAX_SESSIONS; i++)
+    {
+        tsOsvSession *psSession = &asOsvSession[i];
+        if (E_OSV_FREE == psSession->eState) continue;
+
+        u16Clients++;
+        u32PerSum += psSession->u8Per;
+        if (E_OSV_DONE == psSession->eState) u16Done++;
+        if (OSV_bActive(psSession, u32NowMs))
+        {
+            u16Active++;
+            u32Rate += OSV_u32Rate(psSession);
+        }
+        else if (E_OSV_DOWNLOADING == psSession->eState)
+        {
+            u16Stalled++;
+        }
+
+        if (bClients)
+        {
+            uart_printf("  0x%04x: %3d%% %s, image %d, %ld/%ld blks, %ld repeated, %ld B/s, seen %lds ago\r\n",
+                        psSession->u16Addr, psSession->u8Per, apcOsvState[psSession->eState],
+                        psSession->u8Image, psSession->u32NextBlock, psSession->u32Blocks,
+                        psSession->u32Repeats, OSV_u32Rate(psSession),
+                        (u32NowMs - psSession->u32LastMs) / 1000);
+        }
+    }
+
+    uart_printf("OTA: %d clients, %d downloading, %d stalled, %d done, %d untracked, avg %ld%%, %ld B/s\r\n",
+                u16Clients, u16Active, u16Stalled, u16Done, u16OsvUntracked,
+                (u16Clients > 0) ? u32PerSum / u16Clients : 0, u32Rate);
+
+    if (bClients)
+    {
+        uart_printf("OTA: flash cache %ld/%ld reads hit, %ld pages read, %ld ahead\r\n",
+                    g_sOtaCacheStats.u32Hits, g_sOtaCacheStats.u32Reads,
+                    g_sOtaCacheStats.u32Fills, g_sOtaCacheStats.u32ReadAheads);
+    }
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/*
+  session of a client; a new one takes a free slot, else the slot of a
+  finished or the longest silent client
+*/
+PRIVATE tsOsvSession *OSV_psSession(uint16 u16Addr, bool bAdd)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    tsOsvSession *psVictim = NULL;
+    uint32 u32VictimIdle = 0;
+    uint16 i;
+
+    for (i = 0; i < OSV_MAX_SESSIONS; i++)
+    {
+        if (E_OSV_FREE != asOsvSession[i].eState && asOsvSession[i].u16Addr == u16Addr) return &asOsvSession[i];
+    }
+    if (!bAdd) return NULL;
+
+    for (i = 0; i < OSV_MAX_SESSIONS; i++)
+    {
+        tsOsvSession *psSession = &asOsvSession[i];
+        uint32 u32Idle;
+
+        if (E_OSV_FREE == psSession->eState) return psSession;
+        if (OSV_bActive(psSession, u32NowMs)) continue;
+
+        /* done or aborted ones go first */
+        u32Idle = u32NowMs - psSession->u32LastMs;
+        if (E_OSV_DONE == psSession->eState || E_OSV_ABORTED == psSession->eState) u32Idle |= 0x80000000;
+        if (NULL == psVictim || u32Idle > u32VictimIdle)
+        {
+            psVictim = psSession;
+            u32VictimIdle = u32Idle;
+        }
+    }
+
+    if (NULL == psVictim)
+    {
+        u16OsvUntracked++;
+        return NULL;
+    }
+    memset(psVictim, 0, sizeof(tsOsvSession));
+    psVictim->u16Addr = u16Addr;
+    psVictim->eState = E_OSV_NOTIFIED;
+    psVictim->u32StartMs = psVictim->u32LastMs = u32NowMs;
+    return psVictim;
+}
+
+/* notified or downloading, and heard of lately */
+PRIVATE bool OSV_bActive(tsOsvSession *psSession, uint32 u32NowMs)
+{
+    if (E_OSV_NOTIFIED != psSession->eState && E_OSV_DOWNLOADING != psSession->eState) return FALSE;
+    return (u32NowMs - psSession->u32LastMs) < OSV_STALE_MS;
+}
+
+/* bytes/s served to a client since its first block request */
+PRIVATE uint32 OSV_u32Rate(tsOsvSession *psSession)
+{
+    uint32 u32Ms = psSession->u32LastMs - psSession->u32StartMs;
+    if (E_OSV_NOTIFIED == psSession->eState || 0 == u32Ms) return 0;
+    return (uint32)((uint64)psSession->u32ServedBytes * 1000 / u32Ms);
+}
+
+#endif
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,281 @@
+/*
+ * firmware_poll.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_poll.h"
+#include "firmware_sleep.h"
+#include "firmware_uart.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_POL
+#define TRACE_POL  FALSE
+#endif
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/*
+  An end device gets its frames by polling the parent. Right after a
+  transmit or a received frame more traffic is likely, a remote AT
+  response or the rest of a burst, so it polls at the floor interval for
+  POL_FAST_POLLS polls. Then every poll without data doubles the interval
+  up to the ceiling. A poll which brought a frame is followed by another
+  at once, the parent may hold more.
+*/
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+#ifdef TARGET_END
+PRIVATE uint32 POL_u32Interval(void);
+PRIVATE void POL_vPollIn(uint32 u32Ms);
+#endif
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+#ifdef TARGET_END
+PRIVATE uint8  u8PolIdle = 0;           //polls since the last traffic
+PRIVATE uint32 u32PolLastPollMs = 0;
+PRIVATE uint32 u32PolPrevPollMs = 0;
+PRIVATE uint32 u32PolNextMs = 0;        //next poll is due
+PRIVATE uint32 u32PolTxMs = 0;
+PRIVATE bool   bPolAwaitResp = FALSE;   //a frame was sent, the next one received may answer it
+
+PRIVATE tsPolStats sPolStats;
+#endif
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: POL_u32Polled
+ *
+ * DESCRIPTION:
+ * PollTask polled the parent, the interval grows while there's no traffic
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             bSent        R   the stack accepted the poll
+ *
+ * RETURNS:
+ * ms to the next poll
+ *
+ ****************************************************************************/
+PUBLIC uint32 POL_u32Polled(bool bSent)
+{
+#ifdef TARGET_END
+    uint32 u32NowMs = u32HAL_GetMsTime();
+
+    if (bSent)
+    {
+        sPolStats.u32Polls++;
+        u32PolPrevPollMs = u32PolLastPollMs;
+        u32PolLastPollMs = u32NowMs;
+    }
+    else
+    {
+        sPolStats.u32Failed++;
+    }
+    if (u8PolIdle < 0xff) u8PolIdle++;
+
+    uint32 u32Ms = POL_u32Interval();
+    u32PolNextMs = u32NowMs + u32Ms;
+    DBG_vPrintf(TRACE_POL, "POL: next in %d ms \r\n", u32Ms);
+    return u32Ms;
+#else
+    return POL_FIXED_MS;
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: POL_vPollConfirm
+ *
+ * DESCRIPTION:
+ * The parent answered a poll. A frame came with it, poll again soon for
+ * the rest.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8Status     R   MAC status of the poll
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void POL_vPollConfirm(uint8 u8Status)
+{
+#ifdef TARGET_END
+    if (MAC_ENUM_SUCCESS == u8Status)
+    {
+        /* the frame waited at the parent for the last interval at most */
+        sPolStats.u32DataPolls++;
+        sPolStats.u32WaitSumMs += u32PolLastPollMs - u32PolPrevPollMs;
+        u8PolIdle = 0;
+        POL_vPollIn(POL_MORE_DATA_MS);
+    }
+    else if (MAC_ENUM_NO_DATA != u8Status)
+    {
+        sPolStats.u32Failed++;
+    }
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: POL_vTraffic
+ *
+ * DESCRIPTION:
+ * A frame was sent or received, poll fast again
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             bRx          R   received, else sent
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void POL_vTraffic(bool bRx)
+{
+#ifdef TARGET_END
+    uint32 u32NowMs = u32HAL_GetMsTime();
+
+    if (!bRx)
+    {
+        u32PolTxMs = u32NowMs;
+        bPolAwaitResp = TRUE;
+    }
+    else if (bPolAwaitResp)
+    {
+        uint32 u32Ms = u32NowMs - u32PolTxMs;
+        bPolAwaitResp = FALSE;
+        if (u32Ms < POL_RESP_WINDOW_MS)
+        {
+            sPolStats.u32Resps++;
+            sPolStats.u32RespSumMs += u32Ms;
+            if (u32Ms > sPolStats.u32RespMaxMs) sPolStats.u32RespMaxMs = u32Ms;
+        }
+    }
+
+    u8PolIdle = 0;
+    POL_vPollIn(POL_u32Interval());
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: POL_vResetStats
+ *
+ * DESCRIPTION:
+ * Count polls and latency from now on, after the floor or ceiling changed
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void POL_vResetStats(void)
+{
+#ifdef TARGET_END
+    memset(&sPolStats, 0, sizeof(tsPolStats));
+    sPolStats.u32StartMs = u32HAL_GetMsTime();
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: POL_vPrintStatus
+ *
+ * DESCRIPTION:
+ * Print the poll interval, polls per awake hour and downlink latency
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void POL_vPrintStatus(void)
+{
+#ifdef TARGET_END
+    uint32 u32AwakeSec = (u32HAL_GetMsTime() - sPolStats.u32StartMs) / 1000;
+    uint32 u32PerHour = (u32AwakeSec > 0) ? (uint32)((uint64)sPolStats.u32Polls * 3600 / u32AwakeSec) : 0;
+
+    uart_printf("Poll Interval    : %d ms now, floor %d ms, ceiling %d ms \r\n", POL_u32Interval(),
+                g_sDevice.config.pollFloorMs ? g_sDevice.config.pollFloorMs : POL_DEF_FLOOR_MS,
+                g_sDevice.config.pollCeilMs ? g_sDevice.config.pollCeilMs : POL_DEF_CEIL_MS);
+    uart_printf("Polls            : %d in %ds awake, %d per hour(fixed %d ms: %d), %d with data, %d failed \r\n",
+                sPolStats.u32Polls, u32AwakeSec, u32PerHour, POL_FIXED_MS, 3600000 / POL_FIXED_MS,
+                sPolStats.u32DataPolls, sPolStats.u32Failed);
+    uart_printf("Downlink Latency : wait at parent <= %d ms avg, reply to a transmit %d ms avg, %d ms max \r\n",
+                sPolStats.u32DataPolls ? sPolStats.u32WaitSumMs / sPolStats.u32DataPolls : 0,
+                sPolStats.u32Resps ? sPolStats.u32RespSumMs / sPolStats.u32Resps : 0,
+                sPolStats.u32RespMaxMs);
+#endif
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+#ifdef TARGET_END
+
+/* floor for POL_FAST_POLLS polls after traffic, then doubling up to the ceiling */
+PRIVATE uint32 POL_u32Interval(void)
+{
+    uint32 u32Floor = g_sDevice.config.pollFloorMs ? g_sDevice.config.pollFloorMs : POL_DEF_FLOOR_MS;
+    uint32 u32Ceil = g_sDevice.config.pollCeilMs ? g_sDevice.config.pollCeilMs : POL_DEF_CEIL_MS;
+    uint32 u32Ms = u32Floor;
+    uint8 i;
+
+    if (u32Ceil > POL_MAX_CEIL_MS) u32Ceil = POL_MAX_CEIL_MS;
+    if (u32Floor > u32Ceil) return u32Ceil;
+
+    for (i = POL_FAST_POLLS; i < u8PolIdle && u32Ms < u32Ceil; i++)
+    {
+        u32Ms <<= 1;
+    }
+    return (u32Ms > u32Ceil) ? u32Ceil : u32Ms;
+}
+
+/* bring the next poll forward, the timers must stay stopped once a sleep is set */
+PRIVATE void POL_vPollIn(uint32 u32Ms)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+
+    if (bGetSleepStatus() || OS_eGetSWTimerStatus(PollTimer) != OS_E_SWTIMER_RUNNING) return;
+    if ((int32)(u32PolNextMs - u32NowMs) <= (int32)u32Ms) return;
+
+    u32PolNextMs = u32NowMs + u32Ms;
+    vResetATimer(PollTimer, APP_TIME_MS(u32Ms));
+}
+
+#endif
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,393 @@
+/*
+ * firmware_qos.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_qos.h"
+#include "firmware_at_api.h"
+#include "firmware_aggr.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_QOS
+#define TRACE_QOS  FALSE
+#endif
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/* a frame waiting for its turn */
+typedef struct
+{
+    uint16 u16TxMode;
+    uint16 u16DstAddr;
+    uint8  u8Len;
+    uint8  u8Tries;
+    uint32 u32EnqueueMs;
+    uint8  au8Buf[QOS_MAX_FRAME];
+}tsQosFrame;
+
+/* transmit queue of one class */
+typedef struct
+{
+    uint8      u8Head;
+    uint8      u8Count;
+    uint8      u8InFlight;
+    tsQosStats sStats;
+    tsQosFrame asFrame[QOS_QUEUE_LEN];
+}tsQosQueue;
+
+/* an APDU handed to the stack, freed by the confirm of its APS counter */
+typedef struct
+{
+    bool   bUsed;
+    uint8  u8SeqNum;
+    uint8  u8Class;
+    uint32 u32SentMs;
+}tsQosInFlight;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE bool QOS_bMayBypass(teQosClass eClass);
+PRIVATE bool QOS_bTransmit(teQosClass eClass, uint16 u16TxMode, uint16 u16DstAddr, uint8 *pu8Frame, int len);
+PRIVATE void QOS_vExpireInFlight(uint32 u32Now);
+PRIVATE teQosClass QOS_ePickClass(void);
+PRIVATE void QOS_vArmTimer(void);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+PRIVATE tsQosQueue asQosQueue[E_QOS_CLASSES];
+PRIVATE tsQosInFlight asQosInFlight[QOS_APDUS];
+PRIVATE uint8 u8QosCtrlRun = 0;    //control frames sent in a row while bulk waits
+
+/****************************************************************************/
+/***        Tasks                                                         ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: APP_taskQos
+ *
+ * DESCRIPTION:
+ * Scheduler of the transmit queues. When both classes wait, control gets
+ * QOS_CTRL_WEIGHT frames out per bulk frame, so neither starves.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+OS_TASK(APP_taskQos)
+{
+    uint32 u32Now = u32HAL_GetMsTime();
+    teQosClass eClass;
+
+    QOS_vExpireInFlight(u32Now);
+
+    while (E_QOS_CLASSES != (eClass = QOS_ePickClass()))
+    {
+        tsQosQueue *psQueue = &asQosQueue[eClass];
+        tsQosFrame *psFrame = &psQueue->asFrame[psQueue->u8Head];
+
+        if (QOS_bTransmit(eClass, psFrame->u16TxMode, psFrame->u16DstAddr, psFrame->au8Buf, psFrame->u8Len))
+        {
+            uint32 u32Wait = u32Now - psFrame->u32EnqueueMs;
+            psQueue->sStats.u32WaitSumMs += u32Wait;
+            if (u32Wait > psQueue->sStats.u16WaitMaxMs)
+            {
+                psQueue->sStats.u16WaitMaxMs = (u32Wait > 0xffff) ? 0xffff : (uint16)u32Wait;
+            }
+        } else if (++psFrame->u8Tries < QOS_MAX_TRIES)
+        {
+            break;      //no APDU now, try again later
+        } else
+        {
+            DBG_vPrintf(TRACE_QOS, "QOS: class %d frame to 0x%04x dropped\r\n", eClass, psFrame->u16DstAddr);
+            psQueue->sStats.u32Drops++;
+        }
+
+        psQueue->u8Head = (psQueue->u8Head + 1) % QOS_QUEUE_LEN;
+        psQueue->u8Count--;
+    }
+    QOS_vArmTimer();
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: QOS_eClassify
+ *
+ * DESCRIPTION:
+ * Traffic class of an API frame or aggregation container. Data frames
+ * with OPTION_PRIO_MASK go in the control class.
+ *
+ * RETURNS:
+ * teQosClass
+ *
+ ****************************************************************************/
+PUBLIC teQosClass QOS_eClassify(uint8 *pu8Frame, int len)
+{
+    if (len < 3) return E_QOS_CONTROL;
+    if (AGR_DELIMITER == pu8Frame[0]) return E_QOS_BULK;
+
+    switch (pu8Frame[2])
+    {
+    case API_DATA_PACKET:
+        /* delimiter, length, identifier, frameId, option */
+        if (len > 4 && (pu8Frame[4] & OPTION_PRIO_MASK)) return E_QOS_CONTROL;
+        return E_QOS_BULK;
+    case API_STREAM_DATA:
+    case API_OTA_NTC:
+    case API_OTA_REQ:
+    case API_OTA_RESP:
+    case API_OTA_MC_BLK:
+    case API_SAMPLE_BATCH:
+        return E_QOS_BULK;
+    default:
+        return E_QOS_CONTROL;
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: QOS_bSend
+ *
+ * DESCRIPTION:
+ * Send a frame at once when nothing of higher or equal priority waits
+ * and its class has an APDU left, otherwise queue it for APP_taskQos
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16TxMode    R   BROADCAST or UNICAST
+ *             u16DstAddr   R   short address of destination
+ *             pu8Frame     R   frame to send
+ *             len          R   frame length
+ *
+ * RETURNS:
+ * TRUE if the frame is sent or queued
+ *
+ ****************************************************************************/
+PUBLIC bool QOS_bSend(uint16 u16TxMode, uint16 u16DstAddr, uint8 *pu8Frame, int len)
+{
+    teQosClass eClass = QOS_eClassify(pu8Frame, len);
+    tsQosQueue *psQueue = &asQosQueue[eClass];
+    tsQosFrame *psFrame;
+
+    QOS_vExpireInFlight(u32HAL_GetMsTime());
+
+    if (QOS_bMayBypass(eClass) && QOS_bTransmit(eClass, u16TxMode, u16DstAddr, pu8Frame, len))
+    {
+        return TRUE;
+    }
+
+    if (len > QOS_MAX_FRAME || psQueue->u8Count >= QOS_QUEUE_LEN)
+    {
+        psQueue->sStats.u32Drops++;
+        return FALSE;
+    }
+
+    psFrame = &psQueue->asFrame[(psQueue->u8Head + psQueue->u8Count) % QOS_QUEUE_LEN];
+    psFrame->u16TxMode = u16TxMode;
+    psFrame->u16DstAddr = u16DstAddr;
+    psFrame->u8Len = len;
+    psFrame->u8Tries = 0;
+    psFrame->u32EnqueueMs = u32HAL_GetMsTime();
+    memcpy(psFrame->au8Buf, pu8Frame, len);
+    psQueue->u8Count++;
+    psQueue->sStats.u32Queued++;
+
+    /* don't push a running retry further out */
+    if (OS_E_SWTIMER_RUNNING != OS_eGetSWTimerStatus(APP_tmrQos))
+    {
+        vResetATimer(APP_tmrQos, APP_TIME_MS(QOS_RETRY_MS));
+    }
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: QOS_vTxConfirm
+ *
+ * DESCRIPTION:
+ * The stack confirmed a frame, its APDU is free again
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8SeqNum     R   APS counter of the frame
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void QOS_vTxConfirm(uint8 u8SeqNum)
+{
+    int i;
+
+    for (i = 0; i < QOS_APDUS; i++)
+    {
+        if (asQosInFlight[i].bUsed && asQosInFlight[i].u8SeqNum == u8SeqNum)
+        {
+            asQosInFlight[i].bUsed = FALSE;
+            asQosQueue[asQosInFlight[i].u8Class].u8InFlight--;
+            break;
+        }
+    }
+
+    if (asQosQueue[E_QOS_CONTROL].u8Count || asQosQueue[E_QOS_BULK].u8Count)
+    {
+        OS_eActivateTask(APP_taskQos);
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: QOS_vGetStats
+ *
+ * DESCRIPTION:
+ * Statistics of a traffic class
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void QOS_vGetStats(teQosClass eClass, tsQosStats *psStats)
+{
+    *psStats = asQosQueue[eClass].sStats;
+    psStats->u8InFlight = asQosQueue[eClass].u8InFlight;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* control only waits behind control, bulk waits behind anything queued */
+PRIVATE bool QOS_bMayBypass(teQosClass eClass)
+{
+    if (E_QOS_CONTROL == eClass) return (0 == asQosQueue[E_QOS_CONTROL].u8Count);
+
+    return (0 == asQosQueue[E_QOS_CONTROL].u8Count) &&
+           (0 == asQosQueue[E_QOS_BULK].u8Count) &&
+           (asQosQueue[E_QOS_BULK].u8InFlight < QOS_BULK_MAX_APDUS);
+}
+
+/****************************************************************************
+ *
+ * NAME: QOS_bTransmit
+ *
+ * DESCRIPTION:
+ * Hand a frame to the stack and count its APDU for the class
+ *
+ * RETURNS:
+ * TRUE if the stack accepted it
+ *
+ ****************************************************************************/
+PRIVATE bool QOS_bTransmit(teQosClass eClass, uint16 u16TxMode, uint16 u16DstAddr, uint8 *pu8Frame, int len)
+{
+    uint8 u8SeqNum = 0;
+    int i, iFree = 0;
+
+    if (!API_bSendToAirPortApdu(u16TxMode, u16DstAddr, pu8Frame, len, &u8SeqNum)) return FALSE;
+
+    /* take a free entry, or the oldest one if the stack never confirmed */
+    for (i = 0; i < QOS_APDUS; i++)
+    {
+        if (!asQosInFlight[i].bUsed)
+        {
+            iFree = i;
+            break;
+        }
+        if ((int32)(asQosInFlight[i].u32SentMs - asQosInFlight[iFree].u32SentMs) < 0) iFree = i;
+    }
+    if (asQosInFlight[iFree].bUsed) asQosQueue[asQosInFlight[iFree].u8Class].u8InFlight--;
+
+    asQosInFlight[iFree].bUsed = TRUE;
+    asQosInFlight[iFree].u8SeqNum = u8SeqNum;
+    asQosInFlight[iFree].u8Class = eClass;
+    asQosInFlight[iFree].u32SentMs = u32HAL_GetMsTime();
+    asQosQueue[eClass].u8InFlight++;
+    asQosQueue[eClass].sStats.u32Frames++;
+    return TRUE;
+}
+
+/* confirms can get lost, e.g. when the stack drops a frame silently */
+PRIVATE void QOS_vExpireInFlight(uint32 u32Now)
+{
+    int i;
+
+    for (i = 0; i < QOS_APDUS; i++)
+    {
+        if (asQosInFlight[i].bUsed && u32Now - asQosInFlight[i].u32SentMs >= QOS_INFLIGHT_TIMEOUT_MS)
+        {
+            asQosInFlight[i].bUsed = FALSE;
+            asQosQueue[asQosInFlight[i].u8Class].u8InFlight--;
+        }
+    }
+}
+
+/* weighted round robin over the classes that can send */
+PRIVATE teQosClass QOS_ePickClass(void)
+{
+    bool bCtrl = (asQosQueue[E_QOS_CONTROL].u8Count > 0);
+    bool bBulk = (asQosQueue[E_QOS_BULK].u8Count > 0) &&
+                 (asQosQueue[E_QOS_BULK].u8InFlight < QOS_BULK_MAX_APDUS);
+
+    if (bCtrl && bBulk)
+    {
+        if (u8QosCtrlRun < QOS_CTRL_WEIGHT)
+        {
+            u8QosCtrlRun++;
+            return E_QOS_CONTROL;
+        }
+        u8QosCtrlRun = 0;
+        return E_QOS_BULK;
+    }
+    if (bCtrl) return E_QOS_CONTROL;
+    if (bBulk)
+    {
+        u8QosCtrlRun = 0;
+        return E_QOS_BULK;
+    }
+    return E_QOS_CLASSES;
+}
+
+PRIVATE void QOS_vArmTimer(void)
+{
+    if (asQosQueue[E_QOS_CONTROL].u8Count || asQosQueue[E_QOS_BULK].u8Count)
+    {
+        vResetATimer(APP_tmrQos, APP_TIME_MS(QOS_RETRY_MS));
+    } else if (OS_eGetSWTimerStatus(APP_tmrQos) != OS_E_SWTIMER_STOPPED)
+    {
+        OS_eStopSWTimer(APP_tmrQos);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
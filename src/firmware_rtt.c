@@ -0,0 +1,125 @@
+/*
+ * firmware_rtt.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include "firmware_rtt.h"
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: RTT_vInit
+ *
+ * DESCRIPTION:
+ * Forget the samples, the timeout is u32InitRtoMs until rtt is measured
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psRtt        W   estimator
+ *             u32InitRtoMs R   timeout before the first sample
+ *             u32MinRtoMs  R   timeout never goes below
+ *             u32MaxRtoMs  R   nor above, backoff included
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void RTT_vInit(tsRtt *psRtt, uint32 u32InitRtoMs, uint32 u32MinRtoMs, uint32 u32MaxRtoMs)
+{
+    if (u32InitRtoMs < u32MinRtoMs) u32InitRtoMs = u32MinRtoMs;
+    if (u32InitRtoMs > u32MaxRtoMs) u32InitRtoMs = u32MaxRtoMs;
+
+    psRtt->u32SrttMs   = 0;
+    psRtt->u32RttVarMs = 0;
+    psRtt->u32RtoMs    = u32InitRtoMs;
+    psRtt->u32MinRtoMs = u32MinRtoMs;
+    psRtt->u32MaxRtoMs = u32MaxRtoMs;
+}
+
+/****************************************************************************
+ *
+ * NAME: RTT_vSample
+ *
+ * DESCRIPTION:
+ * Jacobson/Karels estimator, RTO = SRTT + 4 * RTTVAR.
+ * A full window queues up in the mesh and RTT jumps while the variance is
+ * still small, so RTO never drops below 1.5 * SRTT to avoid spurious resends.
+ * Only sample frames which were sent once(Karn).
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psRtt        RW  estimator
+ *             u32RttMs     R   measured round trip
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void RTT_vSample(tsRtt *psRtt, uint32 u32RttMs)
+{
+    if (0 == psRtt->u32SrttMs)
+    {
+        psRtt->u32SrttMs = u32RttMs + 1;
+        psRtt->u32RttVarMs = u32RttMs / 2;
+    }
+    else
+    {
+        uint32 u32Err = (u32RttMs > psRtt->u32SrttMs) ?
+            (u32RttMs - psRtt->u32SrttMs) : (psRtt->u32SrttMs - u32RttMs);
+        psRtt->u32RttVarMs = (3 * psRtt->u32RttVarMs + u32Err) / 4;
+        psRtt->u32SrttMs = (7 * psRtt->u32SrttMs + u32RttMs) / 8 + 1;
+    }
+
+    psRtt->u32RtoMs = psRtt->u32SrttMs + 4 * psRtt->u32RttVarMs;
+    if (psRtt->u32RtoMs < psRtt->u32SrttMs * 3 / 2) psRtt->u32RtoMs = psRtt->u32SrttMs * 3 / 2;
+    if (psRtt->u32RtoMs < psRtt->u32MinRtoMs) psRtt->u32RtoMs = psRtt->u32MinRtoMs;
+    if (psRtt->u32RtoMs > psRtt->u32MaxRtoMs) psRtt->u32RtoMs = psRtt->u32MaxRtoMs;
+}
+
+/****************************************************************************
+ *
+ * NAME: RTT_u32Backoff
+ *
+ * DESCRIPTION:
+ * Timeout of a frame, doubled for each time it has been resent
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psRtt        R   estimator
+ *             u8Resends    R   times the frame has been resent
+ *
+ * RETURNS:
+ * timeout in ms
+ *
+ ****************************************************************************/
+PUBLIC uint32 RTT_u32Backoff(tsRtt *psRtt, uint8 u8Resends)
+{
+    if (u8Resends > 7) u8Resends = 7;
+    uint32 u32Rto = psRtt->u32RtoMs << u8Resends;
+    return (u32Rto > psRtt->u32MaxRtoMs) ? psRtt->u32MaxRtoMs : u32Rto;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
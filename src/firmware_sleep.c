@@ -10,6 +10,9 @@
  * Change Log : [Oliver: Modify 2014/05]
  *              [Oliver: Modify 2014/05] Poll period set to 200ms
  *              [Oliver: Modify 2014/06] DATA/API mode support for sleep too
+ *              Poll interval adapts to traffic(firmware_poll.c)
+ *              Timers keep their residual time over a sleep, the wake up
+ *              follows the earliest timer which can't wait
  *
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
@@ -30,6 +33,11 @@
 #include "common.h"
 #include "firmware_sleep.h"
 #include "firmware_aups.h"
+#include "firmware_aggr.h"
+#include "firmware_poll.h"
+#include "firmware_hal.h"
+#include "firmware_uart.h"
+#include "firmware_energy.h"
 
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
@@ -41,13 +49,29 @@
 /****************************************************************************/
 /***        Type Definitions                                              ***/
 /****************************************************************************/
-
+typedef struct
+{
+    OS_thSWTimer hTimer;
+    teSlpTimerKind eKind;
+    bool bKnown;                //armed through vResetATimer/vStartStopTimer
+    bool bCarried;              //restart it at wake
+    uint32 u32DueMs;            //deadline, u32HAL_GetMsTime() time base
+    uint32 u32ResidualMs;       //time left when the sleep began
+}tsSlpTimer;
 
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
 /* wake up call back */
 PUBLIC void vWakeCallBack(void);
+#ifdef TARGET_END
+PRIVATE tsSlpTimer *SLP_psFind(OS_thSWTimer hTimer);
+PRIVATE uint32 SLP_u32Left(tsSlpTimer *psTimer, uint32 u32NowMs);
+PRIVATE uint32 SLP_u32NextWake(uint32 u32Ms);
+PRIVATE void SLP_vSuspend(void);
+PRIVATE void SLP_vResume(void);
+PRIVATE void SLP_vSleepRest(void);
+#endif
 
 /****************************************************************************/
 /***        Exported Variables                                            ***/
@@ -62,6 +86,18 @@ PRIVATE uint32 _wakeupTime = 0;
 /* Pointer to a structure to be populated with the wake point and callback function */
 PRIVATE	pwrm_tsWakeTimerEvent	sWake;
 
+/* timers the sleep scheduler knows */
+PRIVATE tsSlpTimer asSlpTimers[SLP_MAX_TIMERS];
+PRIVATE uint8 u8SlpTimers = 0;
+
+/* rest of a sleep period cut short by a timer */
+PRIVATE uint32 u32SlpOwedMs = 0;
+
+/* time slept since power up */
+PRIVATE uint32 u32SlpSleptMs = 0;
+
+PRIVATE tsSlpStats sSlpStats;
+
 /****************************************************************************/
 /***        External Variables                                            ***/
 /****************************************************************************/
@@ -87,7 +123,133 @@ PRIVATE	pwrm_tsWakeTimerEvent	sWake;
 OS_TASK(SleepScheduleTask)
 {
 #ifdef TARGET_END
-	    Sleep(g_sDevice.config.sleepPeriod);
+    /* finish a period cut short by a timer first */
+    Sleep((u32SlpOwedMs > 0) ? u32SlpOwedMs : g_sDevice.config.sleepPeriod);
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: SLP_vInit
+ *
+ * DESCRIPTION:
+ * Register the software timers of the firmware with the sleep scheduler.
+ * A timer added to the firmware must be registered here, otherwise it keeps
+ * the end device from sleeping.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void SLP_vInit(void)
+{
+#ifdef TARGET_END
+    /* work which is late when it waits for the sleep period */
+    SLP_vRegister(APP_JoinTimer, SLP_TIMER_WAKE);
+    SLP_vRegister(APP_RejoinTimer, SLP_TIMER_WAKE);
+    SLP_vRegister(APP_OTAReqTimer, SLP_TIMER_WAKE);
+
+    /* periodic housekeeping, keeps its cadence over sleeps */
+    SLP_vRegister(App_tmr1sec, SLP_TIMER_DEFER);
+    SLP_vRegister(APP_RouteRequestTimer, SLP_TIMER_DEFER);
+    SLP_vRegister(APP_AgeOutChildrenTmr, SLP_TIMER_DEFER);
+    SLP_vRegister(APP_RadioRecalTimer, SLP_TIMER_DEFER);
+    SLP_vRegister(APP_tmrTopo, SLP_TIMER_DEFER);
+    SLP_vRegister(APP_tmrQos, SLP_TIMER_DEFER);
+    SLP_vRegister(APP_tmrOtaMc, SLP_TIMER_DEFER);
+    SLP_vRegister(APP_tmrOtaSrv, SLP_TIMER_DEFER);
+
+    /* flushed before the sleep, only a retry of a refused container is left */
+    SLP_vRegister(APP_tmrAggr, SLP_TIMER_DEFER);
+
+    /* re-armed by WakeUpTask */
+    SLP_vRegister(APP_tmrHandleUartRx, SLP_TIMER_DROP);
+    SLP_vRegister(Arduino_LoopTimer, SLP_TIMER_DROP);
+    SLP_vRegister(PollTimer, SLP_TIMER_DROP);
+    SLP_vRegister(SleepTimer, SLP_TIMER_DROP);
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: SLP_vRegister
+ *
+ * DESCRIPTION:
+ * Tell the sleep scheduler what a timer does over a sleep
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             hTimer       R   software timer
+ *             eKind        R   wake for it, carry it over or stop it
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void SLP_vRegister(OS_thSWTimer hTimer, teSlpTimerKind eKind)
+{
+#ifdef TARGET_END
+    tsSlpTimer *psTimer = SLP_psFind(hTimer);
+
+    if (NULL == psTimer)
+    {
+        if (u8SlpTimers >= SLP_MAX_TIMERS)
+        {
+            DBG_vPrintf(TRACE_SLEEP, "SLP: timer table full\r\n");
+            return;
+        }
+        psTimer = &asSlpTimers[u8SlpTimers++];
+        memset(psTimer, 0, sizeof(tsSlpTimer));
+        psTimer->hTimer = hTimer;
+    }
+    psTimer->eKind = eKind;
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: SLP_vArmed
+ *
+ * DESCRIPTION:
+ * Note the deadline of a timer being started, called by vResetATimer and
+ * vStartStopTimer
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             hTimer       R   software timer
+ *             u32Ticks     R   ticks it was started with
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void SLP_vArmed(OS_thSWTimer hTimer, uint32 u32Ticks)
+{
+#ifdef TARGET_END
+    tsSlpTimer *psTimer = SLP_psFind(hTimer);
+
+    if (NULL != psTimer)
+    {
+        psTimer->u32DueMs = u32HAL_GetMsTime() + SLP_TICKS_TO_MS(u32Ticks);
+        psTimer->bKnown = TRUE;
+    }
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: SLP_vPrintStatus
+ *
+ * DESCRIPTION:
+ * Print how sleeps were shortened or put off by timers
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void SLP_vPrintStatus(void)
+{
+#ifdef TARGET_END
+    uart_printf("Sleeps           : %d entered, %d cut short for a timer, %d put off, %d timers carried over \r\n",
+                sSlpStats.u32Sleeps, sSlpStats.u32TimerWakes, sSlpStats.u32PutOff, sSlpStats.u32Carried);
 #endif
 }
 
@@ -114,12 +276,47 @@ PUBLIC void vSleepSchedule(void)
 		vResetATimer(SleepTimer, APP_TIME_MS(g_sDevice.config.sleepWaitingTime));
 	}
 }
+/****************************************************************************
+ *
+ * NAME: SLP_u32SleepMs
+ *
+ * DESCRIPTION:
+ * Length of the last sleep as programmed in the wake timer
+ *
+ * RETURNS:
+ * ms
+ *
+ ****************************************************************************/
+PUBLIC uint32 SLP_u32SleepMs(void)
+{
+    return _wakeupTime;
+}
+
+/****************************************************************************
+ *
+ * NAME: SLP_u32UpTimeMs
+ *
+ * DESCRIPTION:
+ * Time since power up, awake and asleep
+ *
+ * RETURNS:
+ * ms
+ *
+ ****************************************************************************/
+PUBLIC uint32 SLP_u32UpTimeMs(void)
+{
+    return u32HAL_GetMsTime() + u32SlpSleptMs;
+}
+
 /****************************************************************************
  *
  * NAME: Sleep
  *
  * DESCRIPTION:
- * set the End Device into sleep mode for n ms
+ * set the End Device into sleep mode for n ms. The wake up comes earlier
+ * when a timer which can't wait is due, the rest of the period is slept
+ * once its work is done(DATA/API mode). Running timers are restarted with
+ * their residual time at wake.
  *
  * PARAMETERS: Name         RW  Usage
  *             ms           W   ms
@@ -131,17 +328,37 @@ PUBLIC void vSleepSchedule(void)
 PUBLIC void Sleep(uint32 ms)
 {
 #ifdef TARGET_END
-	DBG_vPrintf(TRACE_SLEEP, "Sleep %ld ms\r\n", ms);
+    /* Send a sample batch which would get too old in this sleep */
+    UPS_vBatchSleep(ms);
 
-	/* Set the next wake point */
-	_wakeupTime = ms;
-	PWRM_eScheduleActivity(&sWake, _wakeupTime*32 , vWakeCallBack);
+    /* Don't keep collected frames over the sleep */
+    AGR_vFlushAll();
 
-	/*
-	 * Stop all software timers, prepare for sleeping
-	 * Must stop all of the swTimers, otherwise can not enter sleep mode again
-    */
-    stopAllSwTimers();
+    /* Wake for the earliest timer which can't wait */
+    uint32 u32SleepMs = SLP_u32NextWake(ms);
+    if (u32SleepMs < SLP_MIN_SLEEP_MS)
+    {
+        DBG_vPrintf(TRACE_SLEEP, "Timer due in %ld ms, sleep put off\r\n", u32SleepMs);
+        sSlpStats.u32PutOff++;
+        u32SlpOwedMs = ms;
+        if (E_MODE_API == g_sDevice.eMode || E_MODE_DATA == g_sDevice.eMode) SLP_vSleepRest();
+        return;
+    }
+    u32SlpOwedMs = ms - u32SleepMs;
+    if (u32SlpOwedMs > 0) sSlpStats.u32TimerWakes++;
+    sSlpStats.u32Sleeps++;
+
+    DBG_vPrintf(TRACE_SLEEP, "Sleep %ld ms\r\n", u32SleepMs);
+
+    /*
+     * Stop all software timers, prepare for sleeping
+     * Must stop all of the swTimers, otherwise can not enter sleep mode again
+     */
+    SLP_vSuspend();
+
+    /* Set the next wake point */
+    _wakeupTime = u32SleepMs;
+    PWRM_eScheduleActivity(&sWake, _wakeupTime*32 , vWakeCallBack);
 
     /* Set this flag */
     SLEEP_ENABLE = true;
@@ -245,18 +462,31 @@ OS_TASK(WakeUpTask)
     /* Clean sleep flag */
     SLEEP_ENABLE = false;
 
+#ifdef TARGET_END
+    u32SlpSleptMs += _wakeupTime;
+
+    /* Timers carried over the sleep go on where they were */
+    SLP_vResume();
+#endif
+
     /* When a device wakes up, Poll from its parent immediately */
     OS_eActivateTask(PollTask);
 
     /* Wakeup houseKeepping task: determine state */
     if(E_MODE_MCU == g_sDevice.eMode)
     {
-    	ups_init();        //Initialize AUPS
+    	ups_wakeup();      //Resume AUPS, RAM is held
     }
     else if(E_MODE_AT == g_sDevice.eMode)
     {
     	//do nothing now
     }
+#ifdef TARGET_END
+    else if (u32SlpOwedMs > 0)
+    {
+        SLP_vSleepRest(); //Woke for a timer, sleep the rest of the period
+    }
+#endif
     else
     {
     	vSleepSchedule(); //Reset SleepScheduleTimer again in DATA/API mode
@@ -268,7 +498,8 @@ OS_TASK(WakeUpTask)
  *
  * DESCRIPTION:
  * Polling Task requests the buffered data and should normally be
- * called immediately after waking from sleep.
+ * called immediately after waking from sleep. The next poll is fast after
+ * traffic and backs off when idle.
  *
  * RETURNS:
  * void
@@ -284,9 +515,13 @@ OS_TASK(PollTask)
     {
         DBG_vPrintf(TRACE_SLEEP, "\nPoll Failed %d\n", u8PStatus);
     }
+    else
+    {
+        ENG_vPollStart();
+    }
 
-    /* Poll per 200ms */
-    OS_eStartSWTimer(PollTimer, APP_TIME_MS(200), NULL);
+    /* traffic may bring the next poll forward */
+    vResetATimer(PollTimer, APP_TIME_MS(POL_u32Polled(0 == u8PStatus)));
 }
 
 
@@ -295,7 +530,8 @@ OS_TASK(PollTask)
  * NAME: stopAllSwTimers
  *
  * DESCRIPTION:
- * stop all of the software timers, prepare for a sleeping
+ * stop all of the software timers known to the sleep scheduler, they are
+ * not restarted at wake
  *
  * PARAMETERS: Name         RW  Usage
  *
@@ -307,56 +543,123 @@ OS_TASK(PollTask)
 void stopAllSwTimers()
 {
 #ifdef TARGET_END
-    if (OS_eGetSWTimerStatus(App_tmr1sec) != OS_E_SWTIMER_STOPPED)
-    {
-        OS_eStopSWTimer(App_tmr1sec);
-    }
-    if (OS_eGetSWTimerStatus(APP_RouteRequestTimer) != OS_E_SWTIMER_STOPPED)
-    {
-        OS_eStopSWTimer(APP_RouteRequestTimer);
-    }
-    if (OS_eGetSWTimerStatus(APP_JoinTimer) != OS_E_SWTIMER_STOPPED)
-    {
-        OS_eStopSWTimer(APP_JoinTimer);
-    }
-    if (OS_eGetSWTimerStatus(APP_OTAReqTimer) != OS_E_SWTIMER_STOPPED)
-    {
-        OS_eStopSWTimer(APP_OTAReqTimer);
-    }
-    if (OS_eGetSWTimerStatus(APP_tmrHandleUartRx) != OS_E_SWTIMER_STOPPED)
+    uint8 i;
+
+    for (i = 0; i < u8SlpTimers; i++)
     {
-        OS_eStopSWTimer(APP_tmrHandleUartRx);
+        asSlpTimers[i].bCarried = FALSE;
+        if (OS_eGetSWTimerStatus(asSlpTimers[i].hTimer) != OS_E_SWTIMER_STOPPED)
+        {
+            OS_eStopSWTimer(asSlpTimers[i].hTimer);
+        }
     }
-    if (OS_eGetSWTimerStatus(APP_AgeOutChildrenTmr) != OS_E_SWTIMER_STOPPED)
+#endif
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+#ifdef TARGET_END
+
+PRIVATE tsSlpTimer *SLP_psFind(OS_thSWTimer hTimer)
+{
+    uint8 i;
+
+    for (i = 0; i < u8SlpTimers; i++)
     {
-        OS_eStopSWTimer(APP_AgeOutChildrenTmr);
+        if (asSlpTimers[i].hTimer == hTimer) return &asSlpTimers[i];
     }
-    if (OS_eGetSWTimerStatus(APP_RadioRecalTimer) != OS_E_SWTIMER_STOPPED)
+    return NULL;
+}
+
+/* ms until the timer is due, a timer started behind our back is due now */
+PRIVATE uint32 SLP_u32Left(tsSlpTimer *psTimer, uint32 u32NowMs)
+{
+    int32 i32LeftMs = (int32)(psTimer->u32DueMs - u32NowMs);
+
+    if (!psTimer->bKnown || i32LeftMs <= 0) return 0;
+    return (uint32)i32LeftMs;
+}
+
+/* the wanted sleep, shortened to the earliest running SLP_TIMER_WAKE timer */
+PRIVATE uint32 SLP_u32NextWake(uint32 u32Ms)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    uint8 i;
+
+    for (i = 0; i < u8SlpTimers; i++)
     {
-        OS_eStopSWTimer(APP_RadioRecalTimer);
+        tsSlpTimer *psTimer = &asSlpTimers[i];
+        if (SLP_TIMER_WAKE != psTimer->eKind || !psTimer->bKnown ||
+            OS_E_SWTIMER_RUNNING != OS_eGetSWTimerStatus(psTimer->hTimer))
+        {
+            continue;
+        }
+        uint32 u32LeftMs = SLP_u32Left(psTimer, u32NowMs);
+        if (u32LeftMs < u32Ms) u32Ms = u32LeftMs;
     }
-    if (OS_eGetSWTimerStatus(APP_RejoinTimer) != OS_E_SWTIMER_STOPPED)
+    return u32Ms;
+}
+
+/* stop every timer, keeping the residual time of the ones carried over */
+PRIVATE void SLP_vSuspend(void)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    uint8 i;
+
+    for (i = 0; i < u8SlpTimers; i++)
     {
-        OS_eStopSWTimer(APP_RejoinTimer);
+        tsSlpTimer *psTimer = &asSlpTimers[i];
+        OS_teStatus eStatus = OS_eGetSWTimerStatus(psTimer->hTimer);
+
+        psTimer->bCarried = FALSE;
+        if (OS_E_SWTIMER_RUNNING == eStatus && SLP_TIMER_DROP != psTimer->eKind)
+        {
+            psTimer->u32ResidualMs = SLP_u32Left(psTimer, u32NowMs);
+            psTimer->bCarried = TRUE;
+        }
+        if (OS_E_SWTIMER_STOPPED != eStatus)
+        {
+            OS_eStopSWTimer(psTimer->hTimer);
+        }
     }
-    if (OS_eGetSWTimerStatus(Arduino_LoopTimer) != OS_E_SWTIMER_STOPPED)
+}
+
+/*
+ * restart the carried timers less the time slept. A DIO wake counts as the
+ * whole sleep, those timers run early rather than late.
+ */
+PRIVATE void SLP_vResume(void)
+{
+    uint8 i;
+
+    for (i = 0; i < u8SlpTimers; i++)
     {
-        OS_eStopSWTimer(Arduino_LoopTimer);
+        tsSlpTimer *psTimer = &asSlpTimers[i];
+        if (!psTimer->bCarried) continue;
+
+        psTimer->bCarried = FALSE;
+        uint32 u32LeftMs = (psTimer->u32ResidualMs > _wakeupTime) ? psTimer->u32ResidualMs - _wakeupTime : 1;
+        DBG_vPrintf(TRACE_SLEEP, "SLP: timer %d due in %ld ms\r\n", i, u32LeftMs);
+        vResetATimer(psTimer->hTimer, APP_TIME_MS(u32LeftMs));
+        sSlpStats.u32Carried++;
     }
-    if(OS_eGetSWTimerStatus(PollTimer) != OS_E_SWTIMER_STOPPED)
+}
+
+/* short awake window for the due timers, then the rest of the period */
+PRIVATE void SLP_vSleepRest(void)
+{
+    if (g_sDevice.config.sleepWaitingTime > SLP_RESLEEP_MS)
     {
-    	OS_eStopSWTimer(PollTimer);
+        vResetATimer(SleepTimer, APP_TIME_MS(SLP_RESLEEP_MS));
     }
-    if(OS_eGetSWTimerStatus(SleepTimer) != OS_E_SWTIMER_STOPPED)
+    else
     {
-    	OS_eStopSWTimer(SleepTimer);
+        vSleepSchedule();
     }
-#endif
 }
 
-/****************************************************************************/
-/***        Local Functions                                               ***/
-/****************************************************************************/
+#endif
 
 /****************************************************************************/
 /***        END OF FILE                                                   ***/
@@ -30,6 +30,9 @@
 #include "firmware_uart.h"
 #include "firmware_ringbuffer.h"
 #include "firmware_api_pack.h"
+#include "firmware_stream.h"
+#include "firmware_lzss.h"
+#include "firmware_hal.h"
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
 /****************************************************************************/
@@ -37,6 +40,20 @@
 #define TRACE_SPM FALSE
 #endif
 
+#define SPM_STREAM_PEERS    3      //peers we can receive a stream from at the same time
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/* receiving side of the stream of one peer */
+typedef struct
+{
+    bool     bUsed;
+    uint16   u16Addr;
+    uint32   u32LastMs;            //last frame from the peer, the oldest peer gives way
+    tsStream sStream;
+}tsSpmPeer;
+
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
@@ -54,11 +71,22 @@ uint8 spm_rx_mempool[SPM_RX_RB_LEN];
 /****************************************************************************/
 /***        Local Variables                                               ***/
 /****************************************************************************/
+PRIVATE tsStream sStream;              //reliable stream we send in DATA mode
+PRIVATE uint8    u8StreamWindow = 0;   //window sStream is set up with, 0: not set up
+PRIVATE tsSpmPeer asStreamPeer[SPM_STREAM_PEERS];  //streams we receive, sequence and window of each peer
 
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
 PRIVATE void SPM_vProcStream(uint32 dataCnt);
+PRIVATE bool SPM_bStreamEnabled(void);
+PRIVATE void SPM_vStreamSetup(void);
+PRIVATE void SPM_vStreamPoll(void);
+PRIVATE bool SPM_bStreamSend(tsStream *psStream, teStmFrameType eType, void *pvFrame, int len);
+PRIVATE void SPM_vStreamDeliver(tsStream *psStream, uint8 *pu8Data, int len);
+PRIVATE void SPM_vStreamLost(tsStream *psStream, uint16 u16Bytes);
+PRIVATE tsStream *SPM_psStreamPeer(uint16 u16Addr);
+PRIVATE uint16 SPM_u16StreamPeerAddr(tsStream *psStream);
 
 /****************************************************************************/
 /***        Local Functions                                               ***/
@@ -145,6 +173,10 @@ OS_TASK(APP_taskHandleUartRx)
     uint32 size = 0;
     tsApiSpec apiSpec;
 
+    /* retransmission timer of reliable stream shares this task */
+    bool bReliable = (E_MODE_DATA == g_sDevice.eMode) && SPM_bStreamEnabled();
+    if (bReliable) SPM_vStreamPoll();
+
     /* calculate data size of the ring buffer */
     OS_eEnterCriticalSection(mutexRxRb);
     dataCnt = ringbuffer_data_size(&rb_rx_spm);
@@ -226,11 +258,15 @@ OS_TASK(APP_taskHandleUartRx)
         /* Data mode */
     case E_MODE_DATA:
         {
-            /* read some data from ringbuffer */
-            popCnt = MIN(dataCnt, RXFIFOLEN);
+            /* window is full, keep data in the pool, an ack activates us again */
+            if (bReliable && !STM_bTxReady(&sStream)) break;
+
+            /* read some data from ringbuffer, a compressed frame may carry more */
+            bool bZip = (0 != g_sDevice.config.dataCompress) && !bReliable;
+            popCnt = MIN(dataCnt, bZip ? LZS_MAX_RAW : RXFIFOLEN);
 
             OS_eEnterCriticalSection(mutexRxRb);
-            ringbuffer_pop(&rb_rx_spm, tmp, popCnt);
+            ringbuffer_read(&rb_rx_spm, tmp, popCnt);
             OS_eExitCriticalSection(mutexRxRb);
 
             /* pre pos */
@@ -244,17 +280,37 @@ OS_TASK(APP_taskHandleUartRx)
                 clear_ringbuffer(&rb_rx_spm);
             }
             /* if not containing AT, send out the data */
+            else if (bReliable && g_sDevice.eState == E_NETWORK_RUN)
+            {
+                STM_bSend(&sStream, tmp, popCnt, u32HAL_GetMsTime());
+                SPM_vStreamPoll();
+            }
             else if (g_sDevice.eState == E_NETWORK_RUN)    //Make sure network has been created.
             {
                 // Send Data frame,call pack_lib to pack a frame
                 memset(&apiSpec, 0, sizeof(tsApiSpec));
-                PCK_vApiSpecDataFrame(&apiSpec, 0x00, 0x00, tmp, popCnt);
+                if (bZip)
+                {
+                    /* leave what didn't fit in the pool for the next frame */
+                    popCnt = PCK_i32ApiSpecZipDataFrame(&apiSpec, 0x00, 0x00, tmp, popCnt);
+                } else
+                {
+                    PCK_vApiSpecDataFrame(&apiSpec, 0x00, 0x00, tmp, popCnt);
+                }
                 memset(tmp, 0, RXFIFOLEN);
                 size = i32CopyApiSpec(&apiSpec, tmp);
                 API_bSendToAirPort(g_sDevice.config.txMode, g_sDevice.config.unicastDstAddr, tmp, size);
                 //API_bSendToEndPoint(g_sDevice.config.txMode, g_sDevice.config.unicastDstAddr, 2, 2, tmp, popCnt);
             }
 
+            /* AT mode cleared the pool already */
+            if (E_MODE_DATA == g_sDevice.eMode)
+            {
+                OS_eEnterCriticalSection(mutexRxRb);
+                ringbuffer_pop(&rb_rx_spm, NULL, popCnt);
+                OS_eExitCriticalSection(mutexRxRb);
+            }
+
             /* Activate again */
             if ((dataCnt - popCnt) >= THRESHOLD_READ) OS_eActivateTask(APP_taskHandleUartRx);
             else if ((dataCnt - popCnt) > 0) vResetATimer(APP_tmrHandleUartRx, APP_TIME_MS(1));
@@ -321,6 +377,177 @@ PRIVATE void SPM_vProcStream(uint32 dataCnt)
     OS_eExitCriticalSection(mutexRxRb);
 }
 
+/****************************************************************************
+ *
+ * NAME: SPM_vStreamFrameProc
+ *
+ * DESCRIPTION:
+ * Handle a reliable stream frame from AirPort.
+ * Data is delivered in order through CMI, each peer has its own receiving
+ * side. An ack slides our own window and lets the SPM task send what's
+ * waiting in the pool.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             apiSpec      R   API_STREAM_DATA or API_STREAM_ACK frame
+ *             u16SrcAddr   R   where it comes from
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void SPM_vStreamFrameProc(tsApiSpec *apiSpec, uint16 u16SrcAddr)
+{
+    /* receiving side works even if our own sending side is off */
+    if (API_STREAM_DATA == apiSpec->teApiIdentifier)
+    {
+        STM_vRxData(SPM_psStreamPeer(u16SrcAddr), &apiSpec->payload.streamData);
+    }
+    else if (0 != u8StreamWindow && u16SrcAddr == g_sDevice.config.unicastDstAddr)
+    {
+        STM_vRxAck(&sStream, &apiSpec->payload.streamAck, u32HAL_GetMsTime());
+        OS_eActivateTask(APP_taskHandleUartRx);
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: SPM_bStreamEnabled
+ *
+ * DESCRIPTION:
+ * Reliable stream is used for unicast DATA mode when ATRW is non-zero.
+ * (Re)set up the stream if the window has been changed.
+ *
+ * RETURNS:
+ * TRUE if DATA mode should send through the reliable stream
+ *
+ ****************************************************************************/
+PRIVATE bool SPM_bStreamEnabled(void)
+{
+    if (0 == g_sDevice.config.streamWindow || UNICAST != g_sDevice.config.txMode) return FALSE;
+    if (u8StreamWindow != g_sDevice.config.streamWindow) SPM_vStreamSetup();
+    return TRUE;
+}
+
+/* set up the stream with the configured window */
+PRIVATE void SPM_vStreamSetup(void)
+{
+    u8StreamWindow = (g_sDevice.config.streamWindow > 0) ? (uint8)g_sDevice.config.streamWindow : 1;
+    STM_vInit(&sStream, u8StreamWindow, (uint8)random(), SPM_bStreamSend, SPM_vStreamDeliver, SPM_vStreamLost);
+    DBG_vPrintf(TRACE_SPM, "SPM: stream window %d\r\n", u8StreamWindow);
+}
+
+/* run retransmission timers, wake up again when the next one expires */
+PRIVATE void SPM_vStreamPoll(void)
+{
+    uint32 u32Next = STM_u32Poll(&sStream, u32HAL_GetMsTime());
+    if (u32Next > 0) vResetATimer(APP_tmrHandleUartRx, APP_TIME_MS(u32Next));
+}
+
+/* STM_tpfSend, data goes to unicastDstAddr, acks go back to the peer */
+PRIVATE bool SPM_bStreamSend(tsStream *psStream, teStmFrameType eType, void *pvFrame, int len)
+{
+    tsApiSpec apiSpec;
+    uint8 buf[sizeof(tsApiSpec)];
+    uint16 u16Dst;
+    int size;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    if (E_STM_DATA == eType)
+    {
+        assembleApiSpec(&apiSpec, API_STREAM_DATA, (uint8 *)pvFrame, len);
+        u16Dst = g_sDevice.config.unicastDstAddr;
+    }
+    else
+    {
+        assembleApiSpec(&apiSpec, API_STREAM_ACK, (uint8 *)pvFrame, len);
+        u16Dst = SPM_u16StreamPeerAddr(psStream);
+    }
+    size = i32CopyApiSpec(&apiSpec, buf);
+    return API_bSendToAirPort(UNICAST, u16Dst, buf, size);
+}
+
+/* STM_tpfDeliver, in-order data leaves as an ordinary data frame of the peer */
+PRIVATE void SPM_vStreamDeliver(tsStream *psStream, uint8 *pu8Data, int len)
+{
+    tsApiSpec apiSpec;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    PCK_vApiSpecDataFrame(&apiSpec, 0x00, 0x00, pu8Data, len);
+    apiSpec.payload.txDataPacket.unicastAddr = SPM_u16StreamPeerAddr(psStream);
+    apiSpec.checkSum = calCheckSum((uint8 *)&apiSpec.payload, apiSpec.length);
+    CMI_vAirDataDistributor(&apiSpec);
+}
+
+/*
+  STM_tpfLost, the data host sent has a hole. The stream runs in DATA mode,
+  where nothing but data goes to host, so the frame is put on the UART
+  directly, host finds it by its delimiter and identifier.
+*/
+PRIVATE void SPM_vStreamLost(tsStream *psStream, uint16 u16Bytes)
+{
+    tsApiSpec apiSpec;
+    tsStreamLost streamLost;
+    uint8 buf[sizeof(tsApiSpec)];
+    int size;
+
+    DBG_vPrintf(TRACE_SPM, "SPM: stream gave up, %d bytes lost\r\n", u16Bytes);
+    streamLost.unicastAddr = g_sDevice.config.unicastDstAddr;
+    streamLost.bytes = u16Bytes;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    assembleApiSpec(&apiSpec, API_STREAM_LOST, (uint8 *)&streamLost, sizeof(tsStreamLost));
+    size = i32CopyApiSpec(&apiSpec, buf);
+    uart_tx_data(buf, size);
+}
+
+/*
+  Receiving side of a peer, a new peer takes a free entry or the one heard
+  from longest ago. The peer pushed out resends until its stream re-syncs.
+*/
+PRIVATE tsStream *SPM_psStreamPeer(uint16 u16Addr)
+{
+    uint32 u32NowMs = u32HAL_GetMsTime();
+    tsSpmPeer *psPeer = &asStreamPeer[0];
+    uint8 i;
+
+    for (i = 0; i < SPM_STREAM_PEERS; i++)
+    {
+        tsSpmPeer *psEntry = &asStreamPeer[i];
+        if (psEntry->bUsed && psEntry->u16Addr == u16Addr)
+        {
+            psEntry->u32LastMs = u32NowMs;
+            return &psEntry->sStream;
+        }
+        if (!psEntry->bUsed)
+        {
+            if (psPeer->bUsed) psPeer = psEntry;
+        }
+        else if (psPeer->bUsed && u32NowMs - psEntry->u32LastMs > u32NowMs - psPeer->u32LastMs)
+        {
+            psPeer = psEntry;
+        }
+    }
+
+    DBG_vPrintf(TRACE_SPM, "SPM: stream from 0x%04x\r\n", u16Addr);
+    STM_vInit(&psPeer->sStream, 1, 0, SPM_bStreamSend, SPM_vStreamDeliver, NULL);
+    psPeer->bUsed = TRUE;
+    psPeer->u16Addr = u16Addr;
+    psPeer->u32LastMs = u32NowMs;
+    return &psPeer->sStream;
+}
+
+/* peer of a receiving side */
+PRIVATE uint16 SPM_u16StreamPeerAddr(tsStream *psStream)
+{
+    uint8 i;
+
+    for (i = 0; i < SPM_STREAM_PEERS; i++)
+    {
+        if (&asStreamPeer[i].sStream == psStream) return asStreamPeer[i].u16Addr;
+    }
+    return g_sDevice.config.unicastDstAddr;
+}
+
 /****************************************************************************/
 /***        END OF FILE                                                   ***/
 /****************************************************************************/
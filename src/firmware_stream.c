@@ -0,0 +1,406 @@
+/*
+ * firmware_stream.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "firmware_stream.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#define STM_SLOT(seq)          ((seq) % STM_MAX_WINDOW)
+#define STM_FRAME_ID(flags)    (((flags) >> STM_ID_SHIFT) & STM_ID_MASK)
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE bool STM_bTxFrame(tsStream *psStream, uint8 u8Seq);
+PRIVATE void STM_vTxAck(tsStream *psStream);
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: STM_vInit
+ *
+ * DESCRIPTION:
+ * Init a stream end point, the next frame sent starts a new stream(SYN).
+ * The id tells the peer a new stream from an old one, it should differ
+ * from the id used before a reboot, e.g. a random number.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psStream     W   stream
+ *             u8Window     R   frames in flight, 1~STM_MAX_WINDOW
+ *             u8Id         R   id of the stream we send
+ *             pfSend       R   puts a frame on air
+ *             pfDeliver    R   hands in-order data to user
+ *             pfLost       R   tells user the sender gave up, may be NULL
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void STM_vInit(tsStream *psStream, uint8 u8Window, uint8 u8Id,
+                      STM_tpfSend pfSend, STM_tpfDeliver pfDeliver, STM_tpfLost pfLost)
+{
+    memset(psStream, 0, sizeof(tsStream));
+    if (u8Window < 1) u8Window = 1;
+    if (u8Window > STM_MAX_WINDOW) u8Window = STM_MAX_WINDOW;
+    psStream->u8Window  = u8Window;
+    psStream->bSyn      = TRUE;
+    psStream->u8TxId    = u8Id & STM_ID_MASK;
+    RTT_vInit(&psStream->sRtt, STM_INIT_RTO_MS, STM_MIN_RTO_MS, STM_MAX_RTO_MS);
+    psStream->pfSend    = pfSend;
+    psStream->pfDeliver = pfDeliver;
+    psStream->pfLost    = pfLost;
+}
+
+/****************************************************************************
+ *
+ * NAME: STM_bTxReady
+ *
+ * DESCRIPTION:
+ * Is there room in the window for another frame
+ *
+ ****************************************************************************/
+PUBLIC bool STM_bTxReady(tsStream *psStream)
+{
+    return (uint8)(psStream->u8TxNext - psStream->u8TxBase) < psStream->u8Window;
+}
+
+/****************************************************************************
+ *
+ * NAME: STM_bTxIdle
+ *
+ * DESCRIPTION:
+ * Everything sent has been acked
+ *
+ ****************************************************************************/
+PUBLIC bool STM_bTxIdle(tsStream *psStream)
+{
+    return psStream->u8TxNext == psStream->u8TxBase;
+}
+
+/****************************************************************************
+ *
+ * NAME: STM_bSend
+ *
+ * DESCRIPTION:
+ * Queue up to STM_DATA_LEN bytes as the next frame of the stream and send it.
+ * The frame is kept until it's acked.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psStream     RW  stream
+ *             pu8Data      R   data
+ *             len          R   data length
+ *             u32NowMs     R   current time
+ *
+ * RETURNS:
+ * FALSE if the window is full, nothing is queued
+ *
+ ****************************************************************************/
+PUBLIC bool STM_bSend(tsStream *psStream, uint8 *pu8Data, int len, uint32 u32NowMs)
+{
+    if (!STM_bTxReady(psStream)) return FALSE;
+    if (len > STM_DATA_LEN) len = STM_DATA_LEN;
+
+    uint8 u8Seq = psStream->u8TxNext++;
+    tsStmTxSlot *psSlot = &psStream->asTx[STM_SLOT(u8Seq)];
+
+    memcpy(psSlot->data, pu8Data, len);
+    psSlot->len       = (uint8)len;
+    psSlot->retries   = 0;
+    psSlot->bSacked   = FALSE;
+    psSlot->u32SentMs = u32NowMs;
+
+    /* if the radio refuses it, the retransmission timer tries again */
+    STM_bTxFrame(psStream, u8Seq);
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: STM_vRxData
+ *
+ * DESCRIPTION:
+ * Receiver side. A SYN of another stream restarts the window at its seq,
+ * frames of a stream we haven't got the SYN of are dropped and resent by
+ * the peer. In-order frames are delivered at once together with any
+ * buffered frames that follow them, frames ahead are buffered, duplicates
+ * dropped. Every accepted frame is answered by an ack carrying the
+ * cumulative seq and a bitmap of buffered frames.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psStream     RW  stream
+ *             psData       R   received frame
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void STM_vRxData(tsStream *psStream, tsStreamData *psData)
+{
+    uint8 u8Id = STM_FRAME_ID(psData->flags);
+    uint8 u8Diff = (uint8)(psData->seq - psStream->u8RxNext);
+    uint8 len = (psData->dataLen > STM_DATA_LEN) ? STM_DATA_LEN : psData->dataLen;
+    bool bSameStream = psStream->bRxSynced && u8Id == psStream->u8RxId;
+
+    psStream->sStats.u32RxFrames++;
+
+    /*
+      A resent SYN of our stream is always just behind u8RxNext, the peer
+      keeps it only until it's acked. Any other SYN starts a new stream
+      (peer rebooted or gave up), which begins at its seq.
+    */
+    if ((psData->flags & STM_FLAG_SYN) &&
+        !(bSameStream && u8Diff >= (uint8)(256 - STM_MAX_WINDOW)))
+    {
+        memset(psStream->asRx, 0, sizeof(psStream->asRx));
+        psStream->bRxSynced = TRUE;
+        psStream->u8RxId = u8Id;
+        psStream->u8RxNext = psData->seq;
+        psStream->sStats.u32Resyncs++;
+        u8Diff = 0;
+    }
+    else if (!bSameStream)
+    {
+        /* its SYN is late or lost, the peer sends this again */
+        return;
+    }
+    else if (u8Diff >= STM_MAX_WINDOW)
+    {
+        /* duplicate of an old frame, the ack got lost */
+        psStream->sStats.u32RxDuplicates++;
+        STM_vTxAck(psStream);
+        return;
+    }
+
+    if (0 == u8Diff)
+    {
+        psStream->pfDeliver(psStream, psData->data, len);
+        psStream->sStats.u32DeliveredBytes += len;
+        psStream->u8RxNext++;
+
+        /* release frames buffered behind it */
+        tsStmRxSlot *psSlot = &psStream->asRx[STM_SLOT(psStream->u8RxNext)];
+        while (psSlot->bValid)
+        {
+            psStream->pfDeliver(psStream, psSlot->data, psSlot->len);
+            psStream->sStats.u32DeliveredBytes += psSlot->len;
+            psSlot->bValid = FALSE;
+            psStream->u8RxNext++;
+            psSlot = &psStream->asRx[STM_SLOT(psStream->u8RxNext)];
+        }
+    }
+    else
+    {
+        tsStmRxSlot *psSlot = &psStream->asRx[STM_SLOT(psData->seq)];
+        if (psSlot->bValid)
+        {
+            psStream->sStats.u32RxDuplicates++;
+        }
+        else
+        {
+            memcpy(psSlot->data, psData->data, len);
+            psSlot->len = len;
+            psSlot->bValid = TRUE;
+        }
+    }
+    STM_vTxAck(psStream);
+}
+
+/****************************************************************************
+ *
+ * NAME: STM_vRxAck
+ *
+ * DESCRIPTION:
+ * Sender side. Slide the window to the cumulative ack, mark selectively
+ * acked frames, and sample RTT from frames which were sent only once(Karn).
+ * When the peer holds two or more frames behind a hole that's older than
+ * one RTT, the hole is resent without waiting for its timer.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psStream     RW  stream
+ *             psAck        R   received ack
+ *             u32NowMs     R   current time
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void STM_vRxAck(tsStream *psStream, tsStreamAck *psAck, uint32 u32NowMs)
+{
+    uint8 u8InFlight = (uint8)(psStream->u8TxNext - psStream->u8TxBase);
+    uint8 u8Acked = (uint8)(psAck->ackSeq - psStream->u8TxBase);
+    uint8 i, u8Sacked = 0;
+
+    /* stale ack, or one of a previous stream */
+    if (u8Acked > u8InFlight) return;
+    if (u8Acked > 0) psStream->bSyn = FALSE;
+
+    while (psStream->u8TxBase != psAck->ackSeq)
+    {
+        tsStmTxSlot *psSlot = &psStream->asTx[STM_SLOT(psStream->u8TxBase)];
+        if (0 == psSlot->retries && !psSlot->bSacked)
+        {
+            RTT_vSample(&psStream->sRtt, u32NowMs - psSlot->u32SentMs);
+        }
+        psStream->u8TxBase++;
+    }
+
+    u8InFlight = (uint8)(psStream->u8TxNext - psStream->u8TxBase);
+    for (i = 0; i + 1 < u8InFlight && i < 8; i++)
+    {
+        if (psAck->sack & (1 << i))
+        {
+            tsStmTxSlot *psSlot = &psStream->asTx[STM_SLOT(psStream->u8TxBase + 1 + i)];
+            if (!psSlot->bSacked && 0 == psSlot->retries)
+            {
+                RTT_vSample(&psStream->sRtt, u32NowMs - psSlot->u32SentMs);
+            }
+            psSlot->bSacked = TRUE;
+            u8Sacked++;
+        }
+    }
+
+    /* fast retransmit of the hole */
+    if (u8Sacked >= 2 && psStream->sRtt.u32SrttMs > 0)
+    {
+        tsStmTxSlot *psSlot = &psStream->asTx[STM_SLOT(psStream->u8TxBase)];
+        if (u32NowMs - psSlot->u32SentMs >= psStream->sRtt.u32SrttMs)
+        {
+            psSlot->retries++;
+            psSlot->u32SentMs = u32NowMs;
+            psStream->sStats.u32Retransmits++;
+            STM_bTxFrame(psStream, psStream->u8TxBase);
+        }
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: STM_u32Poll
+ *
+ * DESCRIPTION:
+ * Resend frames whose retransmission timer expired. Each retry doubles the
+ * timer of that frame, after STM_MAX_RETRIES the frames in flight are dropped,
+ * user is told how many bytes they held and the stream re-syncs.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             psStream     RW  stream
+ *             u32NowMs     R   current time
+ *
+ * RETURNS:
+ * ms until the next timer expires, 0 if nothing is in flight
+ *
+ ****************************************************************************/
+PUBLIC uint32 STM_u32Poll(tsStream *psStream, uint32 u32NowMs)
+{
+    uint32 u32Next = 0;
+    uint8 u8Seq;
+
+    for (u8Seq = psStream->u8TxBase; u8Seq != psStream->u8TxNext; u8Seq++)
+    {
+        tsStmTxSlot *psSlot = &psStream->asTx[STM_SLOT(u8Seq)];
+        if (psSlot->bSacked) continue;
+
+        uint32 u32Rto = RTT_u32Backoff(&psStream->sRtt, psSlot->retries);
+        uint32 u32Elapsed = u32NowMs - psSlot->u32SentMs;
+        if (u32Elapsed >= u32Rto)
+        {
+            if (psSlot->retries >= STM_MAX_RETRIES)
+            {
+                /* peer is gone, drop what's in flight and start over */
+                uint16 u16Lost = 0;
+                for (u8Seq = psStream->u8TxBase; u8Seq != psStream->u8TxNext; u8Seq++)
+                {
+                    u16Lost += psStream->asTx[STM_SLOT(u8Seq)].len;
+                }
+                psStream->u8TxBase = psStream->u8TxNext;
+                psStream->bSyn = TRUE;
+                psStream->u8SynSeq = psStream->u8TxNext;
+                psStream->u8TxId = (psStream->u8TxId + 1) & STM_ID_MASK;
+                RTT_vInit(&psStream->sRtt, STM_INIT_RTO_MS, STM_MIN_RTO_MS, STM_MAX_RTO_MS);
+                psStream->sStats.u32Resyncs++;
+                psStream->sStats.u32LostBytes += u16Lost;
+                if (NULL != psStream->pfLost) psStream->pfLost(psStream, u16Lost);
+                return 0;
+            }
+            psSlot->retries++;
+            psSlot->u32SentMs = u32NowMs;
+            psStream->sStats.u32Retransmits++;
+            STM_bTxFrame(psStream, u8Seq);
+            u32Elapsed = 0;
+            u32Rto = RTT_u32Backoff(&psStream->sRtt, psSlot->retries);
+        }
+        if (0 == u32Next || u32Rto - u32Elapsed < u32Next)
+        {
+            u32Next = u32Rto - u32Elapsed;
+        }
+    }
+    return u32Next;
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/* put a kept frame on air */
+PRIVATE bool STM_bTxFrame(tsStream *psStream, uint8 u8Seq)
+{
+    tsStmTxSlot *psSlot = &psStream->asTx[STM_SLOT(u8Seq)];
+    tsStreamData sData;
+
+    sData.seq = u8Seq;
+    sData.flags = (uint8)(psStream->u8TxId << STM_ID_SHIFT);
+    if (psStream->bSyn && u8Seq == psStream->u8SynSeq) sData.flags |= STM_FLAG_SYN;
+    sData.dataLen = psSlot->len;
+    memcpy(sData.data, psSlot->data, psSlot->len);
+
+    psStream->sStats.u32TxFrames++;
+    return psStream->pfSend(psStream, E_STM_DATA, &sData, 3 + psSlot->len);
+}
+
+/* ack with cumulative seq and bitmap of buffered frames */
+PRIVATE void STM_vTxAck(tsStream *psStream)
+{
+    tsStreamAck sAck;
+    uint8 i;
+
+    sAck.ackSeq = psStream->u8RxNext;
+    sAck.sack = 0;
+    for (i = 0; i < STM_MAX_WINDOW - 1; i++)
+    {
+        if (psStream->asRx[STM_SLOT(psStream->u8RxNext + 1 + i)].bValid)
+            sAck.sack |= (1 << i);
+    }
+    psStream->pfSend(psStream, E_STM_ACK, &sAck, sizeof(tsStreamAck));
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
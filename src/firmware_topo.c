@@ -0,0 +1,599 @@
+/*
+ * firmware_topo.c
+ * Firmware for SeeedStudio Mesh Bee(Zigbee) module
+ *
+ * Copyright (c) NXP B.V. 2012.
+ * Spread by SeeedStudio
+ * Author     : SeeedStudio
+ * Create Time: 2026/10
+ * Change Log :
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+#include <string.h>
+#include "common.h"
+#include "firmware_topo.h"
+#include "firmware_at_api.h"
+#include "firmware_api_pack.h"
+#include "firmware_uart.h"
+#include "firmware_hal.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+#ifndef TRACE_TPO
+#define TRACE_TPO  FALSE
+#endif
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+/*
+  Requester side of a scan:
+  LISTEN   - responses come back in random slots of the window, the
+             broadcast goes again with a wider window while new nodes
+             keep answering
+  FOLLOWUP - nodes not heard are asked one by one
+  WAIT     - time for the answers of a follow-up round
+*/
+typedef enum
+{
+    E_TPO_IDLE,
+    E_TPO_LISTEN,
+    E_TPO_FOLLOWUP,
+    E_TPO_WAIT
+}teTpoState;
+
+/* a node seen in earlier scans or in the neighbour table */
+typedef struct
+{
+    uint16 u16Addr;
+    uint8  u8Misses;          //scans in a row without answer
+    bool   bHeard;            //answered in this scan
+}tsTpoNode;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+PRIVATE bool TPO_bSendResp(uint16 u16DstAddr, uint8 lqi);
+#ifndef TARGET_END
+PRIVATE bool TPO_bSendReq(uint16 txMode, uint16 u16DstAddr, uint16 u16WindowMs);
+PRIVATE bool TPO_bBroadcast(uint16 u16Nodes);
+PRIVATE tsTpoNode *TPO_psFindNode(uint16 u16Addr);
+PRIVATE tsTpoNode *TPO_psAddNode(uint16 u16Addr);
+PRIVATE void TPO_vSeedNeighbours(void);
+PRIVATE void TPO_vScanStep(uint32 u32Now);
+PRIVATE void TPO_vScanDone(uint32 u32Now);
+#endif
+PRIVATE void TPO_vArmTimer(void);
+
+/****************************************************************************/
+/***        External Functions                                            ***/
+/****************************************************************************/
+extern uint8 calCheckSum(uint8 *in, int len);
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+/* requester, end devices don't scan */
+#ifndef TARGET_END
+PRIVATE tsTpoNode asTpoNode[TPO_MAX_NODES];
+PRIVATE uint16 u16TpoNodes = 0;
+PRIVATE teTpoState eTpoState = E_TPO_IDLE;
+PRIVATE uint8 u8TpoRound = 0;
+PRIVATE uint16 u16TpoCursor = 0;
+PRIVATE uint16 u16TpoRoundSent = 0;
+PRIVATE uint16 u16TpoRoundHeard = 0;
+PRIVATE uint32 u32TpoScanStartMs = 0;
+PRIVATE uint32 u32TpoScanDueMs = 0;
+PRIVATE uint32 u32TpoWindowMs = 0;
+PRIVATE tsTpoStats sTpoStats;
+#endif
+
+/* responder, one answer per window */
+PRIVATE bool bTpoRespPending = FALSE;
+PRIVATE uint16 u16TpoRespAddr = 0;
+PRIVATE uint8 u8TpoRespLqi = 0;
+PRIVATE uint32 u32TpoRespDueMs = 0;
+
+/****************************************************************************/
+/***        Tasks                                                         ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: APP_taskTopo
+ *
+ * DESCRIPTION:
+ * Sends a pending topology response when its slot comes and moves the
+ * scan of this node forward
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+OS_TASK(APP_taskTopo)
+{
+    uint32 u32Now = u32HAL_GetMsTime();
+
+    if (bTpoRespPending && (int32)(u32Now - u32TpoRespDueMs) >= 0)
+    {
+        bTpoRespPending = FALSE;
+        TPO_bSendResp(u16TpoRespAddr, u8TpoRespLqi);
+    }
+
+#ifndef TARGET_END
+    if (E_TPO_IDLE != eTpoState && (int32)(u32Now - u32TpoScanDueMs) >= 0)
+    {
+        TPO_vScanStep(u32Now);
+    }
+#endif
+    TPO_vArmTimer();
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/****************************************************************************
+ *
+ * NAME: TPO_bStartScan
+ *
+ * DESCRIPTION:
+ * Broadcast a topology request with a response window sized for the nodes
+ * known so far. The first scan of a network knows only the neighbours, so
+ * the broadcast is repeated with a window sized for the nodes heard while
+ * new ones keep answering. Nodes that stay silent are asked by unicast
+ * later. A scan in progress starts over.
+ *
+ * RETURNS:
+ * TRUE if the request is sent
+ *
+ ****************************************************************************/
+PUBLIC bool TPO_bStartScan(void)
+{
+#ifndef TARGET_END
+    uint16 i;
+
+    TPO_vSeedNeighbours();
+    for (i = 0; i < u16TpoNodes; i++) asTpoNode[i].bHeard = FALSE;
+
+    memset(&sTpoStats, 0, sizeof(sTpoStats));
+    u32TpoWindowMs = 0;
+    if (!TPO_bBroadcast(u16TpoNodes)) return FALSE;
+
+    u32TpoScanStartMs = u32HAL_GetMsTime();
+    u32TpoScanDueMs = u32TpoScanStartMs + u32TpoWindowMs + TPO_LISTEN_MARGIN_MS;
+    eTpoState = E_TPO_LISTEN;
+    u8TpoRound = 0;
+    TPO_vArmTimer();
+
+    DBG_vPrintf(TRACE_TPO, "TPO: scan, %d known, window %ld ms\r\n", u16TpoNodes, u32TpoWindowMs);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/****************************************************************************
+ *
+ * NAME: TPO_vRequest
+ *
+ * DESCRIPTION:
+ * A topology request arrived. Without a window the response goes at once,
+ * otherwise in a random slot of the window. Requests coming in while a
+ * response is pending are answered by that response.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16SrcAddr   R   requester
+ *             lqi          R   link quality of the request
+ *             u16WindowMs  R   response window, 0: answer now
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void TPO_vRequest(uint16 u16SrcAddr, uint8 lqi, uint16 u16WindowMs)
+{
+    uint16 u16Slots;
+
+    if (0 == u16WindowMs)
+    {
+        TPO_bSendResp(u16SrcAddr, lqi);
+        return;
+    }
+    if (bTpoRespPending) return;
+
+    u16Slots = u16WindowMs / TPO_SLOT_MS;
+    if (0 == u16Slots) u16Slots = 1;
+
+    bTpoRespPending = TRUE;
+    u16TpoRespAddr = u16SrcAddr;
+    u8TpoRespLqi = lqi;
+    u32TpoRespDueMs = u32HAL_GetMsTime() + (uint32)(random() % u16Slots) * TPO_SLOT_MS;
+    TPO_vArmTimer();
+}
+
+/****************************************************************************
+ *
+ * NAME: TPO_bResponse
+ *
+ * DESCRIPTION:
+ * A topology response arrived, note the node for the follow-ups
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16ShortAddr R   responder
+ *
+ * RETURNS:
+ * TRUE if the response should be reported, FALSE for a duplicate
+ *
+ ****************************************************************************/
+PUBLIC bool TPO_bResponse(uint16 u16ShortAddr)
+{
+#ifndef TARGET_END
+    tsTpoNode *psNode;
+
+    if (E_TPO_IDLE == eTpoState) return TRUE;
+
+    psNode = TPO_psFindNode(u16ShortAddr);
+    if (NULL == psNode) psNode = TPO_psAddNode(u16ShortAddr);
+    if (NULL == psNode) return TRUE;    //roster full, still report it
+
+    if (psNode->bHeard)
+    {
+        sTpoStats.u16Duplicates++;
+        return FALSE;
+    }
+    psNode->bHeard = TRUE;
+    sTpoStats.u16Heard++;
+    u16TpoRoundHeard++;
+#endif
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: TPO_vGetStats
+ *
+ * DESCRIPTION:
+ * Statistics of the last scan
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void TPO_vGetStats(tsTpoStats *psStats)
+{
+#ifndef TARGET_END
+    *psStats = sTpoStats;
+    psStats->u16Known = u16TpoNodes;
+#else
+    memset(psStats, 0, sizeof(tsTpoStats));
+#endif
+}
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+#ifndef TARGET_END
+/****************************************************************************
+ *
+ * NAME: TPO_bSendReq
+ *
+ * DESCRIPTION:
+ * Pack and send a topology request
+ *
+ * RETURNS:
+ * TRUE if sent
+ *
+ ****************************************************************************/
+PRIVATE bool TPO_bSendReq(uint16 txMode, uint16 u16DstAddr, uint16 u16WindowMs)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec apiSpec;
+    tsNwkTopoReq nwkTopoReq;
+    int size;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    memset(&nwkTopoReq, 0, sizeof(tsNwkTopoReq));
+    nwkTopoReq.windowMs = u16WindowMs;
+
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsNwkTopoReq);
+    apiSpec.teApiIdentifier = API_TOPO_REQ;
+    apiSpec.payload.nwkTopoReq = nwkTopoReq;
+    apiSpec.checkSum = calCheckSum((uint8 *)&nwkTopoReq, apiSpec.length);
+
+    size = i32CopyApiSpec(&apiSpec, tmp);
+    return API_bSendToAirPort(txMode, u16DstAddr, tmp, size);
+}
+
+/****************************************************************************
+ *
+ * NAME: TPO_bBroadcast
+ *
+ * DESCRIPTION:
+ * Broadcast a topology request with TPO_SLOTS_PER_NODE slots for each node
+ * expected, never narrower than the window of the last round
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u16Nodes     R   nodes expected to answer
+ *
+ * RETURNS:
+ * TRUE if sent
+ *
+ ****************************************************************************/
+PRIVATE bool TPO_bBroadcast(uint16 u16Nodes)
+{
+    uint32 u32Window = (uint32)u16Nodes * TPO_SLOTS_PER_NODE * TPO_SLOT_MS;
+
+    if (u32Window < TPO_MIN_WINDOW_MS) u32Window = TPO_MIN_WINDOW_MS;
+    if (u32Window < u32TpoWindowMs) u32Window = u32TpoWindowMs;
+    if (u32Window > TPO_MAX_WINDOW_MS) u32Window = TPO_MAX_WINDOW_MS;
+
+    if (!TPO_bSendReq(BROADCAST, 0, (uint16)u32Window)) return FALSE;
+
+    u32TpoWindowMs = u32Window;
+    u16TpoRoundHeard = 0;
+    sTpoStats.u16Broadcasts++;
+    return TRUE;
+}
+#endif
+
+/****************************************************************************
+ *
+ * NAME: TPO_bSendResp
+ *
+ * DESCRIPTION:
+ * Pack and send the topology response of this node
+ *
+ * RETURNS:
+ * TRUE if sent
+ *
+ ****************************************************************************/
+PRIVATE bool TPO_bSendResp(uint16 u16DstAddr, uint8 lqi)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = { 0 };
+    tsApiSpec respApiSpec;
+    tsNwkTopoResp nwkTopoResp;
+    int size;
+
+    memset(&respApiSpec, 0, sizeof(tsApiSpec));
+    memset(&nwkTopoResp, 0, sizeof(nwkTopoResp));
+
+    /* Fill in the parameter */
+    nwkTopoResp.dbm = (lqi - 305) / 3;
+    nwkTopoResp.lqi = lqi;
+    nwkTopoResp.nodeFWVer = (uint16)(FW_VERSION);
+    nwkTopoResp.shortAddr = (uint16)ZPS_u16AplZdoGetNwkAddr();              //Short Address
+    nwkTopoResp.nodeMacAddr0 = (uint32)ZPS_u64AplZdoGetIeeeAddr();          //Low
+    nwkTopoResp.nodeMacAddr1 = (uint32)(ZPS_u64AplZdoGetIeeeAddr() >> 32);  //High
+
+    respApiSpec.startDelimiter = API_START_DELIMITER;
+    respApiSpec.length = sizeof(tsNwkTopoResp);
+    respApiSpec.teApiIdentifier = API_TOPO_RESP;
+    respApiSpec.payload.nwkTopoResp = nwkTopoResp;
+    respApiSpec.checkSum = calCheckSum((uint8 *)&nwkTopoResp, respApiSpec.length);
+
+    size = i32CopyApiSpec(&respApiSpec, tmp);
+    return API_bSendToAirPort(UNICAST, u16DstAddr, tmp, size);
+}
+
+#ifndef TARGET_END
+PRIVATE tsTpoNode *TPO_psFindNode(uint16 u16Addr)
+{
+    uint16 i;
+    for (i = 0; i < u16TpoNodes; i++)
+    {
+        if (asTpoNode[i].u16Addr == u16Addr) return &asTpoNode[i];
+    }
+    return NULL;
+}
+
+PRIVATE tsTpoNode *TPO_psAddNode(uint16 u16Addr)
+{
+    tsTpoNode *psNode;
+
+    if (u16TpoNodes >= TPO_MAX_NODES || u16Addr >= 0xfff8) return NULL;
+
+    psNode = &asTpoNode[u16TpoNodes++];
+    psNode->u16Addr = u16Addr;
+    psNode->u8Misses = 0;
+    psNode->bHeard = FALSE;
+    return psNode;
+}
+
+/****************************************************************************
+ *
+ * NAME: TPO_vSeedNeighbours
+ *
+ * DESCRIPTION:
+ * Routers know their neighbours before the first scan, take them in so
+ * they get follow-ups too
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void TPO_vSeedNeighbours(void)
+{
+    ZPS_tsNwkNib *thisNib = ZPS_psNwkNibGetHandle(ZPS_pvAplZdoGetNwkHandle());
+    uint16 i;
+
+    for (i = 0; i < thisNib->sTblSize.u16NtActv; i++)
+    {
+        uint16 u16Addr = thisNib->sTbl.psNtActv[i].u16NwkAddr;
+        if (u16Addr < 0xfff8 && NULL == TPO_psFindNode(u16Addr))
+        {
+            TPO_psAddNode(u16Addr);
+        }
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: TPO_vScanStep
+ *
+ * DESCRIPTION:
+ * Scan state machine, runs when the due time of the state is over.
+ * Responses of a round collide when the window is too narrow for the
+ * nodes out there, a round that still brings new nodes is repeated with
+ * a window sized for all nodes heard so far.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void TPO_vScanStep(uint32 u32Now)
+{
+    switch (eTpoState)
+    {
+    case E_TPO_LISTEN:
+        if (u16TpoRoundHeard > 0 && sTpoStats.u16Broadcasts < TPO_BCAST_ROUNDS &&
+            TPO_bBroadcast(u16TpoNodes))
+        {
+            DBG_vPrintf(TRACE_TPO, "TPO: %d heard, again with %ld ms\r\n", sTpoStats.u16Heard, u32TpoWindowMs);
+            u32TpoScanDueMs = u32Now + u32TpoWindowMs + TPO_LISTEN_MARGIN_MS;
+            break;
+        }
+        u16TpoCursor = 0;
+        u16TpoRoundSent = 0;
+        eTpoState = E_TPO_FOLLOWUP;
+        /* fall through */
+    case E_TPO_FOLLOWUP:
+        while (u16TpoCursor < u16TpoNodes && asTpoNode[u16TpoCursor].bHeard) u16TpoCursor++;
+
+        if (u16TpoCursor < u16TpoNodes)
+        {
+            TPO_bSendReq(UNICAST, asTpoNode[u16TpoCursor].u16Addr, 0);
+            u16TpoCursor++;
+            u16TpoRoundSent++;
+            sTpoStats.u16FollowUps++;
+            u32TpoScanDueMs = u32Now + TPO_FOLLOWUP_GAP_MS;
+        } else if (u16TpoRoundSent > 0)
+        {
+            eTpoState = E_TPO_WAIT;
+            u32TpoScanDueMs = u32Now + TPO_FOLLOWUP_WAIT_MS;
+        } else
+        {
+            TPO_vScanDone(u32Now);
+        }
+        break;
+    case E_TPO_WAIT:
+        if (++u8TpoRound < TPO_FOLLOWUP_ROUNDS)
+        {
+            u16TpoCursor = 0;
+            u16TpoRoundSent = 0;
+            eTpoState = E_TPO_FOLLOWUP;
+            u32TpoScanDueMs = u32Now;
+        } else
+        {
+            TPO_vScanDone(u32Now);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: TPO_vScanDone
+ *
+ * DESCRIPTION:
+ * End of scan, forget nodes that stayed silent for TPO_MAX_MISSES scans
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void TPO_vScanDone(uint32 u32Now)
+{
+    uint16 i, n = 0;
+    uint16 u16Missing = 0;
+
+    for (i = 0; i < u16TpoNodes; i++)
+    {
+        if (asTpoNode[i].bHeard)
+        {
+            asTpoNode[i].u8Misses = 0;
+        } else
+        {
+            u16Missing++;
+            if (++asTpoNode[i].u8Misses >= TPO_MAX_MISSES) continue;
+        }
+        asTpoNode[n++] = asTpoNode[i];
+    }
+    u16TpoNodes = n;
+
+    sTpoStats.u32DurationMs = u32Now - u32TpoScanStartMs;
+    eTpoState = E_TPO_IDLE;
+
+    if (E_MODE_AT == g_sDevice.eMode)
+    {
+        uart_printf("+--Scan done: %d nodes, %d missing, %ld ms\r\n",
+                    sTpoStats.u16Heard, u16Missing, sTpoStats.u32DurationMs);
+    }
+    DBG_vPrintf(TRACE_TPO, "TPO: done, %d heard, %d follow-ups, %d dup\r\n",
+                sTpoStats.u16Heard, sTpoStats.u16FollowUps, sTpoStats.u16Duplicates);
+}
+#endif
+
+/****************************************************************************
+ *
+ * NAME: TPO_vArmTimer
+ *
+ * DESCRIPTION:
+ * Run the task again at the nearest due time, stop the timer if nothing
+ * is pending
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void TPO_vArmTimer(void)
+{
+    uint32 u32Now = u32HAL_GetMsTime();
+    uint32 u32Wait = 0xffffffff;
+    int32 i32Left;
+
+    if (bTpoRespPending)
+    {
+        i32Left = (int32)(u32TpoRespDueMs - u32Now);
+        u32Wait = (i32Left > 0) ? (uint32)i32Left : 1;
+    }
+#ifndef TARGET_END
+    if (E_TPO_IDLE != eTpoState)
+    {
+        i32Left = (int32)(u32TpoScanDueMs - u32Now);
+        u32Wait = MIN(u32Wait, (i32Left > 0) ? (uint32)i32Left : 1);
+    }
+#endif
+
+    if (0xffffffff != u32Wait)
+    {
+        vResetATimer(APP_tmrTopo, APP_TIME_MS(u32Wait));
+    } else if (OS_eGetSWTimerStatus(APP_tmrTopo) != OS_E_SWTIMER_STOPPED)
+    {
+        OS_eStopSWTimer(APP_tmrTopo);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
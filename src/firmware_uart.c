@@ -27,6 +27,7 @@
 #include "common.h"
 #include "firmware_uart.h"
 #include "firmware_cmi.h"
+#include "firmware_energy.h"
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
 /****************************************************************************/
@@ -90,6 +91,7 @@ OS_ISR(APP_isrUART1)
               if not do so, ISR will occur again and again
             */
             u16AHI_UartBlockReadData(UART_COMM, tmp, avlb_cnt);
+            ENG_vUartRx(avlb_cnt);
 
             /* if UART receive a event, sleep later */
 #ifdef TARGET_END
@@ -70,6 +70,12 @@ void arduino_setup(void)
     suli_uart_printf(NULL, NULL, "Setup done.\r\n");
 }
 
+void arduino_resume(void)
+{
+    //I2C master is off in sleep, the adxl345 keeps its setup
+    suli_i2c_init(NULL);
+}
+
 void arduino_loop(void)
 {
     suli_pin_write(&led_io, led_st);
@@ -109,6 +115,15 @@ void arduino_setup(void)
     suli_analog_init(&temp_pin, TEMP);
 }
 
+/*
+ * Called instead of arduino_setup() when the node wakes up from a sleep,
+ * variables keep their values. Turn on again what the loop uses and is off
+ * in sleep, e.g. suli_i2c_init(). ADC and UART are turned on by the firmware.
+ */
+void arduino_resume(void)
+{
+}
+
 void arduino_loop(void)
 {
 #ifdef TARGET_COO
@@ -138,7 +153,12 @@ void arduino_loop(void)
     sprintf(tmp, "E-HeartBeat:%ld\r\n", temper);
     PCK_vApiSpecDataFrame(&apiSpec, 0xec, 0x00, tmp, strlen(tmp));
 
-    /* Air to Coordinator */
+    /*
+      Air to Coordinator. To wake the radio less, batch the samples instead
+      of the two lines below with: if(aupsBatchAdd(&temper, sizeof(temper)))
+      The batches go to ATDA, not 0x0000, as binary API_SAMPLE_BATCH frames
+      of up to ATBN samples; 2-byte samples let the default 8 share a frame.
+    */
     uint16 size = i32CopyApiSpec(&apiSpec, tmp);
     if(API_bSendToAirPort(UNICAST, 0x0000, tmp, size))
     {
@@ -31,8 +31,13 @@
 #include "zigbee_node.h"
 #include "firmware_at_api.h"
 #include "firmware_ota.h"
+#include "firmware_ota_dl.h"
+#include "firmware_ota_delta.h"
+#include "firmware_ota_pack.h"
+#include "firmware_ota_peer.h"
 #include "firmware_hal.h"
 #include "firmware_api_pack.h"
+#include "firmware_sleep.h"
 
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
@@ -42,13 +47,52 @@
 #define TRACE_EP    FALSE
 #endif
 
+#define OTA_PROGRESS_SAVE_BLOCKS    32      //persist the received ranges that often
+#define OTA_CRC_CATCHUP_BLOCKS      4       //out of order blocks read back per block received
+#define OTA_BUILD_STEP_BYTES        4096    //image bytes built from a patch or compressed image per task activation
+#define OTA_BUILD_STEP_MS           10
+
 /****************************************************************************/
 /***        Type Definitions                                              ***/
 /****************************************************************************/
+/* received blocks of a download, a record of its own as it's saved often */
+typedef struct
+{
+    uint32   magic;
+    uint32   crc;                   //image the ranges belong to
+    uint32   totalBytes;
+    uint16   blockSize;
+    uint8    image;                 //OTA_IMAGE_xxx the ranges belong to
+    uint8    runs;
+    tsOdlRun asRun[ODL_MAX_RUNS];
+    uint32   runCrc;                //crc32 of the blocks below runBlocks
+    uint32   runBlocks;
+    uint8    erased;                //bit i: sector i has been erased for this download
+} tsOtaProgress;
 
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
+#ifdef OTA_CLIENT
+PRIVATE bool clientOtaSendReq(uint32 u32BlockIdx);
+PRIVATE void clientOtaSendNack(void);
+PRIVATE bool clientOtaProgressMatches(void);
+PRIVATE void clientOtaSaveProgress(void);
+PRIVATE bool clientOtaWriteBlock(uint32 u32BlockIdx, uint16 len, uint8 *pu8Block);
+PRIVATE void clientOtaCrcAdvance(uint32 u32BlockIdx, uint16 len, uint8 *pu8Block, uint32 u32MaxReads);
+PRIVATE void clientOtaEraseSector(uint32 u32Sector, uint32 u32KeepIdx);
+PRIVATE void clientOtaEraseAhead(void);
+PRIVATE uint32 clientOtaBase(void);
+PRIVATE bool clientOtaImageValid(uint32 u32Len, uint32 u32Crc);
+PRIVATE void clientOtaRequestUpgrade(void);
+PRIVATE void clientOtaStartBuild(void);
+PRIVATE bool clientOtaBuildInit(void);
+PRIVATE void clientOtaBuildStep(uint32 u32InAvail);
+PRIVATE void clientOtaFallbackFull(void);
+PRIVATE void clientOtaReadBase(uint32 u32Offset, uint16 len, uint8 *pu8Buf);
+PRIVATE void clientOtaReadDownload(uint32 u32Offset, uint16 len, uint8 *pu8Buf);
+PRIVATE bool clientOtaWriteImage(uint32 u32Offset, uint16 len, uint8 *pu8Buf);
+#endif
 
 /****************************************************************************/
 /***        Exported Variables                                            ***/
@@ -59,6 +103,26 @@
 /***        Local Variables                                               ***/
 /****************************************************************************/
 PRIVATE bool   bActiveByTimer = FALSE;
+#ifdef OTA_CLIENT
+PRIVATE tsOtaDownload sOtaDl;
+PRIVATE bool   bOtaDlReady = FALSE;    //sOtaDl matches the download in g_sDevice
+PRIVATE bool   bOtaMcNackDue = FALSE;  //multicast round ended, APP_OTAReqTimer sends the NACK
+PRIVATE uint8  u8OtaMcRound = 0;
+PRIVATE tsOtaProgress sOtaProgress;
+PRIVATE PDM_tsRecordDescriptor sOtaProgressPDDesc;
+PRIVATE uint16 u16OtaUnsaved = 0;       //blocks received since the ranges were saved
+PRIVATE uint32 u32OtaSectorErases = 0;
+PRIVATE uint32 u32OtaCorruptBlocks = 0;
+PRIVATE uint32 u32OtaRunCrc = 0xffffffff; //running image crc, in block order
+PRIVATE uint32 u32OtaRunBlocks = 0;       //blocks in u32OtaRunCrc
+PRIVATE union
+{
+    tsOtaDelta sDelta;
+    tsOtaPack  sPack;
+} uOtaBuild;                            //builds the image out of a patch or a compressed image
+PRIVATE bool   bOtaBuildReady = FALSE;  //uOtaBuild is in use
+PRIVATE uint32 u32OtaBuildCrc;          //crc of the image built so far
+#endif
 
 
 /****************************************************************************/
@@ -91,34 +155,65 @@ OS_TASK(APP_taskOTAReq)
 
 	if(1 == g_sDevice.otaDownloading)
 	{
-        tsOtaReq otaReq;
-        memset(&otaReq, 0, sizeof(tsOtaReq));
-
-        otaReq.blockIdx = g_sDevice.otaCurBlock;
-
-        DBG_vPrintf(TRUE, "-OTAReq-\r\nreq blk: %d / %dms\r\n",
-        		    otaReq.blockIdx, g_sDevice.otaReqPeriod);
-
         /* Coordinator can not act as a OTA client */
         if (ZPS_u16AplZdoGetNwkAddr() == 0x0)
         {
             DBG_vPrintf(TRUE, "Invalid ota client addr: 0x0000\r\n");
             g_sDevice.otaDownloading = 0;
+            return;
+        }
+
+        /* resumed after reboot, the saved ranges are in flash */
+        if (!bOtaDlReady) clientOtaStartDownload();
+        if (ODL_bDone(&sOtaDl))
+        {
+            clientOtaFinishing();
+            return;
+        }
+
+        /* a sector per activation, before its blocks are requested */
+        clientOtaEraseAhead();
+
+        /* a compressed image is expanded as its blocks come in */
+        if (OTA_IMAGE_PACKED == g_sDevice.otaImage && sOtaDl.u32FirstHole > 0)
+        {
+            clientOtaBuildStep(sOtaDl.u32FirstHole * g_sDevice.otaBlockSize);
+            if (OTA_IMAGE_PACKED != g_sDevice.otaImage) return;
         }
 
-        /* package apiSpec */
-	    apiSpec.startDelimiter = API_START_DELIMITER;
-	    apiSpec.length = sizeof(tsOtaReq);
-	    apiSpec.teApiIdentifier = API_OTA_REQ;
-	    apiSpec.payload.otaReq = otaReq;
-	    apiSpec.checkSum = calCheckSum((uint8*)&otaReq, apiSpec.length);
+        /* a silent peer is dropped, requests go to the server again */
+        OPR_vCheckSource();
+
+        /* resend timed out requests and fill the window */
+        uint32 u32Next = ODL_u32Poll(&sOtaDl, u32HAL_GetMsTime());
 
-	   /* send through AirPort */
-	   int size = i32CopyApiSpec(&apiSpec, tmp);
-	   API_bSendToAirPort(UNICAST, g_sDevice.otaSvrAddr16, tmp, size);
+        DBG_vPrintf(TRACE_EP, "-OTAReq-\r\nfirst hole: %d, in flight: %d/%d, rto: %dms\r\n",
+                    sOtaDl.u32FirstHole, sOtaDl.u8InFlight, sOtaDl.u8Cwnd, sOtaDl.sRtt.u32RtoMs);
 
-	   /* Require per otaReqPeriod */
-	   vResetATimer(APP_OTAReqTimer, APP_TIME_MS(g_sDevice.otaReqPeriod));
+        if (u32Next > 0) vResetATimer(APP_OTAReqTimer, APP_TIME_MS(u32Next));
+	}
+	else if(3 == g_sDevice.otaDownloading)
+	{
+        if (!bOtaDlReady)
+        {
+            /* resumed after reboot, keep listening to the session */
+            clientOtaStartDownload();
+            vResetATimer(APP_OTAReqTimer, APP_TIME_MS(OTA_MC_SILENCE_MS));
+        }
+        else if (bOtaMcNackDue)
+        {
+            bOtaMcNackDue = FALSE;
+            clientOtaSendNack();
+            vResetATimer(APP_OTAReqTimer, APP_TIME_MS(OTA_MC_SILENCE_MS));
+        }
+        else
+        {
+            /* server went silent, pull the rest by unicast */
+            DBG_vPrintf(TRACE_EP, "OTA mc: silent, pull from blk %d\r\n", sOtaDl.u32FirstHole);
+            g_sDevice.otaDownloading = 1;
+            PDM_vSaveRecord(&g_sDevicePDDesc);
+            OS_eActivateTask(APP_taskOTAReq);
+        }
 	}
 	else if(2 == g_sDevice.otaDownloading)
 	{
@@ -135,6 +230,11 @@ OS_TASK(APP_taskOTAReq)
 
 		vResetATimer(APP_OTAReqTimer, APP_TIME_MS(1000));
 	}
+	else if(4 == g_sDevice.otaDownloading)
+	{
+        /* after a reboot it starts over, the download is still in flash */
+        clientOtaBuildStep(g_sDevice.otaTotalBytes);
+	}
 #endif
 }
 
@@ -143,6 +243,252 @@ OS_TASK(APP_taskOTAReq)
 /***        Exported Functions                                            ***/
 /****************************************************************************/
 
+#ifdef OTA_CLIENT
+/****************************************************************************
+ *
+ * NAME: clientOtaStartDownload
+ *
+ * DESCRIPTION:
+ * (re)init the pipelined block download from g_sDevice, blocks below
+ * otaCurBlock are taken as received. The server's otaReqPeriod only seeds
+ * the request timeout, the request rate follows the measured rtt then.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             None
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void clientOtaStartDownload()
+{
+    uint8 u8Window = (g_sDevice.config.otaWindow > 0) ? (uint8)g_sDevice.config.otaWindow : ODL_DEF_WINDOW;
+
+    if (0 == g_sDevice.otaBlockSize) g_sDevice.otaBlockSize = OTA_BLOCK_SIZE;
+
+    ODL_vInit(&sOtaDl, g_sDevice.otaTotalBlocks, g_sDevice.otaCurBlock,
+              u8Window, g_sDevice.otaReqPeriod, clientOtaSendReq);
+    u32OtaRunCrc = 0xffffffff;
+    u32OtaRunBlocks = 0;
+    if (clientOtaProgressMatches())
+    {
+        ODL_vSetRuns(&sOtaDl, sOtaProgress.asRun, sOtaProgress.runs);
+        /* a saved crc covers runBlocks blocks, none: start from the seed */
+        if (sOtaProgress.runBlocks > 0 && sOtaProgress.runBlocks <= sOtaDl.u32FirstHole)
+        {
+            u32OtaRunCrc = sOtaProgress.runCrc;
+            u32OtaRunBlocks = sOtaProgress.runBlocks;
+        }
+    }
+    g_sDevice.otaCurBlock = sOtaDl.u32FirstHole;
+    u16OtaUnsaved = 0;
+    bOtaDlReady = TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaLoadProgress
+ *
+ * DESCRIPTION:
+ * Load the received ranges of an interrupted download, on power up
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             None
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void clientOtaLoadProgress(void)
+{
+    PDM_eLoadRecord(&sOtaProgressPDDesc, REC_ID2, &sOtaProgress, sizeof(sOtaProgress), FALSE);
+    if (sOtaProgress.magic != PDM_REC_MAGIC || sOtaProgress.runs > ODL_MAX_RUNS)
+    {
+        memset(&sOtaProgress, 0, sizeof(sOtaProgress));
+        sOtaProgress.magic = PDM_REC_MAGIC;
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaPrepareDownload
+ *
+ * DESCRIPTION:
+ * A notice arrived. If it's the image of the saved ranges, the download
+ * goes on from there. Else it starts from scratch, the sectors are erased
+ * later one by one just before they're written.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             None
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void clientOtaPrepareDownload(void)
+{
+    if (0 == g_sDevice.otaCrc || !clientOtaProgressMatches())
+    {
+        sOtaProgress.runs = 0;
+        sOtaProgress.runCrc = 0xffffffff;
+        sOtaProgress.runBlocks = 0;
+        sOtaProgress.erased = 0;
+        sOtaProgress.crc = g_sDevice.otaCrc;
+        sOtaProgress.totalBytes = g_sDevice.otaTotalBytes;
+        sOtaProgress.blockSize = g_sDevice.otaBlockSize;
+        sOtaProgress.image = g_sDevice.otaImage;
+        PDM_vSaveRecord(&sOtaProgressPDDesc);
+    }
+    bOtaBuildReady = FALSE;
+
+    /* the flash is about to change, this router stops serving its image */
+    OPR_vInvalidate();
+    clientOtaStartDownload();
+    DBG_vPrintf(TRACE_EP, "OTA: %d of %d blks in flash \r\n", sOtaDl.u32RxBlocks, sOtaDl.u32TotalBlocks);
+
+    if (ODL_bDone(&sOtaDl)) clientOtaFinishing();
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaRxBlock
+ *
+ * DESCRIPTION:
+ * Take a block response in any order. A block failing its crc is dropped
+ * and requested again. New blocks are written to flash and added to the
+ * running image crc, otaCurBlock follows the first missing block so a
+ * reboot resumes from there.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32BlockIdx  R   block index
+ *             len          R   block length
+ *             pu8Block     R   block data
+ *             pu8BlockCrc  R   block crc, NULL if the server doesn't send it
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void clientOtaRxBlock(uint32 u32BlockIdx, uint16 len, uint8 *pu8Block, uint8 *pu8BlockCrc)
+{
+    if (1 != g_sDevice.otaDownloading && 3 != g_sDevice.otaDownloading) return;
+    if (!bOtaDlReady) clientOtaStartDownload();
+    if (len > g_sDevice.otaBlockSize) len = g_sDevice.otaBlockSize;
+
+    if (NULL != pu8BlockCrc)
+    {
+        uint16 u16Crc;
+        memcpy(&u16Crc, pu8BlockCrc, OTA_BLOCK_CRC_LEN);
+        if (u16Crc != APP_u16OtaBlockCrc(pu8Block, len))
+        {
+            /* its request times out and is sent again */
+            DBG_vPrintf(TRACE_EP, "OTA_RESP: blk %d crc error \r\n", u32BlockIdx);
+            u32OtaCorruptBlocks++;
+            return;
+        }
+    }
+
+    if (!ODL_bRxBlock(&sOtaDl, u32BlockIdx, u32HAL_GetMsTime()))
+    {
+        DBG_vPrintf(TRACE_EP, "OTA_RESP: dup blk: %d \r\n", u32BlockIdx);
+        return;
+    }
+    if (!clientOtaWriteBlock(u32BlockIdx, len, pu8Block))
+    {
+        DBG_vPrintf(TRACE_EP, "OTA_RESP: blk %d not verified \r\n", u32BlockIdx);
+    }
+    else
+    {
+        clientOtaCrcAdvance(u32BlockIdx, len, pu8Block, OTA_CRC_CATCHUP_BLOCKS);
+    }
+
+    g_sDevice.otaCurBlock = sOtaDl.u32FirstHole;
+    if (++u16OtaUnsaved >= OTA_PROGRESS_SAVE_BLOCKS) clientOtaSaveProgress();
+
+    if (ODL_bDone(&sOtaDl))
+    {
+        clientOtaFinishing();
+    }
+    else if (3 == g_sDevice.otaDownloading)
+    {
+        /* the session is alive, a pending NACK keeps its slot */
+        if (!bOtaMcNackDue) vResetATimer(APP_OTAReqTimer, APP_TIME_MS(OTA_MC_SILENCE_MS));
+    }
+    else
+    {
+        /* a request is free, send the next one */
+        OS_eActivateTask(APP_taskOTAReq);
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaMcEnd
+ *
+ * DESCRIPTION:
+ * End of a multicast round. The NACK waits a random time within the
+ * server's window so the clients don't answer all at once. After the last
+ * round the rest is pulled by unicast requests.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u8Round      R   round just ended
+ *             bLast        R   no more multicast rounds
+ *             u16WindowMs  R   NACK window of the server
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void clientOtaMcEnd(uint8 u8Round, bool bLast, uint16 u16WindowMs)
+{
+    if (3 != g_sDevice.otaDownloading) return;
+    if (!bOtaDlReady) clientOtaStartDownload();
+
+    if (bLast)
+    {
+        bOtaMcNackDue = FALSE;
+        g_sDevice.otaDownloading = 1;
+        PDM_vSaveRecord(&g_sDevicePDDesc);
+        OS_eActivateTask(APP_taskOTAReq);
+        return;
+    }
+
+    u8OtaMcRound = u8Round;
+    bOtaMcNackDue = TRUE;
+    if (0 == u16WindowMs) u16WindowMs = 1;
+    vResetATimer(APP_OTAReqTimer, APP_TIME_MS(1 + random() % u16WindowMs));
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaProgress
+ *
+ * DESCRIPTION:
+ * Download progress for OTA status response
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             pu8Per       W   percent of received blocks
+ *             pu32Min      W   estimated minutes left
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PUBLIC void clientOtaProgress(uint8 *pu8Per, uint32 *pu32Min)
+{
+    if (!bOtaDlReady) clientOtaStartDownload();
+    /* no image announced yet */
+    if (0 == sOtaDl.u32TotalBlocks)
+    {
+        *pu8Per = 0;
+        *pu32Min = 0;
+        return;
+    }
+    *pu8Per  = (uint8)((sOtaDl.u32RxBlocks * 100) / sOtaDl.u32TotalBlocks);
+    *pu32Min = ODL_u32EtaMs(&sOtaDl) / 60000;
+}
+#endif
+
 
 /****************************************************************************
  *
@@ -166,6 +512,7 @@ PUBLIC void vResetATimer(OS_thSWTimer hSWTimer, uint32 u32Ticks)
         OS_eStopSWTimer(hSWTimer);
     }
     OS_eStartSWTimer(hSWTimer, u32Ticks, NULL);
+    SLP_vArmed(hSWTimer, u32Ticks);
 }
 
 
@@ -174,12 +521,54 @@ PUBLIC void vResetATimer(OS_thSWTimer hSWTimer, uint32 u32Ticks)
 /***        Local Functions                                            ***/
 /****************************************************************************/
 
+#ifdef OTA_CLIENT
 /****************************************************************************
  *
- * NAME: clientOtaRestartDownload
+ * NAME: clientOtaSendReq
+ *
+ * DESCRIPTION:
+ * send the request of a block to OTA server
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32BlockIdx  R   block index
+ *
+ * RETURNS:
+ * TRUE if it's handed to the air
+ *
+ ****************************************************************************/
+PRIVATE bool clientOtaSendReq(uint32 u32BlockIdx)
+{
+    uint8 tmp[sizeof(tsApiSpec)] = {0};
+    tsApiSpec apiSpec;
+    tsOtaReq otaReq;
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    memset(&otaReq, 0, sizeof(tsOtaReq));
+
+    otaReq.blockIdx = u32BlockIdx;
+    otaReq.blockSize = (uint8)g_sDevice.otaBlockSize;
+    otaReq.image = g_sDevice.otaImage;
+
+    /* package apiSpec */
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaReq);
+    apiSpec.teApiIdentifier = API_OTA_REQ;
+    apiSpec.payload.otaReq = otaReq;
+    apiSpec.checkSum = calCheckSum((uint8*)&otaReq, apiSpec.length);
+
+    /* send through AirPort */
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    /* a neighbour running the image, else the server */
+    return API_bSendToAirPort(UNICAST, OPR_u16Source(), tmp, size);
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaSendNack
  *
  * DESCRIPTION:
- * restart OTA download when crc check failed
+ * report the blocks missed in the last multicast round, from the first
+ * hole on. Holes beyond the bitmap are reported in later rounds. Nothing
+ * is sent before the image size is known.
  *
  * PARAMETERS: Name         RW  Usage
  *             None
@@ -188,34 +577,182 @@ PUBLIC void vResetATimer(OS_thSWTimer hSWTimer, uint32 u32Ticks)
  * void
  *
  ****************************************************************************/
-void clientOtaRestartDownload()
+PRIVATE void clientOtaSendNack(void)
 {
-    if (g_sDevice.otaTotalBytes == 0)
+    uint8 tmp[sizeof(tsApiSpec)] = {0};
+    tsApiSpec apiSpec;
+    tsOtaMcNack nack;
+
+    if (0 == sOtaDl.u32TotalBlocks) return;
+
+    memset(&apiSpec, 0, sizeof(tsApiSpec));
+    memset(&nack, 0, sizeof(tsOtaMcNack));
+
+    nack.session = g_sDevice.otaSession;
+    nack.round = u8OtaMcRound;
+    nack.per = (uint8)((sOtaDl.u32RxBlocks * 100) / sOtaDl.u32TotalBlocks);
+    nack.baseBlock = sOtaDl.u32FirstHole;
+    ODL_u16Gaps(&sOtaDl, sOtaDl.u32FirstHole, nack.gaps, OTA_MC_NACK_BYTES * 8);
+
+    /* package apiSpec */
+    apiSpec.startDelimiter = API_START_DELIMITER;
+    apiSpec.length = sizeof(tsOtaMcNack);
+    apiSpec.teApiIdentifier = API_OTA_MC_NACK;
+    apiSpec.payload.otaMcNack = nack;
+    apiSpec.checkSum = calCheckSum((uint8*)&nack, apiSpec.length);
+
+    /* send through AirPort */
+    int size = i32CopyApiSpec(&apiSpec, tmp);
+    API_bSendToAirPort(UNICAST, g_sDevice.otaSvrAddr16, tmp, size);
+    DBG_vPrintf(TRACE_EP, "OTA mc: NACK round %d, %d%%\r\n", nack.round, nack.per);
+}
+
+/* the saved ranges belong to the download in g_sDevice */
+PRIVATE bool clientOtaProgressMatches(void)
+{
+    return sOtaProgress.magic == PDM_REC_MAGIC &&
+           sOtaProgress.crc == g_sDevice.otaCrc &&
+           sOtaProgress.totalBytes == g_sDevice.otaTotalBytes &&
+           sOtaProgress.blockSize == g_sDevice.otaBlockSize &&
+           sOtaProgress.image == g_sDevice.otaImage;
+}
+
+/* persist the received ranges together with the download state */
+PRIVATE void clientOtaSaveProgress(void)
+{
+    sOtaProgress.magic = PDM_REC_MAGIC;
+    sOtaProgress.crc = g_sDevice.otaCrc;
+    sOtaProgress.totalBytes = g_sDevice.otaTotalBytes;
+    sOtaProgress.blockSize = g_sDevice.otaBlockSize;
+    sOtaProgress.image = g_sDevice.otaImage;
+    sOtaProgress.runs = ODL_u8GetRuns(&sOtaDl, sOtaProgress.asRun, ODL_MAX_RUNS);
+    sOtaProgress.runCrc = u32OtaRunCrc;
+    sOtaProgress.runBlocks = u32OtaRunBlocks;
+    PDM_vSaveRecord(&sOtaProgressPDDesc);
+    PDM_vSaveRecord(&g_sDevicePDDesc);
+    u16OtaUnsaved = 0;
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaWriteBlock
+ *
+ * DESCRIPTION:
+ * Write a block and read it back. The first write of the image into a
+ * sector erases it. A block already in flash(resumed or fetched again
+ * after a crc failure) isn't written. If the flash holds other data the
+ * sectors of the block are erased, the other blocks in there are dropped
+ * and fetched again.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32BlockIdx  R   block index
+ *             len          R   block length
+ *             pu8Block     R   block data
+ *
+ * RETURNS:
+ * TRUE if the block is in flash, else it's dropped
+ *
+ ****************************************************************************/
+PRIVATE bool clientOtaWriteBlock(uint32 u32BlockIdx, uint16 len, uint8 *pu8Block)
+{
+    uint8 au8Flash[OTA_MAX_BLOCK_SIZE];
+    uint32 u32Offset = clientOtaBase() + u32BlockIdx * g_sDevice.otaBlockSize;
+    uint32 u32FirstSector = u32Offset / OTA_SECTOR_SIZE;
+    uint32 u32LastSector = (u32Offset + len - 1) / OTA_SECTOR_SIZE;
+    uint32 u32Sector;
+    bool bErased = FALSE;
+    bool bConflict = FALSE;
+    uint16 i;
+
+    for (u32Sector = u32FirstSector; u32Sector <= u32LastSector; u32Sector++)
     {
-        DBG_vPrintf(TRACE_EP, "otaTotalBytes info lost, cant restart download. \r\n");
-        return;
+        if (sOtaProgress.erased & (1 << u32Sector)) continue;
+        clientOtaEraseSector(u32Sector, u32BlockIdx);
+        bErased = TRUE;
     }
-    // restart the downloading
-    g_sDevice.otaCurBlock   = 0;
-    g_sDevice.otaDownloading = 1;
-    DBG_vPrintf(TRACE_EP, "restart downloading... \r\n");
-    PDM_vSaveRecord(&g_sDevicePDDesc);
 
-    //erase covered sectors
-    APP_vOtaFlashLockEraseAll();
+    APP_vOtaFlashLockRead(u32Offset, len, au8Flash);
+    if (!bErased && 0 == memcmp(au8Flash, pu8Block, len)) return TRUE;
 
-    //start the ota task
-    OS_eActivateTask(APP_taskOTAReq);
+    /* programming only clears bits */
+    for (i = 0; i < len; i++)
+    {
+        if ((au8Flash[i] & pu8Block[i]) != pu8Block[i]) bConflict = TRUE;
+    }
+
+    if (bConflict)
+    {
+        DBG_vPrintf(TRACE_EP, "OTA: blk %d conflicts with flash \r\n", u32BlockIdx);
+        for (u32Sector = u32FirstSector; u32Sector <= u32LastSector; u32Sector++)
+        {
+            clientOtaEraseSector(u32Sector, u32BlockIdx);
+        }
+        bErased = TRUE;
+    }
+
+    APP_vOtaFlashLockWrite(u32Offset, len, pu8Block);
+    APP_vOtaFlashLockRead(u32Offset, len, au8Flash);
+    bool bOk = (0 == memcmp(au8Flash, pu8Block, len));
+    if (!bOk) ODL_vDropBlocks(&sOtaDl, u32BlockIdx, 1);
+
+    /* the dropped blocks must not be taken as received after a reboot */
+    if (bErased) clientOtaSaveProgress();
+    return bOk;
 }
 
+/****************************************************************************
+ *
+ * NAME: clientOtaEraseSector
+ *
+ * DESCRIPTION:
+ * Erase a sector for the download. Blocks in it, except u32KeepIdx which
+ * is about to be written, are dropped and fetched again.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32Sector    R   sector
+ *             u32KeepIdx   R   block not to drop, out of the sector: none
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void clientOtaEraseSector(uint32 u32Sector, uint32 u32KeepIdx)
+{
+    uint32 u32First = (u32Sector * OTA_SECTOR_SIZE - clientOtaBase()) / g_sDevice.otaBlockSize;
+    uint32 u32Last = ((u32Sector + 1) * OTA_SECTOR_SIZE - 1 - clientOtaBase()) / g_sDevice.otaBlockSize;
+
+    DBG_vPrintf(TRACE_EP, "OTA: erase sector %d \r\n", u32Sector);
+    APP_vOtaFlashLockErase((uint8)u32Sector);
+    sOtaProgress.erased |= (1 << u32Sector);
+    u32OtaSectorErases++;
+
+    if (u32KeepIdx < u32First || u32KeepIdx > u32Last)
+    {
+        ODL_vDropBlocks(&sOtaDl, u32First, u32Last - u32First + 1);
+    }
+    else
+    {
+        if (u32KeepIdx > u32First) ODL_vDropBlocks(&sOtaDl, u32First, u32KeepIdx - u32First);
+        if (u32Last > u32KeepIdx) ODL_vDropBlocks(&sOtaDl, u32KeepIdx + 1, u32Last - u32KeepIdx);
+    }
+
+    /* the running crc covered erased blocks */
+    if (u32OtaRunBlocks > sOtaDl.u32FirstHole)
+    {
+        u32OtaRunCrc = 0xffffffff;
+        u32OtaRunBlocks = 0;
+    }
+}
 
 /****************************************************************************
  *
- * NAME: clientOtaFinishing
+ * NAME: clientOtaEraseAhead
  *
  * DESCRIPTION:
- * OTA download finishing routine, check the crc of total downloaded image
- * at the external flash
+ * Erase the sector being written or the one after it if that hasn't been
+ * done for the image yet. One sector per call, so the erase of an image
+ * is spread over the task activations of its download instead of holding
+ * the SPI flash for seconds at once.
  *
  * PARAMETERS: Name         RW  Usage
  *             None
@@ -224,14 +761,90 @@ void clientOtaRestartDownload()
  * void
  *
  ****************************************************************************/
-void clientOtaFinishing()
+PRIVATE void clientOtaEraseAhead(void)
 {
-#ifdef OTA_CLIENT
-    DBG_vPrintf(TRACE_EP, "OtaFinishing: get all %d blocks \r\n", g_sDevice.otaCurBlock);
-    g_sDevice.otaDownloading = 0;
-    PDM_vSaveRecord(&g_sDevicePDDesc);
+    uint32 u32Sectors = (clientOtaBase() + g_sDevice.otaTotalBytes + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE;
+    uint32 u32Sector = (clientOtaBase() + sOtaDl.u32FirstHole * g_sDevice.otaBlockSize) / OTA_SECTOR_SIZE;
+    uint32 u32Ahead = u32Sector + 1;
+
+    for (; u32Sector < u32Sectors && u32Sector <= u32Ahead; u32Sector++)
+    {
+        if (sOtaProgress.erased & (1 << u32Sector)) continue;
+
+        clientOtaEraseSector(u32Sector, 0xffffffff);
+        clientOtaSaveProgress();
+        return;
+    }
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaCrcAdvance
+ *
+ * DESCRIPTION:
+ * Extend the running image crc. The block just written is taken from RAM
+ * if it's next in order, blocks which came earlier out of order are read
+ * back from flash as the bitmap shows them below the first hole, at most
+ * u32MaxReads of them per call.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32BlockIdx  R   block just written
+ *             len          R   its length
+ *             pu8Block     R   its data, NULL if there's none
+ *             u32MaxReads  R   blocks read back at most
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void clientOtaCrcAdvance(uint32 u32BlockIdx, uint16 len, uint8 *pu8Block, uint32 u32MaxReads)
+{
+    uint8 au8Flash[OTA_MAX_BLOCK_SIZE];
+    uint16 u16BlockSize = g_sDevice.otaBlockSize;
+
+    if (NULL != pu8Block && u32BlockIdx == u32OtaRunBlocks)
+    {
+        u32OtaRunCrc = crc32(u32OtaRunCrc, pu8Block, len);
+        u32OtaRunBlocks++;
+    }
+
+    while (u32OtaRunBlocks < sOtaDl.u32FirstHole && u32MaxReads-- > 0)
+    {
+        uint32 u32Offset = u32OtaRunBlocks * u16BlockSize;
+        uint16 rdLen = (g_sDevice.otaTotalBytes - u32Offset > u16BlockSize) ?
+                       u16BlockSize : (uint16)(g_sDevice.otaTotalBytes - u32Offset);
+
+        APP_vOtaFlashLockRead(clientOtaBase() + u32Offset, rdLen, au8Flash);
+        u32OtaRunCrc = crc32(u32OtaRunCrc, au8Flash, rdLen);
+        u32OtaRunBlocks++;
+    }
+}
 
-    //verify the external flash image
+/* external flash offset of the download, a patch or compressed image goes behind the image */
+PRIVATE uint32 clientOtaBase(void)
+{
+    if (OTA_IMAGE_DELTA == g_sDevice.otaImage) return OTA_DELTA_OFFSET;
+    if (OTA_IMAGE_PACKED == g_sDevice.otaImage) return OTA_PACKED_OFFSET;
+    return 0;
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaImageValid
+ *
+ * DESCRIPTION:
+ * Check the new image in external flash, its header and crc
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32Len       R   image length expected
+ *             u32Crc       R   crc of the image in flash
+ *
+ * RETURNS:
+ * TRUE if it can be booted
+ *
+ ****************************************************************************/
+PRIVATE bool clientOtaImageValid(uint32 u32Len, uint32 u32Crc)
+{
     uint8 au8Values[OTA_MAGIC_NUM_LEN];
     uint32 u32TotalImage = 0;
     bool valid = true;
@@ -246,7 +859,7 @@ void clientOtaFinishing()
         //read the image length out
         APP_vOtaFlashLockRead(OTA_IMAGE_LEN_OFFSET, 4, (uint8 *)(&u32TotalImage));
 
-        if (u32TotalImage != g_sDevice.otaTotalBytes)
+        if (u32TotalImage != u32Len)
         {
             DBG_vPrintf(TRACE_EP, "OtaFinishing: total length not match. \r\n");
             valid = false;
@@ -259,22 +872,260 @@ void clientOtaFinishing()
     }
 
     //second, check crc
-    uint32 crc = imageCrc(u32TotalImage);
-    DBG_vPrintf(TRACE_EP, "OtaFinishing: verify crc: 0x%x \r\n", crc);
-    if (crc != g_sDevice.otaCrc)
+    DBG_vPrintf(TRACE_EP, "OtaFinishing: verify crc: 0x%x \r\n", u32Crc);
+    if (u32Crc != g_sDevice.otaCrc)
     {
         DBG_vPrintf(TRACE_EP, "OtaFinishing: crc not match \r\n");
         valid = false;
     }
+    return valid;
+}
 
-    if (valid)
+/* the image is good, ask the server for the go ahead */
+PRIVATE void clientOtaRequestUpgrade(void)
+{
+    //send upgrade request to ota server
+    g_sDevice.otaDownloading = 2;
+    PDM_vSaveRecord(&g_sDevicePDDesc);
+    vResetATimer(APP_OTAReqTimer, APP_TIME_MS(1000));
+}
+
+/* the download is in, the image is built out of it in task state 4 */
+PRIVATE void clientOtaStartBuild(void)
+{
+    g_sDevice.otaDownloading = 4;
+    PDM_vSaveRecord(&g_sDevicePDDesc);
+    OS_eActivateTask(APP_taskOTAReq);
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaBuildInit
+ *
+ * DESCRIPTION:
+ * Start building the image out of a delta patch and the image in internal
+ * flash, or out of a compressed image, from its header in flash
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             None
+ *
+ * RETURNS:
+ * FALSE if the header doesn't match the notice or the running image
+ *
+ ****************************************************************************/
+PRIVATE bool clientOtaBuildInit(void)
+{
+    u32OtaBuildCrc = 0xffffffff;
+
+    if (OTA_IMAGE_DELTA == g_sDevice.otaImage)
     {
-        //send upgrade request to ota server
-        g_sDevice.otaDownloading = 2;
-        PDM_vSaveRecord(&g_sDevicePDDesc);
-        //OS_eActivateTask(APP_taskOTAReq);
-        vResetATimer(APP_OTAReqTimer, APP_TIME_MS(1000));
-        //APP_vOtaKillInternalReboot();
+        tsOdtHeader *psHdr = &uOtaBuild.sDelta.sHdr;
+        if (!ODT_bInit(&uOtaBuild.sDelta, clientOtaReadBase, clientOtaReadDownload, clientOtaWriteImage) ||
+            psHdr->u32PatchLen != g_sDevice.otaTotalBytes ||
+            psHdr->u32BaseCrc != APP_u32OtaRunningCrc() ||
+            psHdr->u32NewLen != g_sDevice.otaImageBytes ||
+            psHdr->u32NewCrc != g_sDevice.otaCrc) return FALSE;
+    }
+    else
+    {
+        tsOpkHeader *psHdr = &uOtaBuild.sPack.sHdr;
+        if (!OPK_bInit(&uOtaBuild.sPack, clientOtaReadDownload, clientOtaWriteImage) ||
+            psHdr->u32PackedLen != g_sDevice.otaTotalBytes ||
+            psHdr->u32ImageLen != g_sDevice.otaImageBytes ||
+            psHdr->u32ImageCrc != g_sDevice.otaCrc) return FALSE;
+    }
+    bOtaBuildReady = TRUE;
+    return TRUE;
+}
+
+/****************************************************************************
+ *
+ * NAME: clientOtaBuildStep
+ *
+ * DESCRIPTION:
+ * Build the next OTA_BUILD_STEP_BYTES of the image. A compressed image is
+ * expanded while it's downloaded, as far as the blocks in order go. When
+ * the image is complete it's checked like a downloaded one, a download
+ * which doesn't give the image falls back to the full image.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             u32InAvail   R   downloaded bytes in order
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void clientOtaBuildStep(uint32 u32InAvail)
+{
+    bool bDone, bError;
+
+    if (!bOtaBuildReady && !clientOtaBuildInit())
+    {
+        DBG_vPrintf(TRACE_EP, "OTA build: image %d doesn't fit \r\n", g_sDevice.otaImage);
+        clientOtaFallbackFull();
+        return;
+    }
+
+    if (OTA_IMAGE_DELTA == g_sDevice.otaImage)
+    {
+        teOdtStatus eStatus = ODT_eStep(&uOtaBuild.sDelta, OTA_BUILD_STEP_BYTES);
+        bDone = (E_ODT_DONE == eStatus);
+        bError = (E_ODT_ERROR == eStatus);
+    }
+    else
+    {
+        teOpkStatus eStatus = OPK_eStep(&uOtaBuild.sPack, u32InAvail, OTA_BUILD_STEP_BYTES);
+        bDone = (E_OPK_DONE == eStatus);
+        bError = (E_OPK_ERROR == eStatus);
+    }
+
+    if (!bDone && !bError)
+    {
+        if (4 == g_sDevice.otaDownloading) vResetATimer(APP_OTAReqTimer, APP_TIME_MS(OTA_BUILD_STEP_MS));
+        return;
+    }
+
+    bOtaBuildReady = FALSE;
+    DBG_vPrintf(TRACE_EP, "OTA build: image %d built, error %d \r\n", g_sDevice.otaImage, bError);
+    if (bDone && clientOtaImageValid(g_sDevice.otaImageBytes, u32OtaBuildCrc))
+    {
+        clientOtaRequestUpgrade();
+    }
+    else
+    {
+        clientOtaFallbackFull();
+    }
+}
+
+/* the patch or compressed image didn't give the image, download the image itself */
+PRIVATE void clientOtaFallbackFull(void)
+{
+    g_sDevice.otaImage = OTA_IMAGE_FULL;
+    g_sDevice.otaTotalBytes = g_sDevice.otaImageBytes;
+    g_sDevice.otaTotalBlocks = APP_u32OtaBlocks(g_sDevice.otaTotalBytes, g_sDevice.otaBlockSize);
+    g_sDevice.otaCurBlock = 0;
+    g_sDevice.otaDownloading = 1;
+    PDM_vSaveRecord(&g_sDevicePDDesc);
+
+    clientOtaPrepareDownload();
+    OS_eActivateTask(APP_taskOTAReq);
+}
+
+/* base image is the running one, memory mapped */
+PRIVATE void clientOtaReadBase(uint32 u32Offset, uint16 len, uint8 *pu8Buf)
+{
+    memcpy(pu8Buf, (uint8 *)(OTA_INTERNAL_FLASH_ADDR + u32Offset), len);
+}
+
+PRIVATE void clientOtaReadDownload(uint32 u32Offset, uint16 len, uint8 *pu8Buf)
+{
+    APP_vOtaFlashLockRead(clientOtaBase() + u32Offset, len, pu8Buf);
+}
+
+/*
+  the image is written in order in chunks of 64 bytes(ODT_BUF_LEN,
+  OPK_BUF_LEN), which don't straddle a sector, so a sector is erased as
+  it's entered
+*/
+PRIVATE bool clientOtaWriteImage(uint32 u32Offset, uint16 len, uint8 *pu8Buf)
+{
+    uint8 au8Flash[OPK_BUF_LEN];
+
+    if (len > sizeof(au8Flash)) return FALSE;
+    if (0 == u32Offset % OTA_SECTOR_SIZE) APP_vOtaFlashLockErase((uint8)(u32Offset / OTA_SECTOR_SIZE));
+
+    APP_vOtaFlashLockWrite(u32Offset, len, pu8Buf);
+    APP_vOtaFlashLockRead(u32Offset, len, au8Flash);
+    if (0 != memcmp(au8Flash, pu8Buf, len)) return FALSE;
+
+    u32OtaBuildCrc = crc32(u32OtaBuildCrc, pu8Buf, len);
+    return TRUE;
+}
+#endif
+
+/****************************************************************************
+ *
+ * NAME: clientOtaRestartDownload
+ *
+ * DESCRIPTION:
+ * restart OTA download when crc check failed. Every block is fetched again
+ * but the flash isn't erased, blocks that match the flash aren't written
+ * and only sectors holding wrong data are erased.
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             None
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+void clientOtaRestartDownload()
+{
+    if (g_sDevice.otaTotalBytes == 0)
+    {
+        DBG_vPrintf(TRACE_EP, "otaTotalBytes info lost, cant restart download. \r\n");
+        return;
+    }
+    // restart the downloading
+    g_sDevice.otaCurBlock   = 0;
+    g_sDevice.otaDownloading = 1;
+#ifdef OTA_CLIENT
+    sOtaProgress.runs = 0;
+    sOtaProgress.runCrc = 0xffffffff;
+    sOtaProgress.runBlocks = 0;
+    clientOtaStartDownload();
+    clientOtaSaveProgress();
+#endif
+    DBG_vPrintf(TRACE_EP, "restart downloading... \r\n");
+
+    //start the ota task
+    OS_eActivateTask(APP_taskOTAReq);
+}
+
+
+/****************************************************************************
+ *
+ * NAME: clientOtaFinishing
+ *
+ * DESCRIPTION:
+ * OTA download finishing routine, check the crc of total downloaded image
+ * at the external flash
+ *
+ * PARAMETERS: Name         RW  Usage
+ *             None
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+void clientOtaFinishing()
+{
+#ifdef OTA_CLIENT
+    DBG_vPrintf(TRACE_EP, "OtaFinishing: get all %d blocks, %d reqs, %d timeouts, %d out of order \r\n",
+                g_sDevice.otaCurBlock, sOtaDl.sStats.u32Requests, sOtaDl.sStats.u32Timeouts,
+                sOtaDl.sStats.u32RxOutOfOrder);
+    DBG_vPrintf(TRACE_EP, "OtaFinishing: %d blocks dropped, %d sectors erased, %d crc errors \r\n",
+                sOtaDl.sStats.u32Dropped, u32OtaSectorErases, u32OtaCorruptBlocks);
+    DBG_vPrintf(TRACE_EP, "OtaFinishing: erase %dms in total, %dms at most \r\n",
+                g_sOtaEraseStats.u32TotalMs, g_sOtaEraseStats.u32MaxMs);
+    DBG_vPrintf(TRACE_EP, "OtaFinishing: %d blocks from a neighbour, %d fallbacks to server \r\n",
+                g_sOprStats.u32PeerBlocks, g_sOprStats.u32Fallbacks);
+
+    /* a delta patch or compressed image is checked by the image built from it */
+    if (OTA_IMAGE_FULL != g_sDevice.otaImage)
+    {
+        clientOtaStartBuild();
+        return;
+    }
+
+    g_sDevice.otaDownloading = 0;
+    PDM_vSaveRecord(&g_sDevicePDDesc);
+
+    //verify the external flash image, the running crc only misses blocks which came out of order
+    clientOtaCrcAdvance(0, 0, NULL, sOtaDl.u32TotalBlocks);
+    if (clientOtaImageValid(g_sDevice.otaTotalBytes, u32OtaRunCrc))
+    {
+        clientOtaRequestUpgrade();
     }
     else
     {
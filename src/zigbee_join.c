@@ -34,6 +34,7 @@
 #include "zigbee_node.h"
 #include "firmware_api_pack.h"
 #include "firmware_cmi.h"
+#include "firmware_sleep.h"
 
 #ifndef TRACE_JOIN
 #define TRACE_JOIN   FALSE
@@ -972,6 +973,7 @@ PUBLIC void vStartStopTimer(OS_thSWTimer hSWTimer, uint32 u32Ticks, teState eNex
         OS_eStopSWTimer(hSWTimer);
     }
     OS_eStartSWTimer(hSWTimer, u32Ticks, NULL);
+    SLP_vArmed(hSWTimer, u32Ticks);
     g_sDevice.eState = eNextState;
 }
 
@@ -32,6 +32,7 @@
 
 #include "firmware_at_api.h"
 #include "firmware_hal.h"
+#include "firmware_energy.h"
 
 #include "suli.h"
 
@@ -137,6 +138,10 @@ PWRM_CALLBACK(PreSleep)
 {
     DBG_vPrintf(TRACE_START, "APP: Going to sleep (CB) ... ");
 
+    /* Energy accounting and ms time, before the tick timer stops */
+    ENG_vPreSleep();
+    vHAL_TickSleep();
+
     /* Turn off On/Sleep Led */
     suli_pin_write(&SleepLed, HAL_PIN_LOW);
 
@@ -192,6 +197,9 @@ PWRM_CALLBACK(Wakeup)
 
     DBG_vPrintf(TRACE_START, "\r\n\r\nAPP: Woken up (CB)\r\n");
 
+    /* Energy accounting */
+    ENG_vWakeup();
+
     if( (u8AHI_PowerStatus()) & RAM_HELD )
     {
 		/* Restore Mac settings (turns radio on) */
@@ -42,6 +42,9 @@
 #include "firmware_sleep.h" //for scheduleSleep()
 #include "suli.h"
 #include "firmware_rpc.h"
+#include "firmware_addr_cache.h"
+#include "firmware_poll.h"
+#include "firmware_energy.h"
 /****************************************************************************/
 /***        Macro Definitions                                             ***/
 /****************************************************************************/
@@ -53,6 +56,14 @@
 #ifndef TRACE_NWK
 #define TRACE_NWK  FALSE
 #endif
+
+/* nwk status codes of ZigBee spec */
+#define NWK_STATUS_NO_ROUTE_AVAILABLE       0x00
+#define NWK_STATUS_TREE_LINK_FAILURE        0x01
+#define NWK_STATUS_NON_TREE_LINK_FAILURE    0x02
+#define NWK_STATUS_SOURCE_ROUTE_FAILURE     0x0b
+#define NWK_STATUS_MTO_ROUTE_FAILURE        0x0c
+#define NWK_STATUS_ADDRESS_CONFLICT         0x0d
 /****************************************************************************/
 /***        Type Definitions                                              ***/
 /****************************************************************************/
@@ -60,6 +71,9 @@
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
+#ifdef TARGET_COO
+PRIVATE void vRequestEarlyMtoRoute(void);
+#endif
 
 #ifdef PDM_EEPROM
 PUBLIC uint8 u8PDM_CalculateFileSystemCapacity(void);
@@ -80,6 +94,9 @@ PUBLIC tsDevice                 g_sDevice;
 
 PRIVATE uint8    u8ChildOfInterest = 0;
 PRIVATE uint8    u8FailedRouteDiscoveries = 0;
+#ifdef TARGET_COO
+PRIVATE uint32   u32LastMtoRouteMs = 0;
+#endif
 
 //mac address which will be used when debug or manufactory.
 //it will be place at .ro_mac_address section which can be
@@ -245,11 +262,15 @@ PUBLIC void vHandleRunningEvent(ZPS_tsAfEvent sStackEvent)
     case ZPS_EVENT_NWK_NEW_NODE_HAS_JOINED:
         DBG_vPrintf(TRACE_NODE, "ZPS_EVENT_NEW_NODE_HAS_JOINED\r\n");
         vDisplayNT();
+#ifdef TARGET_COO
+        vRequestEarlyMtoRoute();
+#endif
         break;
 
     case ZPS_EVENT_NWK_DISCOVERY_COMPLETE:
         break;
     case ZPS_EVENT_NWK_LEAVE_INDICATION:
+        NAC_vInvalidateIeee(sStackEvent.uEvent.sNwkLeaveIndicationEvent.u64ExtAddr);
         break;
     case ZPS_EVENT_NWK_LEAVE_CONFIRM:
         break;
@@ -257,6 +278,36 @@ PUBLIC void vHandleRunningEvent(ZPS_tsAfEvent sStackEvent)
         DBG_vPrintf(TRACE_NODE, "STATUS_INDICATION: 0x%x from 0x%x.\r\n",
                     sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status,
                     sStackEvent.uEvent.sNwkStatusIndicationEvent.u16NwkAddr);
+        /*
+          The conflicting devices will pick new short addresses. A device
+          nothing finds a route to may have rejoined under a new one, the
+          next send to it resolves the address again.
+        */
+        if (NWK_STATUS_ADDRESS_CONFLICT == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status ||
+            NWK_STATUS_NO_ROUTE_AVAILABLE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status ||
+            NWK_STATUS_NON_TREE_LINK_FAILURE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status)
+        {
+            NAC_vInvalidateNwk(sStackEvent.uEvent.sNwkStatusIndicationEvent.u16NwkAddr);
+        }
+#ifdef TARGET_COO
+        /* a router lost its way to us or a source route broke, rebuild the routes */
+        if (NWK_STATUS_MTO_ROUTE_FAILURE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status ||
+            NWK_STATUS_SOURCE_ROUTE_FAILURE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status)
+        {
+            vRequestEarlyMtoRoute();
+        }
+#endif
+#ifdef TARGET_ROU
+        /* the route to coo is broken and no many-to-one request repaired it yet */
+        if (0x0000 == sStackEvent.uEvent.sNwkStatusIndicationEvent.u16NwkAddr &&
+            (NWK_STATUS_NO_ROUTE_AVAILABLE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status ||
+             NWK_STATUS_TREE_LINK_FAILURE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status ||
+             NWK_STATUS_NON_TREE_LINK_FAILURE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status ||
+             NWK_STATUS_MTO_ROUTE_FAILURE == sStackEvent.uEvent.sNwkStatusIndicationEvent.u8Status))
+        {
+            refreshRoute();
+        }
+#endif
         break;
     case ZPS_EVENT_NWK_ROUTE_DISCOVERY_CONFIRM:
 #ifdef TARGET_ROU
@@ -284,11 +335,29 @@ PUBLIC void vHandleRunningEvent(ZPS_tsAfEvent sStackEvent)
     case ZPS_EVENT_ERROR:
         break;
     case ZPS_EVENT_NWK_POLL_CONFIRM:
+        ENG_vPollDone();
+        POL_vPollConfirm(sStackEvent.uEvent.sNwkPollConfirmEvent.u8Status);
         break;
     case ZPS_EVENT_APS_ZDP_REQUEST_RESPONSE:
         {
+#define DEVICE_ANNCE    0x0013
+#define NWK_RESP        0x8000
+            /* keep the IEEE->NWK address cache up to date */
+            if (DEVICE_ANNCE == sStackEvent.uEvent.sApsZdpEvent.u16ClusterId)
+            {
+                NAC_vUpdate(sStackEvent.uEvent.sApsZdpEvent.uZdpData.sDeviceAnnce.u64IeeeAddr,
+                            sStackEvent.uEvent.sApsZdpEvent.uZdpData.sDeviceAnnce.u16NwkAddr);
+#ifdef TARGET_COO
+                /* a node joined somewhere in the network, give it a route to us soon */
+                vRequestEarlyMtoRoute();
+#endif
+            } else if (NWK_RESP == sStackEvent.uEvent.sApsZdpEvent.u16ClusterId &&
+                       !sStackEvent.uEvent.sApsZdpEvent.uZdpData.sNwkAddrRsp.u8Status)
+            {
+                NAC_vUpdate(sStackEvent.uEvent.sApsZdpEvent.uZdpData.sNwkAddrRsp.u64IeeeAddrRemoteDev,
+                            sStackEvent.uEvent.sApsZdpEvent.uZdpData.sNwkAddrRsp.u16NwkAddrRemoteDev);
+            }
 #ifndef TARGET_END
-#define NWK_RESP    0x8000
             if (NWK_RESP == sStackEvent.uEvent.sApsZdpEvent.u16ClusterId)
             {
                 if (!sStackEvent.uEvent.sApsZdpEvent.uZdpData.sNwkAddrRsp.u8Status)
@@ -341,7 +410,11 @@ PUBLIC void vHandleRunningEvent(ZPS_tsAfEvent sStackEvent)
  * NAME: refreshRoute
  *
  * DESCRIPTION:
- * For router, it will make sure the route towards coo periodly.
+ * Coo is a many-to-one concentrator, it broadcasts a many-to-one route
+ * request periodly, every router learns the route towards coo from it
+ * and coo source routes on the way back.
+ * For router, it's only the fallback when the route towards coo broke
+ * between two many-to-one requests, at most once per period.
  *
  * PARAMETERS: Name         RW  Usage
  *             None
@@ -354,6 +427,16 @@ PUBLIC void refreshRoute()
 {
     if (OS_E_SWTIMER_RUNNING != OS_eGetSWTimerStatus(APP_RouteRequestTimer))
     {
+#ifdef TARGET_COO
+        /* Send out a many-to-one route request, coo keeps the route records */
+        ZPS_teStatus eStatus = ZPS_eAplZdoManyToOneRouteRequest(TRUE, MTO_ROUTE_RADIUS);
+        u32LastMtoRouteMs = u32HAL_GetMsTime();
+
+        DBG_vPrintf(TRACE_NODE, "Many-to-one route request sent with eStatus: 0x%02x\r\n", eStatus);
+
+        /* Repeat in MTO_ROUTE_PERIOD_MS */
+        vResetATimer(APP_RouteRequestTimer, APP_TIME_MS(MTO_ROUTE_PERIOD_MS));
+#else
         /* Send out a route request to the coordinator */
         ZPS_teStatus eStatus = ZPS_eAplZdoRouteRequest(
                                0x0000,
@@ -361,11 +444,35 @@ PUBLIC void refreshRoute()
 
         DBG_vPrintf(TRACE_NODE, "Route discovery sent with eStatus: 0x%02x\r\n", eStatus);
 
-        /* Repeat in 60s */
-        OS_eStartSWTimer(APP_RouteRequestTimer, APP_TIME_MS(60000), NULL);
+        /* No more than once in MTO_ROUTE_PERIOD_MS */
+        vResetATimer(APP_RouteRequestTimer, APP_TIME_MS(MTO_ROUTE_PERIOD_MS));
+#endif
     }
 }
 
+#ifdef TARGET_COO
+/****************************************************************************
+ *
+ * NAME: vRequestEarlyMtoRoute
+ *
+ * DESCRIPTION:
+ * Topology changed, send the next many-to-one route request soon, but not
+ * sooner than MTO_ROUTE_MIN_GAP_MS after the last one.
+ *
+ * RETURNS:
+ * void
+ *
+ ****************************************************************************/
+PRIVATE void vRequestEarlyMtoRoute(void)
+{
+    uint32 u32Elapsed = u32HAL_GetMsTime() - u32LastMtoRouteMs;
+    uint32 u32Wait = (u32Elapsed >= MTO_ROUTE_MIN_GAP_MS) ? 1 : (MTO_ROUTE_MIN_GAP_MS - u32Elapsed);
+
+    /* the timer activates APP_taskNWK, refreshRoute() sends when it's stopped */
+    vResetATimer(APP_RouteRequestTimer, APP_TIME_MS(u32Wait));
+}
+#endif
+
 
 
 /****************************************************************************/
@@ -458,8 +565,8 @@ OS_TASK(APP_taskNWK)
     case E_NETWORK_RUN:
         DBG_vPrintf(TRACE_NWK, "Handle State: E_NETWORK_RUN\r\n");
         vHandleRunningEvent(sStackEvent);
-#ifdef TARGET_ROU
-        //router should discovery the route to coo periodly.
+#ifdef TARGET_COO
+        //coo, as a concentrator, gives every router the route to it periodly.
         refreshRoute();
 #endif
         vAHI_DioSetOutput((1 << DIO_ASSOC),0);
@@ -490,7 +597,7 @@ OS_TASK(APP_InitiateRejoin)
         /* Stack not currently able to initiate
          * a rejoin, back off and try again later */
         DBG_vPrintf(TRACE_NODE, "Rejoin Error: %x, stack may already be rejoining\r\n", eStatus);
-        OS_eStartSWTimer(APP_RejoinTimer, APP_TIME_MS(1000), NULL);
+        vResetATimer(APP_RejoinTimer, APP_TIME_MS(1000));
     } else
     {
         bRejoining = TRUE;                                                            // Set the rejoin flag
@@ -572,7 +679,7 @@ OS_TASK(APP_AgeOutChildren)
         u8ChildOfInterest = 0;
     } else
     {
-        OS_eStartSWTimer(APP_AgeOutChildrenTmr, APP_TIME_MS(1600), NULL);        // Re-activate this task in 1.6s to scan for the next child
+        vResetATimer(APP_AgeOutChildrenTmr, APP_TIME_MS(1600));                  // Re-activate this task in 1.6s to scan for the next child
     }
 #endif
 }
@@ -591,6 +698,9 @@ OS_TASK(APP_AgeOutChildren)
 OS_TASK(APP_RadioRecal)
 {
 #ifdef RADIO_RECALIBRATION
+    /* a node that never sleeps counts its awake time here */
+    ENG_vTick();
+
     if (OS_E_SWTIMER_EXPIRED == OS_eGetSWTimerStatus(APP_RadioRecalTimer))
     {
         DBG_vPrintf(TRACE_NODE, "Recalibrate the radio\r\n");
@@ -599,10 +709,10 @@ OS_TASK(APP_RadioRecal)
         if (eStatus)
         {
             DBG_vPrintf(TRACE_NODE, "Recalibration already underway");
-            OS_eStartSWTimer(APP_RadioRecalTimer, APP_TIME_SEC(1), NULL);            // Re-activate this task in 1s
+            vResetATimer(APP_RadioRecalTimer, APP_TIME_SEC(1));                      // Re-activate this task in 1s
         } else
         {
-            OS_eStartSWTimer(APP_RadioRecalTimer, APP_TIME_SEC(120), NULL);        // Re-activate this task in 2min
+            vResetATimer(APP_RadioRecalTimer, APP_TIME_SEC(120));                  // Re-activate this task in 2min
                                                                                    //(u32Ticks max value 0x7fffffff ~=134sec)
         }
     }
@@ -640,10 +750,15 @@ PUBLIC void initDeviceDefault(tsDevice *dev)
     dev->isOTASvr   = FALSE;
     dev->otaTotalBlocks = 0;
     dev->otaTotalBytes  = 0;
+    dev->otaPatchBytes  = 0;
+    dev->otaPackedBytes = 0;
 #ifdef OTA_CLIENT
+    dev->otaImage = OTA_IMAGE_FULL;
+    dev->otaImageBytes = 0;
     dev->otaDownloading = 0;
     dev->otaCurBlock = 0;
     dev->otaReqPeriod = 1000;
+    dev->otaBlockSize = OTA_BLOCK_SIZE;
     dev->otaSvrAddr16 = 0x0;
 #endif
 
@@ -676,6 +791,10 @@ PUBLIC void deleteStackPDM()
     PDM_eLoadRecord(&g_sDevicePDDesc, REC_ID1, &g_sDevice, sizeof(g_sDevice), FALSE);
     memcpy(&g_sDevice, &backup, sizeof(backup));
     PDM_vSaveRecord(&g_sDevicePDDesc);
+#ifdef OTA_CLIENT
+    /* the saved ranges are gone, the blocks are checked against the flash then */
+    clientOtaLoadProgress();
+#endif
 }
 
 
@@ -700,6 +819,9 @@ PUBLIC void node_vInitialise(void)
         initDeviceDefault(&g_sDevice);
         PDM_eLoadRecord(&g_sDevicePDDesc, REC_ID1, &g_sDevice, sizeof(g_sDevice), FALSE);
     }
+#ifdef OTA_CLIENT
+    clientOtaLoadProgress();
+#endif
 
     /* if configed powerup actions non-zero, then node should redo the network related stuff. */
     if (g_sDevice.config.powerUpAction)
@@ -714,6 +836,9 @@ PUBLIC void node_vInitialise(void)
     /* Initialize Application Framework */
     ZPS_eAplAfInit();
 
+    /* Timers the end device keeps over sleeps */
+    SLP_vInit();
+
     DBG_vPrintf(TRACE_NODE, "PDM Free Capacity: %d sectors\r\n", u8PDM_CalculateFileSystemCapacity());
     DBG_vPrintf(TRACE_NODE, "PDM Occupancy: %d sectors\r\n", u8PDM_GetFileSystemOccupancy());
 
@@ -803,7 +928,7 @@ PUBLIC void node_vInitialise(void)
 
     /* Activate the radio recalibration task in 60s */
 #ifdef RADIO_RECALIBRATION
-    OS_eStartSWTimer(APP_RadioRecalTimer, APP_TIME_SEC(60), NULL);
+    vResetATimer(APP_RadioRecalTimer, APP_TIME_SEC(60));
 #endif
 
     /* OTA */
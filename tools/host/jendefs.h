@@ -0,0 +1,31 @@
+/*
+ * jendefs.h
+ * Minimal stand-in for the SDK header, lets SDK independent firmware modules
+ * (firmware_stream.c ...) be built on a PC by the tools in this folder.
+ */
+
+#ifndef JENDEFS_INCLUDED
+#define JENDEFS_INCLUDED
+
+#include <stdint.h>
+
+typedef uint8_t   uint8;
+typedef uint16_t  uint16;
+typedef uint32_t  uint32;
+typedef uint64_t  uint64;
+typedef int8_t    int8;
+typedef int16_t   int16;
+typedef int32_t   int32;
+typedef int64_t   int64;
+typedef unsigned char bool;
+typedef int       bool_t;
+
+#ifndef TRUE
+#define TRUE      1
+#define FALSE     0
+#endif
+
+#define PUBLIC
+#define PRIVATE   static
+
+#endif /* JENDEFS_INCLUDED */
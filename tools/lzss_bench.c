@@ -0,0 +1,167 @@
+/*
+ * lzss_bench.c
+ * Host benchmark of the data frame compression(firmware_lzss.c)
+ *
+ * Feeds representative UART traces through the same framing rule as
+ * PCK_i32ApiSpecZipDataFrame and prints the compression ratio of the air
+ * payload, the frames needed and the codec speed on this host.
+ *
+ * Build & run(from the tools folder):
+ *   cc -O2 -Ihost -I../include -o lzss_bench lzss_bench.c ../src/firmware_lzss.c
+ *   ./lzss_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "firmware_lzss.h"
+
+#define API_DATA_LEN        32      //data bytes of an API data frame
+#define TRACE_LEN           8192
+#define SPEED_ROUNDS        200
+
+static char acTrace[TRACE_LEN + 128];
+static int iTraceLen;
+
+/* ups_arduino_sketch.c heartbeat of a router */
+static void vTraceHeartBeat(void)
+{
+    iTraceLen = 0;
+    while (iTraceLen < TRACE_LEN)
+        iTraceLen += sprintf(&acTrace[iTraceLen], "R-HeartBeat:%ld\r\n", 300L + rand() % 40);
+}
+
+/* CSV telemetry of a sensor node */
+static void vTraceCsv(void)
+{
+    iTraceLen = 0;
+    while (iTraceLen < TRACE_LEN)
+        iTraceLen += sprintf(&acTrace[iTraceLen], "T=%d.%d,H=%d.%d,L=%d\r\n",
+                             20 + rand() % 5, rand() % 10, 40 + rand() % 10, rand() % 10, 500 + rand() % 50);
+}
+
+/* JSON-ish records */
+static void vTraceJson(void)
+{
+    iTraceLen = 0;
+    while (iTraceLen < TRACE_LEN)
+        iTraceLen += sprintf(&acTrace[iTraceLen], "{\"id\":%d,\"temp\":%d.%d,\"bat\":%d}\n",
+                             rand() % 8, 20 + rand() % 5, rand() % 10, 3000 + rand() % 300);
+}
+
+/* random bytes, must fall back to plain frames */
+static void vTraceRandom(void)
+{
+    for (iTraceLen = 0; iTraceLen < TRACE_LEN; iTraceLen++) acTrace[iTraceLen] = (char)rand();
+}
+
+/*
+  Frame the trace as SPM does with up to u32Pool bytes waiting in the UART
+  pool, returns air payload bytes and frames, checks the round trip.
+*/
+static void vFrameTrace(int iPool, int *piAirBytes, int *piFrames, int *piZipped)
+{
+    uint8 au8Zip[API_DATA_LEN];
+    uint8 au8Raw[LZS_MAX_RAW];
+    int pos = 0;
+
+    *piAirBytes = *piFrames = *piZipped = 0;
+    while (pos < iTraceLen)
+    {
+        int len = iTraceLen - pos;
+        int consumed, zipLen;
+        int plain;
+
+        if (len > iPool) len = iPool;
+        plain = (len < API_DATA_LEN) ? len : API_DATA_LEN;
+
+        zipLen = LZS_i32Compress((uint8 *)&acTrace[pos], len, au8Zip, API_DATA_LEN, &consumed);
+        if (consumed >= plain && zipLen < consumed)
+        {
+            if (LZS_i32Decompress(au8Zip, zipLen, au8Raw, sizeof(au8Raw)) != consumed ||
+                memcmp(au8Raw, &acTrace[pos], consumed))
+            {
+                printf("  round trip failed at %d\n", pos);
+                exit(1);
+            }
+            *piAirBytes += zipLen;
+            (*piZipped)++;
+            pos += consumed;
+        } else
+        {
+            *piAirBytes += plain;
+            pos += plain;
+        }
+        (*piFrames)++;
+    }
+}
+
+/* codec speed over LZS_MAX_RAW blocks */
+static void vSpeed(double *pdZip, double *pdUnzip)
+{
+    uint8 au8Zip[LZS_MAX_RAW * 2];
+    uint8 au8Raw[LZS_MAX_RAW];
+    int r, pos, consumed, zipLen = 0;
+    long lBytes = 0;
+    clock_t t;
+
+    t = clock();
+    for (r = 0; r < SPEED_ROUNDS; r++)
+        for (pos = 0; pos + LZS_MAX_RAW <= iTraceLen; pos += LZS_MAX_RAW)
+        {
+            LZS_i32Compress((uint8 *)&acTrace[pos], LZS_MAX_RAW, au8Zip, sizeof(au8Zip), &consumed);
+            lBytes += LZS_MAX_RAW;
+        }
+    *pdZip = lBytes / ((double)(clock() - t) / CLOCKS_PER_SEC);
+
+    zipLen = LZS_i32Compress((uint8 *)acTrace, LZS_MAX_RAW, au8Zip, sizeof(au8Zip), &consumed);
+    lBytes = 0;
+    t = clock();
+    for (r = 0; r < SPEED_ROUNDS * (iTraceLen / LZS_MAX_RAW); r++)
+    {
+        lBytes += LZS_i32Decompress(au8Zip, zipLen, au8Raw, sizeof(au8Raw));
+    }
+    *pdUnzip = lBytes / ((double)(clock() - t) / CLOCKS_PER_SEC);
+}
+
+int main(void)
+{
+    static const struct
+    {
+        const char *name;
+        void (*pfGen)(void);
+    } asTraces[] =
+    {
+        { "heartbeat", vTraceHeartBeat },
+        { "csv",       vTraceCsv },
+        { "json",      vTraceJson },
+        { "random",    vTraceRandom },
+    };
+    static const int aiPool[] = { API_DATA_LEN, LZS_MAX_RAW };
+    unsigned t, p;
+
+    printf("LZSS window %d, matches %d~%d, frame data %d bytes, up to %d raw bytes per frame\n\n",
+           LZS_WINDOW, LZS_MIN_MATCH, LZS_MAX_MATCH, API_DATA_LEN, LZS_MAX_RAW);
+    printf("%-10s %5s %7s %7s %7s %7s %12s %12s\n",
+           "trace", "pool", "ratio", "frames", "plain", "zipped", "zip B/s", "unzip B/s");
+
+    for (t = 0; t < sizeof(asTraces) / sizeof(asTraces[0]); t++)
+    {
+        srand(1);
+        asTraces[t].pfGen();
+        for (p = 0; p < sizeof(aiPool) / sizeof(aiPool[0]); p++)
+        {
+            int iAir, iFrames, iZipped;
+            int iPlainFrames = (iTraceLen + API_DATA_LEN - 1) / API_DATA_LEN;
+            double dZip, dUnzip;
+
+            vFrameTrace(aiPool[p], &iAir, &iFrames, &iZipped);
+            vSpeed(&dZip, &dUnzip);
+            printf("%-10s %5d %7.2f %7d %7d %7d %12.0f %12.0f\n",
+                   asTraces[t].name, aiPool[p], (double)iTraceLen / iAir,
+                   iFrames, iPlainFrames, iZipped, dZip, dUnzip);
+        }
+    }
+    return 0;
+}
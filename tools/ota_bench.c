@@ -0,0 +1,243 @@
+/*
+ * ota_bench.c
+ * Host benchmark of the pipelined OTA block download(firmware_ota_dl.c)
+ *
+ * Downloads an image from a simulated OTA server over a lossy multi-hop
+ * link, once with the old stop-and-wait client(one request per otaReqPeriod)
+ * and once per window size of the pipelined client, and prints the time
+ * each download takes. Then compares block sizes of 50 bytes and 64 bytes(the
+ * flash page aligned size clients negotiate, also OTA_MAX_BLOCK_SIZE).
+ *
+ * Build & run(from the tools folder):
+ *   cc -O2 -Ihost -I../include -o ota_bench ota_bench.c ../src/firmware_ota_dl.c ../src/firmware_rtt.c
+ *   ./ota_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "firmware_ota_dl.h"
+
+/* same as firmware_ota.h, which needs the SDK */
+#define OTA_BLOCK_SIZE      50
+#define OTA_MAX_BLOCK_SIZE  64
+#define OTA_BLOCK_CRC_LEN   2
+#define OTA_FLASH_PAGE_SIZE 256
+
+/* link model */
+#define IMAGE_BYTES         (100 * 1024)
+#define MAX_TIME_MS         (3600 * 1000)   //give up after an hour
+#define HOPS                3
+#define US_PER_BYTE         32      //250 kbit/s
+#define FRAME_OVERHEAD      51      //PHY, MAC, NWK, NWK security and APS headers
+#define HOP_ACCESS_US       2000    //CSMA backoff, turnaround and MAC ack
+#define REQ_PAYLOAD         (4 + 5)
+#define RESP_PAYLOAD(blk)   (4 + 6 + (blk) + 4 + OTA_BLOCK_CRC_LEN)
+#define HOP_LATENCY_MS      8       //per hop forwarding delay
+#define SERVER_READ_MS      5       //server reads a block from flash
+#define QUEUE_LEN           64
+
+typedef struct
+{
+    uint32 u32DueMs;
+    bool   bToServer;
+    uint32 u32BlockIdx;
+}tsSimFrame;
+
+static tsOtaDownload sDl;
+static tsSimFrame asQueue[QUEUE_LEN];
+static int iQueued;
+static uint32 u32Now;
+static uint32 u32BlockSize;
+static uint32 u32TotalBlocks;
+static uint32 u32MediumFreeUs;      //medium is shared by requests and responses
+static uint32 u32ServerFreeMs;
+static double dLoss;
+static uint32 u32AirFrames;
+static uint32 u32PagePrograms;      //client flash writes
+
+static bool bSimFrame(bool bToServer, uint32 u32BlockIdx, uint32 u32ReadyMs)
+{
+    if (iQueued >= QUEUE_LEN) return FALSE;
+
+    uint32 u32Bytes = FRAME_OVERHEAD + (bToServer ? REQ_PAYLOAD : RESP_PAYLOAD(u32BlockSize));
+    uint32 u32Airtime = HOP_ACCESS_US + u32Bytes * US_PER_BYTE;
+    uint32 u32Start = (u32MediumFreeUs > u32ReadyMs * 1000) ? u32MediumFreeUs : u32ReadyMs * 1000;
+    u32MediumFreeUs = u32Start + HOPS * u32Airtime;
+    u32AirFrames++;
+
+    if ((double)rand() / RAND_MAX < dLoss) return TRUE;   //lost on the way
+
+    tsSimFrame *psFrame = &asQueue[iQueued++];
+    psFrame->u32DueMs = (u32MediumFreeUs + 999) / 1000 + HOPS * HOP_LATENCY_MS;
+    psFrame->bToServer = bToServer;
+    psFrame->u32BlockIdx = u32BlockIdx;
+    return TRUE;
+}
+
+static bool bSimRequest(uint32 u32BlockIdx)
+{
+    return bSimFrame(TRUE, u32BlockIdx, u32Now);
+}
+
+/* delivers the frames that are due */
+static void vSimStep(void (*pfRxBlock)(uint32 u32BlockIdx))
+{
+    int i = 0;
+    while (i < iQueued)
+    {
+        if (asQueue[i].u32DueMs <= u32Now)
+        {
+            tsSimFrame sFrame = asQueue[i];
+            asQueue[i] = asQueue[--iQueued];
+            if (sFrame.bToServer)
+            {
+                /* server answers requests one by one */
+                uint32 u32Start = (u32ServerFreeMs > u32Now) ? u32ServerFreeMs : u32Now;
+                u32ServerFreeMs = u32Start + SERVER_READ_MS;
+                bSimFrame(FALSE, sFrame.u32BlockIdx, u32ServerFreeMs);
+            }
+            else
+            {
+                pfRxBlock(sFrame.u32BlockIdx);
+            }
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+static void vSimReset(uint32 u32Block, double dLossRate)
+{
+    srand(1);
+    dLoss = dLossRate;
+    iQueued = 0;
+    u32MediumFreeUs = u32ServerFreeMs = 0;
+    u32AirFrames = 0;
+    u32PagePrograms = 0;
+    u32BlockSize = u32Block;
+    u32TotalBlocks = (IMAGE_BYTES + u32Block - 1) / u32Block;
+}
+
+/* a block which straddles a page takes two page programs */
+static void vSimWrite(uint32 u32BlockIdx)
+{
+    uint32 u32Start = u32BlockIdx * u32BlockSize;
+    u32PagePrograms += (u32Start + u32BlockSize - 1) / OTA_FLASH_PAGE_SIZE - u32Start / OTA_FLASH_PAGE_SIZE + 1;
+}
+
+/* old client: request otaCurBlock every otaReqPeriod, take only that block */
+static uint32 u32LegacyCur;
+static void vLegacyRx(uint32 u32BlockIdx)
+{
+    if (u32BlockIdx == u32LegacyCur)
+    {
+        vSimWrite(u32BlockIdx);
+        u32LegacyCur++;
+    }
+}
+
+static uint32 u32RunLegacy(uint32 u32PeriodMs, double dLossRate)
+{
+    uint32 u32NextReq = 0;
+
+    vSimReset(OTA_BLOCK_SIZE, dLossRate);
+    u32LegacyCur = 0;
+    for (u32Now = 0; u32Now < MAX_TIME_MS && u32LegacyCur < u32TotalBlocks; u32Now++)
+    {
+        vSimStep(vLegacyRx);
+        if (u32Now >= u32NextReq && u32LegacyCur < u32TotalBlocks)
+        {
+            bSimRequest(u32LegacyCur);
+            u32NextReq = u32Now + u32PeriodMs;
+        }
+    }
+    return u32Now;
+}
+
+/* pipelined client */
+static bool bPoll;
+static void vDlRx(uint32 u32BlockIdx)
+{
+    if (ODL_bRxBlock(&sDl, u32BlockIdx, u32Now)) vSimWrite(u32BlockIdx);
+    bPoll = TRUE;
+}
+
+static uint32 u32RunWindow(uint32 u32Block, uint8 u8Window, double dLossRate)
+{
+    uint32 u32Timer = 0;
+
+    vSimReset(u32Block, dLossRate);
+    ODL_vInit(&sDl, u32TotalBlocks, 0, u8Window, 1000, bSimRequest);
+    bPoll = TRUE;
+    for (u32Now = 0; u32Now < MAX_TIME_MS && !ODL_bDone(&sDl); u32Now++)
+    {
+        vSimStep(vDlRx);
+
+        /* task is activated by a response or by its timer */
+        if (bPoll || (u32Timer && u32Now >= u32Timer))
+        {
+            uint32 u32Next = ODL_u32Poll(&sDl, u32Now);
+            u32Timer = u32Next ? u32Now + u32Next : 0;
+            bPoll = FALSE;
+        }
+    }
+    return u32Now;
+}
+
+int main(void)
+{
+    static const uint32 au32Periods[] = { 1000, 200 };
+    static const uint8 au8Windows[] = { 1, 2, 4, 8 };
+    static const uint32 au32Blocks[] = { OTA_BLOCK_SIZE, OTA_MAX_BLOCK_SIZE };
+    static const double adLoss[] = { 0.0, 0.05, 0.10, 0.20 };
+    unsigned i, l;
+
+    printf("image: %d bytes\n", IMAGE_BYTES);
+    printf("link: %d hops, %d us/byte + %d us access/hop, %d ms latency/hop\n",
+           HOPS, US_PER_BYTE, HOP_ACCESS_US, HOP_LATENCY_MS);
+    printf("\n%d byte blocks, download time in s (frames on air)\n", OTA_BLOCK_SIZE);
+    printf("client       ");
+    for (l = 0; l < sizeof(adLoss) / sizeof(adLoss[0]); l++) printf("  loss %2.0f%%        ", adLoss[l] * 100);
+    printf("\n");
+
+    for (i = 0; i < sizeof(au32Periods) / sizeof(au32Periods[0]); i++)
+    {
+        printf("period %4u  ", au32Periods[i]);
+        for (l = 0; l < sizeof(adLoss) / sizeof(adLoss[0]); l++)
+        {
+            uint32 u32Ms = u32RunLegacy(au32Periods[i], adLoss[l]);
+            printf("  %6.1f (%6u)  ", u32Ms / 1000.0, u32AirFrames);
+        }
+        printf("\n");
+    }
+
+    for (i = 0; i < sizeof(au8Windows); i++)
+    {
+        printf("window %4d  ", au8Windows[i]);
+        for (l = 0; l < sizeof(adLoss) / sizeof(adLoss[0]); l++)
+        {
+            uint32 u32Ms = u32RunWindow(OTA_BLOCK_SIZE, au8Windows[i], adLoss[l]);
+            printf("  %6.1f (%6u)  ", u32Ms / 1000.0, u32AirFrames);
+        }
+        printf("\n");
+    }
+
+    printf("\nwindow %d, download time in s (flash page programs)\n", ODL_DEF_WINDOW);
+    printf("block        ");
+    for (l = 0; l < sizeof(adLoss) / sizeof(adLoss[0]); l++) printf("  loss %2.0f%%        ", adLoss[l] * 100);
+    printf("\n");
+    for (i = 0; i < sizeof(au32Blocks) / sizeof(au32Blocks[0]); i++)
+    {
+        printf("size %6u  ", au32Blocks[i]);
+        for (l = 0; l < sizeof(adLoss) / sizeof(adLoss[0]); l++)
+        {
+            uint32 u32Ms = u32RunWindow(au32Blocks[i], ODL_DEF_WINDOW, adLoss[l]);
+            printf("  %6.1f (%6u)  ", u32Ms / 1000.0, u32PagePrograms);
+        }
+        printf("\n");
+    }
+    return 0;
+}
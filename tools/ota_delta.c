@@ -0,0 +1,349 @@
+/*
+ * ota_delta.c
+ * Builds and applies delta OTA patches(firmware_ota_delta.c)
+ *
+ * diff : patch that turns the image nodes run(old) into the new image, load
+ *        it into the coordinator's OTA flash at OTA_DELTA_OFFSET together with
+ *        the full new image
+ * apply: applies a patch with the firmware's own code, to check it
+ * without arguments it runs a self test on a synthetic image and prints the
+ * patch size.
+ *
+ * Build & run(from the tools folder):
+ *   cc -O2 -Ihost -I../include -o ota_delta ota_delta.c ../src/firmware_ota_delta.c
+ *   ./ota_delta diff old.bin new.bin patch.bin [base version, hex]
+ *   ./ota_delta apply old.bin patch.bin new.bin
+ *   ./ota_delta
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "firmware_ota_delta.h"
+
+#define FW_VERSION_OFFSET   0       //nodes check the base version in the notice
+#define MIN_MATCH           8
+#define HASH_BITS           16
+#define MAX_CHAIN           64
+
+typedef struct
+{
+    uint8  *pu8;
+    uint32 u32Len;
+    uint32 u32Size;
+} tsBuf;
+
+static tsBuf sBase, sPatch, sOut;
+
+/* same as the firmware's imageCrc(), no final xor */
+static uint32 u32Crc(uint8 *pu8, uint32 len)
+{
+    uint32 crc = 0xffffffff;
+    uint32 i;
+    int k;
+    for (i = 0; i < len; i++)
+    {
+        crc ^= pu8[i];
+        for (k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return crc;
+}
+
+static void vPut(tsBuf *psBuf, uint8 u8)
+{
+    if (psBuf->u32Len == psBuf->u32Size)
+    {
+        psBuf->u32Size = psBuf->u32Size ? psBuf->u32Size * 2 : 4096;
+        psBuf->pu8 = realloc(psBuf->pu8, psBuf->u32Size);
+    }
+    psBuf->pu8[psBuf->u32Len++] = u8;
+}
+
+static void vPutVarint(tsBuf *psBuf, uint32 u32)
+{
+    while (u32 >= 0x80)
+    {
+        vPut(psBuf, (uint8)(u32 | 0x80));
+        u32 >>= 7;
+    }
+    vPut(psBuf, (uint8)u32);
+}
+
+static void vFlushAdd(tsBuf *psPatch, uint8 *pu8New, uint32 u32From, uint32 u32To)
+{
+    if (u32To == u32From) return;
+    vPut(psPatch, ODT_OP_ADD);
+    vPutVarint(psPatch, u32To - u32From);
+    while (u32From < u32To) vPut(psPatch, pu8New[u32From++]);
+}
+
+static uint32 u32Hash(uint8 *pu8)
+{
+    uint32 h = 0;
+    int i;
+    for (i = 0; i < MIN_MATCH; i++) h = h * 0x9e3779b1 + pu8[i];
+    return h >> (32 - HASH_BITS);
+}
+
+static uint32 u32MatchLen(uint8 *pu8A, uint32 lenA, uint8 *pu8B, uint32 lenB)
+{
+    uint32 n = 0;
+    while (n < lenA && n < lenB && pu8A[n] == pu8B[n]) n++;
+    return n;
+}
+
+/*
+  Greedy diff: at each new position take the longest base match, trying the
+  end of the last copy first(unchanged code after an edit) then a hash chain
+  of base positions with the same MIN_MATCH bytes.
+*/
+static void vDiff(uint8 *pu8Old, uint32 oldLen, uint8 *pu8New, uint32 newLen, uint16 u16BaseVersion, tsBuf *psPatch)
+{
+    int32 *pi32Head = malloc(sizeof(int32) << HASH_BITS);
+    int32 *pi32Prev = malloc(sizeof(int32) * (oldLen + 1));
+    uint8 au8Hdr[ODT_HEADER_LEN];
+    tsOdtHeader sHdr;
+    uint32 i, u32AddFrom = 0, u32BasePos = 0;
+
+    memset(pi32Head, 0xff, sizeof(int32) << HASH_BITS);
+    for (i = 0; i + MIN_MATCH <= oldLen; i++)
+    {
+        uint32 h = u32Hash(&pu8Old[i]);
+        pi32Prev[i] = pi32Head[h];
+        pi32Head[h] = (int32)i;
+    }
+
+    psPatch->u32Len = 0;
+    for (i = 0; i < ODT_HEADER_LEN; i++) vPut(psPatch, 0);
+
+    i = 0;
+    while (i < newLen)
+    {
+        uint32 u32Best = 0, u32BestPos = 0;
+
+        if (u32BasePos < oldLen)
+        {
+            u32Best = u32MatchLen(&pu8Old[u32BasePos], oldLen - u32BasePos, &pu8New[i], newLen - i);
+            u32BestPos = u32BasePos;
+        }
+        if (u32Best < MIN_MATCH && i + MIN_MATCH <= newLen)
+        {
+            int32 i32Cand = pi32Head[u32Hash(&pu8New[i])];
+            int chain = 0;
+            while (i32Cand >= 0 && chain++ < MAX_CHAIN)
+            {
+                uint32 n = u32MatchLen(&pu8Old[i32Cand], oldLen - i32Cand, &pu8New[i], newLen - i);
+                if (n > u32Best)
+                {
+                    u32Best = n;
+                    u32BestPos = (uint32)i32Cand;
+                }
+                i32Cand = pi32Prev[i32Cand];
+            }
+        }
+
+        if (u32Best >= MIN_MATCH)
+        {
+            int32 i32Move = (int32)u32BestPos - (int32)u32BasePos;
+            vFlushAdd(psPatch, pu8New, u32AddFrom, i);
+            vPut(psPatch, ODT_OP_COPY);
+            vPutVarint(psPatch, u32Best);
+            vPutVarint(psPatch, (i32Move < 0) ? (((uint32)-i32Move << 1) | 1) : ((uint32)i32Move << 1));
+            u32BasePos = u32BestPos + u32Best;
+            i += u32Best;
+            u32AddFrom = i;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    vFlushAdd(psPatch, pu8New, u32AddFrom, newLen);
+    vPut(psPatch, ODT_OP_END);
+
+    sHdr.u16BaseVersion = u16BaseVersion;
+    sHdr.u32BaseLen  = oldLen;
+    sHdr.u32BaseCrc  = u32Crc(pu8Old, oldLen);
+    sHdr.u32NewLen   = newLen;
+    sHdr.u32NewCrc   = u32Crc(pu8New, newLen);
+    sHdr.u32PatchLen = psPatch->u32Len;
+    ODT_vWriteHeader(&sHdr, au8Hdr);
+    memcpy(psPatch->pu8, au8Hdr, ODT_HEADER_LEN);
+
+    free(pi32Head);
+    free(pi32Prev);
+}
+
+/* callbacks of the firmware code, they read out of bounds as 0xff like flash */
+static void vRead(tsBuf *psBuf, uint32 u32Offset, uint16 len, uint8 *pu8Buf)
+{
+    uint16 i;
+    for (i = 0; i < len; i++)
+    {
+        pu8Buf[i] = (u32Offset + i < psBuf->u32Len) ? psBuf->pu8[u32Offset + i] : 0xff;
+    }
+}
+
+static void vReadBase(uint32 u32Offset, uint16 len, uint8 *pu8Buf)  { vRead(&sBase, u32Offset, len, pu8Buf); }
+static void vReadPatch(uint32 u32Offset, uint16 len, uint8 *pu8Buf) { vRead(&sPatch, u32Offset, len, pu8Buf); }
+
+static bool bWrite(uint32 u32Offset, uint16 len, uint8 *pu8Buf)
+{
+    uint16 i;
+    if (u32Offset != sOut.u32Len) return FALSE;     //output is written in order
+    for (i = 0; i < len; i++) vPut(&sOut, pu8Buf[i]);
+    return TRUE;
+}
+
+/* apply sPatch to sBase into sOut, with the firmware's 4KB steps */
+static bool bApply(uint32 *pu32Steps)
+{
+    tsOtaDelta sDelta;
+    teOdtStatus eStatus;
+
+    sOut.u32Len = 0;
+    *pu32Steps = 0;
+    if (!ODT_bInit(&sDelta, vReadBase, vReadPatch, bWrite)) return FALSE;
+    if (sDelta.sHdr.u32BaseLen != sBase.u32Len || sDelta.sHdr.u32BaseCrc != u32Crc(sBase.pu8, sBase.u32Len)) return FALSE;
+
+    do
+    {
+        eStatus = ODT_eStep(&sDelta, 4096);
+        (*pu32Steps)++;
+    } while (E_ODT_MORE == eStatus);
+
+    return E_ODT_DONE == eStatus && sOut.u32Len == sDelta.sHdr.u32NewLen &&
+           u32Crc(sOut.pu8, sOut.u32Len) == sDelta.sHdr.u32NewCrc;
+}
+
+static bool bLoad(const char *pcPath, tsBuf *psBuf)
+{
+    FILE *fp = fopen(pcPath, "rb");
+    int c;
+    if (!fp)
+    {
+        perror(pcPath);
+        return FALSE;
+    }
+    psBuf->u32Len = 0;
+    while ((c = fgetc(fp)) != EOF) vPut(psBuf, (uint8)c);
+    fclose(fp);
+    return TRUE;
+}
+
+static bool bSave(const char *pcPath, tsBuf *psBuf)
+{
+    FILE *fp = fopen(pcPath, "wb");
+    if (!fp || fwrite(psBuf->pu8, 1, psBuf->u32Len, fp) != psBuf->u32Len)
+    {
+        perror(pcPath);
+        if (fp) fclose(fp);
+        return FALSE;
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+/* synthetic image: mostly opcodes, literal pools and a zero filled data section */
+static void vMakeImage(tsBuf *psBuf, uint32 len)
+{
+    uint32 i;
+    psBuf->u32Len = 0;
+    for (i = 0; i < len; i++)
+    {
+        if (i > len * 7 / 8) vPut(psBuf, 0);
+        else if ((i & 0xff) < 16) vPut(psBuf, (uint8)(i >> 8));
+        else vPut(psBuf, (uint8)(rand() >> 4));
+    }
+}
+
+static int iSelfTest(void)
+{
+    tsBuf sNew = { 0 };
+    uint32 i, u32Steps;
+    bool bOk = TRUE;
+
+    srand(1);
+    vMakeImage(&sBase, 150 * 1024);
+
+    /* new release: a function grows by 300 bytes, another one shrinks by 100,
+       a few constants and the version change */
+    for (i = 0; i < sBase.u32Len; i++)
+    {
+        if (i == 40000)
+        {
+            uint32 k;
+            for (k = 0; k < 300; k++) vPut(&sNew, (uint8)rand());
+        }
+        if (i >= 100000 && i < 100100) continue;
+        vPut(&sNew, sBase.pu8[i]);
+    }
+    for (i = 0; i < 20; i++) sNew.pu8[(uint32)rand() % sNew.u32Len] ^= 0x5a;
+    sNew.pu8[FW_VERSION_OFFSET] ^= 1;
+
+    vDiff(sBase.pu8, sBase.u32Len, sNew.pu8, sNew.u32Len, 0x1004, &sPatch);
+    printf("base %u bytes, new %u bytes, patch %u bytes (%.1f%% of the new image)\n",
+           sBase.u32Len, sNew.u32Len, sPatch.u32Len, 100.0 * sPatch.u32Len / sNew.u32Len);
+    printf("air blocks of 64 bytes: full %u, delta %u\n",
+           (sNew.u32Len + 63) / 64, (sPatch.u32Len + 63) / 64);
+
+    if (!bApply(&u32Steps) || sOut.u32Len != sNew.u32Len || memcmp(sOut.pu8, sNew.pu8, sNew.u32Len))
+    {
+        printf("apply FAILED\n");
+        bOk = FALSE;
+    }
+    else
+    {
+        printf("apply ok in %u steps\n", u32Steps);
+    }
+
+    /* a damaged patch must be refused, never written past the new image */
+    for (i = 0; i < 200 && bOk; i++)
+    {
+        uint32 u32Pos = ODT_HEADER_LEN + (uint32)rand() % (sPatch.u32Len - ODT_HEADER_LEN);
+        uint8 u8Old = sPatch.pu8[u32Pos];
+        sPatch.pu8[u32Pos] ^= (uint8)(1 + rand() % 255);
+        if (bApply(&u32Steps) || sOut.u32Len > sNew.u32Len)
+        {
+            printf("damaged patch at %u NOT refused\n", u32Pos);
+            bOk = FALSE;
+        }
+        sPatch.pu8[u32Pos] = u8Old;
+    }
+    if (bOk) printf("damaged patches refused\n");
+
+    return bOk ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    tsBuf sNew = { 0 };
+    uint32 u32Steps;
+
+    if (1 == argc) return iSelfTest();
+
+    if ((5 == argc || 6 == argc) && 0 == strcmp(argv[1], "diff"))
+    {
+        uint16 u16Version = (6 == argc) ? (uint16)strtoul(argv[5], NULL, 16) : 0;
+        if (!bLoad(argv[2], &sBase) || !bLoad(argv[3], &sNew)) return 1;
+        vDiff(sBase.pu8, sBase.u32Len, sNew.pu8, sNew.u32Len, u16Version, &sPatch);
+        if (!bSave(argv[4], &sPatch)) return 1;
+        printf("patch %u bytes, %.1f%% of the new image\n", sPatch.u32Len, 100.0 * sPatch.u32Len / sNew.u32Len);
+        return 0;
+    }
+
+    if (5 == argc && 0 == strcmp(argv[1], "apply"))
+    {
+        if (!bLoad(argv[2], &sBase) || !bLoad(argv[3], &sPatch)) return 1;
+        if (!bApply(&u32Steps))
+        {
+            printf("patch does not apply to %s\n", argv[2]);
+            return 1;
+        }
+        return bSave(argv[4], &sOut) ? 0 : 1;
+    }
+
+    printf("usage: %s diff old.bin new.bin patch.bin [base version, hex]\n"
+           "       %s apply old.bin patch.bin new.bin\n", argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,218 @@
+/*
+ * ota_host.c
+ * Streams an OTA image to the coordinator over UART(firmware_ota_host.c)
+ *
+ * The coordinator must be in API mode. The image is announced with
+ * API_OTA_HOST_START, then the coordinator asks for the chunks clients need
+ * with API_OTA_HOST_REQ and this tool answers with API_OTA_HOST_DATA. Start
+ * the rollout with ATOT/ATOF/ATOM while it runs, it keeps serving until the
+ * coordinator reports the image complete in its flash(cache on) or Ctrl-C,
+ * which stops the stream.
+ * Integers in API frames are big endian, the byte order of the JN516x.
+ *
+ * Build & run(from the tools folder):
+ *   cc -O2 -Ihost -o ota_host ota_host.c
+ *   ./ota_host /dev/ttyUSB0 image.bin [cache]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "jendefs.h"
+
+/* frames of include/firmware_at_api.h and firmware_ota.h */
+#define API_START_DELIMITER     0x7e
+#define API_OTA_HOST_START      0x1b
+#define API_OTA_HOST_DATA       0x1c
+#define API_OTA_HOST_REQ        0x9c
+#define OTA_HOST_CHUNK_SIZE     64
+#define OTA_HOST_SEND           0
+#define OTA_HOST_CACHED         1
+#define OTA_HOST_REFUSED        2
+
+static int iFd = -1;
+static volatile sig_atomic_t bStop = 0;
+
+/* same as the firmware's imageCrc(), no final xor */
+static uint32 u32Crc(uint8 *pu8, uint32 len)
+{
+    uint32 crc = 0xffffffff;
+    uint32 i;
+    int k;
+    for (i = 0; i < len; i++)
+    {
+        crc ^= pu8[i];
+        for (k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return crc;
+}
+
+static void vPut32(uint8 *pu8, uint32 u32)
+{
+    pu8[0] = (uint8)(u32 >> 24);
+    pu8[1] = (uint8)(u32 >> 16);
+    pu8[2] = (uint8)(u32 >> 8);
+    pu8[3] = (uint8)u32;
+}
+
+static bool bSendFrame(uint8 u8Id, uint8 *pu8Payload, uint8 u8Len)
+{
+    uint8 au8Frame[3 + 255 + 1];
+    uint8 u8Sum = 0;
+    int i;
+
+    au8Frame[0] = API_START_DELIMITER;
+    au8Frame[1] = u8Len;
+    au8Frame[2] = u8Id;
+    for (i = 0; i < u8Len; i++)
+    {
+        au8Frame[3 + i] = pu8Payload[i];
+        u8Sum += pu8Payload[i];
+    }
+    au8Frame[3 + u8Len] = u8Sum;
+    return write(iFd, au8Frame, 4 + u8Len) == 4 + u8Len;
+}
+
+static bool bSendStart(uint32 u32Bytes, uint32 u32Crc, bool bCache)
+{
+    uint8 au8Start[9];
+    vPut32(&au8Start[0], u32Bytes);
+    vPut32(&au8Start[4], u32Crc);
+    au8Start[8] = bCache ? 1 : 0;
+    return bSendFrame(API_OTA_HOST_START, au8Start, sizeof(au8Start));
+}
+
+/* the chunks of an API_OTA_HOST_REQ, one frame each */
+static void vSendChunks(uint8 *pu8Image, uint32 u32Bytes, uint32 u32Offset, uint32 u32Len)
+{
+    uint8 au8Data[4 + OTA_HOST_CHUNK_SIZE];
+    uint32 u32End = u32Offset + u32Len;
+
+    if (u32End > u32Bytes) u32End = u32Bytes;
+    for (; u32Offset < u32End; u32Offset += OTA_HOST_CHUNK_SIZE)
+    {
+        uint32 n = (u32End - u32Offset > OTA_HOST_CHUNK_SIZE) ? OTA_HOST_CHUNK_SIZE : u32End - u32Offset;
+        vPut32(au8Data, u32Offset);
+        memcpy(&au8Data[4], &pu8Image[u32Offset], n);
+        bSendFrame(API_OTA_HOST_DATA, au8Data, (uint8)(4 + n));
+    }
+}
+
+static bool bOpenPort(const char *pcPort)
+{
+    struct termios sTio;
+
+    iFd = open(pcPort, O_RDWR | O_NOCTTY);
+    if (iFd < 0 || tcgetattr(iFd, &sTio) != 0) return FALSE;
+    cfmakeraw(&sTio);
+    cfsetispeed(&sTio, B115200);
+    cfsetospeed(&sTio, B115200);
+    sTio.c_cc[VMIN] = 0;
+    sTio.c_cc[VTIME] = 5;
+    return tcsetattr(iFd, TCSANOW, &sTio) == 0;
+}
+
+static void vOnSignal(int sig)
+{
+    (void)sig;
+    bStop = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8 au8Rx[512];
+    int iRx = 0;
+    uint32 u32Chunks = 0;
+
+    if (argc < 3 || argc > 4 || (4 == argc && 0 != strcmp(argv[3], "cache")))
+    {
+        printf("usage: %s port image.bin [cache]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[2], "rb");
+    if (NULL == fp)
+    {
+        printf("can't read %s\n", argv[2]);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    uint32 u32Bytes = (uint32)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8 *pu8Image = malloc(u32Bytes);
+    if (NULL == pu8Image || fread(pu8Image, 1, u32Bytes, fp) != u32Bytes)
+    {
+        printf("can't read %s\n", argv[2]);
+        return 1;
+    }
+    fclose(fp);
+
+    if (!bOpenPort(argv[1]))
+    {
+        printf("can't open %s\n", argv[1]);
+        return 1;
+    }
+    signal(SIGINT, vOnSignal);
+
+    uint32 u32ImageCrc = u32Crc(pu8Image, u32Bytes);
+    printf("image %u bytes, crc 0x%08x\n", u32Bytes, u32ImageCrc);
+    bSendStart(u32Bytes, u32ImageCrc, 4 == argc);
+
+    while (!bStop)
+    {
+        int n = read(iFd, &au8Rx[iRx], sizeof(au8Rx) - iRx);
+        if (n > 0) iRx += n;
+
+        /* frames are picked out of the text the coordinator prints */
+        int iPos = 0;
+        while (iRx - iPos >= 4)
+        {
+            if (au8Rx[iPos] != API_START_DELIMITER)
+            {
+                iPos++;
+                continue;
+            }
+            int iLen = au8Rx[iPos + 1];
+            if (iRx - iPos < 4 + iLen) break;
+
+            uint8 *pu8 = &au8Rx[iPos + 3];
+            uint8 u8Sum = 0;
+            int i;
+            for (i = 0; i < iLen; i++) u8Sum += pu8[i];
+            if (au8Rx[iPos + 2] != API_OTA_HOST_REQ || iLen < 7 || u8Sum != pu8[iLen])
+            {
+                iPos++;
+                continue;
+            }
+            iPos += 4 + iLen;
+
+            uint32 u32Offset = ((uint32)pu8[0] << 24) | ((uint32)pu8[1] << 16) | ((uint32)pu8[2] << 8) | pu8[3];
+            uint32 u32Len = ((uint32)pu8[4] << 8) | pu8[5];
+            if (OTA_HOST_CACHED == pu8[6])
+            {
+                printf("\nimage complete in the coordinator's flash\n");
+                return 0;
+            }
+            if (OTA_HOST_REFUSED == pu8[6])
+            {
+                printf("\ncoordinator refused the image\n");
+                return 1;
+            }
+            vSendChunks(pu8Image, u32Bytes, u32Offset, u32Len);
+            u32Chunks += (u32Len + OTA_HOST_CHUNK_SIZE - 1) / OTA_HOST_CHUNK_SIZE;
+            printf("\rchunks sent %u, last offset %u   ", u32Chunks, u32Offset);
+            fflush(stdout);
+        }
+        memmove(au8Rx, &au8Rx[iPos], iRx - iPos);
+        iRx -= iPos;
+    }
+
+    /* Ctrl-C */
+    bSendStart(0, 0, FALSE);
+    printf("\nstream stopped\n");
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * ota_pack.c
+ * Builds and expands compressed OTA images(firmware_ota_pack.c)
+ *
+ * pack  : compress an image, load it into the coordinator's OTA flash at
+ *         OTA_PACKED_OFFSET together with the image itself
+ * unpack: expand a compressed image with the firmware's own code, to check it
+ * without arguments it compresses its own executable as a sample of machine
+ * code, expands it as a client does while the blocks come in and prints the
+ * size on the air.
+ *
+ * Build & run(from the tools folder):
+ *   cc -O2 -Ihost -I../include -o ota_pack ota_pack.c ../src/firmware_ota_pack.c
+ *   ./ota_pack pack image.bin packed.bin
+ *   ./ota_pack unpack packed.bin image.bin
+ *   ./ota_pack
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "firmware_ota_pack.h"
+
+#define PACKED_MAX          (3 * 64 * 1024)     //flash behind OTA_PACKED_OFFSET
+#define BLOCK_SIZE          64                  //OTA_MAX_BLOCK_SIZE
+
+typedef struct
+{
+    uint8  *pu8;
+    uint32 u32Len;
+    uint32 u32Size;
+} tsBuf;
+
+static tsBuf sPacked, sOut;
+
+/* same as the firmware's imageCrc(), no final xor */
+static uint32 u32Crc(uint8 *pu8, uint32 len)
+{
+    uint32 crc = 0xffffffff;
+    uint32 i;
+    int k;
+    for (i = 0; i < len; i++)
+    {
+        crc ^= pu8[i];
+        for (k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return crc;
+}
+
+static void vPut(tsBuf *psBuf, uint8 u8)
+{
+    if (psBuf->u32Len == psBuf->u32Size)
+    {
+        psBuf->u32Size = psBuf->u32Size ? psBuf->u32Size * 2 : 4096;
+        psBuf->pu8 = realloc(psBuf->pu8, psBuf->u32Size);
+    }
+    psBuf->pu8[psBuf->u32Len++] = u8;
+}
+
+/* bit writer, MSB first like the firmware reads it */
+static uint32 u32BitPos;
+
+static void vPutBits(tsBuf *psBuf, uint32 u32Value, int n)
+{
+    while (n--)
+    {
+        if (0 == (u32BitPos & 7)) vPut(psBuf, 0);
+        if (u32Value & (1u << n)) psBuf->pu8[u32BitPos >> 3] |= 0x80 >> (u32BitPos & 7);
+        u32BitPos++;
+    }
+}
+
+/* longest match of pu8In[pos..] in the window, the nearest one of that length */
+static uint32 u32Match(uint8 *pu8In, uint32 len, uint32 pos, uint32 *pu32Dist)
+{
+    uint32 u32Best = 0;
+    uint32 u32Max = (len - pos < OPK_MAX_MATCH) ? len - pos : OPK_MAX_MATCH;
+    uint32 u32Start = (pos > OPK_WINDOW) ? pos - OPK_WINDOW : 0;
+    uint32 i;
+
+    for (i = pos; i-- > u32Start && u32Best < u32Max;)
+    {
+        uint32 n = 0;
+        while (n < u32Max && pu8In[i + n] == pu8In[pos + n]) n++;
+        if (n > u32Best)
+        {
+            u32Best = n;
+            *pu32Dist = pos - i;
+        }
+    }
+    return u32Best;
+}
+
+/* greedy match with one step of lazy evaluation */
+static void vPack(uint8 *pu8In, uint32 len, tsBuf *psOut)
+{
+    tsOpkHeader sHdr;
+    uint32 pos = 0;
+
+    psOut->u32Len = 0;
+    u32BitPos = OPK_HEADER_LEN * 8;
+    while (psOut->u32Len < OPK_HEADER_LEN) vPut(psOut, 0);
+
+    while (pos < len)
+    {
+        uint32 u32Dist = 0, u32NextDist = 0;
+        uint32 n = u32Match(pu8In, len, pos, &u32Dist);
+
+        if (n >= OPK_MIN_MATCH && pos + 1 < len && u32Match(pu8In, len, pos + 1, &u32NextDist) > n)
+        {
+            n = 0;      //a literal now buys a longer match next
+        }
+
+        if (n >= OPK_MIN_MATCH)
+        {
+            vPutBits(psOut, 0, 1);
+            vPutBits(psOut, u32Dist - 1, OPK_INDEX_BITS);
+            vPutBits(psOut, n - OPK_MIN_MATCH, OPK_COUNT_BITS);
+            pos += n;
+        }
+        else
+        {
+            vPutBits(psOut, 0x100 | pu8In[pos], 9);
+            pos++;
+        }
+    }
+
+    sHdr.u32ImageLen  = len;
+    sHdr.u32ImageCrc  = u32Crc(pu8In, len);
+    sHdr.u32PackedLen = psOut->u32Len;
+    OPK_vWriteHeader(&sHdr, psOut->pu8);
+}
+
+/* callbacks of the firmware code */
+static void vRead(uint32 u32Offset, uint16 len, uint8 *pu8Buf)
+{
+    uint16 i;
+    for (i = 0; i < len; i++)
+    {
+        pu8Buf[i] = (u32Offset + i < sPacked.u32Len) ? sPacked.pu8[u32Offset + i] : 0xff;
+    }
+}
+
+static bool bWrite(uint32 u32Offset, uint16 len, uint8 *pu8Buf)
+{
+    uint16 i;
+    if (u32Offset != sOut.u32Len) return FALSE;     //image is written in order
+    for (i = 0; i < len; i++) vPut(&sOut, pu8Buf[i]);
+    return TRUE;
+}
+
+/*
+  expand sPacked into sOut like a client: the compressed blocks come in
+  u32Chunk bytes at a time, 4KB of image per task activation
+*/
+static bool bUnpack(uint32 u32Chunk)
+{
+    static tsOtaPack sPack;
+    teOpkStatus eStatus = E_OPK_MORE;
+    uint32 u32Avail = OPK_HEADER_LEN;
+
+    sOut.u32Len = 0;
+    if (!OPK_bInit(&sPack, vRead, bWrite)) return FALSE;
+
+    while (E_OPK_MORE == eStatus)
+    {
+        if (u32Avail < sPack.sHdr.u32PackedLen) u32Avail += u32Chunk;
+        eStatus = OPK_eStep(&sPack, u32Avail, 4096);
+    }
+
+    return E_OPK_DONE == eStatus && sOut.u32Len == sPack.sHdr.u32ImageLen &&
+           u32Crc(sOut.pu8, sOut.u32Len) == sPack.sHdr.u32ImageCrc;
+}
+
+static bool bLoad(const char *pcPath, tsBuf *psBuf)
+{
+    FILE *fp = fopen(pcPath, "rb");
+    int c;
+    if (!fp)
+    {
+        perror(pcPath);
+        return FALSE;
+    }
+    psBuf->u32Len = 0;
+    while ((c = fgetc(fp)) != EOF) vPut(psBuf, (uint8)c);
+    fclose(fp);
+    return TRUE;
+}
+
+static bool bSave(const char *pcPath, tsBuf *psBuf)
+{
+    FILE *fp = fopen(pcPath, "wb");
+    if (!fp || fwrite(psBuf->pu8, 1, psBuf->u32Len, fp) != psBuf->u32Len)
+    {
+        perror(pcPath);
+        if (fp) fclose(fp);
+        return FALSE;
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+static int iSelfTest(const char *pcSelf)
+{
+    tsBuf sImage = { 0 };
+    uint32 i;
+    bool bOk = TRUE;
+
+    if (!bLoad("/proc/self/exe", &sImage) && !bLoad(pcSelf, &sImage)) return 1;
+    if (sImage.u32Len > 256 * 1024) sImage.u32Len = 256 * 1024;
+
+    vPack(sImage.pu8, sImage.u32Len, &sPacked);
+    printf("image %u bytes, compressed %u bytes (%.1f%%)\n",
+           sImage.u32Len, sPacked.u32Len, 100.0 * sPacked.u32Len / sImage.u32Len);
+    printf("air blocks of %d bytes: full %u, compressed %u\n", BLOCK_SIZE,
+           (sImage.u32Len + BLOCK_SIZE - 1) / BLOCK_SIZE, (sPacked.u32Len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+    /* blocks trickle in, or everything is there at once */
+    if (!bUnpack(BLOCK_SIZE) || memcmp(sOut.pu8, sImage.pu8, sImage.u32Len) ||
+        !bUnpack(sPacked.u32Len))
+    {
+        printf("unpack FAILED\n");
+        bOk = FALSE;
+    }
+    else
+    {
+        printf("unpack ok, streamed and at once\n");
+    }
+
+    /* a damaged image must never give a wrong image or write past it, some
+       damage only moves a back-reference to equal bytes */
+    for (i = 0; i < 200 && bOk; i++)
+    {
+        uint32 u32Pos = OPK_HEADER_LEN + (uint32)rand() % (sPacked.u32Len - OPK_HEADER_LEN);
+        uint8 u8Old = sPacked.pu8[u32Pos];
+        sPacked.pu8[u32Pos] ^= (uint8)(1 + rand() % 255);
+        if ((bUnpack(BLOCK_SIZE) && memcmp(sOut.pu8, sImage.pu8, sImage.u32Len)) || sOut.u32Len > sImage.u32Len)
+        {
+            printf("damaged image at %u NOT refused\n", u32Pos);
+            bOk = FALSE;
+        }
+        sPacked.pu8[u32Pos] = u8Old;
+    }
+    if (bOk) printf("damaged images refused or harmless\n");
+
+    return bOk ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    tsBuf sImage = { 0 };
+
+    if (1 == argc) return iSelfTest(argv[0]);
+
+    if (4 == argc && 0 == strcmp(argv[1], "pack"))
+    {
+        if (!bLoad(argv[2], &sImage)) return 1;
+        vPack(sImage.pu8, sImage.u32Len, &sPacked);
+        printf("compressed %u bytes, %.1f%% of the image\n", sPacked.u32Len, 100.0 * sPacked.u32Len / sImage.u32Len);
+        if (sPacked.u32Len > PACKED_MAX || sPacked.u32Len >= sImage.u32Len)
+        {
+            printf("doesn't fit the flash or doesn't pay, send the image as it is\n");
+            return 1;
+        }
+        return bSave(argv[3], &sPacked) ? 0 : 1;
+    }
+
+    if (4 == argc && 0 == strcmp(argv[1], "unpack"))
+    {
+        if (!bLoad(argv[2], &sPacked)) return 1;
+        if (!bUnpack(sPacked.u32Len))
+        {
+            printf("%s is not a valid compressed image\n", argv[2]);
+            return 1;
+        }
+        return bSave(argv[3], &sOut) ? 0 : 1;
+    }
+
+    printf("usage: %s pack image.bin packed.bin\n"
+           "       %s unpack packed.bin image.bin\n", argv[0], argv[0]);
+    return 1;
+}
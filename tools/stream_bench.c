@@ -0,0 +1,163 @@
+/*
+ * stream_bench.c
+ * Host benchmark of the DATA mode reliable stream(firmware_stream.c)
+ *
+ * Runs two stream end points over a simulated multi-hop link with random
+ * frame loss and prints in-order goodput for different window sizes.
+ *
+ * Build & run(from the tools folder):
+ *   cc -O2 -Ihost -I../include -o stream_bench stream_bench.c ../src/firmware_stream.c ../src/firmware_rtt.c
+ *   ./stream_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "firmware_stream.h"
+
+/* link model */
+#define SIM_TIME_MS         60000   //simulated time of each run
+#define HOPS                3
+#define HOP_AIRTIME_MS      4       //one 802.15.4 frame incl. CSMA and MAC ack
+#define HOP_LATENCY_MS      8       //per hop forwarding delay
+#define QUEUE_LEN           64
+
+typedef struct
+{
+    uint32 u32DueMs;
+    bool   bToReceiver;
+    teStmFrameType eType;
+    uint8  au8Frame[sizeof(tsStreamData)];
+} tsSimFrame;
+
+static tsStream sSender, sReceiver;
+static tsSimFrame asQueue[QUEUE_LEN];
+static int iQueued;
+static uint32 u32Now;
+static uint32 u32MediumFreeMs;      //medium is shared by data and acks
+static double dLoss;
+static uint8 u8TxPattern, u8RxPattern;
+static uint32 u32Corrupt;
+static uint32 u32Lost;
+
+static bool bSimSend(tsStream *psStream, teStmFrameType eType, void *pvFrame, int len)
+{
+    if (iQueued >= QUEUE_LEN) return FALSE;
+
+    /* frames queue up for the medium, the route is HOPS long */
+    uint32 u32Start = (u32MediumFreeMs > u32Now) ? u32MediumFreeMs : u32Now;
+    u32MediumFreeMs = u32Start + HOPS * HOP_AIRTIME_MS;
+
+    if ((double)rand() / RAND_MAX < dLoss) return TRUE;   //lost on the way
+
+    tsSimFrame *psFrame = &asQueue[iQueued++];
+    psFrame->u32DueMs = u32MediumFreeMs + HOPS * HOP_LATENCY_MS;
+    psFrame->bToReceiver = (psStream == &sSender);
+    psFrame->eType = eType;
+    memcpy(psFrame->au8Frame, pvFrame, len);
+    return TRUE;
+}
+
+static void vSimDeliver(tsStream *psStream, uint8 *pu8Data, int len)
+{
+    int i;
+    (void)psStream;
+    for (i = 0; i < len; i++)
+    {
+        if (pu8Data[i] != u8RxPattern++) u32Corrupt++;
+    }
+}
+
+static void vSimLost(tsStream *psStream, uint16 u16Bytes)
+{
+    (void)psStream;
+    u32Lost += u16Bytes;
+}
+
+static void vSimStep(void)
+{
+    int i = 0;
+    while (i < iQueued)
+    {
+        if (asQueue[i].u32DueMs <= u32Now)
+        {
+            tsSimFrame sFrame = asQueue[i];
+            asQueue[i] = asQueue[--iQueued];
+            if (sFrame.bToReceiver)
+                STM_vRxData(&sReceiver, (tsStreamData *)sFrame.au8Frame);
+            else
+                STM_vRxAck(&sSender, (tsStreamAck *)sFrame.au8Frame, u32Now);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+static double dRun(uint8 u8Window, double dLossRate, uint32 *pu32Retx)
+{
+    uint8 au8Buf[STM_DATA_LEN];
+    int i;
+
+    srand(1);
+    dLoss = dLossRate;
+    iQueued = 0;
+    u32MediumFreeMs = 0;
+    u8TxPattern = u8RxPattern = 0;
+    u32Corrupt = 0;
+    u32Lost = 0;
+    STM_vInit(&sSender, u8Window, 1, bSimSend, vSimDeliver, vSimLost);
+    STM_vInit(&sReceiver, 1, 0, bSimSend, vSimDeliver, NULL);
+
+    for (u32Now = 0; u32Now < SIM_TIME_MS; u32Now++)
+    {
+        vSimStep();
+        STM_u32Poll(&sSender, u32Now);
+
+        /* UART is always faster than the air, fill the window */
+        while (STM_bTxReady(&sSender))
+        {
+            for (i = 0; i < STM_DATA_LEN; i++) au8Buf[i] = u8TxPattern++;
+            STM_bSend(&sSender, au8Buf, STM_DATA_LEN, u32Now);
+        }
+    }
+
+    if (u32Corrupt)
+    {
+        printf("  stream corrupted: %u bytes out of order\n", u32Corrupt);
+    }
+    if (u32Lost)
+    {
+        printf("  sender gave up: %u bytes in flight dropped\n", u32Lost);
+    }
+    *pu32Retx = sSender.sStats.u32Retransmits;
+    return (double)sReceiver.sStats.u32DeliveredBytes * 1000 / SIM_TIME_MS;
+}
+
+int main(void)
+{
+    static const uint8 au8Windows[] = { 1, 2, 4, 8 };
+    static const double adLoss[] = { 0.0, 0.05, 0.10, 0.20 };
+    unsigned w, l;
+
+    printf("link: %d hops, %d ms airtime/hop, %d ms latency/hop, %d s per run\n",
+           HOPS, HOP_AIRTIME_MS, HOP_LATENCY_MS, SIM_TIME_MS / 1000);
+    printf("goodput in bytes/s (retransmissions)\n\n");
+    printf("window ");
+    for (l = 0; l < sizeof(adLoss) / sizeof(adLoss[0]); l++) printf("  loss %2.0f%%       ", adLoss[l] * 100);
+    printf("\n");
+
+    for (w = 0; w < sizeof(au8Windows); w++)
+    {
+        printf("%6d ", au8Windows[w]);
+        for (l = 0; l < sizeof(adLoss) / sizeof(adLoss[0]); l++)
+        {
+            uint32 u32Retx;
+            double dGoodput = dRun(au8Windows[w], adLoss[l], &u32Retx);
+            printf("  %6.0f (%5u)  ", dGoodput, u32Retx);
+        }
+        printf("\n");
+    }
+    return 0;
+}